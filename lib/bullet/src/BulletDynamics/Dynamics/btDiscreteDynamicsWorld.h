@@ -68,7 +68,8 @@ protected:
 	
 	void	updateActivationState(btScalar timeStep);
 
-	void	updateActions(btScalar timeStep);
+	///STK: virtual so that the wheel rays of all karts can be cast together
+	virtual void	updateActions(btScalar timeStep);
 
 	void	startProfiling(btScalar timeStep);
 
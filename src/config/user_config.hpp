@@ -744,6 +744,10 @@ namespace UserConfigParams
     /** True if graphical profiler should be displayed */
     PARAM_PREFIX bool m_profiler_enabled  PARAM_DEFAULT( false );
 
+    /** Number of threads used for the per kart queries of a physics step,
+     *  0 to decide depending on the number of cores. */
+    PARAM_PREFIX int  m_kart_threads      PARAM_DEFAULT( 0 );
+
     // ---- Networking
     PARAM_PREFIX StringToUIntUserConfigParam m_stun_servers
         PARAM_DEFAULT(StringToUIntUserConfigParam("stun-servers",
@@ -22,12 +22,14 @@
 #include "items/flyable.hpp"
 
 #include <cmath>
+#include <cstring>
 
 #include <IMeshManipulator.h>
 #include <IMeshSceneNode.h>
 
 #include "achievements/achievements_status.hpp"
 #include "config/player_manager.hpp"
+#include "config/stk_config.hpp"
 #include "graphics/explosion.hpp"
 #include "graphics/irr_driver.hpp"
 #include "graphics/material.hpp"
@@ -658,6 +660,47 @@ void Flyable::restoreState(BareNetworkString *buffer, int count)
     m_has_server_state = true;
 }   // restoreState
 
+// ----------------------------------------------------------------------------
+/** Saves the predicted state of this flyable on a client in the same format
+ *  as saveState(), without changing the body when compressing the physics
+ *  values. Subclasses add the rest of their state to it. A flyable which
+ *  has hit something is predicted not to be part of the state.
+ */
+BareNetworkString* Flyable::savePrediction()
+{
+    if (m_has_hit_something)
+        return new BareNetworkString();
+
+    BareNetworkString *buffer = new BareNetworkString();
+    CompressNetworkBody::compress(m_body->getWorldTransform(),
+        m_body->getLinearVelocity(), m_body->getAngularVelocity(), buffer,
+        NULL/*body*/, NULL/*ms*/);
+    buffer->addUInt16(m_ticks_since_thrown);
+    return buffer;
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Compares a state received from the server with the prediction saved for
+ *  the same time. The physics values can differ by errors small enough not
+ *  to be smoothed, everything else must be identical.
+ *  \param prediction Prediction saved by savePrediction().
+ *  \param buffer The confirmed state from the server.
+ *  \param count Number of bytes of this flyable in buffer.
+ */
+bool Flyable::matchesPrediction(BareNetworkString* prediction,
+                                BareNetworkString* buffer, int count)
+{
+    const int BODY_SIZE = CompressNetworkBody::COMPRESSED_SIZE;
+    if ((int)prediction->size() != count || count < BODY_SIZE ||
+        (int)buffer->size() < count)
+        return false;
+    if (!CompressNetworkBody::isClose(prediction, buffer,
+        stk_config->m_snb_min_adjust_length))
+        return false;
+    return memcmp(prediction->getCurrentData(), buffer->getCurrentData(),
+        count - BODY_SIZE) == 0;
+}   // matchesPrediction
+
 // ----------------------------------------------------------------------------
 void Flyable::addForRewind(const std::string& uid)
 {
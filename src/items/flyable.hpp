@@ -254,6 +254,12 @@ public:
     // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction() OVERRIDE;
+    // ------------------------------------------------------------------------
+    virtual bool matchesPrediction(BareNetworkString* prediction,
+                                   BareNetworkString* buffer, int count)
+                                                                     OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void addRewindInfoEventFunctionAfterFiring();
     // ------------------------------------------------------------------------
     virtual std::function<void()> getLocalStateRestoreFunction() OVERRIDE;
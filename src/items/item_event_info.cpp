@@ -18,6 +18,7 @@
 
 #include "items/item_event_info.hpp"
 
+#include "network/bit_stream.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/rewind_manager.hpp"
@@ -26,30 +27,27 @@
 
 /** Loads an event from a server message. It helps encapsulate the encoding
  *  of events from and into a message buffer.
- *  \param buffer A network string with the event data.
- *  \param count The number of bytes read will be subtracted from this value.
+ *  \param reader The bit stream with the event data.
+ *  \param previous_ticks The time the time of this event is relative to (see
+ *         saveState).
  */
-ItemEventInfo::ItemEventInfo(BareNetworkString *buffer, int *count)
+ItemEventInfo::ItemEventInfo(BitStreamReader *reader, int previous_ticks)
 {
     m_ticks_till_return = 0;
-    m_type    = (EventType)buffer->getUInt8();
-    m_ticks   = buffer->getTime();
-    *count   -= 5;
+    m_type    = (EventType)reader->getBits(2);
+    m_ticks   = reader->getTicks(previous_ticks);
     if (m_type != IEI_SWITCH)
     {
-        m_kart_id = buffer->getInt8();
-        m_index = buffer->getUInt16();
-        *count -= 3;
+        m_kart_id = reader->getVarInt();
+        m_index = reader->getVarUInt();
         if (m_type == IEI_NEW)
         {
-            m_xyz = buffer->getVec3();
-            m_normal = buffer->getVec3();
-            *count -= 24;
+            m_xyz = reader->getVec3();
+            m_normal = reader->getVec3();
         }
         else   // IEI_COLLECT
         {
-            m_ticks_till_return = buffer->getUInt16();
-            *count -= 2;
+            m_ticks_till_return = (int16_t)reader->getVarInt();
         }
     }   // is not switch
     else   // switch
@@ -57,26 +55,31 @@ ItemEventInfo::ItemEventInfo(BareNetworkString *buffer, int *count)
         m_index = -1;
         m_kart_id = -1;
     }
-}   // ItemEventInfo(BareNetworkString, int *count)
+}   // ItemEventInfo(BitStreamReader, int)
 
 //-----------------------------------------------------------------------------
-/** Stores this event into a network string.
- *  \param buffer The network string to which the data should be appended.
+/** Stores this event into a bit stream.
+ *  \param writer The bit stream to which the data should be appended.
+ *  \param previous_ticks The time of the previous event, or the time of the
+ *         state for the first event. Only the difference is stored, which
+ *         usually needs only a few bits.
  */
-void ItemEventInfo::saveState(BareNetworkString *buffer)
+void ItemEventInfo::saveState(BitStreamWriter *writer, int previous_ticks)
 {
     assert(NetworkConfig::get()->isServer());
-    buffer->addUInt8(m_type).addTime(m_ticks);
+    writer->addBits(m_type, 2);
+    writer->addTicks(m_ticks, previous_ticks);
     if (m_type != IEI_SWITCH)
     {
         // Only new item and collecting items need the index and kart id:
-        buffer->addUInt8(m_kart_id).addUInt16(m_index);
+        writer->addVarInt(m_kart_id);
+        writer->addVarUInt(m_index);
         if (m_type == IEI_NEW)
         {
-            buffer->add(m_xyz);
-            buffer->add(m_normal);
+            writer->addVec3(m_xyz);
+            writer->addVec3(m_normal);
         }
         else if (m_type == IEI_COLLECT)
-            buffer->addUInt16(m_ticks_till_return);
+            writer->addVarInt(m_ticks_till_return);
     }
 }   // saveState
@@ -25,7 +25,8 @@
 
 #include <assert.h>
 
-class BareNetworkString;
+class BitStreamReader;
+class BitStreamWriter;
 
 // ------------------------------------------------------------------------
 /** This class stores a delta, i.e. an item event (either collection of
@@ -94,8 +95,8 @@ public:
     }   // ItemEventInfo(switch)
 
     // --------------------------------------------------------------------
-         ItemEventInfo(BareNetworkString *buffer, int *count);
-    void saveState(BareNetworkString *buffer);
+         ItemEventInfo(BitStreamReader *reader, int previous_ticks);
+    void saveState(BitStreamWriter *writer, int previous_ticks);
 
     // --------------------------------------------------------------------
     /** Returns if this event represents a new item. */
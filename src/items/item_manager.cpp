@@ -32,6 +32,7 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/arena_graph.hpp"
 #include "tracks/arena_node.hpp"
+#include "tracks/terrain_info.hpp"
 #include "tracks/track.hpp"
 #include "utils/string_utils.hpp"
 
@@ -283,10 +284,15 @@ Item* ItemManager::dropNewItem(ItemState::ItemType type,
         pos = server_xyz ? *server_xyz : kart->getXYZ();
         Vec3 to = pos + kart->getTrans().getBasis() * Vec3(0, -10000, 0);
         Vec3 hit_point;
+        // The ray starts at the kart, so start with the triangle the kart
+        // is on.
+        int triangle = kart->getTerrainInfo()->getTriangleIndex();
         Track::getCurrentTrack()->getTriangleMesh().castRay(pos, to,
                                                             &hit_point,
                                                             &material_hit,
-                                                            &normal);
+                                                            &normal,
+                                                  /*interpolate*/false,
+                                                            &triangle);
 
         // We will get no material if the kart is 'over nothing' when dropping
         // the bubble gum. In most cases this means that the item does not need
@@ -20,6 +20,7 @@
 
 #include "karts/abstract_kart.hpp"
 #include "modes/world.hpp"
+#include "network/bit_stream.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/rewind_manager.hpp"
@@ -252,17 +253,30 @@ BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
         return s;
     }
 
-    BareNetworkString *s =
-        new BareNetworkString(n * (  sizeof(int) + sizeof(uint16_t)
-                                   + sizeof(uint8_t)              ) );
+    BareNetworkString *s = new BareNetworkString(n * 4);
+    BitStreamWriter writer(s);
+    writer.addVarUInt(n);
+    // The time of the first event is relative to the state time
+    int previous_ticks = World::getWorld()->getTicksSinceStart();
     for (auto p : m_item_events.getData())
     {
-        p.saveState(s);
+        p.saveState(&writer, previous_ticks);
+        previous_ticks = p.getTicks();
     }
     m_item_events.unlock();
+    writer.flush();
     return s;
 }   // saveState
 
+//-----------------------------------------------------------------------------
+/** Item states are not predicted, only the item events in a state are
+ *  checked (see matchesPrediction).
+ */
+BareNetworkString* NetworkItemManager::savePrediction()
+{
+    return new BareNetworkString();
+}   // savePrediction
+
 //-----------------------------------------------------------------------------
 /** Progresses the time for all item by the given number of ticks. Used
  *  when computing a new state from a confirmed state.
@@ -376,11 +390,16 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
     // Note that the actual ItemManager states must NOT be changed here, only
     // the confirmed states in the Network manager are allowed to be modified.
     // They will all be copied to the ItemManager states after the loop.
-    while(count > 0)
+    BitStreamReader reader(buffer);
+    unsigned num_events = has_state ? reader.getVarUInt() : 0;
+    // The time of the first event is relative to the state time
+    int previous_ticks = rewind_to_time;
+    for (unsigned n = 0; n < num_events; n++)
     {
         // 1.1) Decode the event in the message
         // ------------------------------------
-        ItemEventInfo iei(buffer, &count);
+        ItemEventInfo iei(&reader, previous_ticks);
+        previous_ticks = iei.getTicks();
         if(m_network_item_debugging)
             Log::info("NIM", "Rewindto %d current %d iei.index %d iei tick %d iei.coll %d iei.new %d iei.ttr %d confirmed %lx",
                       rewind_to_time, current_time,
@@ -464,7 +483,7 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
                        iei.getTicks());
         }
         current_time = iei.getTicks();
-    }   // while count >0
+    }   // for n < num_events
 
 
     // 2. Update Server 
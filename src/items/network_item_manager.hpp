@@ -92,6 +92,16 @@ public:
         OVERRIDE;
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction() OVERRIDE;
+    // ------------------------------------------------------------------------
+    /** A state without item events doesn't change the confirmed item state.
+     *  Any unconfirmed item event must be restored, so that the client
+     *  confirms it to the server. */
+    virtual bool matchesPrediction(BareNetworkString* prediction,
+                                   BareNetworkString* buffer, int count)
+                                                                      OVERRIDE
+                                                        { return count == 0; }
+    // ------------------------------------------------------------------------
     virtual void rewindToEvent(BareNetworkString *bns) OVERRIDE {};
     // ------------------------------------------------------------------------
     virtual void saveTransform() OVERRIDE {};
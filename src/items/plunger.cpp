@@ -266,6 +266,24 @@ BareNetworkString* Plunger::saveState(std::vector<std::string>* ru)
     return buffer;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+/** Adds the plunger values of saveState() to the prediction of the flyable,
+ *  they must match the state exactly.
+ */
+BareNetworkString* Plunger::savePrediction()
+{
+    BareNetworkString* buffer = Flyable::savePrediction();
+    if (buffer->getTotalSize() == 0)
+        return buffer;
+
+    buffer->addUInt16(m_keep_alive);
+    if (m_rubber_band)
+        buffer->addUInt8(m_rubber_band->get8BitState());
+    else
+        buffer->addUInt8(255);
+    return buffer;
+}   // savePrediction
+
 // ----------------------------------------------------------------------------
 void Plunger::restoreState(BareNetworkString *buffer, int count)
 {
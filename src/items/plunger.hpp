@@ -77,6 +77,8 @@ public:
         OVERRIDE;
     // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
+    // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction() OVERRIDE;
 
 };   // Plunger
 
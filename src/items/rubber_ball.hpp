@@ -233,6 +233,11 @@ public:
     // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
+    /** The path of the ball (control points, interpolation values and track
+     *  sector) is not compared with the server, so a state while a ball is
+     *  flying always causes a rewind. */
+    virtual BareNetworkString* savePrediction() OVERRIDE       { return NULL; }
+    // ------------------------------------------------------------------------
 
 };   // RubberBall
 
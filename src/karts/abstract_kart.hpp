@@ -477,6 +477,11 @@ public:
     /** Returns the terrain info oject. */
     virtual const TerrainInfo *getTerrainInfo() const = 0;
     // ------------------------------------------------------------------------
+    /** Does the terrain raycast of the next update() ahead of time. This
+     *  only reads the track and the data of this kart, so it can be called
+     *  for all karts in parallel. */
+    virtual void prefetchTerrainInfo() = 0;
+    // ------------------------------------------------------------------------
     /** Called when the kart crashes against another kart.
      *  \param k The kart that was hit.
      *  \param update_attachments If true the attachment of this kart and the
@@ -65,6 +65,9 @@ public:
     // Not needed to create any physics for a ghost kart.
     virtual void  createPhysics() OVERRIDE {};
     // ------------------------------------------------------------------------
+    /** The terrain is not used by a ghost kart. */
+    virtual void  prefetchTerrainInfo() OVERRIDE {};
+    // ------------------------------------------------------------------------
     const float   getSuspensionLength(int index, int wheel) const
                { return m_all_physic_info[index].m_suspension_length[wheel]; }
     // ------------------------------------------------------------------------
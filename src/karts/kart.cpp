@@ -755,11 +755,12 @@ void Kart::createPhysics()
 
     // Create the actual vehicle
     // -------------------------
-    m_vehicle_raycaster.reset(
+    btKartRaycaster* raycaster =
         new btKartRaycaster(Physics::getInstance()->getPhysicsWorld(),
                             stk_config->m_smooth_normals &&
-                            Track::getCurrentTrack()->smoothNormals()));
-    m_vehicle.reset(new btKart(m_body.get(), m_vehicle_raycaster.get(), this));
+                            Track::getCurrentTrack()->smoothNormals());
+    m_vehicle_raycaster.reset(raycaster);
+    m_vehicle.reset(new btKart(m_body.get(), raycaster, this));
 
     // never deactivate the vehicle
     m_body->setActivationState(DISABLE_DEACTIVATION);
@@ -1575,20 +1576,8 @@ void Kart::update(int ticks)
     // a rescue texture).
     // To avoid this problem, we do the raycast for terrain detection from
     // the center of the 4 wheel positions (in world coordinates).
-
-    Vec3 from(0.0f, 0.0f, 0.0f);
-    for (unsigned int i = 0; i < 4; i++)
-        from += m_vehicle->getWheelInfo(i).m_raycastInfo.m_hardPointWS;
-
-    // Add a certain epsilon (0.3) to the height of the kart. This avoids
-    // problems of the ray being cast from under the track (which happened
-    // e.g. on tux tollway when jumping down from the ramp, when the chassis
-    // partly tunnels through the track). While tunneling should not be
-    // happening (since Z velocity is clamped), the epsilon is left in place
-    // just to be on the safe side (it will not hit the chassis itself).
-    from = from/4 + (getTrans().getBasis() * Vec3(0.0f, 0.3f, 0.0f));
-
-    m_terrain_info->update(getTrans().getBasis(), from);
+    m_terrain_info->update(getTrans().getBasis(),
+                           getTerrainRayOrigin(getTrans()));
 
     if (m_body->getBroadphaseHandle())
     {
@@ -1817,6 +1806,42 @@ void Kart::update(int ticks)
 
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Returns the point from which the terrain raycast is done: the center of
+ *  the 4 wheel positions, slightly moved up.
+ *  \param trans The transform of the kart.
+ */
+Vec3 Kart::getTerrainRayOrigin(const btTransform &trans) const
+{
+    Vec3 from(0.0f, 0.0f, 0.0f);
+    for (unsigned int i = 0; i < 4; i++)
+        from += m_vehicle->getWheelInfo(i).m_raycastInfo.m_hardPointWS;
+
+    // Add a certain epsilon (0.3) to the height of the kart. This avoids
+    // problems of the ray being cast from under the track (which happened
+    // e.g. on tux tollway when jumping down from the ramp, when the chassis
+    // partly tunnels through the track). While tunneling should not be
+    // happening (since Z velocity is clamped), the epsilon is left in place
+    // just to be on the safe side (it will not hit the chassis itself).
+    return from/4 + (trans.getBasis() * Vec3(0.0f, 0.3f, 0.0f));
+}   // getTerrainRayOrigin
+
+//-----------------------------------------------------------------------------
+/** Does the terrain raycast of the next update() in advance, using the
+ *  transform Moveable::update() will take from the physics. The result is
+ *  only used by update() if the kart has exactly the same transform and
+ *  wheel positions by then (i.e. no animation or rewind moved it).
+ */
+void Kart::prefetchTerrainInfo()
+{
+    if (!m_body || !m_vehicle)
+        return;
+    btTransform trans = getTrans();
+    if (m_body->getInvMass() != 0)
+        m_motion_state->getWorldTransform(trans);
+    m_terrain_info->prefetch(trans.getBasis(), getTerrainRayOrigin(trans));
+}   // prefetchTerrainInfo
+
 //-----------------------------------------------------------------------------
 /** Updates the local speed based on the current physical velocity. The value
  *  is smoothed exponentially to avoid camera stuttering (camera distance
@@ -287,6 +287,7 @@ protected:
     void          playCrashSFX(const Material* m, AbstractKart *k);
     void          loadData(RaceManager::KartType type, bool animatedModel);
     void          updateWeight();
+    Vec3          getTerrainRayOrigin(const btTransform &trans) const;
 public:
                    Kart(const std::string& ident, unsigned int world_kart_id,
                         int position, const btTransform& init_transform,
@@ -540,6 +541,8 @@ public:
         return m_terrain_info;
     }
     // ------------------------------------------------------------------------
+    virtual void prefetchTerrainInfo() OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void setOnScreenText(const wchar_t *text) OVERRIDE;
     // ------------------------------------------------------------------------
     /** Returns the normal of the terrain the kart is over atm. This is
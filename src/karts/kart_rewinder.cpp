@@ -30,6 +30,8 @@
 #include "karts/max_speed.hpp"
 #include "karts/skidding.hpp"
 #include "modes/world.hpp"
+#include "network/bit_stream.hpp"
+#include "network/compress_network_body.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/rewind_manager.hpp"
 #include "network/network_string.hpp"
@@ -65,6 +67,7 @@ void KartRewinder::reset()
     SmoothNetworkBody::setSmoothRotation(true);
     SmoothNetworkBody::setAdjustVerticalOffset(true);
     m_has_server_state = false;
+    m_local_body_ticks = -1;
 }   // reset
 
 // ----------------------------------------------------------------------------
@@ -164,17 +167,9 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
 
     // 1) Firing and related handling
     // -----------
-    buffer->addUInt16(m_bubblegum_ticks);
-    bool plunger_on = m_view_blocked_by_plunger != 0;
-    // m_invulnerable_ticks will not be negative
     AbstractKartAnimation* ka = getKartAnimation();
     bool has_animation = ka != NULL && ka->usePredefinedEndTransform();
-    uint16_t fire_and_invulnerable = (m_fire_clicked ? 1 << 15 : 0) |
-        (has_animation ? 1 << 14 : 0) | (plunger_on ? 1 << 13 : 0) |
-        m_invulnerable_ticks;
-    buffer->addUInt16(fire_and_invulnerable);
-    if (plunger_on)
-        buffer->addUInt16(m_view_blocked_by_plunger);
+    saveStatus(buffer, has_animation);
 
     // 2) Kart animation status (tells the end transformation) or
     // physics values (transform and velocities)
@@ -189,23 +184,57 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
         unsigned et = ka->getEndTicks() & 134217727;
         et |= ka->getAnimationType() << 27;
         buffer->addUInt32(et);
+        buffer->add(body->getLinearVelocity());
+        buffer->add(body->getAngularVelocity());
     }
     else
     {
-        const btTransform &t = body->getWorldTransform();
-        buffer->add(t.getOrigin());
-        btQuaternion q = t.getRotation();
-        buffer->add(q);
+        // This also sets the body to the compressed values, so the server
+        // continues with exactly the values the clients receive
+        CompressNetworkBody::compress(body->getWorldTransform(),
+            body->getLinearVelocity(), body->getAngularVelocity(), buffer,
+            body, body->getMotionState());
     }
 
-    buffer->add(body->getLinearVelocity());
-    buffer->add(body->getAngularVelocity());
-    buffer->addUInt16(m_vehicle->getTimedRotationTicks());
-    buffer->addFloat(m_vehicle->getTimedRotation());
+    saveRemainingState(buffer);
+    return buffer;
+}   // saveState
 
-    // For collision rewind
-    buffer->addUInt16(m_bounce_back_ticks);
-    buffer->addUInt16(m_vehicle->getCentralImpulseTicks());
+// ----------------------------------------------------------------------------
+/** Saves the firing and related status of the kart (the first part of a
+ *  state).
+ *  \param buffer The buffer to append the status to.
+ *  \param has_animation If a kart animation end transform will be saved
+ *         instead of the physics values.
+ */
+void KartRewinder::saveStatus(BareNetworkString* buffer, bool has_animation)
+{
+    bool plunger_on = m_view_blocked_by_plunger != 0;
+    // Most of the ticks are 0 most of the time, which needs 5 bits
+    BitStreamWriter writer(buffer);
+    writer.addBool(m_fire_clicked);
+    writer.addBool(has_animation);
+    writer.addBool(plunger_on);
+    writer.addVarInt(m_bubblegum_ticks);
+    writer.addVarInt(m_invulnerable_ticks);
+    if (plunger_on)
+        writer.addVarInt(m_view_blocked_by_plunger);
+}   // saveStatus
+
+// ----------------------------------------------------------------------------
+/** Saves everything of a state after the physics values: timed rotation and
+ *  impulses, controls, attachment, powerup, nitro, max speed and skidding.
+ */
+void KartRewinder::saveRemainingState(BareNetworkString* buffer)
+{
+    {
+        BitStreamWriter writer(buffer);
+        writer.addVarUInt(m_vehicle->getTimedRotationTicks());
+        // For collision rewind
+        writer.addVarInt(m_bounce_back_ticks);
+        writer.addVarUInt(m_vehicle->getCentralImpulseTicks());
+    }
+    buffer->addFloat(m_vehicle->getTimedRotation());
     buffer->add(m_vehicle->getAdditionalImpulse());
 
     // 3) Steering and other player controls
@@ -226,41 +255,123 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     // 6) Skidding
     // -----------
     m_skidding->saveState(buffer);
+}   // saveRemainingState
+
+// ----------------------------------------------------------------------------
+/** Skips the status saved by saveStatus() when reading a state.
+ */
+void KartRewinder::skipStatus(const BareNetworkString* buffer)
+{
+    BitStreamReader reader(buffer);
+    // Fire clicked and has animation
+    reader.getBits(2);
+    bool has_plunger = reader.getBool();
+    reader.getVarInt();
+    reader.getVarInt();
+    if (has_plunger)
+        reader.getVarInt();
+}   // skipStatus
 
+// ----------------------------------------------------------------------------
+/** Saves the predicted state of this kart on a client, which is compared
+ *  with the state received from the server in matchesPrediction(). It uses
+ *  the same format as a state (without changing the body when compressing
+ *  the physics values), so it can also be restored instead of a state in
+ *  which the server did not include this kart. No prediction is saved while
+ *  a kart animation is shown, a state received for that time will always
+ *  cause a rewind.
+ */
+BareNetworkString* KartRewinder::savePrediction()
+{
+    // Eliminated karts are not part of a state
+    if (m_eliminated)
+        return new BareNetworkString();
+    if (getKartAnimation())
+        return NULL;
+
+    BareNetworkString *buffer = new BareNetworkString(96);
+    saveStatus(buffer, false/*has_animation*/);
+    btRigidBody *body = getBody();
+    CompressNetworkBody::compress(body->getWorldTransform(),
+        body->getLinearVelocity(), body->getAngularVelocity(), buffer,
+        NULL/*body*/, NULL/*ms*/);
+    saveRemainingState(buffer);
     return buffer;
-}   // saveState
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Compares a state received from the server with the prediction saved for
+ *  the same time. All values except the physics ones must be identical, the
+ *  physics values can differ by errors small enough not to be smoothed at
+ *  all.
+ *  \param prediction Prediction saved by savePrediction().
+ *  \param buffer The confirmed state from the server.
+ *  \param count Number of bytes of this kart in buffer.
+ */
+bool KartRewinder::matchesPrediction(BareNetworkString* prediction,
+                                     BareNetworkString* buffer, int count)
+{
+    const int BODY_SIZE = CompressNetworkBody::COMPRESSED_SIZE;
+    // A kart which was eliminated in the prediction (e.g. live join)
+    if (prediction->size() == 0)
+        return false;
+    const char* status = prediction->getCurrentData();
+    const int status_start = prediction->getCurrentOffset();
+    skipStatus(prediction);
+    const int status_size = prediction->getCurrentOffset() - status_start;
+    if (count < status_size + BODY_SIZE || (int)buffer->size() < count ||
+        memcmp(status, buffer->getCurrentData(), status_size) != 0)
+        return false;
+    buffer->skip(status_size);
+
+    if (!CompressNetworkBody::isClose(prediction, buffer,
+        stk_config->m_snb_min_adjust_length))
+        return false;
+
+    const int remaining = count - status_size - BODY_SIZE;
+    return (int)prediction->size() == remaining &&
+        memcmp(prediction->getCurrentData(), buffer->getCurrentData(),
+        remaining) == 0;
+}   // matchesPrediction
 
 // ----------------------------------------------------------------------------
 /** Actually rewind to the specified state. 
  *  \param buffer The buffer with the state info.
- *  \param count Number of bytes that must be used up in this function (not
- *         used).
+ *  \param count Number of bytes that must be used up in this function,
+ *         0 if the server did not include this kart.
  */
 void KartRewinder::restoreState(BareNetworkString *buffer, int count)
 {
     m_has_server_state = true;
+    // The server did not send this kart to this client (see
+    // StateRelevance), and it was eliminated in the local prediction
+    if (count == 0)
+        return;
 
     // 1) Firing and related handling
     // -----------
-    m_bubblegum_ticks = buffer->getUInt16();
-    uint16_t fire_and_invulnerable = buffer->getUInt16();
-    m_fire_clicked = ((fire_and_invulnerable >> 15) & 1) == 1;
-    bool has_animation = ((fire_and_invulnerable >> 14) & 1) == 1;
-    bool has_plunger = ((fire_and_invulnerable >> 13) & 1) == 1;
-    if (has_plunger)
-        m_view_blocked_by_plunger = buffer->getUInt16();
-    else
-        m_view_blocked_by_plunger = 0;
-
-    m_invulnerable_ticks = fire_and_invulnerable & ~(1 << 13);
+    bool has_animation = false;
+    bool has_plunger = false;
+    {
+        BitStreamReader reader(buffer);
+        m_fire_clicked = reader.getBool();
+        has_animation = reader.getBool();
+        has_plunger = reader.getBool();
+        m_bubblegum_ticks = (int16_t)reader.getVarInt();
+        m_invulnerable_ticks = (int16_t)reader.getVarInt();
+        if (has_plunger)
+            m_view_blocked_by_plunger = (int16_t)reader.getVarInt();
+        else
+            m_view_blocked_by_plunger = 0;
+    }
 
     // 2) Kart animation status or transform and velocities
     // -----------
-    m_transfrom_from_network.setOrigin(buffer->getVec3());
-    m_transfrom_from_network.setRotation(buffer->getQuat());
-
+    Vec3 lv, av;
     if (has_animation)
     {
+        m_transfrom_from_network.setOrigin(buffer->getVec3());
+        m_transfrom_from_network.setRotation(buffer->getQuat());
         unsigned et = buffer->getUInt32();
         int end_ticks = et & 134217727;
         KartAnimationType kat = (KartAnimationType)(et >> 27);
@@ -293,10 +404,15 @@ void KartRewinder::restoreState(BareNetworkString *buffer, int count)
                 end_ticks);
         }
         m_last_animation_end_ticks = end_ticks;
+        lv = buffer->getVec3();
+        av = buffer->getVec3();
+    }
+    else
+    {
+        CompressNetworkBody::decompress(buffer, &m_transfrom_from_network,
+            &lv, &av);
     }
 
-    Vec3 lv = buffer->getVec3();
-    Vec3 av = buffer->getVec3();
     // Don't restore to phyics position if showing kart animation
     if (!getKartAnimation())
     {
@@ -313,15 +429,20 @@ void KartRewinder::restoreState(BareNetworkString *buffer, int count)
         setTrans(m_transfrom_from_network);
     }
 
-    uint16_t time_rot = buffer->getUInt16();
+    uint16_t time_rot = 0;
+    uint16_t central_impulse_ticks = 0;
+    {
+        BitStreamReader reader(buffer);
+        time_rot = (uint16_t)reader.getVarUInt();
+        // Collision rewind
+        m_bounce_back_ticks = (int16_t)reader.getVarInt();
+        central_impulse_ticks = (uint16_t)reader.getVarUInt();
+    }
     float timed_rotation_y = buffer->getFloat();
     // Set timed rotation divides by time_rot
     m_vehicle->setTimedRotation(time_rot,
         stk_config->ticks2Time(time_rot) * timed_rotation_y);
 
-    // Collision rewind
-    m_bounce_back_ticks = buffer->getUInt16();
-    uint16_t central_impulse_ticks = buffer->getUInt16();
     Vec3 additional_impulse = buffer->getVec3();
     m_vehicle->setTimedCentralImpulse(central_impulse_ticks,
         additional_impulse, true/*rewind*/);
@@ -358,6 +479,39 @@ void KartRewinder::restoreState(BareNetworkString *buffer, int count)
 
 }   // restoreState
 
+// ----------------------------------------------------------------------------
+/** Called if the server left this kart out of a state and this client has
+ *  no prediction for that time (e.g. the kart was showing an animation, or
+ *  the client joined later). The physics body is restored from what this
+ *  client saved at that time, the rest of the local state was already
+ *  restored in RewindManager::rewindTo().
+ */
+void KartRewinder::restoreLocalState()
+{
+    m_has_server_state = true;
+    if (m_eliminated)
+        return;
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    if (m_local_body_ticks != ticks)
+    {
+        Log::warn("KartRewinder", "Missing local state for kart %d at %d.",
+            getWorldKartId(), ticks);
+        return;
+    }
+    m_local_body_ticks = -1;
+
+    // Don't restore to phyics position if showing kart animation
+    if (getKartAnimation())
+        return;
+    btRigidBody *body = getBody();
+    body->clearForces();
+    body->setLinearVelocity(m_local_lv);
+    body->setAngularVelocity(m_local_av);
+    body->proceedToTransform(m_local_transform);
+    setTrans(m_local_transform);
+    m_vehicle->updateAllWheelTransformsWS();
+}   // restoreLocalState
+
 // ----------------------------------------------------------------------------
 /** Called once a frame. It will add a new kart control event to the rewind
  *  manager if any control values have changed.
@@ -401,9 +555,15 @@ std::function<void()> KartRewinder::getLocalStateRestoreFunction()
     // Skidding local state
     float remaining_jump_time = m_skidding->m_remaining_jump_time;
 
+    // Physics body local state, only used if the server leaves this kart
+    // out of the state without a prediction (see restoreLocalState())
+    btTransform transform = getBody()->getWorldTransform();
+    Vec3 lv = getBody()->getLinearVelocity();
+    Vec3 av = getBody()->getAngularVelocity();
+
     return [brake_ticks, min_nitro_ticks, bubblegum_torque,
         initial_speed, steer_val_l, steer_val_r, current_fraction,
-        max_speed_fraction, remaining_jump_time, this]()
+        max_speed_fraction, remaining_jump_time, transform, lv, av, this]()
     {
         m_brake_ticks = brake_ticks;
         m_min_nitro_ticks = min_nitro_ticks;
@@ -420,5 +580,9 @@ std::function<void()> KartRewinder::getLocalStateRestoreFunction()
         m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
             .m_max_speed_fraction = max_speed_fraction;
         m_skidding->m_remaining_jump_time = remaining_jump_time;
+        m_local_transform = transform;
+        m_local_lv = lv;
+        m_local_av = av;
+        m_local_body_ticks = World::getWorld()->getTicksSinceStart();
     };
 }   // getLocalStateRestoreFunction
@@ -35,6 +35,19 @@ private:
 
     int m_last_animation_end_ticks;
     bool m_has_server_state;
+
+    /** Transform and velocities of the physics body saved locally by the
+     *  client (see getLocalStateRestoreFunction()), used if the server
+     *  leaves this kart out of a state without a prediction at that time. */
+    btTransform m_local_transform;
+    Vec3 m_local_lv, m_local_av;
+
+    /** World ticks at which m_local_transform was restored, or -1. */
+    int m_local_body_ticks;
+
+    void saveStatus(BareNetworkString* buffer, bool has_animation);
+    void saveRemainingState(BareNetworkString* buffer);
+    static void skipStatus(const BareNetworkString* buffer);
 public:
     KartRewinder(const std::string& ident, unsigned int world_kart_id,
                  int position, const btTransform& init_transform,
@@ -47,6 +60,11 @@ public:
         OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
+    virtual void restoreLocalState() OVERRIDE;
+    virtual BareNetworkString* savePrediction() OVERRIDE;
+    virtual bool matchesPrediction(BareNetworkString* prediction,
+                                   BareNetworkString* buffer, int count)
+                                                                     OVERRIDE;
     virtual void rewindToEvent(BareNetworkString *p) OVERRIDE {}
     virtual void update(int ticks) OVERRIDE;
     // -------------------------------------------------------------------------
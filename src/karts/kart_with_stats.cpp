@@ -21,6 +21,7 @@
 #include "karts/explosion_animation.hpp"
 #include "karts/rescue_animation.hpp"
 #include "items/item.hpp"
+#include "items/powerup.hpp"
 #include "modes/linear_world.hpp"
 
 KartWithStats::KartWithStats(const std::string& ident,
@@ -50,6 +51,9 @@ void KartWithStats::reset()
     m_bubblegum_count   = 0;
     m_brake_count       = 0;
     m_off_track_count   = 0;
+    m_powerup_use_count = 0;
+    m_last_lap_ticks    = 0;
+    m_lap_times.clear();
     Kart::reset();
 }   // reset
 
@@ -60,7 +64,12 @@ void KartWithStats::reset()
  */
 void KartWithStats::update(int ticks)
 {
+    // A powerup is used when fire is pressed, which then reduces the
+    // number of powerups the kart has.
+    const int powerups = getPowerup()->getNum();
     Kart::update(ticks);
+    if(getControls().getFire() && getPowerup()->getNum() < powerups)
+        m_powerup_use_count ++;
     if(getSpeed()>m_top_speed        ) m_top_speed = getSpeed();
     float dt = stk_config->ticks2Time(ticks);
     if(getControls().getSkidControl()) m_skidding_time += dt;
@@ -68,6 +77,17 @@ void KartWithStats::update(int ticks)
     LinearWorld *world = dynamic_cast<LinearWorld*>(World::getWorld());
     if(world && !world->isOnRoad(getWorldKartId()))
         m_off_track_count ++;
+    // The first lap is counted from the start of the race (like the fastest
+    // lap in LinearWorld), not from crossing the start line.
+    if(world &&
+       world->getFinishedLapsOfKart(getWorldKartId()) >
+                                                  (int)m_lap_times.size())
+    {
+        int lap_ticks = world->getTicksAtLapForKart(getWorldKartId());
+        m_lap_times.push_back(stk_config->ticks2Time(lap_ticks -
+                                                     m_last_lap_ticks));
+        m_last_lap_ticks = lap_ticks;
+    }
 }   // update
 
 // ----------------------------------------------------------------------------
@@ -21,6 +21,8 @@
 
 #include "karts/kart.hpp"
 
+#include <vector>
+
 /** \defgroup karts */
 
 
@@ -70,6 +72,15 @@ private:
     /** How much time this kart was skidding. */
     float        m_skidding_time;
 
+    /** How many powerups this kart used. */
+    unsigned int m_powerup_use_count;
+
+    /** The time of each lap this kart finished. */
+    std::vector<float> m_lap_times;
+
+    /** Race time in ticks at which the last lap was finished. */
+    int          m_last_lap_ticks;
+
 public:
                  KartWithStats(const std::string& ident,
                                unsigned int world_kart_id,
@@ -120,6 +131,12 @@ public:
     /** Returns how often the kart was off track. */
     unsigned int getOffTrackCount() const { return m_off_track_count; }
     // ------------------------------------------------------------------------
+    /** Returns how many powerups this kart used. */
+    unsigned int getPowerupUseCount() const { return m_powerup_use_count; }
+    // ------------------------------------------------------------------------
+    /** Returns the times of all laps this kart finished. */
+    const std::vector<float>& getLapTimes() const { return m_lap_times; }
+    // ------------------------------------------------------------------------
 
 };   // KartWithStats
 #endif
@@ -216,9 +216,18 @@
 #include "modes/profile_world.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "network/bit_stream.hpp"
+#include "network/chunked_state.hpp"
+#include "network/connection_limiter.hpp"
+#include "network/crypto.hpp"
+#include "network/load_test.hpp"
+#include "network/metrics_exporter.hpp"
 #include "network/network_config.hpp"
+#include "network/network_recorder.hpp"
 #include "network/network_string.hpp"
+#include "network/ranking_worker.hpp"
 #include "network/rewind_manager.hpp"
 #include "network/rewind_queue.hpp"
 #include "network/server.hpp"
@@ -228,6 +237,8 @@
 #include "network/stk_peer.hpp"
 #include "online/profile_manager.hpp"
 #include "online/request_manager.hpp"
+#include "physics/triangle_mesh.hpp"
+#include "race/batch_simulator.hpp"
 #include "race/grand_prix_manager.hpp"
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
@@ -252,7 +263,9 @@
 #include "utils/mini_glm.hpp"
 #include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/translation.hpp"
+#include "utils/worker_pool.hpp"
 
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
@@ -581,6 +594,8 @@ void cmdLineHelp()
     "       --trackdir=DIR     A directory from which additional tracks are "
                               "loaded.\n"
     "       --seed=n           Seed for random number generation to provide reproducible behavior.\n"
+    "       --kart-threads=n   Threads used for the kart queries in each physics\n"
+    "                          step (1 disables them, default: automatic).\n"
     "       --profile-laps=n   Enable automatic driven profile mode for n "
                               "laps.\n"
     "       --profile-time=n   Enable automatic driven profile mode for n "
@@ -588,6 +603,19 @@ void cmdLineHelp()
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --no-graphics      Do not display the actual race.\n"
+    "       --batch-races=FILE Run AI races without graphics as fast as possible,\n"
+    "                          several at a time, and write lap times, item usage\n"
+    "                          and CPU time of each kart and race to the CSV FILE.\n"
+    "       --batch-tracks=t1,t2 Tracks of the batch races (default: all).\n"
+    "       --batch-karts=k1,k2 Karts of the batch races, each race uses one\n"
+    "                          of them for all karts (default: --kart).\n"
+    "       --batch-difficulties=d1,d2 AI difficulties of the batch races\n"
+    "                          (default: --difficulty).\n"
+    "       --batch-repeat=n   Number of races for each track, kart and\n"
+    "                          difficulty (default: 1).\n"
+    "       --batch-laps=n     Number of laps of the batch races (default: 3).\n"
+    "       --batch-jobs=n     Number of batch races run at the same time\n"
+    "                          (default: number of cores).\n"
     "       --sp-shader-debug  Enables debug in sp shader, it will print all unavailable uniforms.\n"
     "       --demo-mode=t      Enables demo mode after t seconds of idle time in "
                                "main menu.\n"
@@ -605,6 +633,15 @@ void cmdLineHelp()
     "       --server-config=file Specify the server_config.xml for server hosting, it will create\n"
     "                            one if not found.\n"
     "       --network-console  Enable network console.\n"
+    "       --load-test=n      Connect n synthetic clients to the server started by\n"
+    "                          this process and log its load. Needs an owner-less\n"
+    "                          server with server-max-players of at least n.\n"
+    "       --record-network=file Record all network events of the server to a file.\n"
+    "                          It stores decrypted data like online names and chat\n"
+    "                          (but not the server password), keep it private.\n"
+    "       --replay-network=file Replay recorded network events in a server without\n"
+    "                          clients, for benchmarking (use the same server config).\n"
+    "       --benchmark-crypto=n Measure the encryption of a state for n peers and exit.\n"
     "       --wan-server=name  Start a Wan server (not a playing client).\n"
     "       --public-server    Allow direct connection to the server (without stk server)\n"
     "       --lan-server=name  Start a LAN server (not a playing client).\n"
@@ -620,6 +657,7 @@ void cmdLineHelp()
     "       --init-user        Save the above login and password (if set) in config.\n"
     "       --disable-polling  Don't poll for logged in user.\n"
     "       --port=n           Port number to use.\n"
+    "       --server-lobbies=n Number of lobbies hosted by this server (server only).\n"
     "       --auto-connect     Automatically connect to fist server and start race\n"
     "       --max-players=n    Maximum number of clients (server only).\n"
     "       --min-players=n    Minimum number of clients for owner less server(server only).\n"
@@ -736,6 +774,13 @@ int handleCmdLineOutputModifier()
     if(CommandLine::has("--no-console-log"))
         Log::toggleConsoleLog(false);
 
+    if (CommandLine::has("--benchmark-crypto", &n) && n > 0)
+    {
+        Crypto::benchmark(n);
+        cleanUserConfig();
+        exit(0);
+    }
+
     return 0;
 }
 
@@ -938,6 +983,9 @@ int handleCmdLinePreliminary()
         Log::info("main", "STK using random seed (%d)", n);
     }
 
+    if (CommandLine::has("--kart-threads", &n))
+        UserConfigParams::m_kart_threads = std::max(n, 1);
+
     return 0;
 }   // handleCmdLinePreliminary
 
@@ -1191,6 +1239,11 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         }
     }
 
+    if (CommandLine::has("--record-network", &s))
+        NetworkRecorder::setRecordFile(s);
+    if (CommandLine::has("--replay-network", &s))
+        NetworkRecorder::setReplayFile(s);
+
     if (CommandLine::has("--network-console"))
     {
         ServerConfig::m_enable_console = true;
@@ -1294,6 +1347,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         NetworkConfig::get()->setClientPort(n);
         ServerConfig::m_server_port = n;
     }
+    if (CommandLine::has("--server-lobbies", &n))
+        ServerConfig::m_server_lobbies = n;
     if (CommandLine::has("--public-server"))
     {
         NetworkConfig::get()->setIsPublicServer();
@@ -1384,6 +1439,9 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             Log::info("main", "Creating a LAN server '%s'.",
                 server_name.c_str());
         }
+        if (STKHost::existHost() && CommandLine::has("--load-test", &n) &&
+            n > 0)
+            LoadTest::create(n);
     }
 
     if (CommandLine::has("--auto-connect"))
@@ -1617,6 +1675,26 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
     if(CommandLine::has("--demo-tracks", &s))
         DemoWorld::setTracks(StringUtils::split(s,','));
 
+    if (BatchSimulator::get())
+    {
+        UserConfigParams::m_no_start_screen = true;
+        if (CommandLine::has("--batch-tracks", &s))
+            BatchSimulator::get()->setTracks(StringUtils::split(s, ','));
+        if (CommandLine::has("--batch-karts", &s))
+            BatchSimulator::get()->setKarts(StringUtils::split(s, ','));
+        if (CommandLine::has("--batch-difficulties", &s))
+        {
+            BatchSimulator::get()
+                ->setDifficulties(StringUtils::split(s, ','));
+        }
+        if (CommandLine::has("--batch-repeat", &n))
+            BatchSimulator::get()->setRepetitions(std::max(n, 1));
+        if (CommandLine::has("--batch-laps", &n))
+            BatchSimulator::get()->setNumLaps(std::max(n, 1));
+        if (CommandLine::has("--batch-jobs", &n))
+            BatchSimulator::get()->setNumJobs(std::max(n, 1));
+    }   // --batch-races
+
 #ifdef ENABLE_WIIUSE
     if(CommandLine::has("--wii"))
         WiimoteManager::enable();
@@ -1900,6 +1978,13 @@ int main(int argc, char *argv[] )
 #endif
             ProfileWorld::disableGraphics();
 
+        // Batch races never display anything.
+        if (CommandLine::has("--batch-races", &s))
+        {
+            ProfileWorld::disableGraphics();
+            BatchSimulator::create(s);
+        }
+
         // Init the minimum managers so that user config exists, then
         // handle all command line options that do not need (or must
         // not have) other managers initialised:
@@ -2225,6 +2310,14 @@ int main(int argc, char *argv[] )
             }   // if !online
         }
 
+        // Batch races
+        // ===========
+        // The original process only starts the races and exits once they
+        // are all done. run() returns in the forked process of each race,
+        // which then runs its race in profile mode below.
+        if (BatchSimulator::get())
+            BatchSimulator::get()->run();
+
         // Not replaying
         // =============
         if(!ProfileWorld::isProfileMode())
@@ -2273,6 +2366,7 @@ int main(int argc, char *argv[] )
         input_manager = NULL;
     }
 
+    LoadTest::destroy();
     if (STKHost::existHost())
         STKHost::get()->shutdown();
 
@@ -2419,7 +2513,10 @@ static void cleanUserConfig()
     {
         // In case that abort is triggered before user_config exists
         if (UserConfigParams::m_crashed) UserConfigParams::m_crashed = false;
-        user_config->saveConfig();
+        // Forked server lobbies leave the config to the original process,
+        // and batch races must not change it.
+        if (ServerConfig::getLobbyIndex() == 0 && !BatchSimulator::get())
+            user_config->saveConfig();
         delete user_config;
     }
 
@@ -2437,6 +2534,8 @@ void runUnitTests()
     GraphicsRestrictions::unitTesting();
     Log::info("UnitTest", "NetworkString");
     NetworkString::unitTesting();
+    Log::info("UnitTest", "BitStream");
+    BitStreamWriter::unitTesting();
     Log::info("UnitTest", "TransportAddress");
     TransportAddress::unitTesting();
     Log::info("UnitTest", "StringUtils::versionToInt");
@@ -2488,6 +2587,36 @@ void runUnitTests()
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "GameProtocol");
+    GameProtocol::unitTesting();
+
+    Log::info("UnitTest", "TickProfiler");
+    TickProfiler::unitTesting();
+
+    Log::info("UnitTest", "STKPeer");
+    STKPeer::unitTesting();
+
+    Log::info("UnitTest", "NetworkRecorder");
+    NetworkRecorder::unitTesting();
+
+    Log::info("UnitTest", "ChunkedState");
+    ChunkedState::unitTesting();
+
+    Log::info("UnitTest", "ConnectionLimiter");
+    ConnectionLimiter::unitTesting();
+
+    Log::info("UnitTest", "RankingWorker");
+    RankingWorker::unitTesting();
+
+    Log::info("UnitTest", "MetricsExporter");
+    MetricsExporter::unitTesting();
+
+    Log::info("UnitTest", "WorkerPool");
+    WorkerPool::unitTesting();
+
+    Log::info("UnitTest", "TriangleMesh");
+    TriangleMesh::unitTesting();
+
     Log::info("UnitTest", "IP ban");
     NetworkConfig::get()->unsetNetworking();
     ServerLobby sl;
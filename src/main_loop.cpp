@@ -33,6 +33,7 @@
 #include "modes/profile_world.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/network_recorder.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/race_event_manager.hpp"
@@ -43,6 +44,7 @@
 #include "race/race_manager.hpp"
 #include "states_screens/state_manager.hpp"
 #include "utils/profiler.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/time.hpp"
 
 #ifndef WIN32
@@ -336,6 +338,23 @@ void MainLoop::run()
         left_over_time += getLimitedDt();
         int num_steps   = stk_config->time2Ticks(left_over_time);
         float dt = stk_config->ticks2Time(1);
+        const bool dedicated_server = ProfileWorld::isNoGraphics() &&
+            !ProfileWorld::isProfileMode() &&
+            NetworkConfig::get()->isNetworking() &&
+            NetworkConfig::get()->isServer();
+        TickProfiler::setEnabled(dedicated_server);
+        // A server without graphics has nothing to do between two ticks, so
+        // instead of waking up every ms in getLimitedDt it sleeps until the
+        // next tick is due. If it is behind, num_steps is already > 0 and
+        // all missing ticks are done without sleeping.
+        if (num_steps == 0 && dedicated_server)
+        {
+            int sleep_ms = (int)((dt - left_over_time) * 1000.0f);
+            if (sleep_ms > 0)
+                StkTime::sleep(sleep_ms);
+            left_over_time += getLimitedDt();
+            num_steps = stk_config->time2Ticks(left_over_time);
+        }
         left_over_time -= num_steps * dt ;
 
         // Shutdown next frame if shutdown request is sent while loading the
@@ -469,6 +488,7 @@ void MainLoop::run()
                                        World::getWorld()->getTicksSinceStart());
                 }
 
+                TickProfiler::Scope tick_profiler(TickProfiler::TS_TICK);
                 PROFILER_PUSH_CPU_MARKER("Protocol manager update",
                                          0x7F, 0x00, 0x7F);
                 if (auto pm = ProtocolManager::lock())
@@ -506,6 +526,8 @@ void MainLoop::run()
                     }
                     World::getWorld()->updateTime(1);
                 }
+                NetworkRecorder::setWorldTicks(World::getWorld() ?
+                    World::getWorld()->getTicksSinceStart() : -1);
             }   // for i < num_steps
 
             // Handle controller the last to avoid slow PC sending actions too 
@@ -58,6 +58,8 @@ public:
     void requestAbort() { m_request_abort = true; }
     void setThrottleFPS(bool throttle) { m_throttle_fps = throttle; }
     void setAllowLargeDt(bool enable) { m_allow_large_dt = enable; }
+    /** Sets the process which this process should exit together with. */
+    void setParentPid(unsigned parent_pid) { m_parent_pid = parent_pid; }
     void renderGUI(int phase, int loop_index=-1, int loop_size=-1);
     // ------------------------------------------------------------------------
     /** Returns true if STK is to be stoppe. */
@@ -47,6 +47,7 @@
 #include "utils/constants.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <climits>
 #include <iostream>
@@ -241,8 +242,9 @@ void LinearWorld::update(int ticks)
 //-----------------------------------------------------------------------------
 void LinearWorld::updateTrackSectors()
 {
-    const unsigned int kart_amount = getNumKarts();
-    for(unsigned int n=0; n<kart_amount; n++)
+    // Each kart only changes its own track sector and kart info, and only
+    // reads the drive graph, so all karts can be done in parallel.
+    m_kart_workers->parallelFor(getNumKarts(), [this](unsigned int n)
     {
         KartInfo& kart_info = m_kart_info[n];
         AbstractKart* kart = m_karts[n].get();
@@ -251,7 +253,7 @@ void LinearWorld::updateTrackSectors()
         // rescued or eliminated
         if(kart->getKartAnimation() &&
            !dynamic_cast<CannonAnimation*>(kart->getKartAnimation()))
-            continue;
+            return;
         // If the kart is off road, and 'flying' over a reset plane
         // don't adjust the distance of the kart, to avoid a jump
         // in the position of the kart (e.g. while falling the kart
@@ -261,12 +263,12 @@ void LinearWorld::updateTrackSectors()
             (!kart->getMaterial() ||
               kart->getMaterial()->isDriveReset()))  &&
              !kart->isGhostKart())
-            continue;
+            return;
         getTrackSector(n)->update(kart->getFrontXYZ());
         kart_info.m_overall_distance = kart_info.m_finished_laps
                                      * Track::getCurrentTrack()->getTrackLength()
                         + getDistanceDownTrackForKart(kart->getWorldKartId(), true);
-    }   // for n
+    });   // for n
 }   // updateTrackSectors
 
 //-----------------------------------------------------------------------------
@@ -23,6 +23,7 @@
 #include "graphics/irr_driver.hpp"
 #include "karts/kart_with_stats.hpp"
 #include "karts/controller/controller.hpp"
+#include "race/batch_simulator.hpp"
 #include "tracks/track.hpp"
 
 #include <ISceneManager.h>
@@ -152,6 +153,8 @@ bool ProfileWorld::isRaceOver()
  */
 void ProfileWorld::update(int ticks)
 {
+    if (m_frame_count == 0 && BatchSimulator::get())
+        BatchSimulator::get()->raceStarted();
     StandardRace::update(ticks);
 
     m_frame_count++;
@@ -345,6 +348,10 @@ void ProfileWorld::enterRaceOverState()
                off_track_count, energy);
         Log::verbose("profile", "");
     }   // for it !=all_groups.end
+
+    // In batch races this does not return, the process of this race exits.
+    if (BatchSimulator::get())
+        BatchSimulator::get()->raceFinished(this);
     delete this;
     main_loop->abort();
 }   // enterRaceOverState
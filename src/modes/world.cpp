@@ -56,6 +56,7 @@
 #include "network/protocols/client_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
 #include "physics/btKart.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -72,20 +73,24 @@
 #include "states_screens/race_result_gui.hpp"
 #include "states_screens/state_manager.hpp"
 #include "tracks/check_manager.hpp"
+#include "tracks/terrain_info.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
 #include "utils/profiler.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
 #include <assert.h>
 #include <ctime>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 
 
 World* World::m_world = NULL;
@@ -139,6 +144,7 @@ World::World() : WorldStatus()
     m_schedule_exit_race = false;
     m_schedule_tutorial  = false;
     m_is_network_world   = false;
+    m_kart_workers       = NULL;
 
     m_stop_music_when_dialog_open = true;
 
@@ -272,9 +278,38 @@ void World::init()
     for (unsigned int i = 0; i < kart_amount; i++)
         initTeamArrows(m_karts[i].get());
 
+    createKartWorkers();
     main_loop->renderGUI(7300);
 }   // init
 
+//-----------------------------------------------------------------------------
+/** Creates the threads for the per kart queries done in each physics step.
+ *  Unless set with --kart-threads, up to 4 threads are used, but only one
+ *  per core that is not used by another lobby of this server.
+ */
+void World::createKartWorkers()
+{
+    unsigned int num_threads = UserConfigParams::m_kart_threads;
+    if (num_threads == 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+        const int lobbies = ServerConfig::m_server_lobbies;
+        if (NetworkConfig::get()->isServer() && lobbies > 1)
+        {
+            // Forked lobbies share the cores, or are bound to one core each
+            if (ServerConfig::m_lobby_cpu_affinity)
+                num_threads = 1;
+            else
+                num_threads /= (unsigned int)lobbies;
+        }
+        num_threads = std::min(num_threads, 4u);
+    }
+    num_threads = std::min(num_threads, (unsigned int)m_karts.size());
+    num_threads = std::max(num_threads, 1u);
+    m_kart_workers = new WorkerPool(num_threads);
+    Log::info("World", "Using %u thread(s) for kart queries.", num_threads);
+}   // createKartWorkers
+
 //-----------------------------------------------------------------------------
 void World::initTeamArrows(AbstractKart* k)
 {
@@ -556,6 +591,7 @@ Controller* World::loadAIController(AbstractKart* kart)
 //-----------------------------------------------------------------------------
 World::~World()
 {
+    delete m_kart_workers;
     material_manager->unloadAllTextures();
     RewindManager::destroy();
 
@@ -902,6 +938,7 @@ void World::scheduleUnpause()
  */
 void World::updateWorld(int ticks)
 {
+    TickProfiler::Scope tick_profiler(TickProfiler::TS_WORLD_UPDATE);
 #ifdef DEBUG
     assert(m_magic_number == 0xB01D6543);
 #endif
@@ -1101,6 +1138,21 @@ void World::update(int ticks)
     // which causes all AI steering commands set. So in the following 
     // physics update the new steering is taken into account.
     const int kart_amount = (int)m_karts.size();
+
+    // The terrain raycasts only read the track and the kart they are done
+    // for, so they are done for all karts in parallel first. Everything
+    // that can affect other karts (items, attachments, controllers) is then
+    // done one kart after another. Kart::update only uses the prefetched
+    // result if the kart was not moved in the meantime, so the result is
+    // the same with any number of threads.
+    if (m_kart_workers->getNumThreads() > 1)
+    {
+        m_kart_workers->parallelFor(kart_amount, [this](unsigned int i)
+            {
+                if (!m_karts[i]->isEliminated())
+                    m_karts[i]->prefetchTerrainInfo();
+            });
+    }
     for (int i = 0 ; i < kart_amount; ++i)
     {
         SpareTireAI* sta =
@@ -1111,6 +1163,7 @@ void World::update(int ticks)
         if (isStartPhase())
             m_karts[i]->makeKartRest();
     }
+    TerrainInfo::discardPrefetches();
     PROFILER_POP_CPU_MARKER();
     if(race_manager->isRecordingRace()) ReplayRecorder::get()->update(ticks);
 
@@ -1119,7 +1172,10 @@ void World::update(int ticks)
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_PUSH_CPU_MARKER("World::update (physics)", 0xa0, 0x7F, 0x00);
-    Physics::getInstance()->update(ticks);
+    {
+        TickProfiler::Scope tick_profiler(TickProfiler::TS_PHYSICS);
+        Physics::getInstance()->update(ticks);
+    }
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_POP_CPU_MARKER();
@@ -46,6 +46,7 @@ class btRigidBody;
 class Controller;
 class ItemState;
 class PhysicalObject;
+class WorkerPool;
 
 namespace Scripting
 {
@@ -131,8 +132,13 @@ protected:
     */
     bool        m_use_highscores;
 
+    /** Threads used for the queries of all karts in each physics step
+     *  which only read the world (e.g. terrain raycasts). */
+    WorkerPool* m_kart_workers;
+
     void  updateHighscores  (int* best_highscore_rank);
     void  resetAllKarts     ();
+    void  createKartWorkers ();
     Controller*
           loadAIController  (AbstractKart *kart);
 
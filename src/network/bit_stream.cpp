@@ -0,0 +1,286 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/bit_stream.hpp"
+
+#include "network/network_string.hpp"
+#include "utils/vec3.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// ----------------------------------------------------------------------------
+/** Adds the lowest 'bits' bits of value.
+ *  \param value The value to add.
+ *  \param bits Number of bits to use, at most 32.
+ */
+void BitStreamWriter::addBits(uint32_t value, unsigned bits)
+{
+    assert(bits <= 32);
+    // m_bits can hold up to 31 bits, so split larger values
+    if (bits > 24)
+    {
+        addBits(value >> 16, bits - 16);
+        addBits(value & 0xffff, 16);
+        return;
+    }
+    value &= (1u << bits) - 1;
+    m_bits = (m_bits << bits) | value;
+    m_bit_count += bits;
+    while (m_bit_count >= 8)
+    {
+        m_bit_count -= 8;
+        m_buffer->addUInt8(uint8_t(m_bits >> m_bit_count));
+    }
+    m_bits &= (1u << m_bit_count) - 1;
+}   // addBits
+
+// ----------------------------------------------------------------------------
+/** Adds an unsigned integer using groups of 4 bits, each with a
+ *  continuation bit. Values below 16 need 5 bits, below 256 10 bits.
+ */
+void BitStreamWriter::addVarUInt(uint32_t value)
+{
+    while (value >= 16)
+    {
+        addBits((value & 15) | 16, 5);
+        value >>= 4;
+    }
+    addBits(value, 5);
+}   // addVarUInt
+
+// ----------------------------------------------------------------------------
+/** Returns the number of bits used for a float in the given range and
+ *  precision.
+ */
+unsigned BitStreamWriter::getRangedFloatBits(float min, float max,
+                                             float precision)
+{
+    assert(max > min && precision > 0.0f);
+    uint32_t steps = (uint32_t)ceilf((max - min) / precision);
+    unsigned bits = 1;
+    while (bits < 32 && (steps >> bits) != 0)
+        bits++;
+    return bits;
+}   // getRangedFloatBits
+
+// ----------------------------------------------------------------------------
+/** Returns the value a reader will get for a ranged float. Senders can use
+ *  this to use exactly the same value as the receiver.
+ */
+float BitStreamWriter::quantizeFloat(float value, float min, float max,
+                                     float precision)
+{
+    uint32_t steps = (uint32_t)ceilf((max - min) / precision);
+    value = std::max(min, std::min(max, value));
+    uint32_t q = std::min(steps, (uint32_t)lroundf((value - min) / precision));
+    return min + q * precision;
+}   // quantizeFloat
+
+// ----------------------------------------------------------------------------
+/** Adds a float which is clamped to [min, max] and rounded to a multiple
+ *  of precision, using only as many bits as needed for that range.
+ */
+void BitStreamWriter::addRangedFloat(float value, float min, float max,
+                                     float precision)
+{
+    uint32_t steps = (uint32_t)ceilf((max - min) / precision);
+    value = std::max(min, std::min(max, value));
+    uint32_t q = std::min(steps, (uint32_t)lroundf((value - min) / precision));
+    addBits(q, getRangedFloatBits(min, max, precision));
+}   // addRangedFloat
+
+// ----------------------------------------------------------------------------
+/** Adds a float without any loss of precision (32 bits). */
+void BitStreamWriter::addFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    addBits(bits, 32);
+}   // addFloat
+
+// ----------------------------------------------------------------------------
+/** Adds a Vec3 without any loss of precision (96 bits). */
+void BitStreamWriter::addVec3(const Vec3& xyz)
+{
+    addFloat(xyz.getX());
+    addFloat(xyz.getY());
+    addFloat(xyz.getZ());
+}   // addVec3
+
+// ----------------------------------------------------------------------------
+/** Writes any remaining bits as a full byte (padded with 0 bits). */
+void BitStreamWriter::flush()
+{
+    if (m_bit_count > 0)
+        addBits(0, 8 - m_bit_count);
+}   // flush
+
+// ============================================================================
+/** Reads a value with the given number of bits.
+ *  \param bits Number of bits to read, at most 32.
+ */
+uint32_t BitStreamReader::getBits(unsigned bits)
+{
+    assert(bits <= 32);
+    if (bits > 24)
+    {
+        uint32_t high = getBits(bits - 16);
+        return (high << 16) | getBits(16);
+    }
+    while (m_bit_count < bits)
+    {
+        m_bits = (m_bits << 8) | m_buffer->getUInt8();
+        m_bit_count += 8;
+    }
+    m_bit_count -= bits;
+    uint32_t value = (m_bits >> m_bit_count) & ((1u << bits) - 1);
+    m_bits &= (1u << m_bit_count) - 1;
+    return value;
+}   // getBits
+
+// ----------------------------------------------------------------------------
+/** Reads an unsigned integer written by BitStreamWriter::addVarUInt. */
+uint32_t BitStreamReader::getVarUInt()
+{
+    uint32_t value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 4)
+    {
+        uint32_t group = getBits(5);
+        value |= (group & 15) << shift;
+        if ((group & 16) == 0)
+            return value;
+    }
+    throw std::out_of_range("getVarUInt invalid data.");
+}   // getVarUInt
+
+// ----------------------------------------------------------------------------
+/** Reads a float written by BitStreamWriter::addRangedFloat with the same
+ *  range and precision.
+ */
+float BitStreamReader::getRangedFloat(float min, float max, float precision)
+{
+    uint32_t q =
+        getBits(BitStreamWriter::getRangedFloatBits(min, max, precision));
+    return min + q * precision;
+}   // getRangedFloat
+
+// ----------------------------------------------------------------------------
+/** Reads a float written by BitStreamWriter::addFloat. */
+float BitStreamReader::getFloat()
+{
+    uint32_t bits = getBits(32);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}   // getFloat
+
+// ----------------------------------------------------------------------------
+/** Reads a Vec3 written by BitStreamWriter::addVec3. */
+Vec3 BitStreamReader::getVec3()
+{
+    float x = getFloat();
+    float y = getFloat();
+    float z = getFloat();
+    return Vec3(x, y, z);
+}   // getVec3
+
+// ============================================================================
+/** Tests writing and reading bit streams. */
+void BitStreamWriter::unitTesting()
+{
+    BareNetworkString s;
+    {
+        BitStreamWriter w(&s);
+        w.addBool(true);
+        w.addBits(5, 3);
+        w.addBits(0xdeadbeef, 32);
+        w.addVarUInt(0);
+        w.addVarUInt(15);
+        w.addVarUInt(16);
+        w.addVarUInt(0xffffffff);
+        w.addVarInt(-1);
+        w.addVarInt(-100000);
+        w.addVarInt(2147483647);
+        w.addTicks(1000, 990);
+        w.addTicks(980, 990);
+        w.addRangedFloat(1.234f, -10.0f, 10.0f, 0.01f);
+        w.addRangedFloat(100.0f, 0.0f, 1.0f, 0.001f);
+        w.addVec3(Vec3(1.5f, -2.25f, 1e10f));
+        w.flush();
+        // Byte based functions can be used after a flush
+        s.addUInt8(42);
+        w.addBool(true);
+    }
+    // Small values and tick differences only need 5 bits each
+    BareNetworkString t;
+    {
+        BitStreamWriter w(&t);
+        w.addVarUInt(3);
+        w.addTicks(101, 100);
+    }
+    assert(t.size() == 2);
+    assert(BitStreamWriter::getRangedFloatBits(-10.0f, 10.0f, 0.01f) == 11);
+
+    // The reads change the readers, so they must not be done in assert()
+    BitStreamReader r(&s);
+    bool b = r.getBool();
+    assert(b);
+    uint32_t u = r.getBits(3);
+    assert(u == 5);
+    u = r.getBits(32);
+    assert(u == 0xdeadbeef);
+    u = r.getVarUInt();
+    assert(u == 0);
+    u = r.getVarUInt();
+    assert(u == 15);
+    u = r.getVarUInt();
+    assert(u == 16);
+    u = r.getVarUInt();
+    assert(u == 0xffffffff);
+    int32_t i = r.getVarInt();
+    assert(i == -1);
+    i = r.getVarInt();
+    assert(i == -100000);
+    i = r.getVarInt();
+    assert(i == 2147483647);
+    int ticks = r.getTicks(990);
+    assert(ticks == 1000);
+    ticks = r.getTicks(990);
+    assert(ticks == 980);
+    float f = r.getRangedFloat(-10.0f, 10.0f, 0.01f);
+    assert(f == BitStreamWriter::quantizeFloat(1.234f, -10.0f, 10.0f, 0.01f));
+    assert(fabsf(BitStreamWriter::quantizeFloat(1.234f, -10.0f, 10.0f, 0.01f)
+                 - 1.23f) < 0.001f);
+    f = r.getRangedFloat(0.0f, 1.0f, 0.001f);
+    assert(f == 1.0f);
+    Vec3 v = r.getVec3();
+    assert(v == Vec3(1.5f, -2.25f, 1e10f));
+    // The padding bits of the flushed byte are skipped
+    u = s.getUInt8();
+    assert(u == 42);
+    BitStreamReader r2(&s);
+    b = r2.getBool();
+    assert(b);
+    assert(s.size() == 0);
+    // Avoid warnings about unused variables
+    (void)b; (void)u; (void)i; (void)ticks; (void)f; (void)v;
+}   // unitTesting
@@ -0,0 +1,141 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_BIT_STREAM_HPP
+#define HEADER_BIT_STREAM_HPP
+
+#include <cstdint>
+
+class BareNetworkString;
+class Vec3;
+
+/** \class BitStreamWriter
+ *  \brief Appends values with arbitrary bit sizes to a BareNetworkString.
+ *  Bits are collected most significant bit first and written to the string
+ *  as soon as a full byte is available. flush() (also called by the
+ *  destructor) pads the last byte with 0, after which normal byte based
+ *  functions of the string can be used again. A BitStreamReader reading
+ *  the same values in the same order consumes exactly the same bytes.
+ *  \ingroup network
+ */
+class BitStreamWriter
+{
+private:
+    /** The string the bytes are appended to. */
+    BareNetworkString* m_buffer;
+
+    /** Bits not yet written to m_buffer, in the lowest m_bit_count bits. */
+    uint32_t m_bits;
+
+    /** Number of bits in m_bits, always < 8 between calls. */
+    unsigned m_bit_count;
+
+public:
+    static void unitTesting();
+
+    // ------------------------------------------------------------------------
+    BitStreamWriter(BareNetworkString* buffer)
+        : m_buffer(buffer), m_bits(0), m_bit_count(0)            {}
+    // ------------------------------------------------------------------------
+    ~BitStreamWriter()                                       { flush(); }
+    // ------------------------------------------------------------------------
+    void addBits(uint32_t value, unsigned bits);
+    // ------------------------------------------------------------------------
+    void addVarUInt(uint32_t value);
+    // ------------------------------------------------------------------------
+    void addRangedFloat(float value, float min, float max, float precision);
+    // ------------------------------------------------------------------------
+    void addFloat(float value);
+    // ------------------------------------------------------------------------
+    void addVec3(const Vec3& xyz);
+    // ------------------------------------------------------------------------
+    void flush();
+    // ------------------------------------------------------------------------
+    /** Adds a single bit. */
+    void addBool(bool value)                     { addBits(value ? 1 : 0, 1); }
+    // ------------------------------------------------------------------------
+    /** Adds a signed integer, small absolute values need few bits. */
+    void addVarInt(int32_t value)
+    {
+        // Zig-zag encoding: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+        addVarUInt(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }   // addVarInt
+    // ------------------------------------------------------------------------
+    /** Adds a time in ticks relative to another time known by the reader
+     *  (e.g. the time of the previous event), which usually is only a few
+     *  bits instead of 32. */
+    void addTicks(int ticks, int reference)    { addVarInt(ticks - reference); }
+    // ------------------------------------------------------------------------
+    static float quantizeFloat(float value, float min, float max,
+                               float precision);
+    // ------------------------------------------------------------------------
+    static unsigned getRangedFloatBits(float min, float max, float precision);
+
+};   // BitStreamWriter
+
+// ============================================================================
+/** \class BitStreamReader
+ *  \brief Reads the values written by a BitStreamWriter from a
+ *  BareNetworkString. Reading past the end of the string throws
+ *  std::out_of_range, like reading a BareNetworkString does.
+ *  \ingroup network
+ */
+class BitStreamReader
+{
+private:
+    /** The string the bytes are read from. */
+    const BareNetworkString* m_buffer;
+
+    /** Bits of the last read byte not yet returned, in the lowest
+     *  m_bit_count bits. */
+    uint32_t m_bits;
+
+    /** Number of bits in m_bits. */
+    unsigned m_bit_count;
+
+public:
+    // ------------------------------------------------------------------------
+    BitStreamReader(const BareNetworkString* buffer)
+        : m_buffer(buffer), m_bits(0), m_bit_count(0)            {}
+    // ------------------------------------------------------------------------
+    uint32_t getBits(unsigned bits);
+    // ------------------------------------------------------------------------
+    uint32_t getVarUInt();
+    // ------------------------------------------------------------------------
+    float getRangedFloat(float min, float max, float precision);
+    // ------------------------------------------------------------------------
+    float getFloat();
+    // ------------------------------------------------------------------------
+    Vec3 getVec3();
+    // ------------------------------------------------------------------------
+    /** Reads a single bit. */
+    bool getBool()                                  { return getBits(1) == 1; }
+    // ------------------------------------------------------------------------
+    /** Reads a signed integer written by BitStreamWriter::addVarInt. */
+    int32_t getVarInt()
+    {
+        uint32_t value = getVarUInt();
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }   // getVarInt
+    // ------------------------------------------------------------------------
+    /** Reads a time written by BitStreamWriter::addTicks. */
+    int getTicks(int reference)             { return reference + getVarInt(); }
+
+};   // BitStreamReader
+
+#endif // HEADER_BIT_STREAM_HPP
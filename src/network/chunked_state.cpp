@@ -0,0 +1,175 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/chunked_state.hpp"
+
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+/** Creates the sender of a state, which compresses the whole state. */
+ChunkedState::ChunkedState(const BareNetworkString& state)
+{
+    m_stream = NULL;
+    m_next_chunk = 0;
+    m_size = state.getTotalSize();
+    uLongf compressed_size = compressBound(m_size);
+    m_data.resize(compressed_size);
+    if (compress2(m_data.data(), &compressed_size,
+        (const Bytef*)state.getData(), m_size, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        // Can only happen if out of memory
+        Log::error("ChunkedState", "Failed to compress %d bytes.", m_size);
+        compressed_size = 0;
+    }
+    m_data.resize(compressed_size);
+    m_chunk_count = (unsigned)(m_data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}   // ChunkedState
+
+// ----------------------------------------------------------------------------
+/** Creates the receiver of a state.
+ *  \param size Size of the uncompressed state.
+ *  \param chunk_count Number of chunks that will be received.
+ */
+ChunkedState::ChunkedState(uint32_t size, unsigned chunk_count)
+{
+    m_size = size;
+    m_chunk_count = chunk_count;
+    m_next_chunk = 0;
+    m_data.resize(size);
+    m_stream = new z_stream();
+    m_stream->zalloc = Z_NULL;
+    m_stream->zfree = Z_NULL;
+    m_stream->opaque = Z_NULL;
+    m_stream->next_in = Z_NULL;
+    m_stream->avail_in = 0;
+    m_stream->next_out = m_data.data();
+    m_stream->avail_out = size;
+    if (inflateInit(m_stream) != Z_OK)
+    {
+        delete m_stream;
+        m_stream = NULL;
+    }
+}   // ChunkedState
+
+// ----------------------------------------------------------------------------
+ChunkedState::~ChunkedState()
+{
+    if (m_stream)
+    {
+        inflateEnd(m_stream);
+        delete m_stream;
+    }
+}   // ~ChunkedState
+
+// ----------------------------------------------------------------------------
+/** Sender: adds the index and the data of the next chunk to a message. */
+void ChunkedState::addNextChunk(BareNetworkString* ns)
+{
+    assert(!isComplete());
+    const size_t start = m_next_chunk * CHUNK_SIZE;
+    const size_t end = std::min(start + CHUNK_SIZE, m_data.size());
+    ns->addUInt16((uint16_t)m_next_chunk);
+    ns->getBuffer().insert(ns->getBuffer().end(), m_data.begin() + start,
+        m_data.begin() + end);
+    m_next_chunk++;
+}   // addNextChunk
+
+// ----------------------------------------------------------------------------
+/** Receiver: decompresses the chunk in the remaining part of a message.
+ *  \return False if the chunk is not the expected one or invalid.
+ */
+bool ChunkedState::readChunk(const BareNetworkString& ns)
+{
+    if (!m_stream || isComplete() || ns.getUInt16() != m_next_chunk)
+        return false;
+    m_stream->next_in = (Bytef*)ns.getCurrentData();
+    m_stream->avail_in = ns.size();
+    int ret = inflate(m_stream, Z_NO_FLUSH);
+    m_next_chunk++;
+    bool ok = ret == Z_OK || ret == Z_STREAM_END;
+    if (isComplete())
+        ok = ok && ret == Z_STREAM_END && m_stream->total_out == m_size;
+    if (!ok || isComplete())
+    {
+        inflateEnd(m_stream);
+        delete m_stream;
+        m_stream = NULL;
+        if (!ok)
+            Log::warn("ChunkedState", "Invalid chunk %d.", m_next_chunk - 1);
+    }
+    return ok;
+}   // readChunk
+
+// ----------------------------------------------------------------------------
+/** Receiver: returns the complete state, the caller must delete it. */
+BareNetworkString* ChunkedState::getState() const
+{
+    assert(isComplete());
+    return new BareNetworkString((const char*)m_data.data(), (int)m_size);
+}   // getState
+
+// ----------------------------------------------------------------------------
+/** Tests that a state is the same after sending and receiving it. */
+void ChunkedState::unitTesting()
+{
+    // Random values below 16, which can be compressed to about half
+    BareNetworkString state;
+    uint32_t random = 1;
+    for (unsigned i = 0; i < 20000; i++)
+    {
+        random = random * 1103515245 + 12345;
+        state.addUInt8((uint8_t)(random >> 28));
+    }
+    ChunkedState sender(state);
+    assert(sender.getChunkCount() > 1);
+    assert(sender.getCompressedSize() < state.getTotalSize());
+
+    ChunkedState receiver(sender.getSize(), sender.getChunkCount());
+    while (!sender.isComplete())
+    {
+        BareNetworkString chunk;
+        sender.addNextChunk(&chunk);
+        assert(chunk.getTotalSize() <= CHUNK_SIZE + 2);
+        bool ok = receiver.readChunk(chunk);
+        assert(ok);
+        (void)ok;
+    }
+    assert(receiver.isComplete());
+    BareNetworkString* result = receiver.getState();
+    assert(result->getTotalSize() == state.getTotalSize());
+    assert(memcmp(result->getData(), state.getData(), 20000) == 0);
+    delete result;
+
+    // Chunks must arrive in order
+    ChunkedState sender2(state);
+    ChunkedState receiver2(sender2.getSize(), sender2.getChunkCount());
+    BareNetworkString chunk;
+    sender2.addNextChunk(&chunk);
+    sender2.addNextChunk(&chunk);
+    chunk.skip(2 + CHUNK_SIZE);
+    bool ok = receiver2.readChunk(chunk);
+    assert(!ok);
+    (void)ok;
+}   // unitTesting
@@ -0,0 +1,85 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_CHUNKED_STATE_HPP
+#define HEADER_CHUNKED_STATE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BareNetworkString;
+struct z_stream_s;
+
+/** \class ChunkedState
+ *  \brief Transfers a large state (e.g. the complete world state for a live
+ *  joining client) compressed with zlib in small chunks, so that it can be
+ *  sent over some time without large fragmented packets. The sender
+ *  compresses the whole state at once, the receiver decompresses each chunk
+ *  as soon as it arrives.
+ *  \ingroup network
+ */
+class ChunkedState : public NoCopy
+{
+public:
+    /** Size of the compressed data in one chunk, small enough that a chunk
+     *  message fits into one packet. */
+    static const unsigned CHUNK_SIZE = 1024;
+
+private:
+    /** Sender: the compressed state. Receiver: the decompressed state. */
+    std::vector<uint8_t> m_data;
+
+    /** Size of the uncompressed state. */
+    uint32_t m_size;
+
+    unsigned m_chunk_count;
+
+    /** Index of the next chunk to send or receive. */
+    unsigned m_next_chunk;
+
+    /** Receiver: the zlib stream, NULL for the sender or after an error. */
+    z_stream_s* m_stream;
+
+public:
+    ChunkedState(const BareNetworkString& state);
+    ChunkedState(uint32_t size, unsigned chunk_count);
+    ~ChunkedState();
+    void addNextChunk(BareNetworkString* ns);
+    bool readChunk(const BareNetworkString& ns);
+    BareNetworkString* getState() const;
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    /** Returns true if all chunks are sent or received. */
+    bool isComplete() const         { return m_next_chunk == m_chunk_count; }
+    // ------------------------------------------------------------------------
+    unsigned getChunkCount() const                 { return m_chunk_count; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of chunks sent or received so far. */
+    unsigned getNextChunk() const                   { return m_next_chunk; }
+    // ------------------------------------------------------------------------
+    uint32_t getSize() const                               { return m_size; }
+    // ------------------------------------------------------------------------
+    /** Returns the compressed size (only for the sender). */
+    size_t getCompressedSize() const                { return m_data.size(); }
+
+};   // ChunkedState
+
+#endif
@@ -25,10 +25,15 @@
 #include "LinearMath/btMotionState.h"
 #include "btBulletDynamicsCommon.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace CompressNetworkBody
 {
     using namespace MiniGLM;
     // ------------------------------------------------------------------------
+    /** Adds the compressed transform and velocities to bns. If body and ms
+     *  are not NULL they are set to the (lossy) compressed values. */
     inline void compress(btTransform t, const Vec3& lv, const Vec3& av,
                          BareNetworkString* bns, btRigidBody* body,
                          btMotionState* ms)
@@ -49,6 +54,8 @@ namespace CompressNetworkBody
             toFloat32(lvs[2]));
         Vec3 uncompressed_av(toFloat32(avs[0]), toFloat32(avs[1]),
             toFloat32(avs[2]));
+        if (!body || !ms)
+            return;
         body->setWorldTransform(t);
         ms->setWorldTransform(t);
         body->setInterpolationWorldTransform(t);
@@ -73,6 +80,35 @@ namespace CompressNetworkBody
         vec[2] = bns->getUInt16();
         *av = Vec3(toFloat32(vec[0]), toFloat32(vec[1]), toFloat32(vec[2]));
     }   // decompress
+    // ------------------------------------------------------------------------
+    /** Size of a compressed transform and velocities: origin, compressed
+     *  quaternion and 6 float16 velocities. */
+    const int COMPRESSED_SIZE = 3 * sizeof(float) + 4 + 6 * 2;
+    // ------------------------------------------------------------------------
+    /** Reads a compressed body from a predicted and a received state, and
+     *  returns true if they differ by errors small enough not to be smoothed
+     *  at all. Both strings must contain at least COMPRESSED_SIZE bytes.
+     *  \param max_distance Largest difference of the positions.
+     */
+    inline bool isClose(const BareNetworkString* prediction,
+                        const BareNetworkString* bns, float max_distance)
+    {
+        btTransform trans, predicted_trans;
+        Vec3 lv, av, predicted_lv, predicted_av;
+        decompress(bns, &trans, &lv, &av);
+        decompress(prediction, &predicted_trans, &predicted_lv,
+            &predicted_av);
+        // Float16 keeps 10 bits of the mantissa
+        const float velocity_error =
+            std::max(0.05f, 0.002f * predicted_lv.length());
+        return (trans.getOrigin() - predicted_trans.getOrigin()).length() <
+            max_distance &&
+            // The rotations differ by less than about 0.01 radians
+            fabsf(trans.getRotation().dot(predicted_trans.getRotation())) >=
+            0.99998f &&
+            (lv - predicted_lv).length() < velocity_error &&
+            (av - predicted_av).length() < 0.05f;
+    }   // isClose
 };
 
 #endif // HEADER_COMPRESS_NETWORK_BODY_HPP
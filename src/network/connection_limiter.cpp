@@ -0,0 +1,195 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/connection_limiter.hpp"
+
+#include "utils/string_utils.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+// ----------------------------------------------------------------------------
+/** Creates a limiter.
+ *  \param rate Connections per second allowed from one IP address. Five
+ *         times as many are allowed at once, and a /24 subnet is allowed
+ *         four times as many as one address.
+ */
+ConnectionLimiter::ConnectionLimiter(float rate)
+{
+    m_rate = rate;
+    m_burst = std::max(1.0f, rate * 5.0f);
+    m_next_cleanup = 0;
+    m_allowed.store(0);
+    m_rejected_ip.store(0);
+    m_rejected_subnet.store(0);
+}   // ConnectionLimiter
+
+// ----------------------------------------------------------------------------
+/** Returns the refilled bucket of an IP address or subnet, a new bucket is
+ *  full. Returns NULL if there is no space for a new bucket.
+ */
+ConnectionLimiter::Bucket*
+    ConnectionLimiter::getBucket(std::unordered_map<uint32_t, Bucket>* buckets,
+                                 uint32_t key, float rate, float burst,
+                                 uint64_t now)
+{
+    auto it = buckets->find(key);
+    if (it == buckets->end())
+    {
+        if (buckets->size() >= MAX_BUCKETS)
+            cleanup(buckets, rate, burst, now);
+        if (buckets->size() >= MAX_BUCKETS)
+            return NULL;
+        Bucket& b = (*buckets)[key];
+        b.m_tokens = burst;
+        b.m_time = now;
+        return &b;
+    }
+    Bucket& b = it->second;
+    if (now > b.m_time)
+    {
+        b.m_tokens = std::min(burst,
+            b.m_tokens + float(now - b.m_time) * rate / 1000.0f);
+        b.m_time = now;
+    }
+    return &b;
+}   // getBucket
+
+// ----------------------------------------------------------------------------
+/** Removes all buckets which would be full by now, they behave the same as
+ *  a new bucket.
+ */
+void ConnectionLimiter::cleanup(std::unordered_map<uint32_t, Bucket>* buckets,
+                                float rate, float burst, uint64_t now)
+{
+    for (auto it = buckets->begin(); it != buckets->end();)
+    {
+        const Bucket& b = it->second;
+        if (now >= b.m_time &&
+            b.m_tokens + float(now - b.m_time) * rate / 1000.0f >= burst)
+            it = buckets->erase(it);
+        else
+            it++;
+    }
+}   // cleanup
+
+// ----------------------------------------------------------------------------
+/** Returns if a new connection or connection request from an IP address is
+ *  allowed, and takes a token from the buckets of the address and of its
+ *  subnet if so.
+ *  \param ip The IP address (as returned by TransportAddress::getIP()).
+ *  \param now Current time in ms.
+ */
+bool ConnectionLimiter::allow(uint32_t ip, uint64_t now)
+{
+    // Localhost, used by the server owner and in load tests
+    if ((ip >> 24) == 0x7f)
+    {
+        m_allowed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (now >= m_next_cleanup)
+    {
+        cleanup(&m_ip_buckets, m_rate, m_burst, now);
+        cleanup(&m_subnet_buckets, m_rate * 4.0f, m_burst * 4.0f, now);
+        m_next_cleanup = now + 10000;
+    }
+
+    Bucket* ip_bucket = getBucket(&m_ip_buckets, ip, m_rate, m_burst, now);
+    if (!ip_bucket || ip_bucket->m_tokens < 1.0f)
+    {
+        m_rejected_ip.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Bucket* subnet_bucket = getBucket(&m_subnet_buckets, ip >> 8,
+        m_rate * 4.0f, m_burst * 4.0f, now);
+    if (!subnet_bucket || subnet_bucket->m_tokens < 1.0f)
+    {
+        m_rejected_subnet.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ip_bucket->m_tokens -= 1.0f;
+    subnet_bucket->m_tokens -= 1.0f;
+    m_allowed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}   // allow
+
+// ----------------------------------------------------------------------------
+/** Returns the counters as a human readable string for the network
+ *  console. */
+std::string ConnectionLimiter::getStatistics() const
+{
+    return StringUtils::insertValues("Connections allowed: %d, rejected "
+        "(per IP): %d, rejected (per subnet): %d", m_allowed.load(),
+        m_rejected_ip.load(), m_rejected_subnet.load());
+}   // getStatistics
+
+// ----------------------------------------------------------------------------
+void ConnectionLimiter::unitTesting()
+{
+    ConnectionLimiter cl(2.0f);
+    // A burst of 10 connections, then 2 per second
+    unsigned allowed = 0;
+    for (int i = 0; i < 10; i++)
+        allowed += cl.allow(0x01020304, 1000) ? 1 : 0;
+    assert(allowed == 10);
+    bool ok = cl.allow(0x01020304, 1000);
+    assert(!ok);
+    ok = cl.allow(0x01020304, 1400);
+    assert(!ok);
+    ok = cl.allow(0x01020304, 1500);
+    assert(ok);
+    ok = cl.allow(0x01020304, 1500);
+    assert(!ok);
+    // Other addresses are not affected
+    ok = cl.allow(0x01020404, 1500);
+    assert(ok);
+    assert(cl.getAllowed() == 12);
+    assert(cl.getRejected() == 3);
+
+    // A /24 subnet can connect 40 times at once
+    allowed = 0;
+    for (uint32_t ip = 0x05060700; ip < 0x05060704; ip++)
+    {
+        for (int i = 0; i < 10; i++)
+            allowed += cl.allow(ip, 2000) ? 1 : 0;
+    }
+    assert(allowed == 40);
+    ok = cl.allow(0x05060710, 2000);
+    assert(!ok);
+    ok = cl.allow(0x05060810, 2000);
+    assert(ok);
+
+    // Localhost is never limited
+    allowed = 0;
+    for (int i = 0; i < 100; i++)
+        allowed += cl.allow(0x7f000001, 2000) ? 1 : 0;
+    assert(allowed == 100);
+
+    // Full buckets are removed, and behave like new ones
+    cl.allow(0x01020304, 60000);
+    assert(cl.m_ip_buckets.size() == 1);
+    assert(cl.m_subnet_buckets.size() == 1);
+    allowed = 0;
+    for (int i = 1; i < 10; i++)
+        allowed += cl.allow(0x01020304, 60000) ? 1 : 0;
+    assert(allowed == 9);
+    ok = cl.allow(0x01020304, 60000);
+    assert(!ok);
+    (void)ok;
+}   // unitTesting
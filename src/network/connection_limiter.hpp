@@ -0,0 +1,90 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_CONNECTION_LIMITER_HPP
+#define HEADER_CONNECTION_LIMITER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/** \class ConnectionLimiter
+ *  \brief A cheap filter for new connections and connection requests of a
+ *  server, applied in the listening thread before any peer is created or
+ *  any message is decrypted. Each IP address and each /24 subnet has a
+ *  token bucket: a connection takes one token, and tokens are refilled
+ *  with a fixed rate up to a maximum (the burst). So a client can connect
+ *  a few times at once, but a flood of connections from one address or
+ *  one subnet is dropped early. Connections from localhost are not
+ *  limited.
+ *  allow() must always be called from the same thread, the counters can be
+ *  read from any thread.
+ *  \ingroup network
+ */
+class ConnectionLimiter : public NoCopy
+{
+private:
+    struct Bucket
+    {
+        float    m_tokens;
+        /** Time in ms the tokens were last refilled. */
+        uint64_t m_time;
+    };
+
+    /** Maximum number of buckets of each kind. If a flood from many
+     *  addresses fills the table, connections from new addresses are
+     *  rejected until old buckets are full again and removed. */
+    static const unsigned MAX_BUCKETS = 16384;
+
+    /** Buckets of IP addresses and of /24 subnets (IP address >> 8). */
+    std::unordered_map<uint32_t, Bucket> m_ip_buckets;
+    std::unordered_map<uint32_t, Bucket> m_subnet_buckets;
+
+    /** Tokens refilled per second and maximum tokens of an IP address. */
+    float m_rate;
+    float m_burst;
+
+    /** Time in ms when full buckets are removed next. */
+    uint64_t m_next_cleanup;
+
+    std::atomic<uint32_t> m_allowed;
+    std::atomic<uint32_t> m_rejected_ip;
+    std::atomic<uint32_t> m_rejected_subnet;
+
+    Bucket* getBucket(std::unordered_map<uint32_t, Bucket>* buckets,
+                      uint32_t key, float rate, float burst, uint64_t now);
+    void cleanup(std::unordered_map<uint32_t, Bucket>* buckets, float rate,
+                 float burst, uint64_t now);
+
+public:
+    static void unitTesting();
+    ConnectionLimiter(float rate);
+    bool allow(uint32_t ip, uint64_t now);
+    std::string getStatistics() const;
+    // ------------------------------------------------------------------------
+    uint32_t getAllowed() const                { return m_allowed.load(); }
+    // ------------------------------------------------------------------------
+    uint32_t getRejected() const
+                     { return m_rejected_ip.load() + m_rejected_subnet.load(); }
+
+};   // ConnectionLimiter
+
+#endif
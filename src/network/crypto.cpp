@@ -0,0 +1,129 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/crypto.hpp"
+
+#if defined(ENABLE_CRYPTO_OPENSSL) || defined(ENABLE_CRYPTO_NETTLE)
+
+#include "network/network_config.hpp"
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+
+#include <chrono>
+
+// ============================================================================
+/** Encrypts the same message for several peers, used for broadcasts. Each
+ *  peer has its own key, so each still needs its own ciphertext, but the
+ *  key schedule of each peer stays expanded in its crypto (only the nonce
+ *  is set per packet), and all ciphertexts are written to one output
+ *  buffer which the caller keeps between broadcasts, so it is only
+ *  allocated when a message is larger than before. The packets then get
+ *  their own copy, so the buffer can be reused at once and is not kept
+ *  alive by peers which acknowledge late. This copy makes it slower than
+ *  encryptSend for each peer (see benchmark()), so STKHost does not use it.
+ *  \param ns The message.
+ *  \param reliable If the packets should be sent reliable.
+ *  \param cryptos The crypto of each receiving peer.
+ *  \param buffer The reusable output buffer.
+ *  \param packets Receives one packet per crypto, in the same order, NULL
+ *         if encryption failed.
+ */
+void Crypto::encryptSendBatch(const BareNetworkString& ns, bool reliable,
+                              const std::vector<Crypto*>& cryptos,
+                              std::vector<uint8_t>* buffer,
+                              std::vector<ENetPacket*>* packets)
+{
+    packets->assign(cryptos.size(), NULL);
+    if (cryptos.empty())
+        return;
+
+    // 4 bytes counter and 4 bytes tag
+    const size_t size = ns.m_buffer.size() + 8;
+    // Each ciphertext starts 16 bytes aligned, unaligned output makes the
+    // encryption noticeably slower
+    const size_t stride = (size + 15) & ~(size_t)15;
+    if (buffer->size() < stride * cryptos.size())
+        buffer->resize(stride * cryptos.size());
+
+    const bool client = NetworkConfig::get()->isClient();
+    const uint32_t flags = reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    for (unsigned i = 0; i < cryptos.size(); i++)
+    {
+        uint8_t* out = buffer->data() + i * stride;
+        if (!cryptos[i]->encryptInto(ns, client, out))
+            continue;
+        (*packets)[i] = enet_packet_create(out, size, flags);
+    }
+}   // encryptSendBatch
+
+// ----------------------------------------------------------------------------
+/** Measures encrypting a state sized message for a number of peers with
+ *  encryptSend for each peer and with encryptSendBatch, and logs the
+ *  results (--benchmark-crypto).
+ *  \param peers Number of peers.
+ */
+void Crypto::benchmark(unsigned peers)
+{
+    const unsigned ITERATIONS = 10000;
+    const unsigned SIZE = 1024;
+
+    std::mt19937 g(1);
+    std::vector<std::unique_ptr<Crypto> > cryptos;
+    std::vector<Crypto*> cryptos_ptr;
+    for (unsigned i = 0; i < peers; i++)
+    {
+        std::vector<uint8_t> key(16), iv(12);
+        for (uint8_t& k : key)
+            k = (uint8_t)g();
+        for (uint8_t& v : iv)
+            v = (uint8_t)g();
+        cryptos.emplace_back(new Crypto(key, iv));
+        cryptos_ptr.push_back(cryptos.back().get());
+    }
+    BareNetworkString ns(SIZE);
+    for (unsigned i = 0; i < SIZE; i++)
+        ns.addUInt8((uint8_t)g());
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < ITERATIONS; i++)
+    {
+        for (Crypto* c : cryptos_ptr)
+            enet_packet_destroy(c->encryptSend(ns, false/*reliable*/));
+    }
+    auto single = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> buffer;
+    std::vector<ENetPacket*> packets;
+    start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < ITERATIONS; i++)
+    {
+        encryptSendBatch(ns, false/*reliable*/, cryptos_ptr, &buffer,
+                         &packets);
+        for (ENetPacket* p : packets)
+            enet_packet_destroy(p);
+    }
+    auto batch = std::chrono::steady_clock::now() - start;
+
+    typedef std::chrono::duration<double, std::micro> us;
+    Log::info("Crypto", "%u bytes to %u peers: %.2f us per broadcast with "
+        "encryptSend, %.2f us with encryptSendBatch.", SIZE, peers,
+        us(single).count() / ITERATIONS, us(batch).count() / ITERATIONS);
+}   // benchmark
+
+#endif
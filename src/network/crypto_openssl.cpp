@@ -129,54 +129,60 @@ bool Crypto::decryptConnectionRequest(BareNetworkString& ns)
 }   // decryptConnectionRequest
 
 // ----------------------------------------------------------------------------
-ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
+/** Encrypts a message with the next packet counter of this crypto.
+ *  \param client If this is a client, clients and server use different
+ *         parts of the nonce.
+ *  \param out Output with space for the message and 8 bytes (4 bytes
+ *         counter and 4 bytes tag).
+ */
+bool Crypto::encryptInto(const BareNetworkString& ns, bool client,
+                         uint8_t* out)
 {
-    // 4 bytes counter and 4 bytes tag
-    ENetPacket* p = enet_packet_create(NULL, ns.m_buffer.size() + 8,
-        (reliable ? ENET_PACKET_FLAG_RELIABLE :
-        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT))
-        );
-    if (p == NULL)
-        return NULL;
-
     std::array<uint8_t, 12> iv = {};
     std::unique_lock<std::mutex> ul(m_crypto_mutex);
 
     uint32_t val = ++m_packet_counter;
-    if (NetworkConfig::get()->isClient())
+    if (client)
         memcpy(iv.data(), &val, 4);
     else
         memcpy(iv.data() + 4, &val, 4);
 
-    uint8_t* packet_start = p->data + 8;
+    uint8_t* packet_start = out + 8;
 
     if (EVP_EncryptInit_ex(m_encrypt, NULL, NULL, NULL, iv.data()) != 1)
-    {
-        enet_packet_destroy(p);
-        return NULL;
-    }
+        return false;
 
     int elen;
     if (EVP_EncryptUpdate(m_encrypt, packet_start, &elen, ns.m_buffer.data(),
         (int)ns.m_buffer.size()) != 1)
-    {
-        enet_packet_destroy(p);
-        return NULL;
-    }
+        return false;
     if (EVP_EncryptFinal_ex(m_encrypt, unused_16_blocks.data(), &elen) != 1)
-    {
-        enet_packet_destroy(p);
-        return NULL;
-    }
-    if (EVP_CIPHER_CTX_ctrl(m_encrypt, EVP_CTRL_GCM_GET_TAG, 4, p->data + 4)
+        return false;
+    if (EVP_CIPHER_CTX_ctrl(m_encrypt, EVP_CTRL_GCM_GET_TAG, 4, out + 4)
         != 1)
+        return false;
+    ul.unlock();
+
+    memcpy(out, &val, 4);
+    return true;
+}   // encryptInto
+
+// ----------------------------------------------------------------------------
+ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
+{
+    // 4 bytes counter and 4 bytes tag
+    ENetPacket* p = enet_packet_create(NULL, ns.m_buffer.size() + 8,
+        (reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT))
+        );
+    if (p == NULL)
+        return NULL;
+
+    if (!encryptInto(ns, NetworkConfig::get()->isClient(), p->data))
     {
         enet_packet_destroy(p);
         return NULL;
     }
-    ul.unlock();
-
-    memcpy(p->data, &val, 4);
     return p;
 }   // encryptSend
 
@@ -75,6 +75,9 @@ private:
         }
         return (len * 3) / 4 - padding;
     }   // calcDecodeLength
+    // ------------------------------------------------------------------------
+    bool encryptInto(const BareNetworkString& ns, bool client, uint8_t* out);
+
 public:
     // ------------------------------------------------------------------------
     static std::string base64(const std::vector<uint8_t>& input);
@@ -152,6 +155,13 @@ public:
     ENetPacket* encryptSend(BareNetworkString& ns, bool reliable);
     // ------------------------------------------------------------------------
     NetworkString* decryptRecieve(ENetPacket* p);
+    // ------------------------------------------------------------------------
+    static void encryptSendBatch(const BareNetworkString& ns, bool reliable,
+                                 const std::vector<Crypto*>& cryptos,
+                                 std::vector<uint8_t>* buffer,
+                                 std::vector<ENetPacket*>* packets);
+    // ------------------------------------------------------------------------
+    static void benchmark(unsigned peers);
 
 };
 
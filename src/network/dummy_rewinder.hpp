@@ -28,6 +28,11 @@
 class DummyRewinder : public Rewinder, public EventRewinder
 {
 public:
+    /** Number of calls to restoreLocalState(), used in unit testing. */
+    int m_local_state_restored;
+    // -------------------------------------------------------------------------
+    DummyRewinder(const std::string& ui = "")
+        : Rewinder(ui)                         { m_local_state_restored = 0; }
     // -------------------------------------------------------------------------
     BareNetworkString* saveState(std::vector<std::string>* ru)  { return NULL; }
     // -------------------------------------------------------------------------
@@ -40,6 +45,8 @@ public:
     // -------------------------------------------------------------------------
     virtual void undoState(BareNetworkString *s)                              {}
     // -------------------------------------------------------------------------
+    virtual void restoreLocalState()              { m_local_state_restored++; }
+    // -------------------------------------------------------------------------
     virtual void undo(BareNetworkString *s)                                   {}
     // -------------------------------------------------------------------------
     virtual void rewind(BareNetworkString *s)                                 {}
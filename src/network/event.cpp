@@ -24,6 +24,7 @@
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <assert.h>
 #include <string.h>
 
 /** \brief Constructor
@@ -41,7 +42,21 @@ constexpr bool isConnectionRequestPacket(unsigned char* data, size_t length)
 // ============================================================================
 Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
 {
+    m_data = NULL;
+    set(event, peer);
+}   // Event(ENetEvent)
+
+// ----------------------------------------------------------------------------
+/** Sets this event from an enet event. This is used by the constructor and
+ *  to reuse an event which was cleared after it was handled.
+ *  \param event : The event that needs to be translated.
+ *  \param peer : The peer that triggered the event.
+ */
+void Event::set(ENetEvent* event, std::shared_ptr<STKPeer> peer)
+{
+    assert(m_data == NULL);
     m_arrival_time = (double)StkTime::getTimeSinceEpoch();
+    m_arrival_time_ms = StkTime::getRealTimeMs();
     m_pdi = PDI_TIMEOUT;
     m_peer = peer;
 
@@ -75,7 +90,9 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
         {
             throw std::runtime_error("Unencrypted content at wrong state.");
         }
-        if (m_peer->getCrypto() && event->channelID == EVENT_CHANNEL_NORMAL)
+        // Replayed messages were recorded after decryption
+        if (m_peer->getCrypto() && !m_peer->isReplayed() &&
+            event->channelID == EVENT_CHANNEL_NORMAL)
         {
             m_data = m_peer->getCrypto()->decryptRecieve(event->packet);
         }
@@ -94,7 +111,7 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
         enet_packet_destroy(event->packet);
     }
 
-}   // Event(ENetEvent)
+}   // set
 
 // ----------------------------------------------------------------------------
 /** \brief Destructor that frees the memory of the package.
@@ -104,3 +121,14 @@ Event::~Event()
     delete m_data;
 }   // ~Event
 
+// ----------------------------------------------------------------------------
+/** Frees the message data and the reference to the peer, so that this event
+ *  can be kept for reuse without keeping the peer alive.
+ */
+void Event::clear()
+{
+    delete m_data;
+    m_data = NULL;
+    m_peer.reset();
+}   // clear
+
@@ -85,12 +85,18 @@ private:
     /** Arrivial time of the event, for timeouts. */
     double m_arrival_time;
 
+    /** Arrival time in milliseconds, to measure the time the event waited
+     *  in the queues of the ProtocolManager. */
+    uint64_t m_arrival_time_ms;
+
     /** For disconnection event, a bit more info is provided. */
     PeerDisconnectInfo m_pdi;
 
 public:
          Event(ENetEvent* event, std::shared_ptr<STKPeer> peer);
         ~Event();
+    void set(ENetEvent* event, std::shared_ptr<STKPeer> peer);
+    void clear();
 
     // ------------------------------------------------------------------------
     /** Returns the type of this event. */
@@ -120,6 +126,9 @@ public:
     /** Returns the arrival time of this event. */
     double getArrivalTime() const { return m_arrival_time; }
     // ------------------------------------------------------------------------
+    /** Returns the arrival time of this event in milliseconds. */
+    uint64_t getArrivalTimeMs() const { return m_arrival_time_ms; }
+    // ------------------------------------------------------------------------
     PeerDisconnectInfo getPeerDisconnectInfo() const { return m_pdi; }
     // ------------------------------------------------------------------------
 
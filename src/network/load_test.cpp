@@ -0,0 +1,393 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/load_test.hpp"
+
+#include "config/stk_config.hpp"
+#include "input/input.hpp"
+#include "network/bit_stream.hpp"
+#include "network/event.hpp"
+#include "network/network.hpp"
+#include "network/network_string.hpp"
+#include "network/remote_kart_info.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "network/network_player_profile.hpp"
+#include "network/peer_vote.hpp"
+#include "network/rewind_manager.hpp"
+#include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/tick_profiler.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+LoadTest* LoadTest::m_load_test = NULL;
+
+// ----------------------------------------------------------------------------
+/** Starts a load test with the given number of clients, which connect to
+ *  the server of this process. Must be called after the server is created.
+ */
+void LoadTest::create(unsigned num_clients)
+{
+    if (m_load_test || num_clients == 0)
+        return;
+    if (num_clients > (unsigned)ServerConfig::m_server_max_players)
+    {
+        Log::warn("LoadTest", "Only %d of the %d clients can join, increase "
+            "server-max-players.", (int)ServerConfig::m_server_max_players,
+            num_clients);
+    }
+    m_load_test = new LoadTest(num_clients);
+}   // create
+
+// ----------------------------------------------------------------------------
+/** Stops the load test and logs the final statistics. */
+void LoadTest::destroy()
+{
+    delete m_load_test;
+    m_load_test = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+LoadTest::LoadTest(unsigned num_clients)
+        : m_server_address(127, 0, 0, 1, STKHost::get()->getPrivatePort())
+{
+    m_clients.resize(num_clients);
+    for (unsigned i = 0; i < num_clients; i++)
+    {
+        Client& c = m_clients[i];
+        c.m_network = NULL;
+        c.m_index = i;
+        c.m_bytes_received = 0;
+        c.m_full_states = 0;
+        c.m_delta_states = 0;
+        c.m_actions_sent = 0;
+        connect(&c);
+    }
+    m_last_report_time = StkTime::getRealTimeMs();
+    m_last_report_bytes = 0;
+    m_last_report_states = 0;
+    m_last_report_rewinds = RewindManager::getRewindCount();
+    m_exit.store(false);
+    m_thread = std::thread(std::bind(&LoadTest::mainLoop, this));
+    Log::info("LoadTest", "Started %d clients.", num_clients);
+}   // LoadTest
+
+// ----------------------------------------------------------------------------
+LoadTest::~LoadTest()
+{
+    m_exit.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+    report(/*final_report*/true);
+    for (Client& c : m_clients)
+    {
+        if (!c.m_network)
+            continue;
+        enet_peer_disconnect_now(c.m_peer, PDI_NORMAL);
+        delete c.m_network;
+    }
+}   // ~LoadTest
+
+// ----------------------------------------------------------------------------
+/** Creates the enet host of a client and starts connecting to the server.
+ */
+void LoadTest::connect(Client* c)
+{
+    ENetAddress addr;
+    addr.host = ENET_HOST_ANY;
+    addr.port = 0;
+    c->m_network = new Network(/*peer_count*/1, EVENT_CHANNEL_COUNT,
+        /*max_in_bandwidth*/0, /*max_out_bandwidth*/0, &addr);
+    c->m_peer = c->m_network->getENetHost() ?
+        c->m_network->connectTo(m_server_address) : NULL;
+    if (!c->m_peer)
+    {
+        Log::warn("LoadTest", "Client %d can't connect.", c->m_index);
+        delete c->m_network;
+        c->m_network = NULL;
+        c->m_state = LTC_RECONNECTING;
+        c->m_next_time = StkTime::getRealTimeMs() + 5000;
+        return;
+    }
+    c->m_state = LTC_CONNECTING;
+    c->m_host_id = std::numeric_limits<uint32_t>::max();
+    c->m_kart_id = -1;
+    c->m_state_ticks = -1;
+}   // connect
+
+// ----------------------------------------------------------------------------
+/** Services the enet hosts of all clients and sends their actions. */
+void LoadTest::mainLoop()
+{
+    VS::setThreadName("LoadTest");
+    while (!m_exit.load())
+    {
+        uint64_t now = StkTime::getRealTimeMs();
+        for (Client& c : m_clients)
+        {
+            if (c.m_state == LTC_RECONNECTING)
+            {
+                if (now >= c.m_next_time)
+                    connect(&c);
+                continue;
+            }
+            ENetEvent event;
+            while (c.m_network &&
+                   enet_host_service(c.m_network->getENetHost(), &event, 0) > 0)
+            {
+                if (event.type == ENET_EVENT_TYPE_CONNECT)
+                {
+                    // See ClientLobby::update, a single player without
+                    // online account (id 0) and so without encryption
+                    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+                    ClientLobby::encodeConnectionRequest(&ns, 1);
+                    ns.addUInt32(0).addUInt32(0)
+                        .encodeString(ServerConfig::m_private_server_password)
+                        .addUInt8(1);
+                    ClientLobby::encodeConnectingPlayer(&ns,
+                        StringUtils::utf8ToWide(StringUtils::insertValues(
+                        "load-test-%d", c.m_index)), 0.0f,
+                        PLAYER_DIFFICULTY_NORMAL);
+                    send(&c, &ns, /*reliable*/true);
+                    c.m_state = LTC_LOBBY;
+                }
+                else if (event.type == ENET_EVENT_TYPE_RECEIVE)
+                {
+                    c.m_bytes_received += event.packet->dataLength;
+                    // Ignore the pings on the unencrypted channel
+                    if (event.channelID == EVENT_CHANNEL_NORMAL &&
+                        event.packet->dataLength >= 2)
+                    {
+                        NetworkString data(event.packet->data,
+                            (int)event.packet->dataLength);
+                        try
+                        {
+                            handlePacket(&c, data);
+                        }
+                        catch (std::exception& e)
+                        {
+                            Log::warn("LoadTest", "Client %d: %s", c.m_index,
+                                e.what());
+                        }
+                    }
+                    enet_packet_destroy(event.packet);
+                }
+                else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+                {
+                    Log::info("LoadTest", "Client %d was disconnected (%d).",
+                        c.m_index, (int)event.data);
+                    delete c.m_network;
+                    c.m_network = NULL;
+                    c.m_state = LTC_RECONNECTING;
+                    c.m_next_time = now + 5000;
+                }
+            }
+            if (c.m_state == LTC_RACING && now >= c.m_next_time)
+                sendAction(&c, now);
+        }
+        if (now >= m_last_report_time + 10000)
+            report(/*final_report*/false);
+        StkTime::sleep(1);
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Handles a message from the server. Only the messages needed to take part
+ *  in a race are handled, everything else is ignored. */
+void LoadTest::handlePacket(Client* c, NetworkString& data)
+{
+    const uint8_t type = data.getUInt8();
+    if (data.getProtocolType() == PROTOCOL_CONTROLLER_EVENTS)
+    {
+        if (type != GameProtocol::GP_STATE &&
+            type != GameProtocol::GP_DELTA_STATE)
+            return;
+        // Acknowledge the state like GameProtocol::addStateToRewindManager,
+        // so the server keeps sending delta states
+        c->m_state_ticks = data.getUInt32();
+        c->m_state_time = StkTime::getRealTimeMs();
+        if (type == GameProtocol::GP_STATE)
+            c->m_full_states++;
+        else
+            c->m_delta_states++;
+        NetworkString ack(PROTOCOL_CONTROLLER_EVENTS, 5);
+        ack.addUInt8(GameProtocol::GP_STATE_ACK).addUInt32(c->m_state_ticks);
+        send(c, &ack, /*reliable*/false);
+        return;
+    }
+    if (data.getProtocolType() != PROTOCOL_LOBBY_ROOM)
+        return;
+
+    switch (type)
+    {
+    case LobbyProtocol::LE_CONNECTION_ACCEPTED:
+        c->m_host_id = data.getUInt32();
+        break;
+    case LobbyProtocol::LE_CONNECTION_REFUSED:
+        Log::warn("LoadTest", "Client %d was refused.", c->m_index);
+        break;
+    case LobbyProtocol::LE_LOAD_WORLD:
+        handleLoadWorld(c, data);
+        break;
+    case LobbyProtocol::LE_START_RACE:
+        c->m_start_time = data.getUInt64();
+        c->m_state = LTC_RACING;
+        c->m_next_time = StkTime::getRealTimeMs();
+        c->m_steer = 0;
+        break;
+    case LobbyProtocol::LE_RACE_FINISHED:
+    {
+        c->m_state = LTC_LOBBY;
+        c->m_state_ticks = -1;
+        NetworkString ack(PROTOCOL_LOBBY_ROOM, 1);
+        ack.setSynchronous(true);
+        ack.addUInt8(LobbyProtocol::LE_RACE_FINISHED_ACK);
+        send(c, &ack, /*reliable*/true);
+        break;
+    }
+    default:
+        break;
+    }
+}   // handlePacket
+
+// ----------------------------------------------------------------------------
+/** Finds the kart of a client in the load world message (see
+ *  ServerLobby::getLoadWorldMessage), and tells the server at once that the
+ *  world is loaded. */
+void LoadTest::handleLoadWorld(Client* c, NetworkString& data)
+{
+    data.getUInt32();   // winner peer id
+    PeerVote winner_vote(data);
+    std::vector<std::shared_ptr<NetworkPlayerProfile> > players =
+        ClientLobby::decodePlayers(data, nullptr);
+    c->m_kart_id = -1;
+    for (unsigned i = 0; i < players.size(); i++)
+    {
+        if (players[i]->getHostId() == c->m_host_id)
+            c->m_kart_id = i;
+    }
+    NetworkString ns(PROTOCOL_LOBBY_ROOM, 1);
+    ns.addUInt8(LobbyProtocol::LE_CLIENT_LOADED_WORLD);
+    send(c, &ns, /*reliable*/true);
+}   // handleLoadWorld
+
+// ----------------------------------------------------------------------------
+/** Sends full acceleration and a random steering every 100 ms after the
+ *  race started, at the estimated world time of the server. */
+void LoadTest::sendAction(Client* c, uint64_t now)
+{
+    c->m_next_time = now + 100;
+    if (c->m_kart_id == -1 || c->m_state_ticks == -1 ||
+        STKHost::get()->getNetworkTimer() < c->m_start_time)
+        return;
+
+    int ticks = c->m_state_ticks +
+        stk_config->time2Ticks((now - c->m_state_time) / 1000.0f);
+    bool steer = m_random.get(5) == 0;
+    if (steer)
+        c->m_steer = (m_random.get(3) - 1) * Input::MAX_VALUE;
+
+    NetworkString ns(PROTOCOL_CONTROLLER_EVENTS, 16);
+    ns.addUInt8(GameProtocol::GP_CONTROLLER_ACTION).addUInt8(steer ? 2 : 1);
+    BitStreamWriter writer(&ns);
+    GameProtocol::addControllerAction(&writer, 0, ticks, c->m_kart_id,
+        PA_ACCEL, Input::MAX_VALUE, 0, 0);
+    if (steer)
+    {
+        const int left = std::max(c->m_steer, 0);
+        const int right = std::max(-c->m_steer, 0);
+        GameProtocol::addControllerAction(&writer, ticks, ticks,
+            c->m_kart_id, left > 0 ? PA_STEER_LEFT : PA_STEER_RIGHT,
+            std::max(left, right), left, right);
+    }
+    writer.flush();
+    send(c, &ns, /*reliable*/true);
+    c->m_actions_sent++;
+}   // sendAction
+
+// ----------------------------------------------------------------------------
+void LoadTest::send(Client* c, NetworkString* ns, bool reliable)
+{
+    ENetPacket* packet = enet_packet_create(ns->getData(),
+        ns->getTotalSize(), (reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+    if (enet_peer_send(c->m_peer, EVENT_CHANNEL_NORMAL, packet) < 0)
+        enet_packet_destroy(packet);
+}   // send
+
+// ----------------------------------------------------------------------------
+/** Logs the number of connected and racing clients, the download rate and
+ *  states per client, the upload rate and rewinds of the server and the
+ *  tick statistics of the server.
+ */
+void LoadTest::report(bool final_report)
+{
+    const uint64_t now = StkTime::getRealTimeMs();
+    const float seconds = std::max(now - m_last_report_time, (uint64_t)1) /
+        1000.0f;
+    unsigned connected = 0, racing = 0, deltas = 0;
+    uint64_t bytes = 0, max_bytes = 0;
+    unsigned states = 0;
+    for (const Client& c : m_clients)
+    {
+        if (c.m_state == LTC_LOBBY || c.m_state == LTC_RACING)
+            connected++;
+        if (c.m_state == LTC_RACING)
+            racing++;
+        bytes += c.m_bytes_received;
+        max_bytes = std::max(max_bytes, c.m_bytes_received);
+        states += c.m_full_states + c.m_delta_states;
+        deltas += c.m_delta_states;
+    }
+    const unsigned n = (unsigned)m_clients.size();
+    const uint32_t rewinds = RewindManager::getRewindCount();
+    if (final_report)
+    {
+        // Totals over the whole test
+        Log::info("LoadTest", "Total per client: %.1f KB received on "
+            "average, %.1f KB max, %.1f states (%d%% delta). Server "
+            "rewinds: %d.", bytes / 1024.0f / n, max_bytes / 1024.0f,
+            (float)states / n, states > 0 ? (int)(deltas * 100 / states) : 0,
+            (int)rewinds);
+    }
+    else
+    {
+        Log::info("LoadTest", "%d/%d connected, %d racing. Per client: "
+            "%.2f KBps down, %.1f states/s.", connected, n, racing,
+            (bytes - m_last_report_bytes) / 1024.0f / seconds / n,
+            (states - m_last_report_states) / seconds / n);
+        unsigned peers = std::max(STKHost::get()->getPeerCount(), 1u);
+        Log::info("LoadTest", "Server upload per peer: %.2f KBps, %.1f "
+            "rewinds/s.", STKHost::get()->getUploadSpeed() / 1024.0f / peers,
+            (rewinds - m_last_report_rewinds) / seconds);
+    }
+    Log::info("LoadTest", "%s", TickProfiler::getStatistics().c_str());
+    m_last_report_time = now;
+    m_last_report_bytes = bytes;
+    m_last_report_states = states;
+    m_last_report_rewinds = rewinds;
+}   // report
@@ -0,0 +1,119 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_LOAD_TEST_HPP
+#define HEADER_LOAD_TEST_HPP
+
+#include "network/transport_address.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/random_generator.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Network;
+class NetworkString;
+struct _ENetPeer;
+
+/** \class LoadTest
+ *  \brief Connects many lightweight clients to a server running in the same
+ *  process (--load-test=n), to find out how many players a server can
+ *  handle. The clients only speak the network protocol: they join the
+ *  lobby, report a loaded world at once, send random steering during a race
+ *  and acknowledge the states, but they do not load a track or simulate
+ *  anything. All clients are handled in one thread, each with its own enet
+ *  host. The server tick times and rewinds, the bandwidth per client and the
+ *  number of states received are logged every 10 seconds and at exit.
+ *  \ingroup network
+ */
+class LoadTest : public NoCopy
+{
+private:
+    enum ClientState
+    {
+        LTC_CONNECTING,
+        LTC_LOBBY,
+        LTC_RACING,
+        LTC_RECONNECTING
+    };
+
+    /** One synthetic client. */
+    struct Client
+    {
+        Network*     m_network;
+        _ENetPeer*   m_peer;
+        ClientState  m_state;
+        /** Used as player name. */
+        unsigned     m_index;
+        uint32_t     m_host_id;
+        int          m_kart_id;
+        /** Ticks of the latest state received and the real time (in ms)
+         *  when it was received, to estimate the current world time. */
+        int          m_state_ticks;
+        uint64_t     m_state_time;
+        /** Real time (in ms) of the next action or reconnection. */
+        uint64_t     m_next_time;
+        /** Start time of the race (network timer), and the current
+         *  steering value. */
+        uint64_t     m_start_time;
+        int          m_steer;
+        uint64_t     m_bytes_received;
+        unsigned     m_full_states;
+        unsigned     m_delta_states;
+        unsigned     m_actions_sent;
+    };
+
+    static LoadTest* m_load_test;
+
+    std::vector<Client> m_clients;
+
+    /** The server the clients connect to (this process). */
+    TransportAddress m_server_address;
+
+    RandomGenerator m_random;
+
+    std::thread m_thread;
+
+    std::atomic_bool m_exit;
+
+    /** Totals at the last report, to compute the rates since. */
+    uint64_t m_last_report_time;
+    uint64_t m_last_report_bytes;
+    unsigned m_last_report_states;
+    uint32_t m_last_report_rewinds;
+
+    LoadTest(unsigned num_clients);
+    ~LoadTest();
+    void mainLoop();
+    void connect(Client* c);
+    void handlePacket(Client* c, NetworkString& data);
+    void handleLoadWorld(Client* c, NetworkString& data);
+    void sendAction(Client* c, uint64_t now);
+    void send(Client* c, NetworkString* ns, bool reliable);
+    void report(bool final_report);
+
+public:
+    static void create(unsigned num_clients);
+    static void destroy();
+
+};   // LoadTest
+
+#endif
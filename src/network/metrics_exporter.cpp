@@ -0,0 +1,288 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/metrics_exporter.hpp"
+
+#include "network/connection_limiter.hpp"
+#include "network/protocol_manager.hpp"
+#include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/tick_profiler.hpp"
+#include "utils/time.hpp"
+
+#include <assert.h>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+uint64_t MetricsExporter::m_next_write_time = 0;
+
+// ----------------------------------------------------------------------------
+/** Adds the HELP and TYPE lines of a metric. */
+void MetricsExporter::addHeader(std::string* out, const char* name,
+                                const char* type, const char* help)
+{
+    *out += StringUtils::insertValues("# HELP %s %s\n# TYPE %s %s\n",
+        name, help, name, type);
+}   // addHeader
+
+// ----------------------------------------------------------------------------
+/** Adds one sample of a metric.
+ *  \param labels The labels without braces (e.g. host_id="1"), or "".
+ */
+void MetricsExporter::addValue(std::string* out, const char* name,
+                               const std::string& labels, double value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.15g", value);
+    *out += name;
+    if (!labels.empty())
+        *out += "{" + labels + "}";
+    *out += " ";
+    *out += buffer;
+    *out += "\n";
+}   // addValue
+
+// ----------------------------------------------------------------------------
+/** Escapes a label value as required by the text format. */
+std::string MetricsExporter::escapeLabel(const std::string& value)
+{
+    std::string result;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c == '\n')
+            result += "\\n";
+        else
+            result += c;
+    }
+    return result;
+}   // escapeLabel
+
+// ----------------------------------------------------------------------------
+/** Returns the resident memory of this process in bytes, or 0 if it is not
+ *  known on this platform. */
+uint64_t MetricsExporter::getResidentMemory()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident)
+        return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}   // getResidentMemory
+
+// ----------------------------------------------------------------------------
+/** Returns all metrics in the Prometheus text format. Can be called from
+ *  any thread. */
+std::string MetricsExporter::getMetrics(STKHost* host)
+{
+    std::string out;
+    auto peers = host->getPeers();
+    // Lobbies forked by server-lobbies write their own files, the label
+    // keeps their samples apart when they are collected together
+    const std::string lobby = StringUtils::insertValues("lobby=\"%d\"",
+        ServerConfig::getLobbyIndex());
+
+    addHeader(&out, "stk_peers", "gauge", "Number of connected peers.");
+    addValue(&out, "stk_peers", lobby, (double)peers.size());
+
+    std::vector<std::string> labels;
+    for (auto& peer : peers)
+    {
+        labels.push_back(StringUtils::insertValues(
+            "%s,host_id=\"%d\",address=\"%s\"", lobby.c_str(),
+            peer->getHostId(),
+            escapeLabel(peer->getAddress().toString()).c_str()));
+    }
+    addHeader(&out, "stk_peer_rtt_ms", "gauge",
+        "Average round trip time of a peer in milliseconds.");
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        addValue(&out, "stk_peer_rtt_ms", labels[i],
+            peers[i]->getAveragePing());
+    }
+    addHeader(&out, "stk_peer_packet_loss_percent", "gauge",
+        "Packet loss of reliable packets of a peer in percent.");
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        addValue(&out, "stk_peer_packet_loss_percent", labels[i],
+            peers[i]->getPacketLoss());
+    }
+    addHeader(&out, "stk_peer_sent_bytes_total", "counter",
+        "Bytes of all messages sent to a peer.");
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        addValue(&out, "stk_peer_sent_bytes_total", labels[i],
+            (double)peers[i]->getBytesSent());
+    }
+    addHeader(&out, "stk_peer_received_bytes_total", "counter",
+        "Bytes of all messages received from a peer.");
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        addValue(&out, "stk_peer_received_bytes_total", labels[i],
+            (double)peers[i]->getBytesReceived());
+    }
+    addHeader(&out, "stk_peer_late_actions_total", "counter",
+        "Late controller actions of a peer, which made the server rewind.");
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        addValue(&out, "stk_peer_late_actions_total", labels[i],
+            peers[i]->getLateActions());
+    }
+
+    addHeader(&out, "stk_rewinds_total", "counter", "Number of rewinds.");
+    addValue(&out, "stk_rewinds_total", lobby,
+        RewindManager::getRewindCount());
+    addHeader(&out, "stk_upload_bytes_per_second", "gauge",
+        "Bytes sent in the last second.");
+    addValue(&out, "stk_upload_bytes_per_second", lobby,
+        host->getUploadSpeed());
+    addHeader(&out, "stk_download_bytes_per_second", "gauge",
+        "Bytes received in the last second.");
+    addValue(&out, "stk_download_bytes_per_second", lobby,
+        host->getDownloadSpeed());
+
+    if (TickProfiler::isEnabled())
+    {
+        const char* quantiles[4] = { "0.5", "0.9", "0.99", "1" };
+        addHeader(&out, "stk_tick_duration_microseconds", "gauge",
+            "Percentiles of the durations of parts of the last ticks.");
+        for (int i = 0; i < TickProfiler::TS_COUNT; i++)
+        {
+            TickProfiler::TickSection section = (TickProfiler::TickSection)i;
+            uint32_t result[4];
+            TickProfiler::getPercentiles(section,
+                std::numeric_limits<uint32_t>::max(), result);
+            for (unsigned j = 0; j < 4; j++)
+            {
+                addValue(&out, "stk_tick_duration_microseconds",
+                    StringUtils::insertValues(
+                    "%s,section=\"%s\",quantile=\"%s\"", lobby.c_str(),
+                    TickProfiler::getSectionName(section), quantiles[j]),
+                    result[j]);
+            }
+        }
+        addHeader(&out, "stk_tick_overruns_total", "counter",
+            "Number of ticks which took longer than one tick.");
+        addValue(&out, "stk_tick_overruns_total", lobby,
+            TickProfiler::getOverruns());
+    }
+
+    if (auto pm = ProtocolManager::lock())
+    {
+        addHeader(&out, "stk_event_queue_depth", "gauge",
+            "Network events waiting for the protocols.");
+        addValue(&out, "stk_event_queue_depth",
+            lobby + ",queue=\"synchronous\"",
+            pm->getEventQueueDepth(true/*synchronous*/));
+        addValue(&out, "stk_event_queue_depth",
+            lobby + ",queue=\"asynchronous\"",
+            pm->getEventQueueDepth(false/*synchronous*/));
+    }
+    addHeader(&out, "stk_enet_commands_total", "counter",
+        "Enet commands (sending, disconnecting) done by the network thread.");
+    addValue(&out, "stk_enet_commands_total", lobby,
+        (double)host->getEnetCommandCount());
+
+    if (const ConnectionLimiter* cl = host->getConnectionLimiter())
+    {
+        addHeader(&out, "stk_connections_allowed_total", "counter",
+            "Connections and connection requests allowed.");
+        addValue(&out, "stk_connections_allowed_total", lobby,
+            cl->getAllowed());
+        addHeader(&out, "stk_connections_rejected_total", "counter",
+            "Connections and connection requests rejected by the limit.");
+        addValue(&out, "stk_connections_rejected_total", lobby,
+            cl->getRejected());
+    }
+    if (const ConnectionLimiter* ql = host->getQueryLimiter())
+    {
+        addHeader(&out, "stk_server_queries_rejected_total", "counter",
+            "LAN and server info queries dropped by the limit.");
+        addValue(&out, "stk_server_queries_rejected_total", lobby,
+            ql->getRejected());
+    }
+
+    uint64_t memory = getResidentMemory();
+    if (memory > 0)
+    {
+        addHeader(&out, "stk_resident_memory_bytes", "gauge",
+            "Resident memory of the server process.");
+        addValue(&out, "stk_resident_memory_bytes", lobby, (double)memory);
+    }
+    return out;
+}   // getMetrics
+
+// ----------------------------------------------------------------------------
+/** Writes the metrics file if it is time to do so. Called regularly by the
+ *  network thread of a server.
+ */
+void MetricsExporter::update(STKHost* host)
+{
+    const std::string& file = ServerConfig::m_metrics_file;
+    if (file.empty())
+        return;
+    uint64_t now = StkTime::getRealTimeMs();
+    if (now < m_next_write_time)
+        return;
+    m_next_write_time = now + (uint64_t)ServerConfig::m_metrics_interval * 1000;
+
+    const std::string tmp = file + ".tmp";
+    std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+    if (!out.is_open())
+    {
+        Log::warn("MetricsExporter", "Can't write to %s.", tmp.c_str());
+        return;
+    }
+    out << getMetrics(host);
+    out.close();
+#ifdef WIN32
+    // rename does not replace an existing file on windows
+    remove(file.c_str());
+#endif
+    if (rename(tmp.c_str(), file.c_str()) != 0)
+        Log::warn("MetricsExporter", "Can't write to %s.", file.c_str());
+}   // update
+
+// ----------------------------------------------------------------------------
+void MetricsExporter::unitTesting()
+{
+    assert(escapeLabel("a\"b\\c\nd") == "a\\\"b\\\\c\\nd");
+
+    std::string out;
+    addHeader(&out, "stk_test", "gauge", "A test.");
+    addValue(&out, "stk_test", "", 3.0);
+    addValue(&out, "stk_test", "a=\"1\"", 0.25);
+    addValue(&out, "stk_test", "", 12345678901.0);
+    assert(out == "# HELP stk_test A test.\n# TYPE stk_test gauge\n"
+        "stk_test 3\nstk_test{a=\"1\"} 0.25\nstk_test 12345678901\n");
+}   // unitTesting
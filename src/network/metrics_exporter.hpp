@@ -0,0 +1,58 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_METRICS_EXPORTER_HPP
+#define HEADER_METRICS_EXPORTER_HPP
+
+#include <cstdint>
+#include <string>
+
+class STKHost;
+
+/** \class MetricsExporter
+ *  \brief Writes metrics of a server and its peers in the Prometheus text
+ *  exposition format to the file set in metrics-file, so many servers can
+ *  be monitored without a network console. The file is written to a
+ *  temporary file first and then renamed, so readers never see a partial
+ *  file. Counters are totals since the start of the server (rates like
+ *  rewinds per second are computed by Prometheus). Each lobby created by
+ *  server-lobbies writes its own file, and all samples have a lobby label
+ *  with the index of the lobby.
+ *  \ingroup network
+ */
+class MetricsExporter
+{
+private:
+    /** When the file should be written next (in ms). */
+    static uint64_t m_next_write_time;
+
+    static void addHeader(std::string* out, const char* name,
+                          const char* type, const char* help);
+    static void addValue(std::string* out, const char* name,
+                         const std::string& labels, double value);
+    static std::string escapeLabel(const std::string& value);
+    static uint64_t getResidentMemory();
+
+public:
+    static void unitTesting();
+    static void update(STKHost* host);
+    static std::string getMetrics(STKHost* host);
+
+};   // MetricsExporter
+
+#endif
@@ -53,12 +53,31 @@ bool Network::m_connection_debug = false;
  *  \param max_outgoing_bandwidth : The maximum outgoing bandwidth.
  *  \param change_port_if_bound : Use another port if the prefered port is
  *                                already bound to a socket.
+ *  \param reuse_address : Allow other sockets to bind the same port, all
+ *                         of them receive broadcasts sent to it.
  */
 Network::Network(int peer_count, int channel_limit,
                  uint32_t max_incoming_bandwidth,
                  uint32_t max_outgoing_bandwidth,
-                 ENetAddress* address, bool change_port_if_bound)
+                 ENetAddress* address, bool change_port_if_bound,
+                 bool reuse_address)
 {
+    if (reuse_address)
+    {
+        // The socket option has to be set before binding
+        m_host = enet_host_create(NULL, peer_count, channel_limit, 0, 0);
+        if (m_host &&
+            (enet_socket_set_option(m_host->socket, ENET_SOCKOPT_REUSEADDR,
+                                    1) < 0 ||
+             enet_socket_bind(m_host->socket, address) < 0))
+        {
+            enet_host_destroy(m_host);
+            m_host = NULL;
+        }
+        if (m_host)
+            m_host->address = *address;
+        return;
+    }
     m_host = enet_host_create(address, peer_count, channel_limit, 0, 0);
     if (m_host)
         return;
@@ -57,7 +57,8 @@ public:
                       uint32_t max_incoming_bandwidth,
                       uint32_t max_outgoing_bandwidth,
                       ENetAddress* address,
-                      bool change_port_if_bound = false);
+                      bool change_port_if_bound = false,
+                      bool reuse_address = false);
     virtual  ~Network();
 
     static void openLog();
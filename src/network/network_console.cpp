@@ -16,12 +16,15 @@
 //  along with this program; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include "network/connection_limiter.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
+#include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 #include "main_loop.hpp"
@@ -42,7 +45,14 @@ void showHelp()
     std::cout << "kickban #, kick and ban # peer of STKHost." << std::endl;
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
-    std::cout << "speedstats, Show upload and download speed." << std::endl;
+    std::cout << "speedstats, Show upload and download speed, and the "
+        "connection quality and state rate of each peer." << std::endl;
+    std::cout << "queuestats, Show network event and command queue "
+        "statistics." << std::endl;
+    std::cout << "tickstats, Show durations of parts of the server ticks."
+        << std::endl;
+    std::cout << "floodstats, Show allowed and rejected connections and "
+        "dropped pending connections." << std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -135,6 +145,46 @@ void mainLoop(STKHost* host)
                 (float)host->getUploadSpeed() / 1024.0f <<
                 "   Download speed (KBps): " <<
                 (float)host->getDownloadSpeed() / 1024.0f  << std::endl;
+            for (auto& peer : host->getPeers())
+            {
+                if (!NetworkConfig::get()->isServer())
+                    break;
+                std::cout << peer->getHostId() << ": " <<
+                    peer->getAddress().toString() << " ping " <<
+                    peer->getAveragePing() << " ms, loss " <<
+                    peer->getPacketLoss() << "%, states per second " <<
+                    (float)ServerConfig::m_state_frequency /
+                    (float)peer->getStateInterval() << std::endl;
+            }
+        }
+        else if (str == "tickstats")
+        {
+            std::cout << TickProfiler::getStatistics();
+        }
+        else if (str == "floodstats")
+        {
+            if (const ConnectionLimiter* cl = host->getConnectionLimiter())
+                std::cout << cl->getStatistics() << std::endl;
+            else
+                std::cout << "Connections are not limited." << std::endl;
+            if (const ConnectionLimiter* ql = host->getQueryLimiter())
+            {
+                std::cout << "Server queries answered: " << ql->getAllowed()
+                    << ", dropped: " << ql->getRejected() << std::endl;
+            }
+            if (auto sl = LobbyProtocol::get<ServerLobby>())
+            {
+                std::cout << "Dropped pending connections: " <<
+                    sl->getEvictedConnections() << std::endl;
+            }
+        }
+        else if (str == "queuestats")
+        {
+            if (auto pm = ProtocolManager::lock())
+                std::cout << pm->getEventQueueStatistics() << std::endl;
+            std::cout << "Enet commands: " << host->getEnetCommandCount() <<
+                ", max per update: " << host->getMaxEnetCommandBatch() <<
+                std::endl;
         }
         else
         {
@@ -0,0 +1,490 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/network_recorder.hpp"
+
+#include "network/event.hpp"
+#include "network/network_string.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/log.hpp"
+#include "utils/tick_profiler.hpp"
+#include "utils/time.hpp"
+
+#include <assert.h>
+#include <cstring>
+
+std::string NetworkRecorder::m_record_file;
+std::string NetworkRecorder::m_replay_file;
+std::atomic<int> NetworkRecorder::m_world_ticks(-1);
+
+/** Size of the part of a record which all event types have. */
+static const unsigned RECORD_HEADER_SIZE = 13;
+
+// ----------------------------------------------------------------------------
+/** Creates a recorder if recording or replaying was requested on the
+ *  command line, otherwise returns NULL. Only used on servers.
+ */
+NetworkRecorder* NetworkRecorder::create()
+{
+    if (m_replay_file.empty() && m_record_file.empty())
+        return NULL;
+    const bool replay = !m_replay_file.empty();
+    const std::string& name = replay ? m_replay_file : m_record_file;
+    FILE* file = fopen(name.c_str(), replay ? "rb" : "wb");
+    if (!file)
+    {
+        Log::error("NetworkRecorder", "Can't open %s.", name.c_str());
+        return NULL;
+    }
+    Log::info("NetworkRecorder", "%s network events %s %s.",
+        replay ? "Replaying" : "Recording", replay ? "from" : "to",
+        name.c_str());
+    return new NetworkRecorder(file, replay);
+}   // create
+
+// ----------------------------------------------------------------------------
+NetworkRecorder::NetworkRecorder(FILE* file, bool replay)
+{
+    m_file = file;
+    m_replay = replay;
+    m_start_time = StkTime::getRealTimeMs();
+    m_wait_start = 0;
+    m_event_count = 0;
+    m_replayed_host_id = 0;
+    m_has_next = false;
+    if (!replay)
+        return;
+
+    // Validated connections are recorded after the connection request
+    Record r;
+    while (readRecord(m_file, &r))
+    {
+        if (r.m_type == RECORD_VALIDATED_CONNECTION)
+            std::swap(m_validated_connections[r.m_host_id], r.m_data);
+    }
+    rewind(m_file);
+    m_has_next = readNextEvent();
+}   // NetworkRecorder
+
+// ----------------------------------------------------------------------------
+NetworkRecorder::~NetworkRecorder()
+{
+    fclose(m_file);
+    if (!m_replay)
+    {
+        Log::info("NetworkRecorder", "Recorded %d network events.",
+            m_event_count);
+    }
+}   // ~NetworkRecorder
+
+// ----------------------------------------------------------------------------
+/** Appends a record to s. */
+void NetworkRecorder::encodeRecord(const Record& r, BareNetworkString* s)
+{
+    s->addUInt8(r.m_type).addUInt32(r.m_time).addUInt32(r.m_host_id)
+        .addUInt32((uint32_t)r.m_ticks);
+    switch (r.m_type)
+    {
+    case EVENT_TYPE_CONNECTED:
+        s->addUInt32(r.m_ip).addUInt16(r.m_port);
+        break;
+    case EVENT_TYPE_DISCONNECTED:
+        s->addUInt32(r.m_pdi);
+        break;
+    case EVENT_TYPE_MESSAGE:
+    case RECORD_VALIDATED_CONNECTION:
+        s->addUInt8(r.m_channel).addUInt32((uint32_t)r.m_data.size());
+        s->getBuffer().insert(s->getBuffer().end(), r.m_data.begin(),
+            r.m_data.end());
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}   // encodeRecord
+
+// ----------------------------------------------------------------------------
+/** Reads the next record from a file.
+ *  \return False at the end of the file or if the file is invalid.
+ */
+bool NetworkRecorder::readRecord(FILE* file, Record* r)
+{
+    char buffer[RECORD_HEADER_SIZE];
+    if (fread(buffer, 1, RECORD_HEADER_SIZE, file) != RECORD_HEADER_SIZE)
+        return false;
+    BareNetworkString header(buffer, RECORD_HEADER_SIZE);
+    r->m_type = header.getUInt8();
+    r->m_time = header.getUInt32();
+    r->m_host_id = header.getUInt32();
+    r->m_ticks = (int)header.getUInt32();
+
+    // Size of the rest of the record, without message data
+    const size_t size = r->m_type == EVENT_TYPE_CONNECTED ? 6 :
+        r->m_type == EVENT_TYPE_DISCONNECTED ? 4 :
+        r->m_type == EVENT_TYPE_MESSAGE ||
+        r->m_type == RECORD_VALIDATED_CONNECTION ? 5 : 0;
+    if (size == 0 || fread(buffer, 1, size, file) != size)
+        return false;
+    BareNetworkString rest(buffer, (int)size);
+    if (r->m_type == EVENT_TYPE_CONNECTED)
+    {
+        r->m_ip = rest.getUInt32();
+        r->m_port = rest.getUInt16();
+    }
+    else if (r->m_type == EVENT_TYPE_DISCONNECTED)
+    {
+        r->m_pdi = rest.getUInt32();
+    }
+    else
+    {
+        r->m_channel = rest.getUInt8();
+        r->m_data.resize(rest.getUInt32());
+        if (!r->m_data.empty() && fread(r->m_data.data(), 1,
+            r->m_data.size(), file) != r->m_data.size())
+            return false;
+    }
+    return true;
+}   // readRecord
+
+// ----------------------------------------------------------------------------
+/** Reads the next event to replay into m_next, skipping the validated
+ *  connections (which were read in advance).
+ *  \return False at the end of the file or if the file is invalid.
+ */
+bool NetworkRecorder::readNextEvent()
+{
+    while (readRecord(m_file, &m_next))
+    {
+        if (m_next.m_type != RECORD_VALIDATED_CONNECTION)
+            return true;
+    }
+    return false;
+}   // readNextEvent
+
+// ----------------------------------------------------------------------------
+/** Records an event received by the listening thread of the server.
+ *  \param event The enet event.
+ *  \param stk_event The event created from it, which must not have been
+ *         passed to the protocol manager yet.
+ */
+void NetworkRecorder::record(const ENetEvent& event, Event* stk_event)
+{
+    Record r;
+    r.m_type = (uint8_t)stk_event->getType();
+    r.m_time = (uint32_t)(StkTime::getRealTimeMs() - m_start_time);
+    r.m_host_id = stk_event->getPeer()->getHostId();
+    r.m_ticks = m_world_ticks.load(std::memory_order_relaxed);
+    switch (stk_event->getType())
+    {
+    case EVENT_TYPE_CONNECTED:
+        r.m_ip = event.peer->address.host;
+        r.m_port = event.peer->address.port;
+        break;
+    case EVENT_TYPE_DISCONNECTED:
+        r.m_pdi = stk_event->getPeerDisconnectInfo();
+        break;
+    case EVENT_TYPE_MESSAGE:
+    {
+        const NetworkString& data = stk_event->data();
+        r.m_channel = event.channelID;
+        r.m_data.assign(data.getData(), data.getData() + data.getTotalSize());
+        break;
+    }
+    }
+    BareNetworkString s(RECORD_HEADER_SIZE + (int)r.m_data.size() + 6);
+    encodeRecord(r, &s);
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    fwrite(s.getData(), 1, s.getTotalSize(), m_file);
+    m_event_count++;
+}   // record
+
+// ----------------------------------------------------------------------------
+/** Records the decrypted content of an encrypted connection request when
+ *  the server validated it, so that it can be replayed without the keys
+ *  from the STK server. Called by the server lobby. The password at the
+ *  start of the request is not recorded, only if it was correct (an empty
+ *  string) or not, see getValidatedConnection().
+ *  \param host_id Host id of the peer.
+ *  \param online_name Name of the online account (utf8).
+ *  \param request The decrypted rest of the connection request.
+ */
+void NetworkRecorder::recordValidatedConnection(uint32_t host_id,
+                                        const std::string& online_name,
+                                        const BareNetworkString& request)
+{
+    BareNetworkString rest(request.getCurrentData(), request.size());
+    std::string password;
+    try
+    {
+        rest.decodeString(&password);
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("NetworkRecorder", "Invalid connection request: %s",
+            e.what());
+        return;
+    }
+    const std::string& server_pw = ServerConfig::m_private_server_password;
+
+    Record r;
+    r.m_type = RECORD_VALIDATED_CONNECTION;
+    r.m_time = (uint32_t)(StkTime::getRealTimeMs() - m_start_time);
+    r.m_host_id = host_id;
+    r.m_ticks = m_world_ticks.load(std::memory_order_relaxed);
+    r.m_channel = 0;
+    BareNetworkString data;
+    data.encodeString(online_name);
+    data.encodeString(std::string(password == server_pw ? "" : "*"));
+    r.m_data = data.getBuffer();
+    r.m_data.insert(r.m_data.end(), rest.getCurrentData(),
+        rest.getCurrentData() + rest.size());
+    BareNetworkString s(RECORD_HEADER_SIZE + (int)r.m_data.size() + 6);
+    encodeRecord(r, &s);
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    fwrite(s.getData(), 1, s.getTotalSize(), m_file);
+}   // recordValidatedConnection
+
+// ----------------------------------------------------------------------------
+/** Returns the decrypted content of a replayed encrypted connection request,
+ *  which can be handled as validated at once.
+ *  \param host_id Recorded host id of the peer (see
+ *         STKPeer::getReplayedHostId).
+ *  \param online_name The name of the online account (utf8).
+ *  \param request The decrypted rest of the connection request.
+ *  \return False if the connection was not validated in the recording.
+ */
+bool NetworkRecorder::getValidatedConnection(uint32_t host_id,
+                                             std::string* online_name,
+                                             BareNetworkString* request)
+{
+    auto it = m_validated_connections.find(host_id);
+    if (it == m_validated_connections.end())
+        return false;
+    BareNetworkString data((const char*)it->second.data(),
+        (int)it->second.size());
+    data.decodeString(online_name);
+    // Put back a password which is (in)correct for this server
+    std::string password;
+    data.decodeString(&password);
+    const std::string& server_pw = ServerConfig::m_private_server_password;
+    BareNetworkString rest;
+    rest.encodeString(password.empty() ? server_pw : server_pw + "*");
+    rest.getBuffer().insert(rest.getBuffer().end(), data.getCurrentData(),
+        data.getCurrentData() + data.size());
+    *request = rest;
+    return true;
+}   // getValidatedConnection
+
+// ----------------------------------------------------------------------------
+/** Called by the listening thread instead of enet_host_service when
+ *  replaying. Fills in the next event if it is due, using the peer slots of
+ *  the enet host for the replayed peers.
+ *  \param host The enet host of the server.
+ *  \param event The event to fill in.
+ *  \param peers The peers of the server now.
+ *  \return True if an event was filled in.
+ */
+bool NetworkRecorder::replay(ENetHost* host, ENetEvent* event,
+               const std::map<ENetPeer*, std::shared_ptr<STKPeer> >& peers)
+{
+    while (m_has_next)
+    {
+        // Events received during a race wait for the world to reach their
+        // tick, events received without world wait for the world to end,
+        // but not forever in case the replay took a different course
+        const uint64_t now = StkTime::getRealTimeMs();
+        const int ticks = m_world_ticks.load(std::memory_order_relaxed);
+        if (m_next.m_ticks >= 0 ? ticks < m_next.m_ticks : ticks >= 0)
+        {
+            if (m_wait_start == 0)
+                m_wait_start = now;
+            if (now < m_wait_start + 10000)
+                return false;
+        }
+        m_wait_start = 0;
+
+        ENetPeer* peer = NULL;
+        auto it = m_replay_peers.find(m_next.m_host_id);
+        if (m_next.m_type == EVENT_TYPE_CONNECTED)
+        {
+            // Use a slot without peer, the server may have reset peers
+            // without a disconnect event
+            for (size_t i = 0; i < host->peerCount; i++)
+            {
+                if (peers.find(&host->peers[i]) == peers.end())
+                {
+                    peer = &host->peers[i];
+                    break;
+                }
+            }
+            if (peer)
+            {
+                for (auto p = m_replay_peers.begin();
+                     p != m_replay_peers.end();)
+                {
+                    if (p->second == peer)
+                        p = m_replay_peers.erase(p);
+                    else
+                        p++;
+                }
+                peer->address.host = m_next.m_ip;
+                peer->address.port = m_next.m_port;
+                m_replay_peers[m_next.m_host_id] = peer;
+            }
+            else
+                Log::warn("NetworkRecorder", "No free peer slot to replay.");
+        }
+        else if (it != m_replay_peers.end())
+        {
+            peer = it->second;
+            if (m_next.m_type == EVENT_TYPE_DISCONNECTED)
+                m_replay_peers.erase(it);
+        }
+
+        memset(event, 0, sizeof(ENetEvent));
+        event->peer = peer;
+        if (m_next.m_type == EVENT_TYPE_CONNECTED)
+            event->type = ENET_EVENT_TYPE_CONNECT;
+        else if (m_next.m_type == EVENT_TYPE_DISCONNECTED)
+        {
+            event->type = ENET_EVENT_TYPE_DISCONNECT;
+            event->data = m_next.m_pdi;
+        }
+        else
+        {
+            event->type = ENET_EVENT_TYPE_RECEIVE;
+            event->channelID = m_next.m_channel;
+            event->packet = enet_packet_create(m_next.m_data.data(),
+                m_next.m_data.size(), ENET_PACKET_FLAG_RELIABLE);
+        }
+
+        m_replayed_host_id = m_next.m_host_id;
+        m_has_next = readNextEvent();
+        if (!m_has_next)
+        {
+            Log::info("NetworkRecorder", "Replayed %d network events in "
+                "%.1f seconds.", m_event_count + 1,
+                (now - m_start_time) / 1000.0f);
+            Log::info("NetworkRecorder", "%s",
+                TickProfiler::getStatistics().c_str());
+            STKHost::get()->requestShutdown();
+        }
+        // Events of unknown peers (e.g. if there was no free slot)
+        if (!peer)
+        {
+            if (event->packet)
+                enet_packet_destroy(event->packet);
+            continue;
+        }
+        m_event_count++;
+        return true;
+    }
+    return false;
+}   // replay
+
+// ----------------------------------------------------------------------------
+/** Tests writing and reading records. */
+void NetworkRecorder::unitTesting()
+{
+    FILE* file = tmpfile();
+    assert(file);
+    Record r;
+    r.m_type = EVENT_TYPE_CONNECTED;
+    r.m_time = 12;
+    r.m_host_id = 3;
+    r.m_ticks = -1;
+    r.m_ip = 0x0100007f;
+    r.m_port = 2759;
+    BareNetworkString s;
+    encodeRecord(r, &s);
+    r.m_type = EVENT_TYPE_MESSAGE;
+    r.m_time = 100000;
+    r.m_ticks = 1234;
+    r.m_channel = 0;
+    r.m_data = { 1, 2, 3, 255 };
+    encodeRecord(r, &s);
+    r.m_type = RECORD_VALIDATED_CONNECTION;
+    r.m_data = { 4, 5 };
+    encodeRecord(r, &s);
+    r.m_type = EVENT_TYPE_DISCONNECTED;
+    r.m_pdi = PDI_KICK;
+    encodeRecord(r, &s);
+    fwrite(s.getData(), 1, s.getTotalSize(), file);
+    rewind(file);
+
+    Record q;
+    bool ok = readRecord(file, &q);
+    assert(ok);
+    assert(q.m_type == EVENT_TYPE_CONNECTED && q.m_time == 12);
+    assert(q.m_host_id == 3 && q.m_ticks == -1);
+    assert(q.m_ip == 0x0100007f && q.m_port == 2759);
+    ok = readRecord(file, &q);
+    assert(ok);
+    assert(q.m_type == EVENT_TYPE_MESSAGE && q.m_time == 100000);
+    assert(q.m_ticks == 1234 && q.m_channel == 0);
+    assert(q.m_data == std::vector<uint8_t>({ 1, 2, 3, 255 }));
+    ok = readRecord(file, &q);
+    assert(ok);
+    assert(q.m_type == RECORD_VALIDATED_CONNECTION);
+    assert(q.m_data == std::vector<uint8_t>({ 4, 5 }));
+    ok = readRecord(file, &q);
+    assert(ok);
+    assert(q.m_type == EVENT_TYPE_DISCONNECTED && q.m_pdi == PDI_KICK);
+    ok = readRecord(file, &q);
+    assert(!ok);
+    (void)ok;
+    fclose(file);
+
+    // The password of a validated connection is not recorded, only if it
+    // was correct
+    file = tmpfile();
+    assert(file);
+    NetworkRecorder recorder(file, false/*replay*/);
+    std::string server_pw = ServerConfig::m_private_server_password;
+    ServerConfig::m_private_server_password = "secret";
+    BareNetworkString request;
+    request.encodeString(std::string("secret")).addUInt8(42);
+    recorder.recordValidatedConnection(7, "name", request);
+    request.getBuffer().clear();
+    request.encodeString(std::string("wrong")).addUInt8(42);
+    recorder.recordValidatedConnection(8, "name", request);
+    rewind(recorder.m_file);
+    for (uint32_t host_id = 7; host_id <= 8; host_id++)
+    {
+        ok = readRecord(recorder.m_file, &q);
+        assert(ok);
+        assert(q.m_type == RECORD_VALIDATED_CONNECTION);
+        assert(q.m_host_id == host_id);
+        std::string data(q.m_data.begin(), q.m_data.end());
+        assert(data.find("secret") == std::string::npos);
+        assert(data.find("wrong") == std::string::npos);
+        recorder.m_validated_connections[host_id] = q.m_data;
+    }
+    std::string name, password;
+    ok = recorder.getValidatedConnection(7, &name, &request);
+    assert(ok && name == "name");
+    request.decodeString(&password);
+    assert(password == "secret" && request.getUInt8() == 42);
+    ok = recorder.getValidatedConnection(8, &name, &request);
+    assert(ok);
+    request.decodeString(&password);
+    assert(password != "secret" && request.getUInt8() == 42);
+    ServerConfig::m_private_server_password = server_pw;
+}   // unitTesting
@@ -0,0 +1,165 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_NETWORK_RECORDER_HPP
+#define HEADER_NETWORK_RECORDER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class BareNetworkString;
+class Event;
+class STKPeer;
+typedef struct _ENetEvent ENetEvent;
+typedef struct _ENetHost ENetHost;
+typedef struct _ENetPeer ENetPeer;
+
+/** \class NetworkRecorder
+ *  \brief Records all events a server receives (--record-network), and
+ *  feeds them back into a server without any clients (--replay-network).
+ *  This allows to benchmark the server protocols with real sessions
+ *  offline. The recorded events are already decrypted, and replayed peers
+ *  use the peer slots of the enet host in disconnected state, so nothing
+ *  is sent to them (but all messages are still created). Replayed peers are
+ *  marked (see STKPeer::isReplayed), so their messages are not decrypted
+ *  again. The keys of encrypted connection requests come from the STK
+ *  server, so the decrypted request is recorded when the server validated
+ *  it, and a replayed request is validated with it at once.
+ *  Events are replayed as fast as possible: events received during a race
+ *  are only replayed once the world reached the tick at which they were
+ *  received, and events received without a world only when there is no
+ *  world (but not later than 10 seconds, in case the replay took a
+ *  different course). When the replay is finished the server is shut down.
+ *  \ingroup network
+ */
+class NetworkRecorder : public NoCopy
+{
+public:
+    /** Type of a record with the decrypted content of a validated
+     *  connection request, in addition to the EVENT_TYPEs. */
+    static const uint8_t RECORD_VALIDATED_CONNECTION = 16;
+
+    /** One recorded event. */
+    struct Record
+    {
+        /** The EVENT_TYPE or RECORD_VALIDATED_CONNECTION. */
+        uint8_t              m_type;
+        /** Time in ms since the start of the recording. */
+        uint32_t             m_time;
+        uint32_t             m_host_id;
+        /** World ticks when the event was received, or -1 without world. */
+        int                  m_ticks;
+        /** Address of a connecting peer (in enet byte order). */
+        uint32_t             m_ip;
+        uint16_t             m_port;
+        /** PeerDisconnectInfo of a disconnection. */
+        uint32_t             m_pdi;
+        uint8_t              m_channel;
+        /** The (decrypted) message, or the online name and the decrypted
+         *  connection request of a validated connection. */
+        std::vector<uint8_t> m_data;
+    };
+
+private:
+    /** File names from the command line. */
+    static std::string m_record_file;
+    static std::string m_replay_file;
+
+    /** Ticks of the world, set in the main thread and read in the listening
+     *  thread, -1 if there is no world. */
+    static std::atomic<int> m_world_ticks;
+
+    FILE* m_file;
+
+    /** Records are written by the listening thread and by the server lobby
+     *  (for validated connections). */
+    std::mutex m_file_mutex;
+
+    bool m_replay;
+
+    /** Real time (in ms) when recording or replaying started. */
+    uint64_t m_start_time;
+
+    /** Real time (in ms) since when the next event waits for the world, or
+     *  0 if it does not wait. */
+    uint64_t m_wait_start;
+
+    /** The next event to replay, if m_has_next is true. */
+    Record m_next;
+    bool m_has_next;
+
+    /** Number of events recorded or replayed. */
+    unsigned m_event_count;
+
+    /** Maps the host id of a replayed peer to the enet peer slot used. */
+    std::map<uint32_t, ENetPeer*> m_replay_peers;
+
+    /** The validated connection requests of a replay, read in advance since
+     *  they are recorded after the connection request. Indexed by the
+     *  recorded host id. */
+    std::map<uint32_t, std::vector<uint8_t> > m_validated_connections;
+
+    /** Recorded host id of the event replayed last. */
+    uint32_t m_replayed_host_id;
+
+    NetworkRecorder(FILE* file, bool replay);
+    bool readNextEvent();
+
+public:
+    static NetworkRecorder* create();
+    static void encodeRecord(const Record& r, BareNetworkString* s);
+    static bool readRecord(FILE* file, Record* r);
+    static void unitTesting();
+    ~NetworkRecorder();
+    void record(const ENetEvent& event, Event* stk_event);
+    void recordValidatedConnection(uint32_t host_id,
+                                   const std::string& online_name,
+                                   const BareNetworkString& request);
+    bool getValidatedConnection(uint32_t host_id, std::string* online_name,
+                                BareNetworkString* request);
+    bool replay(ENetHost* host, ENetEvent* event,
+                const std::map<ENetPeer*, std::shared_ptr<STKPeer> >& peers);
+    // ------------------------------------------------------------------------
+    bool isReplaying() const                               { return m_replay; }
+    // ------------------------------------------------------------------------
+    static void setRecordFile(const std::string& f)     { m_record_file = f; }
+    // ------------------------------------------------------------------------
+    static const std::string& getRecordFile()        { return m_record_file; }
+    // ------------------------------------------------------------------------
+    static void setReplayFile(const std::string& f)     { m_replay_file = f; }
+    // ------------------------------------------------------------------------
+    /** Returns the recorded host id of the event replayed last. */
+    uint32_t getReplayedHostId() const          { return m_replayed_host_id; }
+    // ------------------------------------------------------------------------
+    /** Called by the main loop after each tick. */
+    static void setWorldTicks(int ticks)
+    {
+        m_world_ticks.store(ticks, std::memory_order_relaxed);
+    }   // setWorldTicks
+
+};   // NetworkRecorder
+
+#endif
@@ -23,6 +23,7 @@
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
@@ -76,20 +77,6 @@ ProtocolManager::~ProtocolManager()
         m_all_protocols[i].abort();
     }
 
-    m_sync_events_to_process.lock();
-    for (EventList::iterator i =m_sync_events_to_process.getData().begin();
-                             i!=m_sync_events_to_process.getData().end(); ++i)
-        delete *i;
-    m_sync_events_to_process.getData().clear();
-    m_sync_events_to_process.unlock();
-
-    m_async_events_to_process.lock();
-    for (EventList::iterator i = m_async_events_to_process.getData().begin();
-                             i!= m_async_events_to_process.getData().end(); ++i)
-        delete *i;
-    m_async_events_to_process.getData().clear();
-    m_async_events_to_process.unlock();
-
     m_requests.lock();
     m_requests.getData().clear();
     m_requests.unlock();
@@ -120,19 +107,168 @@ void ProtocolManager::abort()
 void ProtocolManager::propagateEvent(Event* event)
 {
     if (event->isSynchronous())
+        m_sync_events.push(event);
+    else
+        m_async_events.push(event);
+}   // propagateEvent
+
+// ----------------------------------------------------------------------------
+/** Moves events which did not fit into the queues before into them. This
+ *  is called regularly by the network thread, so that no event is stuck
+ *  when no new events arrive.
+ */
+void ProtocolManager::flushEvents()
+{
+    m_sync_events.flush();
+    m_async_events.flush();
+}   // flushEvents
+
+// ----------------------------------------------------------------------------
+/** Creates an event for an enet event, reusing an already handled event if
+ *  possible. Must only be called from the network thread.
+ *  \param event The enet event.
+ *  \param peer The peer that triggered the event.
+ */
+Event* ProtocolManager::createEvent(ENetEvent* event,
+                                    std::shared_ptr<STKPeer> peer)
+{
+    Event* stk_event = m_sync_events.getRecycledEvent();
+    if (!stk_event)
+        stk_event = m_async_events.getRecycledEvent();
+    if (!stk_event)
+        return new Event(event, peer);
+    try
     {
-        m_sync_events_to_process.lock();
-        m_sync_events_to_process.getData().push_back(event);
-        m_sync_events_to_process.unlock();
+        stk_event->set(event, peer);
     }
-    else
+    catch (std::exception&)
     {
-        m_async_events_to_process.lock();
-        m_async_events_to_process.getData().push_back(event);
-        m_async_events_to_process.unlock();
+        delete stk_event;
+        throw;
     }
-    return;
-}   // propagateEvent
+    return stk_event;
+}   // createEvent
+
+// ----------------------------------------------------------------------------
+/** Returns a description of the depth and waiting time of the event queues,
+ *  used by the network console.
+ */
+std::string ProtocolManager::getEventQueueStatistics() const
+{
+    return "Synchronous events: " + m_sync_events.getStatistics() +
+        "\nAsynchronous events: " + m_async_events.getStatistics();
+}   // getEventQueueStatistics
+
+// ============================================================================
+ProtocolManager::EventQueue::EventQueue()
+{
+    m_max_depth.store(0);
+    m_overflow_count.store(0);
+    m_delivered.store(0);
+    m_total_wait_ms.store(0);
+    m_max_wait_ms.store(0);
+}   // EventQueue
+
+// ----------------------------------------------------------------------------
+/** Deletes all events. Only one thread must be active at this time. */
+ProtocolManager::EventQueue::~EventQueue()
+{
+    Event* event = NULL;
+    while (m_incoming.pop(&event))
+        delete event;
+    while (m_recycled.pop(&event))
+        delete event;
+    for (Event* e : m_overflow)
+        delete e;
+    for (Event* e : m_events)
+        delete e;
+}   // ~EventQueue
+
+// ----------------------------------------------------------------------------
+/** Adds a new event, called from the network thread only. */
+void ProtocolManager::EventQueue::push(Event* event)
+{
+    flush();
+    if (!m_overflow.empty() || !m_incoming.push(event))
+    {
+        m_overflow.push_back(event);
+        m_overflow_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint32_t depth = (uint32_t)(m_incoming.size() + m_overflow.size());
+    if (depth > m_max_depth.load(std::memory_order_relaxed))
+        m_max_depth.store(depth, std::memory_order_relaxed);
+}   // push
+
+// ----------------------------------------------------------------------------
+/** Moves events from the overflow list into the ring, called from the
+ *  network thread only. */
+void ProtocolManager::EventQueue::flush()
+{
+    while (!m_overflow.empty() && m_incoming.push(m_overflow.front()))
+        m_overflow.pop_front();
+}   // flush
+
+// ----------------------------------------------------------------------------
+/** Returns an already handled event for reuse or NULL, called from the
+ *  network thread only. */
+Event* ProtocolManager::EventQueue::getRecycledEvent()
+{
+    Event* event = NULL;
+    m_recycled.pop(&event);
+    return event;
+}   // getRecycledEvent
+
+// ----------------------------------------------------------------------------
+/** Appends all newly arrived events to the list of events to handle and
+ *  returns this list. Called from the consumer thread only. */
+ProtocolManager::EventList& ProtocolManager::EventQueue::receive()
+{
+    Event* event = NULL;
+    if (m_incoming.size() == 0)
+        return m_events;
+    const uint64_t now = StkTime::getRealTimeMs();
+    uint64_t total_wait = 0;
+    uint64_t max_wait = m_max_wait_ms.load(std::memory_order_relaxed);
+    uint64_t count = 0;
+    while (m_incoming.pop(&event))
+    {
+        m_events.push_back(event);
+        uint64_t wait = now > event->getArrivalTimeMs() ?
+            now - event->getArrivalTimeMs() : 0;
+        total_wait += wait;
+        max_wait = std::max(max_wait, wait);
+        count++;
+    }
+    m_delivered.fetch_add(count, std::memory_order_relaxed);
+    m_total_wait_ms.fetch_add(total_wait, std::memory_order_relaxed);
+    m_max_wait_ms.store(max_wait, std::memory_order_relaxed);
+    return m_events;
+}   // receive
+
+// ----------------------------------------------------------------------------
+/** Gives a handled event back to the network thread for reuse, called from
+ *  the consumer thread only. */
+void ProtocolManager::EventQueue::recycle(Event* event)
+{
+    event->clear();
+    if (!m_recycled.push(event))
+        delete event;
+}   // recycle
+
+// ----------------------------------------------------------------------------
+std::string ProtocolManager::EventQueue::getStatistics() const
+{
+    uint64_t delivered = m_delivered.load(std::memory_order_relaxed);
+    uint64_t total_wait = m_total_wait_ms.load(std::memory_order_relaxed);
+    return StringUtils::insertValues("depth %d (max %d), overflows %d, "
+        "delivered %d, wait ms avg %f max %d",
+        (int)m_incoming.size(),
+        m_max_depth.load(std::memory_order_relaxed),
+        m_overflow_count.load(std::memory_order_relaxed),
+        (unsigned)delivered,
+        delivered == 0 ? 0.0f : (float)total_wait / (float)delivered,
+        (unsigned)m_max_wait_ms.load(std::memory_order_relaxed));
+}   // getStatistics
 
 // ----------------------------------------------------------------------------
 /** \brief Asks the manager to start a protocol.
@@ -428,37 +564,33 @@ void ProtocolManager::update(int ticks)
     assert(std::this_thread::get_id() != m_asynchronous_update_thread.get_id());
 
     // before updating, notify protocols that they have received events
-    m_sync_events_to_process.lock();
-    EventList::iterator i = m_sync_events_to_process.getData().begin();
-
-    while (i != m_sync_events_to_process.getData().end())
+    EventList& events = m_sync_events.receive();
+    unsigned kept = 0;
+    for (unsigned n = 0; n < events.size(); n++)
     {
-        m_sync_events_to_process.unlock();
+        Event* event = events[n];
         bool can_be_deleted = true;
         try
         {
-            can_be_deleted = sendEvent(*i);
+            can_be_deleted = sendEvent(event);
         }
         catch (std::exception& e)
         {
-            const std::string& name = (*i)->getPeer()->getAddress().toString();
+            const std::string& name = event->getPeer()->getAddress().toString();
             Log::error("ProtocolManager",
                 "Synchronous event error from %s: %s", name.c_str(), e.what());
-            Log::error("ProtocolManager", (*i)->data().getLogMessage().c_str());
+            Log::error("ProtocolManager",
+                event->data().getLogMessage().c_str());
         }
-        m_sync_events_to_process.lock();
         if (can_be_deleted)
-        {
-            delete *i;
-            i = m_sync_events_to_process.getData().erase(i);
-        }
+            m_sync_events.recycle(event);
         else
         {
             // This should only happen if the protocol has not been started
-            ++i;
+            events[kept++] = event;
         }
     }
-    m_sync_events_to_process.unlock();
+    events.resize(kept);
 
     // Now update all protocols.
     for (unsigned int i = 0; i < m_all_protocols.size(); i++)
@@ -484,42 +616,37 @@ void ProtocolManager::asynchronousUpdate()
     PROFILER_PUSH_CPU_MARKER("Message delivery", 255, 0, 0);
     // First deliver asynchronous messages for all protocols
     // =====================================================
-    m_async_events_to_process.lock();
-    EventList::iterator i = m_async_events_to_process.getData().begin();
-    while (i != m_async_events_to_process.getData().end())
+    EventList& events = m_async_events.receive();
+    unsigned kept = 0;
+    for (unsigned n = 0; n < events.size(); n++)
     {
-        m_async_events_to_process.unlock();
-
-        m_all_protocols[(*i)->getType()].lock();
+        Event* event = events[n];
+        m_all_protocols[event->getType()].lock();
         bool result = true;
         try
         {
-            result = sendEvent(*i);
+            result = sendEvent(event);
         }
         catch (std::exception& e)
         {
-            const std::string& name = (*i)->getPeer()->getAddress().toString();
+            const std::string& name = event->getPeer()->getAddress().toString();
             Log::error("ProtocolManager", "Asynchronous event "
                 "error from %s: %s", name.c_str(), e.what());
             Log::error("ProtocolManager",
-                (*i)->data().getLogMessage().c_str());
+                event->data().getLogMessage().c_str());
         }
-        m_all_protocols[(*i)->getType()].unlock();
+        m_all_protocols[event->getType()].unlock();
 
-        m_async_events_to_process.lock();
         if (result)
-        {
-            delete *i;
-            i = m_async_events_to_process.getData().erase(i);
-        }
+            m_async_events.recycle(event);
         else
         {
             // This should only happen if the protocol has not been started
             // or already terminated (e.g. late ping answer)
-            ++i;
+            events[kept++] = event;
         }
-    }   // while i != m_events_to_process.end()
-    m_async_events_to_process.unlock();
+    }   // for n < events.size()
+    events.resize(kept);
 
     PROFILER_POP_CPU_MARKER();
     PROFILER_PUSH_CPU_MARKER("Message delivery", 255, 0, 0);
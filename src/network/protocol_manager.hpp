@@ -27,17 +27,20 @@
 #include "network/protocol.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/singleton.hpp"
+#include "utils/spsc_queue.hpp"
 #include "utils/synchronised.hpp"
 #include "utils/types.hpp"
 
 #include <atomic>
 #include <list>
 #include <memory>
+#include <string>
 #include <vector>
 #include <thread>
 
 class Event;
 class STKPeer;
+typedef struct _ENetEvent ENetEvent;
 
 #define TIME_TO_KEEP_EVENTS 1.0
 
@@ -199,15 +202,54 @@ private:
     std::vector<OneProtocolType> m_all_protocols;
 
     /** A list of network events - messages, disconnect and disconnects. */
-    typedef std::list<Event*> EventList;
+    typedef std::vector<Event*> EventList;
+
+    /** Passes events from the network thread (the only producer) to one
+     *  consumer thread without locking. Handled events are sent back
+     *  through a second ring, so the network thread can reuse them. If the
+     *  consumer falls behind and the ring is full, events are kept in an
+     *  overflow list of the network thread, which keeps the order. */
+    class EventQueue
+    {
+    private:
+        typedef SPSCQueue<Event*, 1024> EventRing;
+
+        /** New events, from network thread to consumer. */
+        EventRing m_incoming;
+
+        /** Handled events, from consumer back to network thread. */
+        EventRing m_recycled;
+
+        /** Events which did not fit into m_incoming, network thread only. */
+        std::list<Event*> m_overflow;
+
+        /** Events received but not yet handled, consumer thread only. */
+        EventList m_events;
+
+        /** Statistics, written by one thread and read by the console. */
+        std::atomic<uint32_t> m_max_depth, m_overflow_count;
+        std::atomic<uint64_t> m_delivered, m_total_wait_ms, m_max_wait_ms;
+
+    public:
+                 EventQueue();
+                ~EventQueue();
+        void     push(Event* event);
+        void     flush();
+        Event*   getRecycledEvent();
+        EventList& receive();
+        void     recycle(Event* event);
+        std::string getStatistics() const;
+        /** Returns the number of events waiting to be received. */
+        uint32_t getDepth() const       { return (uint32_t)m_incoming.size(); }
+    };   // class EventQueue
 
     /** Contains the network events to pass synchronously to protocols
      *  (i.e. from the main thread). */
-    Synchronised<EventList> m_sync_events_to_process;
+    EventQueue m_sync_events;
 
     /** Contains the network events to pass asynchronously to protocols
     *  (i.e. from the separate ProtocolManager thread). */
-    Synchronised<EventList> m_async_events_to_process;
+    EventQueue m_async_events;
 
     /** Contains the requests to start/pause etc... protocols. */
     Synchronised< std::vector<ProtocolRequest> > m_requests;
@@ -236,6 +278,17 @@ public:
     virtual  ~ProtocolManager();
     void      abort();
     void      propagateEvent(Event* event);
+    void      flushEvents();
+    Event*    createEvent(ENetEvent* event, std::shared_ptr<STKPeer> peer);
+    std::string getEventQueueStatistics() const;
+    // ------------------------------------------------------------------------
+    /** Returns the number of events waiting for the main thread (if
+     *  synchronous) or for the protocol manager thread. */
+    uint32_t getEventQueueDepth(bool synchronous) const
+    {
+        return synchronous ? m_sync_events.getDepth()
+                           : m_async_events.getDepth();
+    }   // getEventQueueDepth
     std::shared_ptr<Protocol> getProtocol(ProtocolType type);
     void      requestStart(std::shared_ptr<Protocol> protocol);
     void      requestPause(std::shared_ptr<Protocol> protocol);
@@ -34,6 +34,7 @@
 #include "karts/kart_properties.hpp"
 #include "karts/kart_properties_manager.hpp"
 #include "modes/linear_world.hpp"
+#include "network/chunked_state.hpp"
 #include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
@@ -165,6 +166,7 @@ bool ClientLobby::notifyEvent(Event* event)
         case LE_BAD_TEAM:              handleBadTeam();            break;
         case LE_BAD_CONNECTION:        handleBadConnection();      break;
         case LE_LIVE_JOIN_ACK:        liveJoinAcknowledged(event); break;
+        case LE_LIVE_JOIN_STATE:       handleLiveJoinState(event); break;
         case LE_KART_INFO:             handleKartInfo(event);      break;
         default:
             return false;
@@ -254,26 +256,8 @@ void ClientLobby::addAllPlayers(Event* event)
 
     std::shared_ptr<STKPeer> peer = event->getPeerSP();
     peer->cleanPlayerProfiles();
-    std::vector<std::shared_ptr<NetworkPlayerProfile> > players;
-    unsigned player_count = data.getUInt8();
-
-    for (unsigned i = 0; i < player_count; i++)
-    {
-        core::stringw player_name;
-        data.decodeStringW(&player_name);
-        uint32_t host_id = data.getUInt32();
-        float kart_color = data.getFloat();
-        uint32_t online_id = data.getUInt32();
-        PerPlayerDifficulty ppd = (PerPlayerDifficulty)data.getUInt8();
-        uint8_t local_id = data.getUInt8();
-        KartTeam team = (KartTeam)data.getUInt8();
-        auto player = std::make_shared<NetworkPlayerProfile>(peer, player_name,
-            host_id, kart_color, online_id, ppd, local_id, team);
-        std::string kart_name;
-        data.decodeString(&kart_name);
-        player->setKartName(kart_name);
-        players.push_back(player);
-    }
+    std::vector<std::shared_ptr<NetworkPlayerProfile> > players =
+        decodePlayers(data, peer);
     uint32_t random_seed = data.getUInt32();
     ItemManager::updateRandomSeed(random_seed);
     if (race_manager->isBattleMode())
@@ -317,6 +301,82 @@ void ClientLobby::addAllPlayers(Event* event)
     input_manager->getDeviceManager()->setAssignMode(ASSIGN);
 }   // addAllPlayers
 
+//-----------------------------------------------------------------------------
+/** Decodes the players of a race with their karts, as sent in the
+ *  LE_LOAD_WORLD message (see ServerLobby::getLoadWorldMessage).
+ *  \param data The message, with the read offset at the player count.
+ *  \param peer The peer the players are associated with.
+ */
+std::vector<std::shared_ptr<NetworkPlayerProfile> >
+    ClientLobby::decodePlayers(NetworkString& data,
+                               std::shared_ptr<STKPeer> peer)
+{
+    std::vector<std::shared_ptr<NetworkPlayerProfile> > players;
+    unsigned player_count = data.getUInt8();
+
+    for (unsigned i = 0; i < player_count; i++)
+    {
+        core::stringw player_name;
+        data.decodeStringW(&player_name);
+        uint32_t host_id = data.getUInt32();
+        float kart_color = data.getFloat();
+        uint32_t online_id = data.getUInt32();
+        PerPlayerDifficulty ppd = (PerPlayerDifficulty)data.getUInt8();
+        uint8_t local_id = data.getUInt8();
+        KartTeam team = (KartTeam)data.getUInt8();
+        auto player = std::make_shared<NetworkPlayerProfile>(peer, player_name,
+            host_id, kart_color, online_id, ppd, local_id, team);
+        std::string kart_name;
+        data.decodeString(&kart_name);
+        player->setKartName(kart_name);
+        players.push_back(player);
+    }
+    return players;
+}   // decodePlayers
+
+//-----------------------------------------------------------------------------
+/** Adds the start of a connection request: the version, the user agent, the
+ *  karts and tracks of this client, and the number of players.
+ */
+void ClientLobby::encodeConnectionRequest(NetworkString* ns,
+                                          uint8_t player_count)
+{
+    ns->addUInt8(LE_CONNECTION_REQUESTED)
+        .addUInt32(ServerConfig::m_server_version)
+        .encodeString(StringUtils::getUserAgentString());
+
+    auto all_k = kart_properties_manager->getAllAvailableKarts();
+    auto all_t = track_manager->getAllTrackIdentifiers();
+    if (all_k.size() >= 65536)
+        all_k.resize(65535);
+    if (all_t.size() >= 65536)
+        all_t.resize(65535);
+    ns->addUInt16((uint16_t)all_k.size()).addUInt16((uint16_t)all_t.size());
+    for (const std::string& kart : all_k)
+    {
+        ns->encodeString(kart);
+    }
+    for (const std::string& track : all_t)
+    {
+        ns->encodeString(track);
+    }
+    ns->addUInt8(player_count);
+}   // encodeConnectionRequest
+
+//-----------------------------------------------------------------------------
+/** Adds one player to the (possibly encrypted) part of a connection request
+ *  after the server password.
+ */
+void ClientLobby::encodeConnectingPlayer(BareNetworkString* ns,
+                                         const core::stringw& name,
+                                         float kart_color,
+                                         PerPlayerDifficulty ppd)
+{
+    ns->encodeString(name).addFloat(kart_color);
+    // Per-player handicap
+    ns->addUInt8(ppd);
+}   // encodeConnectingPlayer
+
 //-----------------------------------------------------------------------------
 void ClientLobby::update(int ticks)
 {
@@ -331,29 +391,10 @@ void ClientLobby::update(int ticks)
     case LINKED:
     {
         NetworkString* ns = getNetworkString();
-        ns->addUInt8(LE_CONNECTION_REQUESTED)
-            .addUInt32(ServerConfig::m_server_version)
-            .encodeString(StringUtils::getUserAgentString());
-
-        auto all_k = kart_properties_manager->getAllAvailableKarts();
-        auto all_t = track_manager->getAllTrackIdentifiers();
-        if (all_k.size() >= 65536)
-            all_k.resize(65535);
-        if (all_t.size() >= 65536)
-            all_t.resize(65535);
-        ns->addUInt16((uint16_t)all_k.size()).addUInt16((uint16_t)all_t.size());
-        for (const std::string& kart : all_k)
-        {
-            ns->encodeString(kart);
-        }
-        for (const std::string& track : all_t)
-        {
-            ns->encodeString(track);
-        }
         assert(!NetworkConfig::get()->isAddingNetworkPlayers());
         const uint8_t player_count =
             (uint8_t)NetworkConfig::get()->getNetworkPlayers().size();
-        ns->addUInt8(player_count);
+        encodeConnectionRequest(ns, player_count);
 
         bool encryption = false;
         uint32_t id = PlayerManager::getCurrentOnlineId();
@@ -375,12 +416,9 @@ void ClientLobby::update(int ticks)
             .addUInt8(player_count);
         for (auto& p : NetworkConfig::get()->getNetworkPlayers())
         {
-            core::stringw name;
             PlayerProfile* player = std::get<1>(p);
-            rest->encodeString(player->getName()).
-                addFloat(player->getDefaultKartColor());
-            // Per-player handicap
-            rest->addUInt8(std::get<2>(p));
+            encodeConnectingPlayer(rest, player->getName(),
+                player->getDefaultKartColor(), std::get<2>(p));
         }
 
         finalizeConnectionRequest(ns, rest, encryption);
@@ -415,8 +453,10 @@ void ClientLobby::update(int ticks)
         break;
     case REQUESTING_CONNECTION:
     case CONNECTED:
+        // The complete state must be restored before the world can start
         if (m_start_live_game_time != std::numeric_limits<uint64_t>::max() &&
-            STKHost::get()->getNetworkTimer() >= m_start_live_game_time)
+            STKHost::get()->getNetworkTimer() >= m_start_live_game_time &&
+            !m_live_join_state)
         {
             finishLiveJoin();
         }
@@ -1087,12 +1127,45 @@ void ClientLobby::liveJoinAcknowledged(Event* event)
             k->setLiveJoinKart(m_last_live_join_util_ticks);
     }
 
+    // The complete state follows in LE_LIVE_JOIN_STATE messages
+    const uint32_t state_size = data.getUInt32();
+    const unsigned chunk_count = data.getUInt16();
+    m_live_join_state.reset(new ChunkedState(state_size, chunk_count));
+}   // liveJoinAcknowledged
+
+//-----------------------------------------------------------------------------
+/** Decompresses a chunk of the complete state sent after a live join ack,
+ *  and restores the state once all chunks are received.
+ */
+void ClientLobby::handleLiveJoinState(Event* event)
+{
+    World* w = World::getWorld();
+    if (!w || !m_live_join_state)
+        return;
+
+    if (!m_live_join_state->readChunk(event->data()))
+    {
+        // The world can't be started without the state
+        m_live_join_state.reset();
+        STKHost::get()->setErrorMessage(
+            m_disconnected_msg.at(PDI_BAD_CONNECTION));
+        STKHost::get()->requestShutdown();
+        return;
+    }
+    if (!m_live_join_state->isComplete())
+        return;
+
+    Log::info("ClientLobby", "Received complete state of %d bytes in %d "
+        "chunks.", m_live_join_state->getSize(),
+        m_live_join_state->getChunkCount());
+    std::unique_ptr<BareNetworkString> state(m_live_join_state->getState());
+    m_live_join_state.reset();
     NetworkItemManager* nim =
     dynamic_cast<NetworkItemManager*>(ItemManager::get());
     assert(nim);
-    nim->restoreCompleteState(data);
-    w->restoreCompleteState(data);
-}   // liveJoinAcknowledged
+    nim->restoreCompleteState(*state);
+    w->restoreCompleteState(*state);
+}   // handleLiveJoinState
 
 //-----------------------------------------------------------------------------
 void ClientLobby::finishLiveJoin()
@@ -34,6 +34,7 @@ enum KartTeam : int8_t;
 enum PerPlayerDifficulty : uint8_t;
 
 class BareNetworkString;
+class ChunkedState;
 class Server;
 
 struct LobbyPlayer
@@ -104,6 +105,10 @@ private:
 
     uint64_t m_start_live_game_time;
 
+    /** The complete state received in chunks after a live join, NULL if
+     *  there is none or it has been restored. */
+    std::unique_ptr<ChunkedState> m_live_join_state;
+
     /** The state of the finite state machine. */
     std::atomic<ClientState> m_state;
 
@@ -121,11 +126,20 @@ private:
     irr::core::stringw m_total_players;
 
     void liveJoinAcknowledged(Event* event);
+    void handleLiveJoinState(Event* event);
     void handleKartInfo(Event* event);
     void finishLiveJoin();
 public:
              ClientLobby(const TransportAddress& a, std::shared_ptr<Server> s);
     virtual ~ClientLobby();
+    static std::vector<std::shared_ptr<NetworkPlayerProfile> >
+        decodePlayers(NetworkString& data, std::shared_ptr<STKPeer> peer);
+    static void encodeConnectionRequest(NetworkString* ns,
+                                        uint8_t player_count);
+    static void encodeConnectingPlayer(BareNetworkString* ns,
+                                       const irr::core::stringw& name,
+                                       float kart_color,
+                                       PerPlayerDifficulty ppd);
     void doneWithResults();
     bool receivedServerResult()            { return m_received_server_result; }
     void startingRaceNow();
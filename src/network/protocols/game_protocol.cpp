@@ -22,6 +22,7 @@
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/player_controller.hpp"
 #include "modes/world.hpp"
+#include "network/bit_stream.hpp"
 #include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/game_setup.hpp"
@@ -33,9 +34,13 @@
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <algorithm>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol;
 // ============================================================================
@@ -57,7 +62,7 @@ GameProtocol::GameProtocol()
             : Protocol( PROTOCOL_CONTROLLER_EVENTS)
 {
     m_data_to_send = getNetworkString();
-
+    m_sent_state_count = 0;
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -66,6 +71,29 @@ GameProtocol::~GameProtocol()
     delete m_data_to_send;
 }   // ~GameProtocol
 
+//-----------------------------------------------------------------------------
+/** Adds the value of a compressed action. Digital input only uses 0 and
+ *  Input::MAX_VALUE, which need 2 bits, all other values need 16 bits.
+ */
+static void addActionValue(BitStreamWriter* writer, uint16_t value)
+{
+    const bool digital = value == 0 || value == Input::MAX_VALUE;
+    writer->addBool(digital);
+    if (digital)
+        writer->addBool(value != 0);
+    else
+        writer->addBits(value, 15);
+}   // addActionValue
+
+//-----------------------------------------------------------------------------
+/** Reads a value written by addActionValue. */
+static uint16_t getActionValue(BitStreamReader* reader)
+{
+    if (reader->getBool())
+        return reader->getBool() ? Input::MAX_VALUE : 0;
+    return (uint16_t)reader->getBits(15);
+}   // getActionValue
+
 //-----------------------------------------------------------------------------
 /** Synchronous update - will send all commands collected during the last
  *  frame (and could optional only send messages every N frames).
@@ -86,7 +114,10 @@ void GameProtocol::sendActions()
     m_data_to_send->addUInt8(GP_CONTROLLER_ACTION)
                    .addUInt8(uint8_t(m_all_actions.size()));
 
-    // Add all actions
+    // Add all actions, the time of each action is relative to the previous
+    // one (the first one is relative to 0)
+    BitStreamWriter writer(m_data_to_send);
+    int previous_ticks = 0;
     for (auto& a : m_all_actions)
     {
         if (Network::m_connection_debug)
@@ -96,18 +127,46 @@ void GameProtocol::sendActions()
                 a.m_ticks, a.m_kart_id, a.m_action, a.m_value, a.m_value_l,
                 a.m_value_r);
         }
-        m_data_to_send->addUInt32(a.m_ticks);
-        m_data_to_send->addUInt8(a.m_kart_id);
-        const auto& c = compressAction(a);
-        m_data_to_send->addUInt8(std::get<0>(c)).addUInt16(std::get<1>(c))
-            .addUInt16(std::get<2>(c)).addUInt16(std::get<3>(c));
+        addControllerAction(&writer, previous_ticks, a.m_ticks, a.m_kart_id,
+            a.m_action, a.m_value, a.m_value_l, a.m_value_r);
+        previous_ticks = a.m_ticks;
     }   // for a in m_all_actions
+    writer.flush();
 
     // FIXME: for now send reliable
     sendToServer(m_data_to_send, /*reliable*/ true);
     m_all_actions.clear();
 }   // sendActions
 
+//-----------------------------------------------------------------------------
+/** Adds one controller action to a GP_CONTROLLER_ACTION message (after the
+ *  number of actions).
+ *  \param writer The writer for the message.
+ *  \param previous_ticks Time of the previous action in the message, or 0
+ *         for the first one.
+ *  \param ticks Time of this action.
+ */
+void GameProtocol::addControllerAction(BitStreamWriter* writer,
+                                       int previous_ticks, int ticks,
+                                       int kart_id, PlayerAction action,
+                                       int value, int value_l, int value_r)
+{
+    Action a;
+    a.m_ticks   = ticks;
+    a.m_kart_id = kart_id;
+    a.m_action  = action;
+    a.m_value   = value;
+    a.m_value_l = value_l;
+    a.m_value_r = value_r;
+    writer->addTicks(ticks, previous_ticks);
+    writer->addVarUInt(kart_id);
+    const auto& c = compressAction(a);
+    writer->addBits(std::get<0>(c), 8);
+    addActionValue(writer, std::get<1>(c));
+    addActionValue(writer, std::get<2>(c));
+    addActionValue(writer, std::get<3>(c));
+}   // addControllerAction
+
 //-----------------------------------------------------------------------------
 /** Called when a message from a remote GameProtocol is received.
  */
@@ -127,6 +186,8 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
     case GP_ADJUST_TIME:       handleAdjustTime(event);       break;
+    case GP_DELTA_STATE:       handleDeltaState(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
     //case GP_ITEM_UPDATE:       handleItemUpdate(event);       break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     default: Log::error("GameProtocol",
@@ -188,9 +249,10 @@ void GameProtocol::handleControllerAction(Event *event)
     //int rewind_delta = 0;
     int cur_ticks = 0;
     const int not_rewound = RewindManager::get()->getNotRewoundWorldTicks();
+    BitStreamReader reader(&data);
     for (unsigned int i = 0; i < count; i++)
     {
-        cur_ticks = data.getUInt32();
+        cur_ticks = reader.getTicks(cur_ticks);
         // Since this is running in a thread, it might be called during
         // a rewind, i.e. with an incorrect world time. So the event
         // time needs to be compared with the World time independent
@@ -200,7 +262,7 @@ void GameProtocol::handleControllerAction(Event *event)
             will_trigger_rewind = true;
             //rewind_delta = not_rewound - cur_ticks;
         }
-        uint8_t kart_id = data.getUInt8();
+        uint8_t kart_id = (uint8_t)reader.getVarUInt();
         if (NetworkConfig::get()->isServer() &&
             !peer->availableKartID(kart_id))
         {
@@ -209,10 +271,10 @@ void GameProtocol::handleControllerAction(Event *event)
             return;
         }
 
-        uint8_t w = data.getUInt8();
-        uint16_t x = data.getUInt16();
-        uint16_t y = data.getUInt16();
-        uint16_t z = data.getUInt16();
+        uint8_t w = (uint8_t)reader.getBits(8);
+        uint16_t x = getActionValue(&reader);
+        uint16_t y = getActionValue(&reader);
+        uint16_t z = getActionValue(&reader);
         if (Network::m_connection_debug)
         {
             const auto& a = decompressAction(w, x, y, z);
@@ -239,6 +301,8 @@ void GameProtocol::handleControllerAction(Event *event)
         peer->updateLastActivity();
         if (!will_trigger_rewind)
             STKHost::get()->sendPacketExcept(peer, &data, false);
+        else
+            peer->addLateAction();
 
         // FIXME unless there is a network jitter more than 100ms (more than
         // server delay), time adjust is not necessary
@@ -390,14 +454,197 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
 
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
- *  can be sent to the clients.
+ *  can be sent to the clients. Karts which are not relevant for a client
+ *  (see StateRelevance) are left out of its state, and clients with a bad
+ *  connection only get some states (see STKPeer::updateStateInterval).
+ *  Each client which has acknowledged a state that is still kept as
+ *  baseline gets the state delta encoded against that baseline, all other
+ *  clients get the full state.
  */
 void GameProtocol::sendState()
 {
+    TickProfiler::Scope tick_profiler(TickProfiler::TS_SEND_STATE);
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    const auto& buffer = m_data_to_send->getBuffer();
+    auto& states = m_sent_states[ticks];
+    std::shared_ptr<BareNetworkString> state_buffer =
+        RewindInfoState::createStateBuffer();
+    states[0] = state_buffer;
+    const std::vector<uint8_t>& payload = state_buffer->getBuffer();
+    state_buffer->getBuffer().assign(buffer.begin() + 1/*protocol type*/ +
+        1/*gp event type*/ + 4/*time*/, buffer.end());
+
+    std::map<std::weak_ptr<STKPeer>, int,
+        std::owner_less<std::weak_ptr<STKPeer> > > acks;
+    {
+        std::lock_guard<std::mutex> lock(m_state_acks_mutex);
+        // Forget the acknowledgements of disconnected peers
+        for (auto it = m_state_acks.begin(); it != m_state_acks.end();)
+        {
+            if (it->first.expired())
+                it = m_state_acks.erase(it);
+            else
+                it++;
+        }
+        acks = m_state_acks;
+    }
+
+    // Peers which get the same karts share one full state, and peers which
+    // also acknowledged the same state share one delta state, which are
+    // sent to all of them at once
+    std::map<uint64_t, NetworkString*> full_states;
+    full_states[0] = m_data_to_send;
+    std::map<std::tuple<int, uint64_t, uint64_t>, NetworkString*>
+        delta_states;
+    std::map<NetworkString*, std::vector<STKPeer*> > recipients;
+    auto peers = STKHost::get()->getPeers();
+    for (auto& peer : peers)
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        // Peers with a bad connection only get every n-th state
+        if ((m_sent_state_count + peer->getHostId()) %
+            peer->getStateInterval() != 0)
+            continue;
+        const uint64_t mask =
+            m_state_relevance.getSkippedKarts(peer->getAvailableKartIDs());
+        std::shared_ptr<BareNetworkString>& filtered = states[mask];
+        NetworkString*& state = full_states[mask];
+        if (!state)
+        {
+            filtered = RewindInfoState::createStateBuffer();
+            filterState(payload, mask, &filtered->getBuffer());
+            state = getNetworkString();
+            state->addUInt8(GP_STATE).addUInt32(ticks);
+            state->getBuffer().insert(state->getBuffer().end(),
+                filtered->getBuffer().begin(), filtered->getBuffer().end());
+        }
+        auto& sent_masks = m_sent_masks[peer];
+        sent_masks[ticks] = mask;
+
+        NetworkString* send = state;
+        auto ack = acks.find(peer);
+        if (ack != acks.end() && ack->second < ticks &&
+            sent_masks.find(ack->second) != sent_masks.end() &&
+            m_sent_states.find(ack->second) != m_sent_states.end())
+        {
+            const uint64_t ack_mask = sent_masks[ack->second];
+            auto& baselines = m_sent_states[ack->second];
+            auto baseline = baselines.find(ack_mask);
+            if (baseline != baselines.end())
+            {
+                NetworkString*& delta = delta_states[std::make_tuple(
+                    ack->second, ack_mask, mask)];
+                if (!delta)
+                {
+                    delta = getNetworkString();
+                    delta->addUInt8(GP_DELTA_STATE).addUInt32(ticks)
+                        .addUInt32(ack->second);
+                    encodeStateDelta(filtered->getBuffer(),
+                                     baseline->second->getBuffer(), delta);
+                }
+                if (delta->getTotalSize() < state->getTotalSize())
+                    send = delta;
+            }
+        }
+        recipients[send].push_back(peer.get());
+    }
+    for (auto& r : recipients)
+    {
+        STKHost::get()->sendPacketToPeers(r.second, r.first,
+            /*reliable*/false);
+    }
+    for (auto& delta : delta_states)
+        delete delta.second;
+    for (auto& state : full_states)
+    {
+        if (state.second != m_data_to_send)
+            delete state.second;
+    }
+
+    while (m_sent_states.size() > MAX_DELTA_BASELINES)
+        m_sent_states.erase(m_sent_states.begin());
+    const int oldest_ticks = m_sent_states.begin()->first;
+    for (auto it = m_sent_masks.begin(); it != m_sent_masks.end();)
+    {
+        if (it->first.expired())
+        {
+            it = m_sent_masks.erase(it);
+            continue;
+        }
+        // A peer only acknowledges newer states, so states before its
+        // acknowledged state can't be its baseline anymore
+        int oldest_baseline = oldest_ticks;
+        auto ack = acks.find(it->first);
+        if (ack != acks.end())
+            oldest_baseline = std::max(oldest_baseline, ack->second);
+        it->second.erase(it->second.begin(),
+            it->second.lower_bound(oldest_baseline));
+        it++;
+    }
+    m_state_relevance.nextState();
+    m_sent_state_count++;
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Removes the data of karts from a state payload (see finalizeState), which
+ *  is replaced by an empty block. The names of all rewinders are kept, so a
+ *  client restores the missing karts from its own prediction instead of
+ *  treating them as disconnected.
+ *  \param state The full state payload.
+ *  \param skipped_karts Bit mask of the world kart ids to leave out.
+ *  \param result The filtered state payload.
+ */
+void GameProtocol::filterState(const std::vector<uint8_t>& state,
+                               uint64_t skipped_karts,
+                               std::vector<uint8_t>* result)
+{
+    if (skipped_karts == 0 || state.empty())
+    {
+        *result = state;
+        return;
+    }
+    result->clear();
+    result->reserve(state.size());
+    const size_t num_names = state[0];
+    size_t offset = 1;
+    std::vector<bool> skipped(num_names, false);
+    for (size_t i = 0; i < num_names && offset < state.size(); i++)
+    {
+        const size_t length = state[offset];
+        // Kart rewinders are called "K" followed by the world kart id
+        if (length > 1 && offset + 1 + length <= state.size() &&
+            state[offset + 1] == 'K')
+        {
+            std::string id(state.begin() + offset + 2,
+                           state.begin() + offset + 1 + length);
+            unsigned kart_id = 0;
+            if (StringUtils::fromString(id, kart_id) && kart_id < 64)
+                skipped[i] = (skipped_karts >> kart_id & 1) != 0;
+        }
+        offset += 1 + length;
+    }
+    offset = std::min(offset, state.size());
+    result->insert(result->end(), state.begin(), state.begin() + offset);
+    for (size_t i = 0; i < num_names && offset + 2 <= state.size(); i++)
+    {
+        const size_t size = state[offset] << 8 | state[offset + 1];
+        const size_t end = std::min(offset + 2 + size, state.size());
+        if (skipped[i])
+        {
+            result->push_back(0);
+            result->push_back(0);
+        }
+        else
+        {
+            result->insert(result->end(), state.begin() + offset,
+                           state.begin() + end);
+        }
+        offset = end;
+    }
+}   // filterState
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -406,22 +653,203 @@ void GameProtocol::handleState(Event *event)
     assert(NetworkConfig::get()->isClient());
     NetworkString &data = event->data();
     int ticks          = data.getUInt32();
+    std::shared_ptr<BareNetworkString> payload =
+        RewindInfoState::createStateBuffer();
+    payload->getBuffer().assign(data.getBuffer().begin() +
+        data.getCurrentOffset(), data.getBuffer().end());
+    addStateToRewindManager(ticks, payload);
+}   // handleState
+
+// ----------------------------------------------------------------------------
+/** Called when a state delta encoded against a previously received state
+ *  is received from the server. If that baseline is not available anymore
+ *  the state is ignored, and the server will send a full state again once
+ *  the baseline is too old.
+ */
+void GameProtocol::handleDeltaState(Event *event)
+{
+    assert(NetworkConfig::get()->isClient());
+    NetworkString &data = event->data();
+    int ticks          = data.getUInt32();
+    int baseline_ticks = data.getUInt32();
+    auto baseline = m_state_baselines.find(baseline_ticks);
+    std::shared_ptr<BareNetworkString> payload =
+        RewindInfoState::createStateBuffer();
+    if (baseline == m_state_baselines.end() ||
+        !decodeStateDelta(data, baseline->second->getBuffer(),
+                          &payload->getBuffer()))
+    {
+        Log::warn("GameProtocol", "Can't decode state at %d with baseline "
+            "%d, ignored.", ticks, baseline_ticks);
+        return;
+    }
+    addStateToRewindManager(ticks, payload);
+}   // handleDeltaState
+
+// ----------------------------------------------------------------------------
+/** Keeps a (full) state received from the server as baseline for later delta
+ *  states, acknowledges it to the server and hands it to the rewind manager.
+ *  \param ticks Time of the state.
+ *  \param payload The state content, shared by the baseline and the rewind
+ *         info, so its bytes must not be modified anymore. The rewind info
+ *         uses the read offset after this function returns.
+ */
+void GameProtocol::addStateToRewindManager(int ticks,
+                                   std::shared_ptr<BareNetworkString> payload)
+{
+    m_state_baselines[ticks] = payload;
+    // Keep more baselines than the server, so any baseline the server still
+    // uses is available as long as states are not reordered too much
+    while (m_state_baselines.size() > 2 * MAX_DELTA_BASELINES)
+        m_state_baselines.erase(m_state_baselines.begin());
+
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // Unreliable, the next state will be acknowledged anyway
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
 
     // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
+    unsigned rewinder_size = payload->getUInt8();
     std::vector<std::string> rewinder_using;
     for (unsigned i = 0; i < rewinder_size; i++)
     {
         std::string name;
-        data.decodeString(&name);
+        payload->decodeString(&name);
         rewinder_using.push_back(name);
     }
+    const int start_offset = payload->getCurrentOffset();
+    payload->reset();
 
-    // The memory for bns will be handled in the RewindInfoState object
-    RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
-        rewinder_using, data.getBuffer());
+    RewindInfoState* ris = new RewindInfoState(ticks, start_offset,
+        rewinder_using, payload);
     RewindManager::get()->addNetworkRewindInfo(ris);
-}   // handleState
+}   // addStateToRewindManager
+
+// ----------------------------------------------------------------------------
+/** Called on the server when a client acknowledges a state, which can then
+ *  be used as baseline for states sent to that client.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    assert(NetworkConfig::get()->isServer());
+    int ticks = event->data().getUInt32();
+    std::lock_guard<std::mutex> lock(m_state_acks_mutex);
+    auto& ack = m_state_acks[event->getPeerSP()];
+    if (ticks > ack)
+        ack = ticks;
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Adds a variable length unsigned integer, 7 bits per byte. */
+static void addVarUInt(BareNetworkString* out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out->addUInt8(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out->addUInt8(uint8_t(value));
+}   // addVarUInt
+
+// ----------------------------------------------------------------------------
+/** Reads a variable length unsigned integer written by addVarUInt. Returns
+ *  false if the data is truncated or invalid. */
+static bool getVarUInt(const BareNetworkString& in, uint32_t* value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 7)
+    {
+        if (in.size() == 0)
+            return false;
+        uint8_t b = in.getUInt8();
+        *value |= uint32_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}   // getVarUInt
+
+// ----------------------------------------------------------------------------
+/** Encodes a state as difference to a baseline state. The state is xor'ed
+ *  with the baseline (bytes past the end of the baseline count as 0), then
+ *  written as alternating runs of unchanged and changed bytes: the length of
+ *  each run as variable length integer, followed by the xor'ed bytes for
+ *  changed runs. Most of a state (items, static karts, unchanged fields of
+ *  moving karts) is identical between two states, so this is much smaller
+ *  than the full state.
+ *  \param state The state to encode.
+ *  \param baseline The state the receiver already has.
+ *  \param out The encoded data is appended here.
+ */
+void GameProtocol::encodeStateDelta(const std::vector<uint8_t>& state,
+                                    const std::vector<uint8_t>& baseline,
+                                    BareNetworkString* out)
+{
+    auto base = [&baseline](size_t i) -> uint8_t
+        { return i < baseline.size() ? baseline[i] : 0; };
+    const size_t n = state.size();
+    out->addUInt32((uint32_t)n);
+    size_t i = 0;
+    while (i < n)
+    {
+        const size_t same_start = i;
+        while (i < n && state[i] == base(i))
+            i++;
+        addVarUInt(out, (uint32_t)(i - same_start));
+        if (i == n)
+            break;
+        // A single unchanged byte costs more as separate run than as part
+        // of the changed bytes
+        const size_t changed_start = i;
+        while (i < n && !(state[i] == base(i) &&
+               (i + 1 == n || state[i + 1] == base(i + 1))))
+            i++;
+        addVarUInt(out, (uint32_t)(i - changed_start));
+        for (size_t j = changed_start; j < i; j++)
+            out->addUInt8(state[j] ^ base(j));
+    }
+}   // encodeStateDelta
+
+// ----------------------------------------------------------------------------
+/** Decodes a state encoded with encodeStateDelta.
+ *  \param in The encoded data, all remaining data must belong to the state.
+ *  \param baseline The baseline used when encoding.
+ *  \param state On return the decoded state.
+ *  \return False if the data is invalid.
+ */
+bool GameProtocol::decodeStateDelta(const BareNetworkString& in,
+                                    const std::vector<uint8_t>& baseline,
+                                    std::vector<uint8_t>* state)
+{
+    auto base = [&baseline](size_t i) -> uint8_t
+        { return i < baseline.size() ? baseline[i] : 0; };
+    if (in.size() < 4)
+        return false;
+    const uint32_t n = in.getUInt32();
+    // Don't allocate absurd amounts of memory for corrupted data
+    if (n > 32 * 1024 * 1024)
+        return false;
+    state->resize(n);
+    uint32_t i = 0;
+    while (i < n)
+    {
+        uint32_t same = 0;
+        if (!getVarUInt(in, &same) || same > n - i)
+            return false;
+        for (uint32_t j = 0; j < same; j++, i++)
+            (*state)[i] = base(i);
+        if (i == n)
+            break;
+        uint32_t changed = 0;
+        if (!getVarUInt(in, &changed) || changed == 0 || changed > n - i ||
+            changed > in.size())
+            return false;
+        for (uint32_t j = 0; j < changed; j++, i++)
+            (*state)[i] = in.getUInt8() ^ base(i);
+    }
+    return in.size() == 0;
+}   // decodeStateDelta
 
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
@@ -462,3 +890,69 @@ void GameProtocol::addInitialTicks(STKPeer* p, int ticks)
         p->getHostId(), ticks);
     m_initial_ticks[p] = ticks;
 }   // addInitialTicks
+
+// ----------------------------------------------------------------------------
+/** Tests encoding and decoding of delta states. */
+void GameProtocol::unitTesting()
+{
+    std::vector<uint8_t> baseline = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+    // Identical state only needs the size and one run
+    BareNetworkString same;
+    encodeStateDelta(baseline, baseline, &same);
+    assert(same.size() == 5);
+    std::vector<uint8_t> result;
+    bool ok = decodeStateDelta(same, baseline, &result);
+    assert(ok);
+    assert(result == baseline);
+
+    // Changed, longer and shorter states, and an empty baseline
+    std::vector<std::vector<uint8_t> > states =
+    {
+        { 1, 2, 0, 4, 5, 6, 7, 0, 0, 10 },
+        { 9, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 },
+        { 1, 2, 3 },
+        { },
+    };
+    std::vector<uint8_t> empty;
+    for (auto& state : states)
+    {
+        for (auto* base : { &baseline, &empty })
+        {
+            BareNetworkString delta;
+            encodeStateDelta(state, *base, &delta);
+            result.clear();
+            ok = decodeStateDelta(delta, *base, &result);
+            assert(ok);
+            assert(result == state);
+        }
+    }
+
+    // Long runs need more than one byte for their length
+    std::vector<uint8_t> big_baseline(1000, 7);
+    std::vector<uint8_t> big_state = big_baseline;
+    big_state[500] = 3;
+    BareNetworkString big_delta;
+    encodeStateDelta(big_state, big_baseline, &big_delta);
+    assert(big_delta.size() < 16);
+    ok = decodeStateDelta(big_delta, big_baseline, &result);
+    assert(ok);
+    assert(result == big_state);
+
+    // Truncated data must be rejected
+    BareNetworkString truncated(big_delta.getData(),
+                                big_delta.getTotalSize() - 1);
+    ok = decodeStateDelta(truncated, big_baseline, &result);
+    assert(!ok);
+
+    // Filtering karts keeps all names and leaves an empty block for them
+    std::vector<uint8_t> state = { 3, 2, 'K', '0', 2, 'K', '1', 1, 'I',
+                                   0, 2, 5, 6, 0, 1, 7, 0, 1, 8 };
+    filterState(state, 0, &result);
+    assert(result == state);
+    filterState(state, 2, &result);
+    std::vector<uint8_t> filtered = { 3, 2, 'K', '0', 2, 'K', '1', 1, 'I',
+                                      0, 2, 5, 6, 0, 0, 0, 1, 8 };
+    assert(result == filtered);
+    (void)ok;   // avoid warning about unused variable
+}   // unitTesting
@@ -21,6 +21,7 @@
 
 #include "network/event_rewinder.hpp"
 #include "network/protocol.hpp"
+#include "network/state_relevance.hpp"
 
 #include "input/input.hpp"                // for PlayerAction
 #include "utils/cpp2011.hpp"
@@ -28,11 +29,13 @@
 
 #include <cstdlib>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include <tuple>
 
 class BareNetworkString;
+class BitStreamWriter;
 class NetworkString;
 class STKPeer;
 
@@ -44,13 +47,40 @@ private:
      * asynchronous event update. */
     mutable std::mutex m_world_deleting_mutex;
 
-    /** The type of game events to be forwarded to the server. */
-    enum { GP_CONTROLLER_ACTION,
-           GP_STATE,
-           GP_ITEM_UPDATE,
-           GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
-    };
+    /** How many states sent (server) or received (client) are kept as
+     *  baselines for delta encoded states. */
+    static const unsigned MAX_DELTA_BASELINES = 16;
+
+    /** Client: the state payloads (everything after GP_STATE and ticks) of
+     *  the last states received, indexed by ticks. Only used from the
+     *  network thread. The buffers are shared with the RewindInfoState of
+     *  the same state. */
+    std::map<int, std::shared_ptr<BareNetworkString> > m_state_baselines;
+
+    /** Server: the state payloads of the last states sent, indexed by ticks
+     *  and by the mask of karts left out for the receiving peers (see
+     *  StateRelevance). Only used from main thread. */
+    std::map<int, std::map<uint64_t, std::shared_ptr<BareNetworkString> > >
+        m_sent_states;
+
+    /** Server: the mask of karts left out of each state in m_sent_states
+     *  sent to a peer, so a delta is encoded against exactly the state the
+     *  peer has acknowledged. */
+    std::map<std::weak_ptr<STKPeer>, std::map<int, uint64_t>,
+        std::owner_less<std::weak_ptr<STKPeer> > > m_sent_masks;
+
+    /** Server: decides which karts are left out of the state for a peer. */
+    StateRelevance m_state_relevance;
+
+    /** Server: number of states sent so far. */
+    unsigned m_sent_state_count;
+
+    /** Server: the latest state ticks each peer has acknowledged. */
+    std::map<std::weak_ptr<STKPeer>, int,
+        std::owner_less<std::weak_ptr<STKPeer> > > m_state_acks;
+
+    /** Protects m_state_acks, which is updated in the network thread. */
+    std::mutex m_state_acks_mutex;
 
     /** A network string that collects all information from the server to be sent
      *  next. */
@@ -76,13 +106,17 @@ private:
 
     void handleControllerAction(Event *event);
     void handleState(Event *event);
+    void handleDeltaState(Event *event);
+    void handleStateAck(Event *event);
+    void addStateToRewindManager(int ticks,
+                                 std::shared_ptr<BareNetworkString> payload);
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
     static std::weak_ptr<GameProtocol> m_game_protocol;
     std::map<STKPeer*, int> m_initial_ticks;
     std::map<STKPeer*, double> m_last_adjustments;
     // Maximum value of values are only 32768
-    std::tuple<uint8_t, uint16_t, uint16_t, uint16_t>
+    static std::tuple<uint8_t, uint16_t, uint16_t, uint16_t>
                                                 compressAction(const Action& a)
     {
         uint8_t w = (uint8_t)(a.m_action & 63) |
@@ -104,6 +138,16 @@ private:
         return std::make_tuple(a, b, c, d);
     }
 public:
+    /** The type of game events to be forwarded to the server. */
+    enum { GP_CONTROLLER_ACTION,
+           GP_STATE,
+           GP_ITEM_UPDATE,
+           GP_ITEM_CONFIRMATION,
+           GP_ADJUST_TIME,
+           GP_DELTA_STATE,
+           GP_STATE_ACK
+    };
+
              GameProtocol();
     virtual ~GameProtocol();
 
@@ -117,6 +161,25 @@ public:
     void sendState();
     void finalizeState(std::vector<std::string>& cur_rewinder);
     void adjustTimeForClient(STKPeer *peer, int ticks);
+    // ------------------------------------------------------------------------
+    static void encodeStateDelta(const std::vector<uint8_t>& state,
+                                 const std::vector<uint8_t>& baseline,
+                                 BareNetworkString* out);
+    // ------------------------------------------------------------------------
+    static bool decodeStateDelta(const BareNetworkString& in,
+                                 const std::vector<uint8_t>& baseline,
+                                 std::vector<uint8_t>* state);
+    // ------------------------------------------------------------------------
+    static void addControllerAction(BitStreamWriter* writer,
+                                    int previous_ticks, int ticks,
+                                    int kart_id, PlayerAction action,
+                                    int value, int value_l, int value_r);
+    // ------------------------------------------------------------------------
+    static void filterState(const std::vector<uint8_t>& state,
+                            uint64_t skipped_karts,
+                            std::vector<uint8_t>* result);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
     void sendItemEventConfirmation(int ticks);
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
@@ -141,6 +204,8 @@ public:
     /** Returns the NetworkString in which a state was saved. */
     NetworkString* getState() const { return m_data_to_send;  }
     // ------------------------------------------------------------------------
+    StateRelevance& getStateRelevance()          { return m_state_relevance; }
+    // ------------------------------------------------------------------------
     void addInitialTicks(STKPeer* p, int ticks);
     // ------------------------------------------------------------------------
     std::unique_lock<std::mutex> acquireWorldDeletingMutex() const
@@ -73,7 +73,8 @@ public:
         LE_LIVE_JOIN, // Client live join or spectate
         LE_LIVE_JOIN_ACK, // Server tell client live join or spectate succeed
         LE_KART_INFO, // Client or server exchange new kart info
-        LE_CLIENT_BACK_LOBBY // Client tell server to go back lobby
+        LE_CLIENT_BACK_LOBBY, // Client tell server to go back lobby
+        LE_LIVE_JOIN_STATE // Server sends part of the complete state
     };
 
     enum RejectReason : uint8_t
@@ -220,6 +221,9 @@ public:
     // ------------------------------------------------------------------------
     void storePlayingTrack(int track_id)   { m_current_track.store(track_id); }
     // ------------------------------------------------------------------------
+    /** Returns the index of the playing track, or -1 if none. */
+    int getCurrentTrackIndex() const         { return m_current_track.load(); }
+    // ------------------------------------------------------------------------
     Track* getPlayingTrack() const;
 };   // class LobbyProtocol
 
@@ -27,17 +27,20 @@
 #include "karts/kart_properties_manager.hpp"
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
+#include "network/chunked_state.hpp"
 #include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
+#include "network/network_recorder.hpp"
 #include "network/peer_vote.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/protocols/connect_to_peer.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/race_event_manager.hpp"
+#include "network/ranking_worker.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
@@ -50,6 +53,7 @@
 #include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
 #include "utils/random_generator.hpp"
+#include "utils/tick_profiler.hpp"
 #include "utils/time.hpp"
 
 #include <algorithm>
@@ -123,6 +127,7 @@ ServerLobby::ServerLobby() : LobbyProtocol(NULL)
 
     m_last_success_poll_time.store(StkTime::getRealTimeMs() + 30000);
     m_server_owner_id.store(-1);
+    m_evicted_connections.store(0);
     m_registered_for_once_only = false;
     m_has_created_server_id_file = false;
     setHandleDisconnections(true);
@@ -945,19 +950,26 @@ void ServerLobby::finishedLoadingLiveJoinClient(Event* event)
         spectator = true;
     }
 
-    NetworkString* ns = getNetworkString(10);
-    ns->setSynchronous(true);
-    ns->addUInt8(LE_LIVE_JOIN_ACK).addUInt64(m_client_starting_time)
-        .addUInt64(live_join_start_time)
-        .addUInt32(m_last_live_join_util_ticks);
-
     NetworkItemManager* nim =
         dynamic_cast<NetworkItemManager*>(ItemManager::get());
     assert(nim);
-    nim->saveCompleteState(ns);
+    BareNetworkString state;
+    nim->saveCompleteState(&state);
     nim->addLiveJoinPeer(peer);
+    w->saveCompleteState(&state);
+
+    // The complete state can be large on tracks with many items, so it is
+    // sent compressed in chunks during the next ticks, see sendLiveJoinStates
+    ChunkedState* chunked_state = new ChunkedState(state);
+    m_live_join_states[peer].reset(chunked_state);
 
-    w->saveCompleteState(ns);
+    NetworkString* ns = getNetworkString(16);
+    ns->setSynchronous(true);
+    ns->addUInt8(LE_LIVE_JOIN_ACK).addUInt64(m_client_starting_time)
+        .addUInt64(live_join_start_time)
+        .addUInt32(m_last_live_join_util_ticks)
+        .addUInt32(chunked_state->getSize())
+        .addUInt16((uint16_t)chunked_state->getChunkCount());
 
     m_peers_ready[peer] = false;
     peer->setWaitingForGame(false);
@@ -969,6 +981,52 @@ void ServerLobby::finishedLoadingLiveJoinClient(Event* event)
     peer->updateLastActivity();
 }   // finishedLoadingLiveJoinClient
 
+//-----------------------------------------------------------------------------
+/** Sends the next chunks of the complete states to live joining peers. Only
+ *  a few chunks are sent per tick (less to peers with a reduced state rate),
+ *  so the transfer does not cause bursts which delay the other peers.
+ */
+void ServerLobby::sendLiveJoinStates()
+{
+    World* w = World::getWorld();
+    for (auto it = m_live_join_states.begin();
+         it != m_live_join_states.end();)
+    {
+        std::shared_ptr<STKPeer> peer = it->first.lock();
+        if (!w || !peer)
+        {
+            it = m_live_join_states.erase(it);
+            continue;
+        }
+        ChunkedState* chunked_state = it->second.get();
+        if (w->getTicksSinceStart() % peer->getStateInterval() == 0)
+        {
+            for (unsigned i = 0; i < LIVE_JOIN_CHUNKS_PER_TICK &&
+                 !chunked_state->isComplete(); i++)
+            {
+                NetworkString* ns =
+                    getNetworkString(ChunkedState::CHUNK_SIZE + 3);
+                ns->setSynchronous(true);
+                ns->addUInt8(LE_LIVE_JOIN_STATE);
+                chunked_state->addNextChunk(ns);
+                peer->sendPacket(ns, true/*reliable*/);
+                delete ns;
+            }
+        }
+        if (chunked_state->isComplete())
+        {
+            Log::info("ServerLobby", "Sent complete state of %d bytes (%d "
+                "compressed) in %d chunks to %s.", chunked_state->getSize(),
+                (int)chunked_state->getCompressedSize(),
+                chunked_state->getChunkCount(),
+                peer->getAddress().toString().c_str());
+            it = m_live_join_states.erase(it);
+        }
+        else
+            it++;
+    }
+}   // sendLiveJoinStates
+
 //-----------------------------------------------------------------------------
 /** Simple finite state machine.  Once this
  *  is known, register the server and its address with the stk server so that
@@ -976,6 +1034,9 @@ void ServerLobby::finishedLoadingLiveJoinClient(Event* event)
  */
 void ServerLobby::update(int ticks)
 {
+    TickProfiler::Scope tick_profiler(TickProfiler::TS_SERVER_LOBBY);
+    if (!m_live_join_states.empty())
+        sendLiveJoinStates();
     World* w = World::getWorld();
     bool world_started = m_state.load() >= WAIT_FOR_WORLD_LOADED &&
         m_state.load() <= RACING && m_server_has_loaded_world.load();
@@ -1644,262 +1705,41 @@ void ServerLobby::checkRaceFinished()
         m_result_ns->addUInt32(fastest_lap);
     }
     if (ServerConfig::m_ranked)
-    {
         computeNewRankings();
-        submitRankingsToAddons();
-    }
     m_state.store(WAIT_FOR_RACE_STOPPED);
 }   // checkRaceFinished
 
 //-----------------------------------------------------------------------------
-/** Compute the new player's rankings used in ranked servers
+/** Queues computing and submitting the new player's rankings used in ranked
+ *  servers, which is done by the ranking worker.
  */
 void ServerLobby::computeNewRankings()
 {
     // No ranking for battle mode
-    if (!race_manager->modeHasLaps())
+    if (!race_manager->modeHasLaps() || !m_ranking_worker)
         return;
 
-    // Using a vector of vector, it would be possible to fill
-    // all j < i v[i][j] with -v[j][i]
-    // Would this be worth it ?
-    std::vector<double> scores_change;
-    std::vector<double> new_scores;
-
-    unsigned player_count = race_manager->getNumPlayers();
-    for (unsigned i = 0; i < player_count; i++)
-    {
-        const uint32_t id = race_manager->getKartInfo(i).getOnlineId();
-        new_scores.push_back(m_scores.at(id));
-        new_scores[i] += distributeBasePoints(id);
-    }
- 
-    // First, update the number of ranked races
-    for (unsigned i = 0; i < player_count; i++)
-    {
-         const uint32_t id = race_manager->getKartInfo(i).getOnlineId();
-         m_num_ranked_races.at(id)++;
-    }
-
-    // Now compute points exchanges
-    for (unsigned i = 0; i < player_count; i++)
+    World* w = World::getWorld();
+    assert(w);
+    std::vector<RankingWorker::RaceResult> results;
+    for (unsigned i = 0; i < race_manager->getNumPlayers(); i++)
     {
-        scores_change.push_back(0.0);
-
-        World* w = World::getWorld();
-        assert(w);
-        double player1_scores = new_scores[i];
+        RankingWorker::RaceResult result;
+        result.m_online_id = race_manager->getKartInfo(i).getOnlineId();
+        result.m_name = StringUtils::wideToUtf8(
+            race_manager->getKartInfo(i).getPlayerName());
         // If the player has quitted before the race end,
         // the value will be incorrect, but it will not be used
-        double player1_time  = race_manager->getKartRaceTime(i);
-        double player1_factor =
-            computeRankingFactor(race_manager->getKartInfo(i).getOnlineId());
-        double player1_handicap = (   w->getKart(i)->getPerPlayerDifficulty()
-                                   == PLAYER_DIFFICULTY_HANDICAP             ) ? HANDICAP_OFFSET : 0;
-
-        for (unsigned j = 0; j < player_count; j++)
-        {
-            // Don't compare a player with himself
-            if (i == j)
-                continue;
-
-            double result = 0.0;
-            double expected_result = 0.0;
-            double ranking_importance = 0.0;
-            double max_time = 0.0;
-
-            // No change between two quitting players
-            if (w->getKart(i)->isEliminated() &&
-                w->getKart(j)->isEliminated())
-                continue;
-
-            double player2_scores = new_scores[j];
-            double player2_time = race_manager->getKartRaceTime(j);
-            double player2_handicap = (   w->getKart(j)->getPerPlayerDifficulty()
-                                       == PLAYER_DIFFICULTY_HANDICAP             ) ? HANDICAP_OFFSET : 0;
-
-            // Compute the result and race ranking importance
-            double player_factors = std::min(player1_factor,
-                computeRankingFactor(
-                race_manager->getKartInfo(j).getOnlineId()));
-
-            double mode_factor = getModeFactor();
-
-            if (w->getKart(i)->isEliminated())
-            {
-                result = 0.0;
-                player1_time = player2_time; // for getTimeSpread
-                max_time = MAX_SCALING_TIME;
-            }
-            else if (w->getKart(j)->isEliminated())
-            {
-                result = 1.0;
-                player2_time = player1_time;
-                max_time = MAX_SCALING_TIME;
-            }
-            else
-            {
-                // If time difference > 2,5% ; the result is 1 or 0
-                // Otherwise, it is averaged between 0 and 1.
-                if (player1_time <= player2_time)
-                {
-                    result =
-                        (player2_time - player1_time) / (player1_time / 20.0);
-                    result = std::min(1.0, 0.5 + result);
-                }
-                else
-                {
-                    result =
-                        (player1_time - player2_time) / (player2_time / 20.0);
-                    result = std::max(0.0, 0.5 - result);
-                }
-
-                max_time = std::min(std::max(player1_time, player2_time),
-                    MAX_SCALING_TIME);
-            }
-
-            ranking_importance = mode_factor *
-                scalingValueForTime(max_time) * player_factors;
-
-            // Compute the expected result using an ELO-like function
-            double diff = player2_scores - player1_scores;
-
-            if (!w->getKart(i)->isEliminated() && !w->getKart(j)->isEliminated())
-                diff += player1_handicap - player2_handicap;
-
-            double uncertainty = std::max(getUncertaintySpread(race_manager->getKartInfo(i).getOnlineId()),
-                                          getUncertaintySpread(race_manager->getKartInfo(j).getOnlineId()) );
-
-            expected_result = 1.0/ (1.0 + std::pow(10.0,
-                diff / (  BASE_RANKING_POINTS / 2.0
-                        * getModeSpread()
-                        * getTimeSpread(std::min(player1_time, player2_time))
-                        * uncertainty )));
-
-            // Compute the ranking change
-            scores_change[i] +=
-                ranking_importance * (result - expected_result);
-        }
-    }
-
-    // Don't merge it in the main loop as new_scores value are used there
-    for (unsigned i = 0; i < player_count; i++)
-    {
-        new_scores[i] += scores_change[i];
-        const uint32_t id = race_manager->getKartInfo(i).getOnlineId();
-        m_scores.at(id) =  new_scores[i];
-        if (m_scores.at(id) > m_max_scores.at(id))
-            m_max_scores.at(id) = m_scores.at(id);
-    }
+        result.m_time = race_manager->getKartRaceTime(i);
+        result.m_eliminated = w->getKart(i)->isEliminated();
+        result.m_handicap = w->getKart(i)->getPerPlayerDifficulty() ==
+            PLAYER_DIFFICULTY_HANDICAP;
+        results.push_back(result);
+    }
+    m_ranking_worker->addRaceResult(results,
+        race_manager->isTimeTrialMode());
 }   // computeNewRankings
 
-//-----------------------------------------------------------------------------
-/** Compute the ranking factor, used to make top rankings more stable
- *  and to allow new players to faster get to an appropriate ranking
- */
-double ServerLobby::computeRankingFactor(uint32_t online_id)
-{
-    double max_points = m_max_scores.at(online_id);
-    unsigned num_races = m_num_ranked_races.at(online_id);
-
-    if (max_points >= (BASE_RANKING_POINTS * 2.0))
-        return 0.6;
-    else if (max_points >= (BASE_RANKING_POINTS * 1.75) || num_races > 500)
-        return 0.7;
-    else if (max_points >= (BASE_RANKING_POINTS * 1.5) || num_races > 250)
-        return 0.8;
-    else if (max_points >= (BASE_RANKING_POINTS * 1.25) || num_races > 100)
-        return 1.0;
-    // The base ranking points are not distributed all at once
-    // So it's not guaranteed a player reach them
-    else if (max_points >= (BASE_RANKING_POINTS) || num_races > 50)
-        return 1.2;
-    else
-        return 1.5;
-
-}   // computeRankingFactor
-
-//-----------------------------------------------------------------------------
-/** Returns the mode race importance factor,
- *  used to make ranking move slower in more random modes.
- */
-double ServerLobby::getModeFactor()
-{
-    if (race_manager->isTimeTrialMode())
-        return 1.0;
-    return 0.7;
-}   // getModeFactor
-
-//-----------------------------------------------------------------------------
-/** Returns the mode spread factor, used so that a similar difference in
- *  skill will result in a similar ranking difference in more random modes.
- */
-double ServerLobby::getModeSpread()
-{
-    if (race_manager->isTimeTrialMode())
-        return 1.0;
-
-    //TODO: the value used here for normal races is a wild guess.
-    // When hard data to the spread tendencies of time-trial
-    // and normal mode becomes available, update this to make
-    // the spreads more comparable
-    return 1.5;
-}   // getModeSpread
-
-//-----------------------------------------------------------------------------
-/** Returns the time spread factor.
- *  Short races are more random, so the expected result changes depending
- *  on race duration.
- */
-double ServerLobby::getTimeSpread(double time)
-{
-    return sqrt(120.0 / time);
-}   // getTimeSpread
-
-//-----------------------------------------------------------------------------
-/** Returns the uncertainty spread factor.
- *  The ranking of new players is not yet reliable,
- *  so weight the expected results twoards 0.5 by using a > 1 spread
- */
-double ServerLobby::getUncertaintySpread(uint32_t online_id)
-{
-    unsigned num_races  = m_num_ranked_races.at(online_id);
-    if (num_races <= 60)
-        return 0.5 + (4.0/sqrt(num_races+3));
-    else
-        return 1.0;
-}   // getUncertaintySpread
-
-//-----------------------------------------------------------------------------
-/** Compute the scaling value of a given time
- *  This is linear to race duration, getTimeSpread takes care
- *  of expecting a more random result in shorter races.
- */
-double ServerLobby::scalingValueForTime(double time)
-{
-    return time * MAX_POINTS_PER_SECOND;
-}   // scalingValueForTime
-
-//-----------------------------------------------------------------------------
-/** Manages the distribution of the base points.
- *  Gives half of the points progressively
- *  by smaller and smaller chuncks from race 1 to 60.
- *  The race count is incremented after this is called, so num_races
- *  is between 0 and 59.
- *  The first half is distributed when the player enters
- *  for the first time in a ranked server.
- */
-double ServerLobby::distributeBasePoints(uint32_t online_id)
-{
-    unsigned num_races  = m_num_ranked_races.at(online_id);
-    if (num_races < 60)
-    {
-        return BASE_RANKING_POINTS / 8000.0 * std::max((96u - num_races), 41u);
-    }
-    else
-        return 0.0;
-}   // distributeBasePoints
-
 //-----------------------------------------------------------------------------
 /** Called when a client disconnects.
  *  \param event The disconnect event.
@@ -1945,10 +1785,8 @@ void ServerLobby::clearDisconnectedRankedPlayer()
     {
         if (it->second.expired())
         {
-            const uint32_t id = it->first;
-            m_scores.erase(id);
-            m_max_scores.erase(id);
-            m_num_ranked_races.erase(id);
+            if (m_ranking_worker)
+                m_ranking_worker->forgetRanking(it->first);
             it = m_ranked_players.erase(it);
         }
         else
@@ -2147,8 +1985,30 @@ void ServerLobby::connectionRequested(Event* event)
         return;
     }
 
-    if (encrypted_size != 0)
+    if (encrypted_size != 0 && peer->isReplayed())
     {
+        // The keys from the STK server are not available in a replay, the
+        // request is validated with its recorded decrypted content
+        std::string online_name;
+        BareNetworkString request;
+        if (STKHost::get()->getNetworkRecorder()->getValidatedConnection(
+            peer->getReplayedHostId(), &online_name, &request))
+        {
+            handleUnencryptedConnection(peer, request, online_id,
+                StringUtils::utf8ToWide(online_name));
+        }
+        else
+        {
+            Log::warn("ServerLobby", "Replayed connection of %s was not "
+                "validated.", peer->getAddress().toString().c_str());
+        }
+    }
+    else if (encrypted_size != 0)
+    {
+        if (ServerConfig::m_max_pending_connections > 0 &&
+            m_pending_connection.size() >=
+            (unsigned)ServerConfig::m_max_pending_connections)
+            evictPendingConnection();
         m_pending_connection[peer] = std::make_pair(online_id,
             BareNetworkString(data.getCurrentData(), encrypted_size));
     }
@@ -2883,6 +2743,50 @@ void ServerLobby::handlePendingConnection()
     }
 }   // handlePendingConnection
 
+//-----------------------------------------------------------------------------
+/** Removes pending connections of peers which are gone, and if there are
+ *  still too many the oldest one, whose peer is disconnected. This keeps a
+ *  flood of encrypted connection requests from growing the table without
+ *  bound.
+ */
+void ServerLobby::evictPendingConnection()
+{
+    auto oldest = m_pending_connection.end();
+    float oldest_time = -1.0f;
+    for (auto it = m_pending_connection.begin();
+         it != m_pending_connection.end();)
+    {
+        auto peer = it->first.lock();
+        if (!peer)
+        {
+            it = m_pending_connection.erase(it);
+            continue;
+        }
+        if (peer->getConnectedTime() > oldest_time)
+        {
+            oldest_time = peer->getConnectedTime();
+            oldest = it;
+        }
+        it++;
+    }
+    if (oldest == m_pending_connection.end() ||
+        m_pending_connection.size() <
+        (unsigned)ServerConfig::m_max_pending_connections)
+        return;
+
+    auto peer = oldest->first.lock();
+    m_pending_connection.erase(oldest);
+    m_evicted_connections.fetch_add(1);
+    NetworkString* message = getNetworkString(2);
+    message->setSynchronous(true);
+    message->addUInt8(LE_CONNECTION_REFUSED).addUInt8(RR_BUSY);
+    peer->sendPacket(message, true/*reliable*/, false/*encrypted*/);
+    peer->reset();
+    delete message;
+    Log::info("ServerLobby", "Too many pending connections, dropped %s.",
+        peer->getAddress().toString().c_str());
+}   // evictPendingConnection
+
 //-----------------------------------------------------------------------------
 bool ServerLobby::decryptConnectionRequest(std::shared_ptr<STKPeer> peer,
     BareNetworkString& data, const std::string& key, const std::string& iv,
@@ -2892,6 +2796,12 @@ bool ServerLobby::decryptConnectionRequest(std::shared_ptr<STKPeer> peer,
         Crypto::decode64(key), Crypto::decode64(iv)));
     if (crypto->decryptConnectionRequest(data))
     {
+        NetworkRecorder* recorder = STKHost::get()->getNetworkRecorder();
+        if (recorder)
+        {
+            recorder->recordValidatedConnection(peer->getHostId(),
+                StringUtils::wideToUtf8(online_name), data);
+        }
         peer->setCrypto(std::move(crypto));
         std::lock_guard<std::mutex> lock(m_connection_mutex);
         Log::info("ServerLobby", "%s validated",
@@ -2904,95 +2814,17 @@ bool ServerLobby::decryptConnectionRequest(std::shared_ptr<STKPeer> peer,
 }   // decryptConnectionRequest
 
 //-----------------------------------------------------------------------------
+/** Starts fetching the ranking of a player who joined a ranked server, the
+ *  ranking worker does that in its own thread. */
 void ServerLobby::getRankingForPlayer(std::shared_ptr<NetworkPlayerProfile> p)
 {
-    Online::XMLRequest* request = new Online::XMLRequest();
-    NetworkConfig::get()->setUserDetails(request, "get-ranking");
-
+    if (!m_ranking_worker)
+        m_ranking_worker.reset(new RankingWorker());
     const uint32_t id = p->getOnlineId();
-    request->addParameter("id", id);
-    request->executeNow();
-
-    const XMLNode* result = request->getXMLData();
-    std::string rec_success;
-
-    // Default result
-    double score = 2000.0;
-    double max_score = 2000.0;
-    unsigned num_races = 0;
-    if (result->get("success", &rec_success))
-    {
-        if (rec_success == "yes")
-        {
-            result->get("scores", &score);
-            result->get("max-scores", &max_score);
-            result->get("num-races-done", &num_races);
-        }
-        else
-        {
-            Log::error("ServerLobby", "No ranking info found.");
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "No ranking info found.");
-    }
     m_ranked_players[id] = p;
-    m_scores[id] = score;
-    m_max_scores[id] = max_score;
-    m_num_ranked_races[id] = num_races;
-    delete request;
+    m_ranking_worker->fetchRanking(id);
 }   // getRankingForPlayer
 
-//-----------------------------------------------------------------------------
-void ServerLobby::submitRankingsToAddons()
-{
-    // No ranking for battle mode
-    if (!race_manager->modeHasLaps())
-        return;
-
-    // ========================================================================
-    class SumbitRankingRequest : public Online::XMLRequest
-    {
-    public:
-        SumbitRankingRequest(uint32_t online_id, double scores,
-                             double max_scores, unsigned num_races)
-            : XMLRequest(true)
-        {
-            addParameter("id", online_id);
-            addParameter("scores", scores);
-            addParameter("max-scores", max_scores);
-            addParameter("num-races-done", num_races);
-        }
-        virtual void afterOperation()
-        {
-            Online::XMLRequest::afterOperation();
-            const XMLNode* result = getXMLData();
-            std::string rec_success;
-            if (!(result->get("success", &rec_success) &&
-                rec_success == "yes"))
-            {
-                Log::error("ServerLobby", "Failed to submit scores.");
-            }
-        }
-    };   // UpdatePlayerRankingRequest
-    // ========================================================================
-
-    for (unsigned i = 0; i < race_manager->getNumPlayers(); i++)
-    {
-        const uint32_t id = race_manager->getKartInfo(i).getOnlineId();
-        SumbitRankingRequest* request = new SumbitRankingRequest
-            (id, m_scores.at(id), m_max_scores.at(id),
-            m_num_ranked_races.at(id));
-        NetworkConfig::get()->setUserDetails(request, "submit-ranking");
-        Log::info("ServerLobby", "Submiting ranking for %s (%d) : %lf, %lf %d",
-            StringUtils::wideToUtf8(
-            race_manager->getKartInfo(i).getPlayerName()).c_str(), id,
-            m_scores.at(id), m_max_scores.at(id), m_num_ranked_races.at(id));
-        request->queue();
-    }
-}   // submitRankingsToAddons
-
 //-----------------------------------------------------------------------------
 /** This function is called when all clients have loaded the world and
  *  are therefore ready to start the race. It determine the start time in
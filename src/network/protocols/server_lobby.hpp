@@ -35,8 +35,10 @@
 #include <tuple>
 
 class BareNetworkString;
+class ChunkedState;
 class NetworkString;
 class NetworkPlayerProfile;
+class RankingWorker;
 class STKPeer;
 
 class ServerLobby : public LobbyProtocol
@@ -97,6 +99,13 @@ private:
     std::map<std::weak_ptr<STKPeer>, bool,
         std::owner_less<std::weak_ptr<STKPeer> > > m_peers_ready;
 
+    /** Complete states which are being sent to live joining peers. */
+    std::map<std::weak_ptr<STKPeer>, std::unique_ptr<ChunkedState>,
+        std::owner_less<std::weak_ptr<STKPeer> > > m_live_join_states;
+
+    /** Number of chunks of a complete state sent per tick to a peer. */
+    static const unsigned LIVE_JOIN_CHUNKS_PER_TICK = 2;
+
     /** It indicates if this server is unregistered with the stk server. */
     std::weak_ptr<bool> m_server_unregistered;
 
@@ -127,26 +136,18 @@ private:
         std::pair<uint32_t, BareNetworkString>,
         std::owner_less<std::weak_ptr<STKPeer> > > m_pending_connection;
 
+    /** Number of pending connections dropped because there were too many
+     *  (see max-pending-connections). */
+    std::atomic<uint32_t> m_evicted_connections;
+
     std::map<std::string, uint64_t> m_pending_peer_connection;
 
     /* Ranking related variables */
-    // If updating the base points, update the base points distribution in DB
-    const double BASE_RANKING_POINTS   = 4000.0;
-    const double MAX_SCALING_TIME      = 500.0;
-    const double MAX_POINTS_PER_SECOND = 0.125;
-    const double HANDICAP_OFFSET       = 1000.0;
-
     /** Online id to profile map, handling disconnection in ranked server */
     std::map<uint32_t, std::weak_ptr<NetworkPlayerProfile> > m_ranked_players;
 
-    /** Multi-session ranking scores for each current player */
-    std::map<uint32_t, double> m_scores;
-
-    /** The maximum ranking scores achieved for each current player */
-    std::map<uint32_t, double> m_max_scores;
-
-    /** Number of ranked races done for each current players */
-    std::map<uint32_t, unsigned> m_num_ranked_races;
+    /** Computes, caches and submits the rankings in ranked servers. */
+    std::unique_ptr<RankingWorker> m_ranking_worker;
 
     NetworkString* m_result_ns;
 
@@ -185,6 +186,7 @@ private:
     bool registerServer(bool now);
     void finishedLoadingWorldClient(Event *event);
     void finishedLoadingLiveJoinClient(Event *event);
+    void sendLiveJoinStates();
     void kickHost(Event* event);
     void changeTeam(Event* event);
     void handleChat(Event* event);
@@ -245,6 +247,7 @@ private:
         std::swap(m_keys, new_keys);
     }
     void handlePendingConnection();
+    void evictPendingConnection();
     void handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
                                      BareNetworkString& data,
                                      uint32_t online_id,
@@ -257,16 +260,8 @@ private:
                                   const irr::core::stringw& online_name);
     bool handleAllVotes(PeerVote* winner, uint32_t* winner_peer_id);
     void getRankingForPlayer(std::shared_ptr<NetworkPlayerProfile> p);
-    void submitRankingsToAddons();
     void computeNewRankings();
     void clearDisconnectedRankedPlayer();
-    double computeRankingFactor(uint32_t online_id);
-    double distributeBasePoints(uint32_t online_id);
-    double getModeFactor();
-    double getModeSpread();
-    double getTimeSpread(double time);
-    double getUncertaintySpread(uint32_t online_id);
-    double scalingValueForTime(double time);
     void checkRaceFinished();
     void getHitCaptureLimit(float num_karts);
     void configPeersStartTime();
@@ -315,6 +310,8 @@ public:
     float getStartupBoostOrPenaltyForKart(uint32_t ping, unsigned kart_id);
     int getDifficulty() const                   { return m_difficulty.load(); }
     int getGameMode() const                      { return m_game_mode.load(); }
+    uint32_t getEvictedConnections() const
+                                        { return m_evicted_connections.load(); }
 };   // class ServerLobby
 
 #endif // SERVER_LOBBY_HPP
@@ -0,0 +1,587 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/ranking_worker.hpp"
+
+#include "io/xml_node.hpp"
+#include "network/network_config.hpp"
+#include "online/xml_request.hpp"
+#include "utils/log.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <stdexcept>
+
+const double RankingWorker::BASE_RANKING_POINTS   = 4000.0;
+const double RankingWorker::MAX_SCALING_TIME      = 500.0;
+const double RankingWorker::MAX_POINTS_PER_SECOND = 0.125;
+const double RankingWorker::HANDICAP_OFFSET       = 1000.0;
+
+// ----------------------------------------------------------------------------
+/** Starts the worker thread, which uses the STK server for the rankings. */
+RankingWorker::RankingWorker()
+{
+    m_fetch = fetchOnline;
+    m_submit = submitOnline;
+    m_busy = false;
+    m_exit = false;
+    m_thread = std::thread(std::bind(&RankingWorker::mainLoop, this));
+}   // RankingWorker
+
+// ----------------------------------------------------------------------------
+/** Finishes all queued jobs (including submitting the rankings) and stops
+ *  the worker thread. */
+RankingWorker::~RankingWorker()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_exit = true;
+    m_jobs_cv.notify_all();
+    ul.unlock();
+    m_thread.join();
+}   // ~RankingWorker
+
+// ----------------------------------------------------------------------------
+/** Replaces the requests to the STK server, must be called before any job
+ *  is added. */
+void RankingWorker::setEndpoint(const FetchFunction& fetch,
+                                const SubmitFunction& submit)
+{
+    m_fetch = fetch;
+    m_submit = submit;
+}   // setEndpoint
+
+// ----------------------------------------------------------------------------
+void RankingWorker::addJob(const std::function<void()>& job)
+{
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    m_jobs.push_back(job);
+    m_jobs_cv.notify_all();
+}   // addJob
+
+// ----------------------------------------------------------------------------
+void RankingWorker::mainLoop()
+{
+    VS::setThreadName("RankingWorker");
+    while (true)
+    {
+        std::unique_lock<std::mutex> ul(m_jobs_mutex);
+        m_busy = false;
+        // Submit the new rankings once nothing else is waiting
+        if (m_jobs.empty() && !m_pending_submits.empty())
+        {
+            m_busy = true;
+            ul.unlock();
+            submitPending();
+            continue;
+        }
+        // Wake up waitForJobs
+        m_jobs_cv.notify_all();
+        m_jobs_cv.wait(ul, [this]() { return m_exit || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            break;
+        std::function<void()> job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+        ul.unlock();
+        try
+        {
+            job();
+        }
+        catch (std::exception& e)
+        {
+            Log::error("RankingWorker", "%s", e.what());
+        }
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Blocks until all queued jobs are done and all rankings are submitted. */
+void RankingWorker::waitForJobs()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_jobs_cv.wait(ul, [this]() { return m_jobs.empty() && !m_busy; });
+}   // waitForJobs
+
+// ----------------------------------------------------------------------------
+/** Queues fetching the ranking of a player who joined the server. The
+ *  ranking must be fetched before the first race result of the player is
+ *  added. */
+void RankingWorker::fetchRanking(uint32_t online_id)
+{
+    addJob([this, online_id]()
+        {
+            Ranking ranking;
+            auto it = m_pending_submits.find(online_id);
+            if (it != m_pending_submits.end())
+            {
+                // The STK server does not know the latest ranking yet
+                ranking = it->second;
+            }
+            else if (!m_fetch(online_id, &ranking))
+            {
+                Log::error("RankingWorker", "No ranking info found for %d.",
+                    online_id);
+                ranking = Ranking();
+            }
+            std::lock_guard<std::mutex> lock(m_rankings_mutex);
+            m_rankings[online_id] = ranking;
+        });
+}   // fetchRanking
+
+// ----------------------------------------------------------------------------
+/** Queues removing the cached ranking of a player who left the server. A
+ *  ranking which is not submitted yet will still be submitted. */
+void RankingWorker::forgetRanking(uint32_t online_id)
+{
+    addJob([this, online_id]()
+        {
+            std::lock_guard<std::mutex> lock(m_rankings_mutex);
+            m_rankings.erase(online_id);
+        });
+}   // forgetRanking
+
+// ----------------------------------------------------------------------------
+/** Queues computing and submitting the new rankings after a race.
+ *  \param results The result of each player in the race.
+ *  \param time_trial If the race was a time trial.
+ */
+void RankingWorker::addRaceResult(const std::vector<RaceResult>& results,
+                                  bool time_trial)
+{
+    addJob([this, results, time_trial]()
+        {
+            handleRaceResult(results, time_trial);
+        });
+}   // addRaceResult
+
+// ----------------------------------------------------------------------------
+/** Returns the cached ranking of a player, false if there is none. */
+bool RankingWorker::getRanking(uint32_t online_id, Ranking* ranking) const
+{
+    std::lock_guard<std::mutex> lock(m_rankings_mutex);
+    auto it = m_rankings.find(online_id);
+    if (it == m_rankings.end())
+        return false;
+    *ranking = it->second;
+    return true;
+}   // getRanking
+
+// ----------------------------------------------------------------------------
+void RankingWorker::handleRaceResult(const std::vector<RaceResult>& results,
+                                     bool time_trial)
+{
+    std::vector<Ranking> rankings;
+    std::unique_lock<std::mutex> ul(m_rankings_mutex);
+    for (const RaceResult& result : results)
+    {
+        auto it = m_rankings.find(result.m_online_id);
+        if (it == m_rankings.end())
+        {
+            Log::error("RankingWorker", "No ranking for %s (%d), the race "
+                "is not ranked.", result.m_name.c_str(), result.m_online_id);
+            return;
+        }
+        rankings.push_back(it->second);
+    }
+    ul.unlock();
+
+    computeNewRankings(results, time_trial, &rankings);
+
+    ul.lock();
+    for (unsigned i = 0; i < results.size(); i++)
+    {
+        const uint32_t id = results[i].m_online_id;
+        const Ranking& r = rankings[i];
+        m_rankings[id] = r;
+        m_pending_submits[id] = r;
+        Log::info("RankingWorker", "New ranking for %s (%d) : %lf, %lf %d",
+            results[i].m_name.c_str(), id, r.m_score, r.m_max_score,
+            r.m_num_races);
+    }
+}   // handleRaceResult
+
+// ----------------------------------------------------------------------------
+/** Submits the latest ranking of each player whose ranking changed. */
+void RankingWorker::submitPending()
+{
+    std::map<uint32_t, Ranking> submits;
+    std::swap(submits, m_pending_submits);
+    for (auto& s : submits)
+    {
+        if (!m_submit(s.first, s.second))
+        {
+            Log::error("RankingWorker", "Failed to submit scores for %d.",
+                s.first);
+        }
+    }
+}   // submitPending
+
+// ----------------------------------------------------------------------------
+bool RankingWorker::fetchOnline(uint32_t online_id, Ranking* ranking)
+{
+    Online::XMLRequest* request = new Online::XMLRequest();
+    NetworkConfig::get()->setUserDetails(request, "get-ranking");
+    request->addParameter("id", online_id);
+    request->executeNow();
+
+    const XMLNode* result = request->getXMLData();
+    std::string rec_success;
+    bool success = result->get("success", &rec_success) &&
+        rec_success == "yes";
+    if (success)
+    {
+        result->get("scores", &ranking->m_score);
+        result->get("max-scores", &ranking->m_max_score);
+        result->get("num-races-done", &ranking->m_num_races);
+    }
+    delete request;
+    return success;
+}   // fetchOnline
+
+// ----------------------------------------------------------------------------
+bool RankingWorker::submitOnline(uint32_t online_id, const Ranking& ranking)
+{
+    Online::XMLRequest* request = new Online::XMLRequest();
+    NetworkConfig::get()->setUserDetails(request, "submit-ranking");
+    request->addParameter("id", online_id);
+    request->addParameter("scores", ranking.m_score);
+    request->addParameter("max-scores", ranking.m_max_score);
+    request->addParameter("num-races-done", ranking.m_num_races);
+    request->executeNow();
+
+    const XMLNode* result = request->getXMLData();
+    std::string rec_success;
+    bool success = result->get("success", &rec_success) &&
+        rec_success == "yes";
+    delete request;
+    return success;
+}   // submitOnline
+
+// ----------------------------------------------------------------------------
+/** Computes the new rankings of the players of a race.
+ *  \param results The result of each player.
+ *  \param time_trial If the race was a time trial.
+ *  \param rankings The rankings of the players before the race (in the same
+ *         order as results), which are replaced by the new rankings.
+ */
+void RankingWorker::computeNewRankings(const std::vector<RaceResult>& results,
+                                       bool time_trial,
+                                       std::vector<Ranking>* rankings)
+{
+    assert(results.size() == rankings->size());
+    std::vector<Ranking>& r = *rankings;
+
+    // Using a vector of vector, it would be possible to fill
+    // all j < i v[i][j] with -v[j][i]
+    // Would this be worth it ?
+    std::vector<double> scores_change;
+    std::vector<double> new_scores;
+
+    const unsigned player_count = (unsigned)results.size();
+    for (unsigned i = 0; i < player_count; i++)
+    {
+        new_scores.push_back(r[i].m_score);
+        new_scores[i] += distributeBasePoints(r[i].m_num_races);
+    }
+
+    // First, update the number of ranked races
+    for (unsigned i = 0; i < player_count; i++)
+        r[i].m_num_races++;
+
+    // Now compute points exchanges
+    for (unsigned i = 0; i < player_count; i++)
+    {
+        scores_change.push_back(0.0);
+
+        double player1_scores = new_scores[i];
+        // If the player has quitted before the race end,
+        // the value will be incorrect, but it will not be used
+        double player1_time  = results[i].m_time;
+        double player1_factor = computeRankingFactor(r[i]);
+        double player1_handicap = results[i].m_handicap ? HANDICAP_OFFSET : 0;
+
+        for (unsigned j = 0; j < player_count; j++)
+        {
+            // Don't compare a player with himself
+            if (i == j)
+                continue;
+
+            double result = 0.0;
+            double expected_result = 0.0;
+            double ranking_importance = 0.0;
+            double max_time = 0.0;
+
+            // No change between two quitting players
+            if (results[i].m_eliminated && results[j].m_eliminated)
+                continue;
+
+            double player2_scores = new_scores[j];
+            double player2_time = results[j].m_time;
+            double player2_handicap =
+                results[j].m_handicap ? HANDICAP_OFFSET : 0;
+
+            // Compute the result and race ranking importance
+            double player_factors = std::min(player1_factor,
+                computeRankingFactor(r[j]));
+
+            double mode_factor = getModeFactor(time_trial);
+
+            if (results[i].m_eliminated)
+            {
+                result = 0.0;
+                player1_time = player2_time; // for getTimeSpread
+                max_time = MAX_SCALING_TIME;
+            }
+            else if (results[j].m_eliminated)
+            {
+                result = 1.0;
+                player2_time = player1_time;
+                max_time = MAX_SCALING_TIME;
+            }
+            else
+            {
+                // If time difference > 2,5% ; the result is 1 or 0
+                // Otherwise, it is averaged between 0 and 1.
+                if (player1_time <= player2_time)
+                {
+                    result =
+                        (player2_time - player1_time) / (player1_time / 20.0);
+                    result = std::min(1.0, 0.5 + result);
+                }
+                else
+                {
+                    result =
+                        (player1_time - player2_time) / (player2_time / 20.0);
+                    result = std::max(0.0, 0.5 - result);
+                }
+
+                max_time = std::min(std::max(player1_time, player2_time),
+                    MAX_SCALING_TIME);
+            }
+
+            ranking_importance = mode_factor *
+                scalingValueForTime(max_time) * player_factors;
+
+            // Compute the expected result using an ELO-like function
+            double diff = player2_scores - player1_scores;
+
+            if (!results[i].m_eliminated && !results[j].m_eliminated)
+                diff += player1_handicap - player2_handicap;
+
+            double uncertainty =
+                std::max(getUncertaintySpread(r[i].m_num_races),
+                         getUncertaintySpread(r[j].m_num_races));
+
+            expected_result = 1.0/ (1.0 + std::pow(10.0,
+                diff / (  BASE_RANKING_POINTS / 2.0
+                        * getModeSpread(time_trial)
+                        * getTimeSpread(std::min(player1_time, player2_time))
+                        * uncertainty )));
+
+            // Compute the ranking change
+            scores_change[i] +=
+                ranking_importance * (result - expected_result);
+        }
+    }
+
+    // Don't merge it in the main loop as new_scores value are used there
+    for (unsigned i = 0; i < player_count; i++)
+    {
+        r[i].m_score = new_scores[i] + scores_change[i];
+        if (r[i].m_score > r[i].m_max_score)
+            r[i].m_max_score = r[i].m_score;
+    }
+}   // computeNewRankings
+
+// ----------------------------------------------------------------------------
+/** Compute the ranking factor, used to make top rankings more stable
+ *  and to allow new players to faster get to an appropriate ranking
+ */
+double RankingWorker::computeRankingFactor(const Ranking& ranking)
+{
+    double max_points = ranking.m_max_score;
+    unsigned num_races = ranking.m_num_races;
+
+    if (max_points >= (BASE_RANKING_POINTS * 2.0))
+        return 0.6;
+    else if (max_points >= (BASE_RANKING_POINTS * 1.75) || num_races > 500)
+        return 0.7;
+    else if (max_points >= (BASE_RANKING_POINTS * 1.5) || num_races > 250)
+        return 0.8;
+    else if (max_points >= (BASE_RANKING_POINTS * 1.25) || num_races > 100)
+        return 1.0;
+    // The base ranking points are not distributed all at once
+    // So it's not guaranteed a player reach them
+    else if (max_points >= (BASE_RANKING_POINTS) || num_races > 50)
+        return 1.2;
+    else
+        return 1.5;
+
+}   // computeRankingFactor
+
+// ----------------------------------------------------------------------------
+/** Returns the mode race importance factor,
+ *  used to make ranking move slower in more random modes.
+ */
+double RankingWorker::getModeFactor(bool time_trial)
+{
+    if (time_trial)
+        return 1.0;
+    return 0.7;
+}   // getModeFactor
+
+// ----------------------------------------------------------------------------
+/** Returns the mode spread factor, used so that a similar difference in
+ *  skill will result in a similar ranking difference in more random modes.
+ */
+double RankingWorker::getModeSpread(bool time_trial)
+{
+    if (time_trial)
+        return 1.0;
+
+    //TODO: the value used here for normal races is a wild guess.
+    // When hard data to the spread tendencies of time-trial
+    // and normal mode becomes available, update this to make
+    // the spreads more comparable
+    return 1.5;
+}   // getModeSpread
+
+// ----------------------------------------------------------------------------
+/** Returns the time spread factor.
+ *  Short races are more random, so the expected result changes depending
+ *  on race duration.
+ */
+double RankingWorker::getTimeSpread(double time)
+{
+    return sqrt(120.0 / time);
+}   // getTimeSpread
+
+// ----------------------------------------------------------------------------
+/** Returns the uncertainty spread factor.
+ *  The ranking of new players is not yet reliable,
+ *  so weight the expected results twoards 0.5 by using a > 1 spread
+ */
+double RankingWorker::getUncertaintySpread(unsigned num_races)
+{
+    if (num_races <= 60)
+        return 0.5 + (4.0/sqrt(num_races+3));
+    else
+        return 1.0;
+}   // getUncertaintySpread
+
+// ----------------------------------------------------------------------------
+/** Compute the scaling value of a given time
+ *  This is linear to race duration, getTimeSpread takes care
+ *  of expecting a more random result in shorter races.
+ */
+double RankingWorker::scalingValueForTime(double time)
+{
+    return time * MAX_POINTS_PER_SECOND;
+}   // scalingValueForTime
+
+// ----------------------------------------------------------------------------
+/** Manages the distribution of the base points.
+ *  Gives half of the points progressively
+ *  by smaller and smaller chuncks from race 1 to 60.
+ *  The race count is incremented after this is called, so num_races
+ *  is between 0 and 59.
+ *  The first half is distributed when the player enters
+ *  for the first time in a ranked server.
+ */
+double RankingWorker::distributeBasePoints(unsigned num_races)
+{
+    if (num_races < 60)
+    {
+        return BASE_RANKING_POINTS / 8000.0 * std::max((96u - num_races), 41u);
+    }
+    else
+        return 0.0;
+}   // distributeBasePoints
+
+// ----------------------------------------------------------------------------
+void RankingWorker::unitTesting()
+{
+    std::vector<RaceResult> results(2);
+    results[0].m_online_id = 1;
+    results[0].m_time = 100.0;
+    results[0].m_eliminated = false;
+    results[0].m_handicap = false;
+    results[1] = results[0];
+    results[1].m_online_id = 2;
+    results[1].m_time = 110.0;
+
+    // Both new players get base points, and the winner takes points from
+    // the other player
+    std::vector<Ranking> rankings(2);
+    computeNewRankings(results, true/*time_trial*/, &rankings);
+    assert(rankings[0].m_num_races == 1 && rankings[1].m_num_races == 1);
+    assert(rankings[0].m_score > rankings[1].m_score);
+    assert(rankings[1].m_score > 2000.0);
+    assert(fabs(rankings[0].m_score + rankings[1].m_score - 4096.0) < 0.001);
+    assert(rankings[0].m_max_score == rankings[0].m_score);
+
+    // The worker with a local stub instead of the STK server
+    std::vector<uint32_t> submitted;
+    {
+        RankingWorker rw;
+        rw.setEndpoint([](uint32_t online_id, Ranking* ranking)
+            {
+                ranking->m_score = online_id == 1 ? 3000.0 : 2000.0;
+                ranking->m_max_score = ranking->m_score;
+                ranking->m_num_races = 100;
+                return online_id != 3;
+            },
+            [&submitted](uint32_t online_id, const Ranking& ranking)
+            {
+                submitted.push_back(online_id);
+                return true;
+            });
+        rw.fetchRanking(1);
+        rw.fetchRanking(2);
+        rw.fetchRanking(3);
+        rw.addRaceResult(results, false/*time_trial*/);
+        rw.addRaceResult(results, false/*time_trial*/);
+        rw.waitForJobs();
+
+        Ranking r1, r2, r3;
+        bool ok = rw.getRanking(1, &r1);
+        ok = rw.getRanking(2, &r2) && ok;
+        assert(ok);
+        assert(r1.m_num_races == 102 && r2.m_num_races == 102);
+        assert(r1.m_score > 3000.0 && r2.m_score < 2000.0);
+        // A failed fetch uses the default ranking
+        ok = rw.getRanking(3, &r3);
+        assert(ok && r3.m_num_races == 0);
+        // Both races are submitted, maybe combined
+        assert(submitted.size() >= 2 && submitted.size() <= 4);
+
+        rw.forgetRanking(1);
+        rw.waitForJobs();
+        ok = rw.getRanking(1, &r1);
+        assert(!ok);
+        (void)ok;
+
+        // Remaining rankings are submitted when the worker is destroyed
+        submitted.clear();
+        rw.fetchRanking(1);
+        rw.addRaceResult(results, true/*time_trial*/);
+    }
+    assert(submitted.size() == 2);
+}   // unitTesting
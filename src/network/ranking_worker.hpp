@@ -0,0 +1,140 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_RANKING_WORKER_HPP
+#define HEADER_RANKING_WORKER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** \class RankingWorker
+ *  \brief Computes and submits the rankings of a ranked server in its own
+ *  thread, so that neither the ranking math nor the http requests to the
+ *  STK server stall the lobby at the end of a race.
+ *  The lobby queues jobs (fetching the ranking of a new player, the result
+ *  of a race, forgetting a player who left), which are done in order. The
+ *  rankings of all current players are cached in the worker for as long as
+ *  they stay on the server, so each player is only fetched once. New
+ *  rankings are submitted when no other job is waiting; if several races
+ *  finished in the meantime, only the latest ranking of each player is
+ *  submitted.
+ *  The online requests can be replaced (e.g. by a local stub in tests) with
+ *  setEndpoint().
+ *  \ingroup network
+ */
+class RankingWorker : public NoCopy
+{
+public:
+    /** The ranking of one player. */
+    struct Ranking
+    {
+        double   m_score;
+        double   m_max_score;
+        unsigned m_num_races;
+        Ranking() : m_score(2000.0), m_max_score(2000.0), m_num_races(0) {}
+    };
+
+    /** The result of one player in a race. */
+    struct RaceResult
+    {
+        uint32_t    m_online_id;
+        /** Player name (utf8), only used for logging. */
+        std::string m_name;
+        /** Race time in seconds, unused if eliminated. */
+        double      m_time;
+        /** If the player quit before the end of the race. */
+        bool        m_eliminated;
+        bool        m_handicap;
+    };
+
+    /** Fetches the ranking of a player, returns false on error. */
+    typedef std::function<bool(uint32_t, Ranking*)> FetchFunction;
+    /** Submits the ranking of a player, returns false on error. */
+    typedef std::function<bool(uint32_t, const Ranking&)> SubmitFunction;
+
+private:
+    // If updating the base points, update the base points distribution in DB
+    static const double BASE_RANKING_POINTS;
+    static const double MAX_SCALING_TIME;
+    static const double MAX_POINTS_PER_SECOND;
+    static const double HANDICAP_OFFSET;
+
+    FetchFunction m_fetch;
+    SubmitFunction m_submit;
+
+    std::thread m_thread;
+
+    /** Protects m_jobs, m_busy and m_exit. */
+    std::mutex m_jobs_mutex;
+    std::condition_variable m_jobs_cv;
+    std::deque<std::function<void()> > m_jobs;
+
+    /** True while the worker does a job. */
+    bool m_busy;
+    bool m_exit;
+
+    /** Protects m_rankings, which is changed only in the worker thread. */
+    mutable std::mutex m_rankings_mutex;
+    std::map<uint32_t, Ranking> m_rankings;
+
+    /** New rankings not submitted yet, only used in the worker thread. */
+    std::map<uint32_t, Ranking> m_pending_submits;
+
+    void mainLoop();
+    void addJob(const std::function<void()>& job);
+    void handleRaceResult(const std::vector<RaceResult>& results,
+                          bool time_trial);
+    void submitPending();
+    static bool fetchOnline(uint32_t online_id, Ranking* ranking);
+    static bool submitOnline(uint32_t online_id, const Ranking& ranking);
+    static double computeRankingFactor(const Ranking& ranking);
+    static double distributeBasePoints(unsigned num_races);
+    static double getModeFactor(bool time_trial);
+    static double getModeSpread(bool time_trial);
+    static double getTimeSpread(double time);
+    static double getUncertaintySpread(unsigned num_races);
+    static double scalingValueForTime(double time);
+
+public:
+    static void unitTesting();
+    static void computeNewRankings(const std::vector<RaceResult>& results,
+                                   bool time_trial,
+                                   std::vector<Ranking>* rankings);
+    RankingWorker();
+    ~RankingWorker();
+    void setEndpoint(const FetchFunction& fetch,
+                     const SubmitFunction& submit);
+    void fetchRanking(uint32_t online_id);
+    void forgetRanking(uint32_t online_id);
+    void addRaceResult(const std::vector<RaceResult>& results,
+                       bool time_trial);
+    bool getRanking(uint32_t online_id, Ranking* ranking) const;
+    void waitForJobs();
+
+};   // RankingWorker
+
+#endif
@@ -22,6 +22,9 @@
 #include "network/rewinder.hpp"
 #include "network/rewind_manager.hpp"
 #include "items/projectile_manager.hpp"
+#include "utils/synchronised.hpp"
+
+#include <algorithm>
 
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
@@ -46,15 +49,115 @@ void RewindInfo::setTicks(int ticks)
 }   // setTicks
 
 // ============================================================================
+/** Memory of deleted RewindInfo objects, which is reused for new objects
+ *  instead of allocating it for each event and state. There is one list for
+ *  each size in steps of 16 bytes. RewindInfo are created in the network
+ *  thread and deleted in the main thread, so the lists are synchronised.
+ *  This is never freed, so RewindInfo can be deleted at any time. */
+static const size_t REWIND_INFO_POOL_STEP  = 16;
+static const size_t REWIND_INFO_POOL_SIZES = 16;
+static Synchronised<std::vector<void*> >* g_rewind_info_pool =
+    new Synchronised<std::vector<void*> >[REWIND_INFO_POOL_SIZES];
+
+// ----------------------------------------------------------------------------
+/** Allocates the memory of a RewindInfo object, reusing the memory of a
+ *  deleted RewindInfo of similar size if possible.
+ */
+void* RewindInfo::operator new(size_t size)
+{
+    const size_t n = (size + REWIND_INFO_POOL_STEP - 1) /
+                     REWIND_INFO_POOL_STEP;
+    if (n >= REWIND_INFO_POOL_SIZES)
+        return ::operator new(size);
+
+    void* p = NULL;
+    Synchronised<std::vector<void*> >& pool = g_rewind_info_pool[n];
+    pool.lock();
+    if (!pool.getData().empty())
+    {
+        p = pool.getData().back();
+        pool.getData().pop_back();
+    }
+    pool.unlock();
+    return p ? p : ::operator new(n * REWIND_INFO_POOL_STEP);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+/** Keeps the memory of a deleted RewindInfo for later objects, unless
+ *  enough memory of this size is kept already.
+ */
+void RewindInfo::operator delete(void* p, size_t size)
+{
+    const size_t n = (size + REWIND_INFO_POOL_STEP - 1) /
+                     REWIND_INFO_POOL_STEP;
+    if (n < REWIND_INFO_POOL_SIZES)
+    {
+        Synchronised<std::vector<void*> >& pool = g_rewind_info_pool[n];
+        pool.lock();
+        if (pool.getData().size() < 4096)
+        {
+            pool.getData().push_back(p);
+            p = NULL;
+        }
+        pool.unlock();
+    }
+    ::operator delete(p);
+}   // operator delete
+
+// ============================================================================
+/** Unused state buffers, kept to avoid allocating memory for each state.
+ *  This is never freed, so buffers can be released at any time. */
+static Synchronised<std::vector<BareNetworkString*> >* g_state_buffer_pool =
+    new Synchronised<std::vector<BareNetworkString*> >();
+
+// ----------------------------------------------------------------------------
+/** Returns an empty buffer for a state. The buffer can be shared by several
+ *  users without copying, and it is reused for another state when it is not
+ *  used anymore. It can be called from any thread.
+ */
+std::shared_ptr<BareNetworkString> RewindInfoState::createStateBuffer()
+{
+    BareNetworkString* buffer = NULL;
+    g_state_buffer_pool->lock();
+    if (!g_state_buffer_pool->getData().empty())
+    {
+        buffer = g_state_buffer_pool->getData().back();
+        g_state_buffer_pool->getData().pop_back();
+    }
+    g_state_buffer_pool->unlock();
+    if (!buffer)
+        buffer = new BareNetworkString();
+    return std::shared_ptr<BareNetworkString>(buffer, recycleStateBuffer);
+}   // createStateBuffer
+
+// ----------------------------------------------------------------------------
+/** Called when the last user of a state buffer releases it. The buffer is
+ *  kept (with its memory) for a later state, unless enough buffers are
+ *  already available.
+ */
+void RewindInfoState::recycleStateBuffer(BareNetworkString* buffer)
+{
+    buffer->getBuffer().clear();
+    buffer->reset();
+    g_state_buffer_pool->lock();
+    if (g_state_buffer_pool->getData().size() < 128)
+    {
+        g_state_buffer_pool->getData().push_back(buffer);
+        buffer = NULL;
+    }
+    g_state_buffer_pool->unlock();
+    delete buffer;
+}   // recycleStateBuffer
+
+// ----------------------------------------------------------------------------
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
                                  std::vector<std::string>& rewinder_using,
-                                 std::vector<uint8_t>& buffer)
+                                 std::shared_ptr<BareNetworkString> buffer)
                : RewindInfo(ticks, true/*is_confirmed*/)
 {
     std::swap(m_rewinder_using, rewinder_using);
     m_start_offset = start_offset;
-    m_buffer = new BareNetworkString();
-    std::swap(m_buffer->getBuffer(), buffer);
+    m_buffer = buffer;
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
@@ -65,7 +168,7 @@ RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
                : RewindInfo(ticks, is_confirmed)
 {
     m_start_offset = 0;
-    m_buffer = buffer;
+    m_buffer.reset(buffer);
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
@@ -99,7 +202,23 @@ void RewindInfoState::restore()
         }
         try
         {
-            r->restoreState(m_buffer, data_size);
+            // A rewinder not sent by the server to this client (see
+            // StateRelevance) is restored from the local prediction, or
+            // from the local state if there is no prediction for this time
+            if (data_size == 0)
+            {
+                BareNetworkString* prediction =
+                    RewindManager::get()->getPrediction(getTicks(), name);
+                if (!prediction)
+                {
+                    r->restoreLocalState();
+                    continue;
+                }
+                prediction->reset();
+                r->restoreState(prediction, prediction->size());
+                continue;
+            }
+            r->restoreState(m_buffer.get(), data_size);
         }
         catch (std::exception& e)
         {
@@ -120,6 +239,71 @@ void RewindInfoState::restore()
     }   // for all rewinder
 }   // restore
 
+// ----------------------------------------------------------------------------
+/** Returns true if this state matches the state predicted by the client for
+ *  all rewinders, so restoring it and replaying till now is not needed.
+ *  \param predictions The predictions (see Rewinder::savePrediction) of all
+ *         rewinders at the time of this state. An empty prediction can be
+ *         missing in the state (e.g. for eliminated karts), and a rewinder
+ *         without data in the state matches any prediction.
+ */
+bool RewindInfoState::matchesPrediction(const std::map<std::string,
+                            std::unique_ptr<BareNetworkString> >& predictions)
+{
+    m_buffer->reset();
+    m_buffer->skip(m_start_offset);
+    bool matches = true;
+    for (const std::string& name : m_rewinder_using)
+    {
+        const uint16_t data_size = m_buffer->getUInt16();
+        const unsigned current_offset_now = m_buffer->getCurrentOffset();
+        std::shared_ptr<Rewinder> r =
+            RewindManager::get()->getRewinder(name);
+        auto it = predictions.find(name);
+        if (!r || it == predictions.end())
+        {
+            matches = false;
+            break;
+        }
+        BareNetworkString* prediction = it->second.get();
+        if (!prediction)
+        {
+            matches = false;
+            break;
+        }
+        // Not sent by the server to this client, the prediction is kept
+        if (data_size == 0)
+            continue;
+        prediction->reset();
+        try
+        {
+            matches = r->matchesPrediction(prediction, m_buffer.get(),
+                data_size);
+        }
+        catch (std::exception&)
+        {
+            matches = false;
+        }
+        if (!matches)
+            break;
+        m_buffer->reset();
+        m_buffer->skip(current_offset_now + data_size);
+    }   // for all rewinder
+
+    m_buffer->reset();
+    if (!matches)
+        return false;
+    // A rewinder which was predicted must not be missing in the state
+    for (auto& p : predictions)
+    {
+        if (p.second && p.second->getTotalSize() > 0 &&
+            std::find(m_rewinder_using.begin(), m_rewinder_using.end(),
+            p.first) == m_rewinder_using.end())
+            return false;
+    }
+    return true;
+}   // matchesPrediction
+
 // ============================================================================
 RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                                  BareNetworkString *buffer, bool is_confirmed)
@@ -27,6 +27,8 @@
 
 #include <assert.h>
 #include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -58,6 +60,8 @@ public:
     RewindInfo(int ticks, bool is_confirmed);
 
     void setTicks(int ticks);
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
 
     /** Called when going back in time to undo any rewind information. */
     virtual void undo() = 0;
@@ -88,6 +92,15 @@ public:
 
 // ============================================================================
 /** A class that stores a game state and can rewind it.
+ *  The content of the state buffer is not changed after the state was
+ *  received, so it is shared with other users of the same state (e.g.
+ *  GameProtocol keeps states as baseline for delta states, which only use
+ *  the bytes) instead of being copied. The read offset of the buffer is
+ *  changed by restore() and matchesPrediction(), which set it themselves
+ *  before reading, so only they may use it (in the main thread). A rewind
+ *  still parses each rewinder state from the buffer, it is not a plain
+ *  memory copy. Buffers are created with createStateBuffer(), and are
+ *  recycled for later states when the last user releases them.
  */
 class RewindInfoState: public RewindInfo
 {
@@ -96,23 +109,27 @@ private:
 
     int m_start_offset;
 
-    /** Pointer to the buffer which stores all states. */
-    BareNetworkString *m_buffer;
+    /** The buffer which stores all states. */
+    std::shared_ptr<BareNetworkString> m_buffer;
+
+    static void recycleStateBuffer(BareNetworkString* buffer);
 
 public:
+    static std::shared_ptr<BareNetworkString> createStateBuffer();
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
                     std::vector<std::string>& rewinder_using,
-                    std::vector<uint8_t>& buffer);
+                    std::shared_ptr<BareNetworkString> buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
     // ------------------------------------------------------------------------
-    virtual ~RewindInfoState()                             { delete m_buffer; }
-    // ------------------------------------------------------------------------
     virtual void restore();
     // ------------------------------------------------------------------------
+    bool matchesPrediction(const std::map<std::string,
+                           std::unique_ptr<BareNetworkString> >& predictions);
+    // ------------------------------------------------------------------------
     /** Returns a pointer to the state buffer. */
-    BareNetworkString *getBuffer() const { return m_buffer; }
+    BareNetworkString *getBuffer() const { return m_buffer.get(); }
     // ------------------------------------------------------------------------
     virtual bool isState() const { return true; }
     // ------------------------------------------------------------------------
@@ -30,11 +30,13 @@
 #include "race/history.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
+#include "utils/tick_profiler.hpp"
 
 #include <algorithm>
 
 RewindManager* RewindManager::m_rewind_manager = NULL;
 bool           RewindManager::m_enable_rewind_manager = false;
+std::atomic<uint32_t> RewindManager::m_rewind_count(0);
 
 /** Creates the singleton. */
 RewindManager *RewindManager::create()
@@ -87,6 +89,7 @@ void RewindManager::reset()
 
     clearExpiredRewinder();
     m_rewind_queue.reset();
+    m_predictions.clear();
 }   // reset
 
 // ----------------------------------------------------------------------------    
@@ -180,12 +183,20 @@ void RewindManager::saveState()
  */
 void RewindManager::update(int ticks_not_used)
 {
+    TickProfiler::Scope tick_profiler(TickProfiler::TS_REWIND_MANAGER);
     // FIXME: rename ticks_not_used
     if (!m_enable_rewind_manager ||
-        m_all_rewinder.size() == 0 ||
-        m_is_rewinding)  return;
+        m_all_rewinder.size() == 0)  return;
 
     int ticks = World::getWorld()->getTicksSinceStart();
+    if (m_is_rewinding)
+    {
+        // The replay after a rewind gives a new prediction, otherwise no
+        // state received during the replayed time could skip a rewind
+        if (NetworkConfig::get()->isClient() && shouldSaveState(ticks))
+            savePredictions(ticks);
+        return;
+    }
 
     m_not_rewound_ticks.store(ticks, std::memory_order_relaxed);
 
@@ -202,6 +213,7 @@ void RewindManager::update(int ticks_not_used)
             if (auto r = p.second.lock())
                 ret.push_back(r->getLocalStateRestoreFunction());
         }
+        savePredictions(ticks);
     }
     else
     {
@@ -213,6 +225,59 @@ void RewindManager::update(int ticks_not_used)
     PROFILER_POP_CPU_MARKER();
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Saves the predictions of all rewinders on a client for a time at which
+ *  the server saves a state. A rewinder which can't predict its state gets
+ *  a NULL prediction, so a state at this time will always cause a rewind.
+ *  \param ticks Current world time.
+ */
+void RewindManager::savePredictions(int ticks)
+{
+    auto& predictions = m_predictions[ticks];
+    predictions.clear();
+    for (auto& p : m_all_rewinder)
+    {
+        if (auto r = p.second.lock())
+            predictions[p.first].reset(r->savePrediction());
+    }
+}   // savePredictions
+
+// ----------------------------------------------------------------------------
+/** Returns the prediction of a rewinder at the given time, or NULL if there
+ *  is none. It is used for rewinders the server did not include in a state.
+ *  \param ticks Time of the state.
+ *  \param name Unique identity of the rewinder.
+ */
+BareNetworkString* RewindManager::getPrediction(int ticks,
+                                                const std::string& name)
+{
+    auto it = m_predictions.find(ticks);
+    if (it == m_predictions.end())
+        return NULL;
+    auto prediction = it->second.find(name);
+    return prediction == it->second.end() ? NULL : prediction->second.get();
+}   // getPrediction
+
+// ----------------------------------------------------------------------------
+/** Returns true if the rewind to a newly received state can be skipped,
+ *  because the client predicted that state correctly for all rewinders, and
+ *  no other network event was received in the past after that state. Only
+ *  the whole world can be rewound, since all karts and items share one
+ *  physics world, so a single mismatch needs a full rewind.
+ *  \param rewind_ticks Time of the received state.
+ */
+bool RewindManager::canSkipRewind(int rewind_ticks)
+{
+    if (m_rewind_queue.getLatestPastNetworkEvent() >= rewind_ticks)
+        return false;
+    auto it = m_predictions.find(rewind_ticks);
+    if (it == m_predictions.end())
+        return false;
+    RewindInfoState* state = dynamic_cast<RewindInfoState*>
+        (m_rewind_queue.findConfirmedState(rewind_ticks));
+    return state && state->matchesPrediction(it->second);
+}   // canSkipRewind
+
 // ----------------------------------------------------------------------------
 /** Replays all events from the last event played till the specified time.
  *  \param world_ticks Up to (and inclusive) which time events will be replayed.
@@ -234,6 +299,17 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // be getTime()+dt - world time has not been updated yet).
     m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
 
+    if (needs_rewind && !fast_forward && canSkipRewind(rewind_ticks))
+    {
+        m_rewind_queue.skipUntil(world_ticks);
+        needs_rewind = false;
+        // States before the matching one can't be used for a rewind anymore
+        m_predictions.erase(m_predictions.begin(),
+            m_predictions.upper_bound(rewind_ticks));
+        m_local_state.erase(m_local_state.begin(),
+            m_local_state.upper_bound(rewind_ticks));
+    }
+
     if (needs_rewind)
     {
         Log::setPrefix("Rewind");
@@ -287,6 +363,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
                              bool fast_forward)
 {
     assert(!m_is_rewinding);
+    m_rewind_count.fetch_add(1, std::memory_order_relaxed);
     bool is_history = history->replayHistory();
     history->setReplayHistory(false);
 
@@ -353,6 +430,9 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
         m_rewind_queue.next();
         current = m_rewind_queue.getCurrent();
     }
+    // The predictions are still needed for rewinders missing in the state
+    m_predictions.erase(m_predictions.begin(),
+        m_predictions.upper_bound(exact_rewind_ticks));
 
     // Now go forward through the list of rewind infos till we reach 'now':
     while (world->getTicksSinceStart() < now_ticks)
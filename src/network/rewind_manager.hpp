@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Rewinder;
 class RewindInfo;
 class RewindInfoEventFunction;
@@ -92,8 +93,18 @@ private:
      *  rewind data in case of local races only. */
     static bool           m_enable_rewind_manager;
 
+    /** Number of rewinds since the start of STK, for the metrics file. */
+    static std::atomic<uint32_t> m_rewind_count;
+
     std::map<int, std::vector<std::function<void()> > > m_local_state;
 
+    /** On a client the predicted states of all rewinders (see
+     *  Rewinder::savePrediction) at the times the server saves a state,
+     *  indexed by ticks and unique identity of the rewinder. If a received
+     *  state matches the prediction, no rewind is needed. */
+    std::map<int, std::map<std::string, std::unique_ptr<BareNetworkString> > >
+        m_predictions;
+
     /** A list of all objects that can be rewound. */
     std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
 
@@ -133,6 +144,8 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    void savePredictions(int ticks);
+    bool canSkipRewind(int rewind_ticks);
 
 public:
     // First static functions to manage rewinding.
@@ -146,6 +159,9 @@ public:
     /** Returns if rewinding is enabled or not. */
     static bool isEnabled() { return m_enable_rewind_manager; }
     // ------------------------------------------------------------------------
+    /** Returns the number of rewinds done since the start of STK. */
+    static uint32_t getRewindCount()           { return m_rewind_count.load(); }
+    // ------------------------------------------------------------------------
     /** Returns the singleton. This function will not automatically create
      *  the singleton. */
     static RewindManager *get()
@@ -166,6 +182,7 @@ public:
                          BareNetworkString *buffer, int ticks);
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void saveState();
+    BareNetworkString* getPrediction(int ticks, const std::string& name);
     // ------------------------------------------------------------------------
     std::shared_ptr<Rewinder> getRewinder(const std::string& name)
     {
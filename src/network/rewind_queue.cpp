@@ -27,6 +27,8 @@
 #include "network/rewind_manager.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <limits>
 
 /** The RewindQueue stores one TimeStepInfo for each time step done.
  *  The TimeStepInfo stores all states and events to be used at the
@@ -73,43 +75,76 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    if (m_all_rewind_info.empty())
+        m_all_rewind_info.resize(256);
+    else if (m_first_ticks <= m_last_ticks)
+        cleanupOldRewindInfo(m_last_ticks + 1);
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_first_ticks = 0;
+    m_last_ticks = -1;
+    m_current_ticks = std::numeric_limits<int>::min();
+    m_current_index = 0;
     m_latest_confirmed_state_time = -1;
+    m_latest_past_network_event = -1;
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Makes sure that the ring buffer can store the given number of ticks.
+ *  \param span Number of ticks from the first to the last stored tick.
+ */
+void RewindQueue::growRing(int span)
+{
+    size_t size = m_all_rewind_info.size();
+    if ((size_t)span <= size)
+        return;
+    while (size < (size_t)span)
+        size *= 2;
+    std::vector<TickRewindInfo> ring(size);
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+    {
+        TickRewindInfo& tri = ring[t & (size - 1)];
+        std::swap(tri.m_states, getTickRewindInfo(t).m_states);
+        std::swap(tri.m_events, getTickRewindInfo(t).m_events);
+    }
+    m_all_rewind_info.swap(ring);
+}   // growRing
+
 // ----------------------------------------------------------------------------
 /** Inserts a RewindInfo object in the list of all events at the correct time.
  *  If there are several RewindInfo at the exact same time, state RewindInfo
- *  will be insert at the front, and event info at the end of the RewindInfo
- *  with the same time.
+ *  will be insert before the events, and event info at the end of the
+ *  RewindInfo with the same time.
  *  \param ri The RewindInfo object to insert.
- *  \param update_current If set, the current pointer will be updated if
- *         necessary to point to the new event
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    const int ticks = ri->getTicks();
+    if (m_first_ticks > m_last_ticks)
+    {
+        m_first_ticks = m_last_ticks = ticks;
+    }
+    else if (ticks < m_first_ticks)
+    {
+        growRing(m_last_ticks - ticks + 1);
+        m_first_ticks = ticks;
+    }
+    else if (ticks > m_last_ticks)
+    {
+        growRing(ticks - m_first_ticks + 1);
+        m_last_ticks = ticks;
+    }
 
-    while (i != m_all_rewind_info.begin())
+    TickRewindInfo& tri = getTickRewindInfo(ticks);
+    if (ri->isEvent())
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
-        // Now test if 'ri' needs to be inserted after the
-        // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        tri.m_events.push_back(ri);
+        return;
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
-    else
-        m_all_rewind_info.insert(i, ri);  
+    // Keep the current pointer at the same RewindInfo if it points to an
+    // event of this tick
+    if (ticks == m_current_ticks && m_current_index >= tri.m_states.size())
+        m_current_index++;
+    tri.m_states.push_back(ri);
 }   // insertRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -201,6 +236,10 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
                                    int *rewind_ticks)
 {
     *needs_rewind = false;
+    // A server never rewinds, so nothing before the current time is needed
+    if (NetworkConfig::get()->isServer())
+        cleanupOldRewindInfo(world_ticks);
+
     m_network_events.lock();
     if(m_network_events.getData().empty())
     {
@@ -255,6 +294,9 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
         }
 
         insertRewindInfo(*i);
+        if (!(*i)->isState() && (*i)->getTicks() < world_ticks &&
+            (*i)->getTicks() > m_latest_past_network_event)
+            m_latest_past_network_event = (*i)->getTicks();
 
         // Check if a rewind is necessary, i.e. a message is received in the
         // past of client (server never rewinds). Even if
@@ -313,27 +355,119 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
 
 }   // mergeNetworkData
 
+// ----------------------------------------------------------------------------
+/** Returns the confirmed state at the given time, or NULL if there is none.
+ *  \param ticks Time (in ticks).
+ */
+RewindInfo* RewindQueue::findConfirmedState(int ticks)
+{
+    if (ticks < m_first_ticks || ticks > m_last_ticks)
+        return NULL;
+    const std::vector<RewindInfo*>& states = getTickRewindInfo(ticks).m_states;
+    for (auto i = states.rbegin(); i != states.rend(); i++)
+    {
+        if ((*i)->isConfirmed())
+            return *i;
+    }
+    return NULL;
+}   // findConfirmedState
+
+// ----------------------------------------------------------------------------
+/** Used instead of a rewind if the received state matches the state
+ *  predicted by the client: continues with the first rewind info at or
+ *  after the given time, without undoing or replaying anything.
+ *  \param ticks Time (in ticks).
+ */
+void RewindQueue::skipUntil(int ticks)
+{
+    m_current_ticks = ticks;
+    m_current_index = 0;
+    m_latest_past_network_event = -1;
+}   // skipUntil
+
 // ----------------------------------------------------------------------------
 /** Deletes all states and event before the given time.
  *  \param ticks Time (in ticks).
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
+    for (int t = m_first_ticks; t < ticks && t <= m_last_ticks; t++)
+    {
+        TickRewindInfo& tri = getTickRewindInfo(t);
+        for (RewindInfo* ri : tri.m_states)
+            delete ri;
+        for (RewindInfo* ri : tri.m_events)
+            delete ri;
+        tri.m_states.clear();
+        tri.m_events.clear();
+    }
+    if (ticks > m_first_ticks)
+        m_first_ticks = ticks;
+    if (m_current_ticks < ticks)
+    {
+        m_current_ticks = ticks;
+        m_current_index = 0;
+    }
+}   // cleanupOldRewindInfo
 
-    while ( (*i)->getTicks() < ticks)
+// ----------------------------------------------------------------------------
+/** Finds the position of the current RewindInfo, i.e. the first one stored
+ *  at or after m_current_ticks/m_current_index.
+ *  \param ticks[out] Tick of the current RewindInfo, or m_last_ticks + 1 if
+ *         there is none.
+ *  \param index[out] Index of the current RewindInfo in its tick.
+ */
+void RewindQueue::findCurrent(int *ticks, unsigned *index) const
+{
+    int t = std::max(m_current_ticks, m_first_ticks);
+    unsigned i = t == m_current_ticks ? m_current_index : 0;
+    for (; t <= m_last_ticks; t++, i = 0)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        if (i < getTickRewindInfo(t).size())
+        {
+            *ticks = t;
+            *index = i;
+            return;
+        }
     }
+    *ticks = m_last_ticks + 1;
+    *index = 0;
+}   // findCurrent
 
-}   // cleanupOldRewindInfo
+// ----------------------------------------------------------------------------
+/** Returns the current RewindInfo, or NULL if there is none (see
+ *  hasMoreRewindInfo()).
+ */
+RewindInfo* RewindQueue::getCurrent()
+{
+    int ticks;
+    unsigned index;
+    findCurrent(&ticks, &index);
+    if (ticks > m_last_ticks)
+        return NULL;
+    m_current_ticks = ticks;
+    m_current_index = index;
+    return getTickRewindInfo(ticks).get(index);
+}   // getCurrent
+
+// ----------------------------------------------------------------------------
+/** Sets the current element to be the next one. A RewindInfo added later
+ *  at the same tick will become the current one.
+ */
+void RewindQueue::next()
+{
+    int ticks;
+    unsigned index;
+    findCurrent(&ticks, &index);
+    assert(ticks <= m_last_ticks);
+    m_current_ticks = ticks;
+    m_current_index = index + 1;
+}   // next
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return !hasMoreRewindInfo();
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -341,7 +475,10 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    int ticks;
+    unsigned index;
+    findCurrent(&ticks, &index);
+    return ticks <= m_last_ticks;
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -353,29 +490,34 @@ bool RewindQueue::hasMoreRewindInfo() const
  */
 int RewindQueue::undoUntil(int undo_ticks)
 {
-    // A rewind is done after a state in the past is inserted. This function
-    // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    // A rewind is done after a state in the past is inserted, so the queue
+    // can't be empty
+    assert(m_first_ticks <= m_last_ticks);
+    m_latest_past_network_event = -1;
+    for (int t = m_last_ticks; t >= m_first_ticks; t--)
     {
-        // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        TickRewindInfo& tri = getTickRewindInfo(t);
+        for (unsigned i = tri.size(); i > 0; i--)
         {
-            // This shouldn't happen, but add some debug info just in case
-            Log::error("undoUntil",
-                       "At %d rewinding to %d current = %d = begin",
-                       World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+            RewindInfo* ri = tri.get(i - 1);
+            if (t <= undo_ticks && ri->isState() && ri->isConfirmed())
+            {
+                m_current_ticks = t;
+                m_current_index = i - 1;
+                return t;
+            }
+            // Undo all events and states from the current time
+            ri->undo();
         }
-        m_current--;
     }
 
-    return (*m_current)->getTicks();
+    // This shouldn't happen, but add some debug info just in case
+    Log::error("undoUntil", "At %d rewinding to %d no confirmed state "
+               "found after %d", World::getWorld()->getTicksSinceStart(),
+               undo_ticks, m_first_ticks);
+    m_current_ticks = m_first_ticks;
+    m_current_index = 0;
+    return m_first_ticks;
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -385,15 +527,33 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    RewindInfo* ri = getCurrent();
+    while (ri && ri->getTicks() == ticks)
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
-        m_current++;
+        if (ri->isEvent())
+            ri->replay();
+        next();
+        ri = getCurrent();
     }   // while current->getTIcks == ticks
 
 }   // replayAllEvents
 
+// ----------------------------------------------------------------------------
+/** Returns all stored RewindInfo in the order in which they are handled,
+ *  used in unit testing.
+ */
+std::vector<RewindInfo*> RewindQueue::getAllRewindInfo() const
+{
+    std::vector<RewindInfo*> all;
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+    {
+        const TickRewindInfo& tri = getTickRewindInfo(t);
+        for (unsigned i = 0; i < tri.size(); i++)
+            all.push_back(tri.get(i));
+    }
+    return all;
+}   // getAllRewindInfo
+
 // ----------------------------------------------------------------------------
 /** Unit tests for RewindQueue. It tests:
  *  - Sorting order of RewindInfos at the same time (i.e. state before time
@@ -401,6 +561,8 @@ void RewindQueue::replayAllEvents(int ticks)
  *  - Sorting order of RewindInfos with different timestamps (and a mixture
  *    of types).
  *  - Special cases that triggered incorrect behaviour previously.
+ *  It also measures how long it takes to handle 10000 network events per
+ *  second of a race.
  */
 void RewindQueue::unitTesting()
 {
@@ -415,57 +577,53 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.getAllRewindInfo().front()->isState());
+    assert(!q0.getAllRewindInfo().front()->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.getAllRewindInfo().size() == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    std::vector<RewindInfo*> all = q0.getAllRewindInfo();
+    assert(all.size() == 2);
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q0.getAllRewindInfo();
+    assert(all.size() == 3);
+    assert(all[0]->isState());
+    assert(all[1]->isState());
+    assert(all[2]->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
     // Then adding an earlier event
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
-    // rii points to the 3rd element, the ones added just now
-    // should be elements4 and 5:
-    rii++;
-    assert((*rii)->getTicks()==1);
-    rii++;
-    assert((*rii)->getTicks()==4);
+    // The ones added just now should be elements 4 and 5:
+    all = q0.getAllRewindInfo();
+    assert(all[3]->getTicks()==1);
+    assert(all[4]->getTicks()==4);
+    assert(q0.findConfirmedState(0) == all[1]);
+    assert(q0.findConfirmedState(1) == NULL);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q1.getAllRewindInfo();
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -484,20 +642,20 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
-    if (current_old != b1.m_current)
+    if (ri != b1.getCurrent())
         Log::fatal("RewindQueue", "current_old != b1.m_current");
 
     // This should not trigger an exception, now current points to the
     // second event at the same time:
     b1.next();
+    ri = b1.getCurrent();
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(!b1.hasMoreRewindInfo());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -506,7 +664,71 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
-
+    assert(b2.getCurrent()->getTicks() == 3);
+
+    // 4) A state added at the current tick after its events were played
+    //    must not cause these events to be played again
+    RewindQueue b3;
+    b3.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(), true, 7);
+    b3.replayAllEvents(7);
+    b3.addLocalState(NULL, true, 7);
+    assert(!b3.hasMoreRewindInfo());
+
+    // 5) The ring buffer grows when many ticks are stored
+    RewindQueue b4;
+    for (int t = 1000; t >= 0; t -= 10)
+        b4.addLocalEvent(NULL, NULL, true, t);
+    b4.addLocalEvent(NULL, NULL, true, 2000);
+    all = b4.getAllRewindInfo();
+    assert(all.size() == 102);
+    for (unsigned i = 0; i < 101; i++)
+        assert(all[i]->getTicks() == (int)i * 10);
+
+    // 6) A kart left out of a state by the server (see StateRelevance)
+    //    without a prediction on this client (e.g. it was showing an
+    //    animation) must be restored from the local state, not be left
+    //    with its values from the current time
+    bool rewind_enabled = RewindManager::isEnabled();
+    RewindManager::setEnable(true);
+    auto left_out = std::make_shared<DummyRewinder>("K0");
+    RewindManager::get()->addRewinder(left_out);
+    std::shared_ptr<BareNetworkString> buffer =
+        std::make_shared<BareNetworkString>();
+    buffer->addUInt16(0);
+    std::vector<std::string> rewinder_using = { "K0" };
+    RewindInfoState left_out_state(10, 0, rewinder_using, buffer);
+    assert(RewindManager::get()->getPrediction(10, "K0") == NULL);
+    left_out_state.restore();
+    assert(left_out->m_local_state_restored == 1);
+    RewindManager::setEnable(rewind_enabled);
+
+    // Benchmark: 10 seconds at 120 ticks per second with 10000 network
+    // events per second, and a confirmed state every 10 ticks
+    // -----------------------------------------------------------------
+    RewindQueue bench;
+    const int events_per_second = 10000, ticks_per_second = 120;
+    auto start = std::chrono::steady_clock::now();
+    int events = 0;
+    for (int t = 0; t < 10 * ticks_per_second; t++)
+    {
+        int n = (t + 1) * events_per_second / ticks_per_second -
+                t * events_per_second / ticks_per_second;
+        for (int i = 0; i < n; i++)
+        {
+            bench.addNetworkEvent(dummy_rewinder.get(),
+                                  new BareNetworkString(), t);
+        }
+        events += n;
+        if (t % 10 == 9)
+            bench.addNetworkState(NULL, t - 5);
+        bench.mergeNetworkData(t, &needs_rewind, &rewind_ticks);
+        bench.replayAllEvents(t);
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now() - start).count();
+    // Old ticks are removed once a later confirmed state is merged
+    assert(bench.getAllRewindInfo().size() < 20 * 84);
+    Log::info("RewindQueue", "Benchmark: %d events in %dus (%fus per event).",
+              events, (int)us, float(us) / events);
 
 }   // unitTesting
@@ -22,24 +22,48 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
 class EventRewinder;
 class RewindInfo;
-class TimeStepInfo;
 
 /** \ingroup network
+ *  Stores all states and events in a ring buffer indexed by ticks, so a
+ *  RewindInfo can be inserted, found and removed without searching. For
+ *  each tick the states are kept before the events, each in the order in
+ *  which they were added.
  */
 
 class RewindQueue
 {
 private:
-
-    typedef std::list<RewindInfo*> AllRewindInfo;
-
-    AllRewindInfo m_all_rewind_info;
+    /** All states and events of one tick. The vectors keep their memory
+     *  when the tick is removed, so the ring does not allocate memory once
+     *  it has been used for a few ticks. */
+    struct TickRewindInfo
+    {
+        std::vector<RewindInfo*> m_states;
+        std::vector<RewindInfo*> m_events;
+        // --------------------------------------------------------------------
+        unsigned size() const
+        {
+            return (unsigned)(m_states.size() + m_events.size());
+        }
+        // --------------------------------------------------------------------
+        RewindInfo* get(unsigned index) const
+        {
+            return index < m_states.size() ? m_states[index]
+                : m_events[index - m_states.size()];
+        }
+    };
+
+    /** The ring buffer, index is ticks modulo its size (a power of 2). */
+    std::vector<TickRewindInfo> m_all_rewind_info;
+
+    /** First and last tick stored in m_all_rewind_info, the queue is empty
+     *  if m_first_ticks > m_last_ticks. */
+    int m_first_ticks, m_last_ticks;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
@@ -49,14 +73,33 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Tick and index in this tick of the current time step info to be
+     *  handled. If there is no RewindInfo at this position, the current
+     *  one is the next one stored. */
+    int m_current_ticks;
+    unsigned m_current_index;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
+    /** Latest time of a network event which was merged in the past (i.e.
+     *  it was not played when it happened) since the last rewind, or -1. */
+    int m_latest_past_network_event;
 
     void cleanupOldRewindInfo(int ticks);
+    void growRing(int span);
+    void findCurrent(int *ticks, unsigned *index) const;
+    std::vector<RewindInfo*> getAllRewindInfo() const;
+    // ------------------------------------------------------------------------
+    TickRewindInfo& getTickRewindInfo(int ticks)
+    {
+        return m_all_rewind_info[ticks & (m_all_rewind_info.size() - 1)];
+    }   // getTickRewindInfo
+    // ------------------------------------------------------------------------
+    const TickRewindInfo& getTickRewindInfo(int ticks) const
+    {
+        return m_all_rewind_info[ticks & (m_all_rewind_info.size() - 1)];
+    }   // getTickRewindInfo
 
 public:
         static void unitTesting();
@@ -83,6 +126,10 @@ public:
     bool hasMoreRewindInfo() const;
     int  undoUntil(int undo_ticks);
     void insertRewindInfo(RewindInfo *ri);
+    RewindInfo* findConfirmedState(int ticks);
+    void skipUntil(int ticks);
+    RewindInfo* getCurrent();
+    void next();
 
     // ------------------------------------------------------------------------
     /** Returns the time of the latest confirmed state. */
@@ -91,22 +138,13 @@ public:
         return m_latest_confirmed_state_time;
     }
     // ------------------------------------------------------------------------
-    /** Sets the current element to be the next one and returns the next
-     *  RewindInfo element. */
-    void next()
+    /** Returns the time of the latest network event merged in the past since
+     *  the last rewind, or -1 if there is none. Such events are only played
+     *  by a rewind. */
+    int getLatestPastNetworkEvent() const
     {
-        assert(m_current != m_all_rewind_info.end());
-        m_current++;
-        return;
-    }   // operator++
-
-    // ------------------------------------------------------------------------
-    /** Returns the current RewindInfo. Caller must make sure that there is at
-     *  least one more RewindInfo (see hasMoreRewindInfo()). */
-    RewindInfo* getCurrent()
-    {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
-    }   // getNext
+        return m_latest_past_network_event;
+    }
 
 };   // RewindQueue
 
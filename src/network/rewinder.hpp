@@ -93,6 +93,30 @@ public:
     virtual std::function<void()> getLocalStateRestoreFunction()
                                                              { return nullptr; }
     // -------------------------------------------------------------------------
+    /** Called on a client instead of restoreState() if the server left this
+     *  rewinder out of a state (see StateRelevance) and no prediction was
+     *  saved for that time, e.g. because the kart was showing an animation
+     *  or the client joined later. It restores what this client saved
+     *  itself for that time (see getLocalStateRestoreFunction()). */
+    virtual void restoreLocalState()                                          {}
+    // -------------------------------------------------------------------------
+    /** Called on a client at the times the server saves a state. It returns
+     *  what is needed to decide later if the state received from the server
+     *  for this time matches the local prediction (see matchesPrediction()),
+     *  or NULL if this is not supported, in which case a received state
+     *  always causes a rewind. An empty buffer means that this rewinder
+     *  does not need to be part of the state (e.g. an eliminated kart).
+     *  The caller takes ownership of the buffer. */
+    virtual BareNetworkString* savePrediction()                 { return NULL; }
+    // -------------------------------------------------------------------------
+    /** Returns true if the confirmed state in buffer (count bytes) matches
+     *  the prediction saved by savePrediction() for the same time closely
+     *  enough that no rewind is needed for this rewinder. The read offsets
+     *  of both buffers can be changed. */
+    virtual bool matchesPrediction(BareNetworkString* prediction,
+                                   BareNetworkString* buffer, int count)
+                                                               { return false; }
+    // -------------------------------------------------------------------------
     const std::string& getUniqueIdentity() const
     {
         assert(!m_unique_identity.empty() && m_unique_identity.size() < 255);
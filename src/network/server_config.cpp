@@ -35,17 +35,33 @@ static std::vector<UserConfigParam*> g_server_params;
 #include "io/file_manager.hpp"
 #include "network/game_setup.hpp"
 #include "network/network_config.hpp"
+#include "network/network_recorder.hpp"
 #include "network/protocols/lobby_protocol.hpp"
 #include "network/stk_host.hpp"
+#include "online/request_manager.hpp"
 #include "race/race_manager.hpp"
 #include "utils/string_utils.hpp"
+#include "main_loop.hpp"
 
 #include <fstream>
 
+#ifdef __linux__
+#  include <sched.h>
+#endif
+#if !defined(WIN32) && !defined(ANDROID)
+#  include <errno.h>
+#  include <string.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif
+
 namespace ServerConfig
 {
 // ============================================================================
 std::string g_server_config_path;
+/** Index of the lobby run by this process, 0 for the original process and
+ *  1 to server-lobbies - 1 for each forked one. */
+unsigned g_lobby_index = 0;
 // ============================================================================
 FloatServerConfigParam::FloatServerConfigParam(float default_value,
                                                const char* param_name,
@@ -181,6 +197,10 @@ std::string getServerConfigXML()
 // ----------------------------------------------------------------------------
 void writeServerConfigToDisk()
 {
+    // Forked lobbies have a different port and name in memory, only the
+    // first lobby owns the config file
+    if (g_lobby_index != 0)
+        return;
     const std::string& config_xml = getServerConfigXML();
     try
     {
@@ -271,6 +291,142 @@ core::stringw getModeName(unsigned id)
     }
 }   // getModeName
 
+// ----------------------------------------------------------------------------
+unsigned getLobbyIndex()
+{
+    return g_lobby_index;
+}   // getLobbyIndex
+
+// ----------------------------------------------------------------------------
+/** Binds the lobby run by this process to one CPU core if
+ *  lobby-cpu-affinity is enabled. Only the cores this process may run on
+ *  (e.g. limited by taskset or a container) are used.
+ */
+static void setLobbyCPUAffinity()
+{
+    if (!m_lobby_cpu_affinity || m_server_lobbies <= 1)
+        return;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        Log::warn("ServerConfig", "Failed to get the cores of lobby %d: %s",
+            g_lobby_index, strerror(errno));
+        return;
+    }
+    const int cores = CPU_COUNT(&set);
+    if (cores == 0)
+        return;
+    // Lobby n uses the n-th allowed core (modulo the number of them)
+    int nth = (int)(g_lobby_index % cores);
+    int core = -1;
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &set) && nth-- == 0)
+        {
+            core = i;
+            break;
+        }
+    }
+    if (core == -1)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        Log::warn("ServerConfig", "Failed to bind lobby %d to core %d: %s",
+            g_lobby_index, core, strerror(errno));
+    }
+#else
+    Log::warn("ServerConfig", "lobby-cpu-affinity is only supported on "
+        "Linux.");
+#endif
+}   // setLobbyCPUAffinity
+
+// ----------------------------------------------------------------------------
+/** Returns the name of an output file for the lobby run by this process: the
+ *  first lobby uses the configured name, all other lobbies insert their
+ *  index before the extension (e.g. metrics.prom becomes metrics.2.prom).
+ */
+static std::string getLobbyFileName(const std::string& name)
+{
+    if (name.empty() || g_lobby_index == 0)
+        return name;
+    const std::string index = StringUtils::toString(g_lobby_index);
+    const size_t dot = name.find_last_of('.');
+    const size_t slash = name.find_last_of("/\\");
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot <= slash + 1) || dot == 0)
+        return name + "." + index;
+    return name.substr(0, dot) + "." + index + name.substr(dot);
+}   // getLobbyFileName
+
+// ----------------------------------------------------------------------------
+/** Creates server-lobbies - 1 extra lobbies by forking this process. This is
+ *  done after all karts and tracks are loaded, so all lobbies share that data
+ *  copy-on-write, while each lobby keeps its own STKHost, World, Physics and
+ *  rewind state (which are all process-wide singletons). Each forked lobby
+ *  exits together with the original process.
+ *  The request manager thread is stopped while forking, since fork() only
+ *  copies the calling thread. All files written by a server are renamed per
+ *  lobby (see getLobbyFileName()), so lobbies don't overwrite each other.
+ */
+static void forkServerLobbies()
+{
+    const int lobbies = m_server_lobbies;
+    if (lobbies <= 1)
+        return;
+#if defined(WIN32) || defined(ANDROID)
+    Log::warn("ServerConfig", "server-lobbies is not supported on this "
+        "platform, only one lobby will be created.");
+#else
+    const pid_t parent_pid = getpid();
+    const std::string server_name = m_server_name;
+    Online::RequestManager::get()->stopNetworkThreadForFork();
+    for (int i = 1; i < lobbies; i++)
+    {
+        // Otherwise buffered output is written by each lobby again
+        Log::flushBuffers();
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            Log::error("ServerConfig", "Failed to fork server lobby %d: %s",
+                i, strerror(errno));
+            break;
+        }
+        if (pid == 0)
+        {
+            g_lobby_index = i;
+            if (m_server_port != 0)
+                m_server_port = m_server_port + i;
+            m_server_name = server_name + " #" + StringUtils::toString(i + 1);
+            m_tick_profile_file = getLobbyFileName(m_tick_profile_file);
+            m_metrics_file = getLobbyFileName(m_metrics_file);
+            NetworkRecorder::setRecordFile(
+                getLobbyFileName(NetworkRecorder::getRecordFile()));
+            // Only the original process reads from stdin
+            STKHost::m_enable_console = false;
+            main_loop->setParentPid((unsigned)parent_pid);
+            break;
+        }
+        Log::info("ServerConfig", "Forked server lobby %d, pid %d.", i,
+            (int)pid);
+    }
+    Online::RequestManager::get()->restartNetworkThreadAfterFork();
+    if (g_lobby_index == 0)
+    {
+        // All lobbies share the discovery port (see STKHost::mainLoop), so
+        // only broadcasts reach all of them
+        Log::info("ServerConfig", "LAN discovery broadcasts are answered by "
+            "all %d lobbies, but LAN queries sent directly to this host "
+            "(e.g. from the \"Enter server address\" dialog) only reach "
+            "one of them.", lobbies);
+    }
+#endif
+}   // forkServerLobbies
+
 // ----------------------------------------------------------------------------
 void loadServerLobbyFromConfig()
 {
@@ -344,6 +500,8 @@ void loadServerLobbyFromConfig()
         race_manager->getMajorMode() == RaceManager::MAJOR_MODE_GRAND_PRIX;
     const bool is_battle = race_manager->isBattleMode();
 
+    forkServerLobbies();
+    setLobbyCPUAffinity();
     std::shared_ptr<LobbyProtocol> server_lobby;
     server_lobby = STKHost::create();
 
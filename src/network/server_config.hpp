@@ -99,6 +99,46 @@ namespace ServerConfig
         "in user config, than any port. STK will auto change to random "
         "port if the port you specify failed to be bound."));
 
+    SERVER_CFG_PREFIX IntServerConfigParam m_server_lobbies
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1, "server-lobbies",
+        "Number of independent lobbies hosted by this server (Linux and "
+        "macOS only). Each extra lobby is a forked copy of this process "
+        "sharing all loaded karts and tracks, using server-port + n (if "
+        "server-port is not 0) and server name with \" #n\" appended. "
+        "Files written by lobby n (like tick-profile-file and metrics-file) "
+        "get .n inserted before their extension."));
+
+    SERVER_CFG_PREFIX BoolServerConfigParam m_lobby_cpu_affinity
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false, "lobby-cpu-affinity",
+        "If server-lobbies is larger than 1, bind each lobby to a single CPU "
+        "core (lobby n uses the n-th core modulo the number of cores this "
+        "server may run on, Linux only), "
+        "so lobbies are packed onto cores instead of being moved around by "
+        "the operating system."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_tick_profile_file
+        SERVER_CFG_DEFAULT(StringServerConfigParam("", "tick-profile-file",
+        "If not empty, a server without graphics appends the 50th, 90th "
+        "and 99th percentile and the maximum duration (in microseconds) of "
+        "parts of its ticks to this file (CSV) every tick-profile-interval "
+        "seconds. The network console command tickstats shows them too."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_tick_profile_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(60, "tick-profile-interval",
+        "Interval in seconds for writing to tick-profile-file."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_metrics_file
+        SERVER_CFG_DEFAULT(StringServerConfigParam("", "metrics-file",
+        "If not empty, the server rewrites this file every metrics-interval "
+        "seconds with metrics of the server and each peer (round trip "
+        "time, packet loss, bytes sent and received, rewinds, tick "
+        "durations, queue depths, memory) in the Prometheus text format, "
+        "e.g. for the textfile collector of the node exporter."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_metrics_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(10, "metrics-interval",
+        "Interval in seconds for writing metrics-file."));
+
     SERVER_CFG_PREFIX IntServerConfigParam m_server_mode
         SERVER_CFG_DEFAULT(IntServerConfigParam(3, "server-mode",
         "Game mode in server, 0 is normal race (grand prix), "
@@ -303,6 +343,41 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX FloatServerConfigParam m_state_relevance_distance
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(0.0f,
+        "state-relevance-distance",
+        "If positive, karts further away than this distance (in meters along "
+        "the track) from the karts of a player are sent to that player in "
+        "only every second state, and karts more than 3 times as far away in "
+        "every fourth state, which saves bandwidth with many players. Karts "
+        "behind count twice as far away, karts which recently collided are "
+        "always sent. 0 sends all karts in every state."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_connection_rate_limit
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(2.0f,
+        "connection-rate-limit",
+        "Number of new connections and connection requests per second "
+        "allowed from one IP address, 5 times as many are allowed at once, "
+        "and a /24 subnet is allowed 4 times as many as one address. More "
+        "are dropped before being processed, which protects the server "
+        "against connection floods. Localhost is not limited. 0 disables "
+        "the limit."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_server_query_rate_limit
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(5.0f,
+        "server-query-rate-limit",
+        "Number of LAN and server info queries per second answered for one "
+        "IP address, with the same bursts as connection-rate-limit. More are "
+        "dropped, so server list scanners can't keep the server busy. 0 "
+        "disables the limit."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_max_pending_connections
+        SERVER_CFG_DEFAULT(IntServerConfigParam(32,
+        "max-pending-connections",
+        "Maximum number of encrypted connection requests which wait for the "
+        "keys of their players from the STK server. If more arrive, the "
+        "oldest request is dropped and its peer disconnected."));
+
     SERVER_CFG_PREFIX StringToUIntServerConfigParam m_server_ip_ban_list
         SERVER_CFG_DEFAULT(StringToUIntServerConfigParam("server-ip-ban-list",
         "ip: IP in X.X.X.X/Y (CIDR) format for banning, use Y of 32 for a "
@@ -321,7 +396,7 @@ namespace ServerConfig
 
     // ========================================================================
     /** Server version, will be advanced if there are protocol changes. */
-    static const uint32_t m_server_version = 5;
+    static const uint32_t m_server_version = 6;
     // ========================================================================
     void loadServerConfig(const std::string& path = "");
     // ------------------------------------------------------------------------
@@ -344,6 +419,8 @@ namespace ServerConfig
     // ------------------------------------------------------------------------
     void loadServerLobbyFromConfig();
     // ------------------------------------------------------------------------
+    unsigned getLobbyIndex();
+    // ------------------------------------------------------------------------
     std::string getConfigDirectory();
 
 };   // namespace ServerConfig
@@ -0,0 +1,174 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_relevance.hpp"
+
+#include "config/stk_config.hpp"
+#include "karts/abstract_kart.hpp"
+#include "modes/linear_world.hpp"
+#include "network/server_config.hpp"
+#include "tracks/arena_graph.hpp"
+#include "tracks/drive_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/** Karts which collided less than this many seconds ago are always sent. */
+static const float INTERACTION_TIME = 3.0f;
+
+// ----------------------------------------------------------------------------
+/** Called when two karts collided, so both are sent in every state to the
+ *  peers of either kart for a while.
+ */
+void StateRelevance::addInteraction(unsigned kart_a, unsigned kart_b)
+{
+    m_interactions[std::make_pair(std::min(kart_a, kart_b),
+        std::max(kart_a, kart_b))] = World::getWorld()->getTicksSinceStart();
+}   // addInteraction
+
+// ----------------------------------------------------------------------------
+/** Called after each state sent, removes old interactions.
+ */
+void StateRelevance::nextState()
+{
+    m_state_count++;
+    const int oldest = World::getWorld()->getTicksSinceStart() -
+        stk_config->time2Ticks(INTERACTION_TIME);
+    for (auto it = m_interactions.begin(); it != m_interactions.end();)
+    {
+        if (it->second < oldest)
+            it = m_interactions.erase(it);
+        else
+            it++;
+    }
+}   // nextState
+
+// ----------------------------------------------------------------------------
+bool StateRelevance::hasInteracted(unsigned kart_a, unsigned kart_b,
+                                   int ticks) const
+{
+    auto it = m_interactions.find(std::make_pair(std::min(kart_a, kart_b),
+        std::max(kart_a, kart_b)));
+    return it != m_interactions.end() &&
+        ticks - it->second <= stk_config->time2Ticks(INTERACTION_TIME);
+}   // hasInteracted
+
+// ----------------------------------------------------------------------------
+/** Returns the distance of a kart as seen from the kart of a peer: along
+ *  the track in linear races (the shorter way round the lap), along the
+ *  arena graph in battle and soccer, and in a straight line otherwise. It
+ *  is doubled if the kart is behind the viewing kart.
+ */
+float StateRelevance::getDistance(const AbstractKart* viewer,
+                                  const AbstractKart* kart) const
+{
+    World* world = World::getWorld();
+    const Vec3 diff = kart->getXYZ() - viewer->getXYZ();
+    float distance = diff.length();
+    LinearWorld* lw = dynamic_cast<LinearWorld*>(world);
+    WorldWithRank* wwr = dynamic_cast<WorldWithRank*>(world);
+    if (lw && DriveGraph::get())
+    {
+        float track_distance = fabsf(
+            lw->getDistanceDownTrackForKart(kart->getWorldKartId(), false) -
+            lw->getDistanceDownTrackForKart(viewer->getWorldKartId(), false));
+        const float lap_length = DriveGraph::get()->getLapLength();
+        if (lap_length > 0.0f)
+        {
+            track_distance = fmodf(track_distance, lap_length);
+            track_distance = std::min(track_distance,
+                                      lap_length - track_distance);
+        }
+        distance = track_distance;
+    }
+    else if (wwr && ArenaGraph::get())
+    {
+        int from = wwr->getSectorForKart(viewer);
+        int to = wwr->getSectorForKart(kart);
+        if (from != Graph::UNKNOWN_SECTOR && to != Graph::UNKNOWN_SECTOR)
+            distance = ArenaGraph::get()->getDistance(from, to);
+    }
+
+    const Vec3 forward = viewer->getTrans().getBasis().getColumn(2);
+    if (forward.dot(diff) < 0.0f)
+        distance *= 2.0f;
+    return distance;
+}   // getDistance
+
+// ----------------------------------------------------------------------------
+/** Returns how often the state of a kart at the given distance is sent:
+ *  1 for every state, 2 for every second state and 4 for every fourth.
+ *  \param distance Distance of the kart, see getDistance().
+ *  \param relevance_distance Distance up to which karts are always sent.
+ */
+unsigned StateRelevance::getUpdateInterval(float distance,
+                                           float relevance_distance)
+{
+    if (relevance_distance <= 0.0f || distance < relevance_distance)
+        return 1;
+    if (distance < 3.0f * relevance_distance)
+        return 2;
+    return 4;
+}   // getUpdateInterval
+
+// ----------------------------------------------------------------------------
+/** Returns a bit mask of the world kart ids of all karts which are not
+ *  included in the current state for a peer (only the first 64 karts can
+ *  be skipped).
+ *  \param viewer_karts World kart ids of the karts of the peer. If it has
+ *         no karts (e.g. a spectator) all karts are sent.
+ */
+uint64_t StateRelevance::getSkippedKarts(
+                                const std::set<unsigned>& viewer_karts) const
+{
+    const float relevance_distance = ServerConfig::m_state_relevance_distance;
+    if (relevance_distance <= 0.0f || viewer_karts.empty())
+        return 0;
+
+    World* world = World::getWorld();
+    const int ticks = world->getTicksSinceStart();
+    const unsigned num_karts = std::min(world->getNumKarts(), 64u);
+    uint64_t skipped = 0;
+    for (unsigned i = 0; i < num_karts; i++)
+    {
+        AbstractKart* kart = world->getKart(i);
+        if (viewer_karts.find(i) != viewer_karts.end() ||
+            kart->isEliminated() || kart->getKartAnimation())
+            continue;
+        float distance = std::numeric_limits<float>::max();
+        for (unsigned id : viewer_karts)
+        {
+            if (id >= world->getNumKarts())
+                continue;
+            if (hasInteracted(id, i, ticks))
+            {
+                distance = 0.0f;
+                break;
+            }
+            distance = std::min(distance,
+                                getDistance(world->getKart(id), kart));
+        }
+        const unsigned interval =
+            getUpdateInterval(distance, relevance_distance);
+        // Spread the karts over the states, so the size of states is similar
+        if ((m_state_count + i) % interval != 0)
+            skipped |= uint64_t(1) << i;
+    }
+    return skipped;
+}   // getSkippedKarts
@@ -0,0 +1,65 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_RELEVANCE_HPP
+#define HEADER_STATE_RELEVANCE_HPP
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+
+class AbstractKart;
+
+/** \class StateRelevance
+ *  \brief Decides on a server which karts are not included in the state sent
+ *  to a peer, so that karts far away from the karts of that peer are sent
+ *  less often. The distance is measured along the drive graph in linear
+ *  races and along the arena graph in battle and soccer, karts behind count
+ *  twice as far away. Karts which recently collided with a kart of the peer
+ *  or show a kart animation are always sent, as are all other rewinders
+ *  (e.g. projectiles). A client restores karts missing in a state from its
+ *  own prediction. It is only used in the main thread.
+ *  \ingroup network
+ */
+class StateRelevance
+{
+private:
+    /** Time (in ticks) of the last collision of two karts, indexed by the
+     *  smaller and the larger world kart id. */
+    std::map<std::pair<unsigned, unsigned>, int> m_interactions;
+
+    /** Number of states sent so far, used to spread the states of far away
+     *  karts evenly. */
+    unsigned m_state_count;
+
+    float getDistance(const AbstractKart* viewer,
+                      const AbstractKart* kart) const;
+    bool hasInteracted(unsigned kart_a, unsigned kart_b, int ticks) const;
+
+public:
+    StateRelevance() : m_state_count(0)                                   {}
+    void addInteraction(unsigned kart_a, unsigned kart_b);
+    void nextState();
+    uint64_t getSkippedKarts(const std::set<unsigned>& viewer_karts) const;
+    static unsigned getUpdateInterval(float distance,
+                                      float relevance_distance);
+
+};   // StateRelevance
+
+#endif
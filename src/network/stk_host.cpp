@@ -21,11 +21,15 @@
 #include "config/stk_config.hpp"
 #include "config/user_config.hpp"
 #include "io/file_manager.hpp"
+#include "network/connection_limiter.hpp"
+#include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
+#include "network/metrics_exporter.hpp"
 #include "network/network_config.hpp"
 #include "network/network_console.hpp"
 #include "network/network_player_profile.hpp"
+#include "network/network_recorder.hpp"
 #include "network/network_string.hpp"
 #include "network/network_timer_synchronizer.hpp"
 #include "network/protocols/connect_to_peer.hpp"
@@ -263,6 +267,17 @@ STKHost::STKHost(bool server)
         m_network = new Network(ServerConfig::m_server_max_players + 1,
             /*channel_limit*/EVENT_CHANNEL_COUNT, /*max_in_bandwidth*/0,
             /*max_out_bandwidth*/ 0, &addr, true/*change_port_if_bound*/);
+        m_network_recorder = NetworkRecorder::create();
+        if (ServerConfig::m_connection_rate_limit > 0.0f)
+        {
+            m_connection_limiter =
+                new ConnectionLimiter(ServerConfig::m_connection_rate_limit);
+        }
+        if (ServerConfig::m_server_query_rate_limit > 0.0f)
+        {
+            m_query_limiter =
+                new ConnectionLimiter(ServerConfig::m_server_query_rate_limit);
+        }
     }
     else
     {
@@ -298,8 +313,16 @@ void STKHost::init()
     m_shutdown         = false;
     m_authorised       = false;
     m_network          = NULL;
+    m_network_recorder = NULL;
+    m_connection_limiter = NULL;
+    m_query_limiter    = NULL;
+    m_server_info      = NULL;
+    m_server_info_key  = 0;
+    m_server_info_track = -1;
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
     m_client_ping.store(0);
+    m_max_enet_cmd_batch.store(0);
+    m_enet_cmd_count.store(0);
 
     // Start with initialising ENet
     // ============================
@@ -336,6 +359,10 @@ STKHost::~STKHost()
     Network::closeLog();
     stopListening();
 
+    delete m_network_recorder;
+    delete m_connection_limiter;
+    delete m_query_limiter;
+    delete m_server_info;
     delete m_network;
     enet_deinitialize();
     delete m_separate_process;
@@ -695,7 +722,11 @@ void STKHost::mainLoop()
     {
         TransportAddress address(0, stk_config->m_server_discovery_port);
         ENetAddress eaddr = address.toEnetAddress();
-        direct_socket = new Network(1, 1, 0, 0, &eaddr);
+        // Lobbies forked from this process share the discovery port, so all
+        // of them can be found by LAN broadcasts
+        direct_socket = new Network(1, 1, 0, 0, &eaddr,
+            /*change_port_if_bound*/false,
+            /*reuse_address*/ServerConfig::m_server_lobbies > 1);
         if (direct_socket->getENetHost() == NULL)
         {
             Log::warn("STKHost", "No direct socket available, this "
@@ -707,8 +738,10 @@ void STKHost::mainLoop()
 
     uint64_t last_ping_time = StkTime::getRealTimeMs();
     uint64_t last_update_speed_time = StkTime::getRealTimeMs();
+    uint64_t last_state_interval_time = StkTime::getRealTimeMs();
     uint64_t last_ping_time_update_for_client = StkTime::getRealTimeMs();
     std::map<std::string, uint64_t> ctp;
+    EnetCommandList copied_list;
     while (m_exit_timeout.load() > StkTime::getRealTimeMs())
     {
         // Clear outdated connect to peer list every 15 seconds
@@ -730,6 +763,8 @@ void STKHost::mainLoop()
             getNetwork()->getENetHost()->totalSentData = 0;
             getNetwork()->getENetHost()->totalReceivedData = 0;
         }
+        if (NetworkConfig::get()->isServer())
+            MetricsExporter::update(this);
 
         auto sl = LobbyProtocol::get<ServerLobby>();
         if (direct_socket && sl && sl->waitingForPlayers())
@@ -748,6 +783,13 @@ void STKHost::mainLoop()
         if (is_server)
         {
             std::unique_lock<std::mutex> peer_lock(m_peers_mutex);
+            if (last_state_interval_time < StkTime::getRealTimeMs())
+            {
+                // Adapt the state rate of each peer once per second
+                last_state_interval_time = StkTime::getRealTimeMs() + 1000;
+                for (auto& p : m_peers)
+                    p.second->updateStateInterval();
+            }
             const float timeout = ServerConfig::m_validation_timeout;
             bool need_ping = false;
             if (sl && (!sl->isRacing() || sl->allowJoinedPlayersWaiting()) &&
@@ -847,8 +889,10 @@ void STKHost::mainLoop()
                     (!sl->allowJoinedPlayersWaiting() ||
                     !sl->isRacing() || it->second->isWaitingForGame()))
                 {
-                    need_destroy_packet = false;
-                    enet_peer_send(it->first, EVENT_CHANNEL_UNENCRYPTED, packet);
+                    // Replayed peers are not connected, so sending fails
+                    if (enet_peer_send(it->first, EVENT_CHANNEL_UNENCRYPTED,
+                        packet) == 0)
+                        need_destroy_packet = false;
                 }
 
                 // Remove peer which has not been validated after a specific time
@@ -874,19 +918,34 @@ void STKHost::mainLoop()
                 enet_packet_destroy(packet);
         }
 
-        std::list<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
-            ENetCommandType> > copied_list;
+        // Swap with the previously processed (now empty) list, so threads
+        // adding commands can reuse its memory and hold the lock shortly
         std::unique_lock<std::mutex> lock(m_enet_cmd_mutex);
         std::swap(copied_list, m_enet_cmd);
         lock.unlock();
+        if (copied_list.size() > m_max_enet_cmd_batch.load())
+            m_max_enet_cmd_batch.store((uint32_t)copied_list.size());
+        m_enet_cmd_count.fetch_add(copied_list.size());
         for (auto& p : copied_list)
         {
             switch (std::get<3>(p))
             {
             case ECT_SEND_PACKET:
-                enet_peer_send(std::get<0>(p), (uint8_t)std::get<2>(p),
-                    std::get<1>(p));
+            {
+                ENetPacket* packet = std::get<1>(p);
+                if (enet_peer_send(std::get<0>(p), (uint8_t)std::get<2>(p),
+                    packet) < 0 && packet->referenceCount == 0)
+                    enet_packet_destroy(packet);
                 break;
+            }
+            case ECT_RELEASE_PACKET:
+            {
+                // Drop the reference held by sendPacketToPeers
+                ENetPacket* packet = std::get<1>(p);
+                if (--packet->referenceCount == 0)
+                    enet_packet_destroy(packet);
+                break;
+            }
             case ECT_DISCONNECT:
                 enet_peer_disconnect(std::get<0>(p), std::get<2>(p));
                 break;
@@ -900,9 +959,17 @@ void STKHost::mainLoop()
                 break;
             }
         }
+        copied_list.clear();
+
+        // Move events which did not fit into the protocol manager queues
+        if (auto pm = ProtocolManager::lock())
+            pm->flushEvents();
 
         bool need_ping_update = false;
-        while (enet_host_service(host, &event, 10) != 0)
+        const bool replay = m_network_recorder &&
+            m_network_recorder->isReplaying();
+        while (replay ? m_network_recorder->replay(host, &event, m_peers) :
+               enet_host_service(host, &event, 10) != 0)
         {
             auto lp = LobbyProtocol::get<LobbyProtocol>();
             if (!is_server &&
@@ -926,15 +993,32 @@ void STKHost::mainLoop()
             if (event.type == ENET_EVENT_TYPE_NONE)
                 continue;
 
+            // The protocol manager reuses already handled events
+            auto pm = ProtocolManager::lock();
             Event* stk_event = NULL;
             if (event.type == ENET_EVENT_TYPE_CONNECT)
             {
+                // Drop connection floods before any peer is created
+                if (m_connection_limiter && !replay &&
+                    !m_connection_limiter->allow(
+                    TransportAddress(event.peer->address).getIP(),
+                    StkTime::getRealTimeMs()))
+                {
+                    enet_peer_disconnect_now(event.peer, PDI_BAD_CONNECTION);
+                    continue;
+                }
                 auto stk_peer = std::make_shared<STKPeer>
                     (event.peer, this, m_next_unique_host_id++);
+                if (replay)
+                {
+                    stk_peer->setReplayed(
+                        m_network_recorder->getReplayedHostId());
+                }
                 std::unique_lock<std::mutex> lock(m_peers_mutex);
                 m_peers[event.peer] = stk_peer;
                 lock.unlock();
-                stk_event = new Event(&event, stk_peer);
+                stk_event = pm ? pm->createEvent(&event, stk_peer)
+                               : new Event(&event, stk_peer);
                 TransportAddress addr(event.peer->address);
                 Log::info("STKHost", "%s has just connected. There are "
                     "now %u peers.", addr.toString().c_str(), getPeerCount());
@@ -957,7 +1041,9 @@ void STKHost::mainLoop()
                 // profile and handle it for disconnection
                 if (m_peers.find(event.peer) != m_peers.end())
                 {
-                    stk_event = new Event(&event, m_peers.at(event.peer));
+                    auto& peer = m_peers.at(event.peer);
+                    stk_event = pm ? pm->createEvent(&event, peer)
+                                   : new Event(&event, peer);
                     std::lock_guard<std::mutex> lock(m_peers_mutex);
                     m_peers.erase(event.peer);
                 }
@@ -1029,9 +1115,20 @@ void STKHost::mainLoop()
                     enet_packet_destroy(event.packet);
                     continue;
                 }
+                // Peers which are not validated yet can only send
+                // connection requests, which are expensive to handle
+                if (m_connection_limiter && !replay && !peer->isValidated() &&
+                    !m_connection_limiter->allow(
+                    peer->getAddress().getIP(), StkTime::getRealTimeMs()))
+                {
+                    enet_packet_destroy(event.packet);
+                    continue;
+                }
+                peer->addBytesReceived(event.packet->dataLength);
                 try
                 {
-                    stk_event = new Event(&event, peer);
+                    stk_event = pm ? pm->createEvent(&event, peer)
+                                   : new Event(&event, peer);
                 }
                 catch (std::exception& e)
                 {
@@ -1045,6 +1142,8 @@ void STKHost::mainLoop()
                 enet_packet_destroy(event.packet);
                 continue;
             }
+            if (m_network_recorder && !replay)
+                m_network_recorder->record(event, stk_event);
             if (stk_event->getType() == EVENT_TYPE_MESSAGE)
             {
                 Network::logPacket(stk_event->data(), true);
@@ -1060,17 +1159,62 @@ void STKHost::mainLoop()
             }   // if message event
 
             // notify for the event now.
-            auto pm = ProtocolManager::lock();
             if (pm && !pm->isExiting())
                 pm->propagateEvent(stk_event);
             else
                 delete stk_event;
         }   // while enet_host_service
+        // enet_host_service waits for events, the replay does not
+        if (replay)
+            StkTime::sleep(1);
     }   // while m_exit_timeout.load() > StkTime::getRealTimeMs()
     delete direct_socket;
     Log::info("STKHost", "Listening has been stopped.");
 }   // mainLoop
 
+// ----------------------------------------------------------------------------
+/** Returns the answer to a LAN server query, consisting of server name, max
+ *  players, current players and the lobby state. It is only serialised again
+ *  if anything in it has changed since the last query, so answering many
+ *  queries costs almost nothing.
+ */
+const BareNetworkString& STKHost::getServerInfo(std::shared_ptr<ServerLobby> sl)
+{
+    const std::string& pw = ServerConfig::m_private_server_password;
+    const bool in_game =
+        sl->getCurrentState() != ServerLobby::WAITING_FOR_START_GAME;
+    const uint8_t players = (uint8_t)getTotalPlayers();
+    const uint8_t difficulty = (uint8_t)sl->getDifficulty();
+    const uint8_t game_mode = (uint8_t)sl->getGameMode();
+    const uint32_t key = players | difficulty << 8 | game_mode << 16 |
+        (uint32_t)in_game << 24 | (uint32_t)!pw.empty() << 25;
+    const int track = sl->getCurrentTrackIndex();
+    if (m_server_info && key == m_server_info_key &&
+        track == m_server_info_track)
+        return *m_server_info;
+
+    m_server_info_key = key;
+    m_server_info_track = track;
+    const std::string& name = sl->getGameSetup()->getServerNameUtf8();
+    delete m_server_info;
+    m_server_info = new BareNetworkString((int)name.size() + 1 + 11);
+    BareNetworkString& s = *m_server_info;
+    s.addUInt32(ServerConfig::m_server_version);
+    s.encodeString(name);
+    s.addUInt8((uint8_t)ServerConfig::m_server_max_players);
+    s.addUInt8(players);
+    s.addUInt16(m_private_port);
+    s.addUInt8(difficulty);
+    s.addUInt8(game_mode);
+    s.addUInt8(!pw.empty());
+    s.addUInt8(in_game ? 1 : 0);
+    std::string current_track;
+    if (track != -1)
+        current_track = track_manager->getTrack(track)->getIdent();
+    s.encodeString(current_track);
+    return s;
+}   // getServerInfo
+
 // ----------------------------------------------------------------------------
 /** Handles a direct request given to a socket. This is typically a LAN 
  *  request, but can also be used if the server is public (i.e. not behind
@@ -1096,30 +1240,15 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
     const std::string connection_cmd = std::string("connection-request") +
         StringUtils::toString(m_private_port);
 
+    // Scanners of server lists can send lots of queries, so limit them
+    // before doing anything else
+    if (command != connection_cmd && m_query_limiter &&
+        !m_query_limiter->allow(sender.getIP(), StkTime::getRealTimeMs()))
+        return;
+
     if (command == "stk-server")
     {
-        Log::verbose("STKHost", "Received LAN server query");
-        const std::string& name = sl->getGameSetup()->getServerNameUtf8();
-        // Send the answer, consisting of server name, max players, 
-        // current players
-        const std::string& pw = ServerConfig::m_private_server_password;
-        BareNetworkString s((int)name.size()+1+11);
-        s.addUInt32(ServerConfig::m_server_version);
-        s.encodeString(name);
-        s.addUInt8((uint8_t)ServerConfig::m_server_max_players);
-        s.addUInt8((uint8_t)getTotalPlayers());
-        s.addUInt16(m_private_port);
-        s.addUInt8((uint8_t)sl->getDifficulty());
-        s.addUInt8((uint8_t)sl->getGameMode());
-        s.addUInt8(!pw.empty());
-        s.addUInt8((uint8_t)
-            (sl->getCurrentState() == ServerLobby::WAITING_FOR_START_GAME ?
-            0 : 1));
-        std::string current_track;
-        if (Track* t = sl->getPlayingTrack())
-            current_track = t->getIdent();
-        s.encodeString(current_track);
-        direct_socket->sendRawPacket(s, sender);
+        direct_socket->sendRawPacket(getServerInfo(sl), sender);
     }   // if message is server-requested
     else if (command == connection_cmd)
     {
@@ -1134,6 +1263,9 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
             Log::error("STKHost", "which is outside of LAN - rejected.");
             return;
         }
+        if (m_connection_limiter && !m_connection_limiter->allow(
+            sender.getIP(), StkTime::getRealTimeMs()))
+            return;
         if (ctp.find(peer_addr) == ctp.end())
         {
             ctp[peer_addr] = StkTime::getRealTimeMs();
@@ -1209,11 +1341,13 @@ bool STKHost::isConnectedTo(const TransportAddress& peer)
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1224,11 +1358,13 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1241,15 +1377,17 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1262,14 +1400,81 @@ void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data to a list of peers. Each peer with encryption needs
+ *  its own encrypted packet (encryptSend is faster here than
+ *  Crypto::encryptSendBatch, see --benchmark-crypto), all other peers share
+ *  one ENetPacket, so the data is copied only once instead of once per
+ *  peer. The send commands of all peers are queued with one lock.
+ *  \param peers The peers to send the data to. The caller must make sure
+ *         they are not deleted while this function runs.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                NetworkString *data, bool reliable)
+{
+    std::vector<ENetPeer*> shared_peers;
+    std::vector<std::pair<ENetPeer*, ENetPacket*> > encrypted_packets;
+    for (STKPeer* peer : peers)
+    {
+        if (!peer->canSendPacket())
+            continue;
+        if (peer->getCrypto())
+        {
+            ENetPacket* packet =
+                peer->getCrypto()->encryptSend(*data, reliable);
+            if (!packet)
+                continue;
+            peer->addBytesSent(packet->dataLength);
+            encrypted_packets.emplace_back(peer->getENetPeer(), packet);
+        }
+        else
+        {
+            shared_peers.push_back(peer->getENetPeer());
+            peer->addBytesSent(data->getTotalSize());
+        }
+    }
+    if (!encrypted_packets.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
+        for (auto& p : encrypted_packets)
+        {
+            m_enet_cmd.emplace_back(p.first, p.second, EVENT_CHANNEL_NORMAL,
+                ECT_SEND_PACKET);
+        }
+    }
+    if (shared_peers.empty())
+        return;
+
+    ENetPacket* packet = enet_packet_create(data->getData(),
+        data->getTotalSize(), (reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+    if (!packet)
+        return;
+    // Enet frees a packet as soon as no peer references it anymore, which
+    // can happen after the first peer sent it while the other send commands
+    // are not yet executed. So hold a reference until all are queued.
+    packet->referenceCount++;
+    std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
+    for (ENetPeer* peer : shared_peers)
+    {
+        m_enet_cmd.emplace_back(peer, packet, EVENT_CHANNEL_NORMAL,
+            ECT_SEND_PACKET);
+    }
+    m_enet_cmd.emplace_back(nullptr, packet, 0, ECT_RELEASE_PACKET);
+}   // sendPacketToPeers
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
@@ -45,10 +45,14 @@
 #include <set>
 #include <thread>
 #include <tuple>
+#include <vector>
 
+class BareNetworkString;
+class ConnectionLimiter;
 class GameSetup;
 class LobbyProtocol;
 class NetworkPlayerProfile;
+class NetworkRecorder;
 class NetworkTimerSynchronizer;
 class Server;
 class ServerLobby;
@@ -58,7 +62,8 @@ enum ENetCommandType : unsigned int
 {
     ECT_SEND_PACKET = 0,
     ECT_DISCONNECT = 1,
-    ECT_RESET = 2
+    ECT_RESET = 2,
+    ECT_RELEASE_PACKET = 3
 };
 
 class STKHost
@@ -84,6 +89,24 @@ private:
     /** ENet host interfacing sockets. */
     Network* m_network;
 
+    /** Records or replays the received events, if enabled. */
+    NetworkRecorder* m_network_recorder;
+
+    /** Drops connection floods on servers, NULL if disabled. Only used in
+     *  the listening thread. */
+    ConnectionLimiter* m_connection_limiter;
+
+    /** Drops floods of LAN and server info queries on servers, NULL if
+     *  disabled. Only used in the listening thread. */
+    ConnectionLimiter* m_query_limiter;
+
+    /** The serialised answer to server info queries, only rebuilt if the
+     *  lobby state in m_server_info_key or the playing track change. Only
+     *  used in the listening thread. */
+    BareNetworkString* m_server_info;
+    uint32_t m_server_info_key;
+    int m_server_info_track;
+
     /** Network console thread */
     std::thread m_network_console;
 
@@ -92,13 +115,19 @@ private:
 
     /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
      *  thread. */
-    std::list<std::tuple</*peer receive*/ENetPeer*,
+    typedef std::vector<std::tuple</*peer receive*/ENetPeer*,
         /*packet to send*/ENetPacket*, /*integer data*/uint32_t,
-        ENetCommandType> > m_enet_cmd;
+        ENetCommandType> > EnetCommandList;
+    EnetCommandList m_enet_cmd;
 
     /** Protect \ref m_enet_cmd from multiple threads usage. */
     std::mutex m_enet_cmd_mutex;
 
+    /** Largest number of enet commands handled in one go, and total number
+     *  of commands, for the network console. */
+    std::atomic<uint32_t> m_max_enet_cmd_batch;
+    std::atomic<uint64_t> m_enet_cmd_count;
+
     /** The list of peers connected to this instance. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
 
@@ -167,6 +196,8 @@ private:
                                    std::map<std::string, uint64_t>& ctp);
     // ------------------------------------------------------------------------
     void mainLoop();
+    // ------------------------------------------------------------------------
+    const BareNetworkString& getServerInfo(std::shared_ptr<ServerLobby> sl);
 
 public:
     /** If a network console should be started. */
@@ -228,6 +259,9 @@ public:
     // ------------------------------------------------------------------------
     void sendPacketToAllPeers(NetworkString *data, bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           NetworkString *data, bool reliable = true);
+    // ------------------------------------------------------------------------
     void sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                   NetworkString* data, bool reliable = true);
     // ------------------------------------------------------------------------
@@ -273,6 +307,20 @@ public:
         m_enet_cmd.emplace_back(peer, packet, i, ect);
     }
     // ------------------------------------------------------------------------
+    uint32_t getMaxEnetCommandBatch() const
+                                       { return m_max_enet_cmd_batch.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getEnetCommandCount() const   { return m_enet_cmd_count.load(); }
+    // ------------------------------------------------------------------------
+    /** Returns the connection limiter, or NULL if connections are not
+     *  limited. */
+    const ConnectionLimiter* getConnectionLimiter() const
+                                               { return m_connection_limiter; }
+    // ------------------------------------------------------------------------
+    /** Returns the limiter of server info queries, or NULL if queries are
+     *  not limited. */
+    const ConnectionLimiter* getQueryLimiter() const { return m_query_limiter; }
+    // ------------------------------------------------------------------------
     /** Returns the last error (or "" if no error has happened). */
     const irr::core::stringw& getErrorMessage() const
                                                     { return m_error_message; }
@@ -345,6 +393,9 @@ public:
     NetworkTimerSynchronizer* getNetworkTimerSynchronizer() const
                                                         { return m_nts.get(); }
     // ------------------------------------------------------------------------
+    /** Returns the recorder of network events, NULL if not enabled. */
+    NetworkRecorder* getNetworkRecorder() const  { return m_network_recorder; }
+    // ------------------------------------------------------------------------
     uint64_t getNetworkTimer() const
                   { return StkTime::getRealTimeMs() - m_network_timer.load(); }
     // ------------------------------------------------------------------------
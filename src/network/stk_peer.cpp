@@ -28,6 +28,8 @@
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <algorithm>
+#include <assert.h>
 #include <string.h>
 
 /** Constructor for an empty peer.
@@ -37,9 +39,16 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
 {
     m_enet_peer           = enet_peer;
     m_host_id             = host_id;
+    m_replayed_host_id    = std::numeric_limits<uint32_t>::max();
     m_connected_time      = StkTime::getRealTimeMs();
     m_validated.store(false);
     m_average_ping.store(0);
+    m_state_interval.store(1);
+    m_packet_loss.store(0);
+    m_bytes_sent.store(0);
+    m_bytes_received.store(0);
+    m_late_actions.store(0);
+    m_good_link_updates = 0;
     m_waiting_for_game.store(true);
     m_spectator.store(false);
     m_disconnected.store(false);
@@ -103,14 +112,9 @@ void STKPeer::reset()
  */
 void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
 {
-    if (m_disconnected.load())
+    if (!canSendPacket())
         return;
     TransportAddress a(m_enet_peer->address);
-    // Enet will reuse a disconnected peer so we check here to avoid sending
-    // to wrong peer
-    if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
-        a != m_peer_address)
-        return;
 
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
@@ -128,6 +132,7 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
 
     if (packet)
     {
+        addBytesSent(packet->dataLength);
         if (Network::m_connection_debug)
         {
             Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
@@ -140,6 +145,20 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
     }
 }   // sendPacket
 
+//-----------------------------------------------------------------------------
+/** Returns true if packets can be sent to this peer now.
+ */
+bool STKPeer::canSendPacket() const
+{
+    if (m_disconnected.load())
+        return false;
+    TransportAddress a(m_enet_peer->address);
+    // Enet will reuse a disconnected peer so we check here to avoid sending
+    // to wrong peer
+    return m_enet_peer->state == ENET_PEER_STATE_CONNECTED &&
+        a == m_peer_address;
+}   // canSendPacket
+
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
  */
@@ -193,6 +212,101 @@ uint32_t STKPeer::getPing()
     return m_enet_peer->roundTripTime;
 }   // getPing
 
+//-----------------------------------------------------------------------------
+/** Adapts how often states are sent to this peer to the quality of its
+ *  connection. It is called once per second in the listening thread on the
+ *  server, which also updates the enet statistics used here.
+ */
+void STKPeer::updateStateInterval()
+{
+    // A lot of reliable data not acknowledged yet, more unreliable states
+    // would only delay it further (and the lobby messages waiting for it)
+    const bool backlog =
+        m_enet_peer->reliableDataInTransit * 2 > m_enet_peer->windowSize;
+    const uint32_t packet_loss = m_enet_peer->packetLoss * 100 /
+        ENET_PEER_PACKET_LOSS_SCALE;
+    m_packet_loss.store(packet_loss);
+    const uint32_t interval = getNewStateInterval(m_state_interval.load(),
+        &m_good_link_updates, packet_loss, m_enet_peer->roundTripTime,
+        m_enet_peer->roundTripTimeVariance, backlog);
+    if (interval != m_state_interval.load())
+    {
+        Log::debug("STKPeer", "%s state interval %d, loss %d%%, rtt %d, "
+            "variance %d, backlog %d.", m_peer_address.toString().c_str(),
+            interval, packet_loss, m_enet_peer->roundTripTime,
+            m_enet_peer->roundTripTimeVariance, backlog);
+        m_state_interval.store(interval);
+    }
+}   // updateStateInterval
+
+//-----------------------------------------------------------------------------
+/** Returns the new state interval of a peer: it is doubled (up to 4) if the
+ *  connection is congested, which is indicated by packet loss or a high
+ *  variance of the round trip time, and set to 4 at once if reliable data
+ *  is piling up. It is halved after 3 updates in a row without congestion,
+ *  so it is always 1, 2 or 4.
+ *  \param interval The current state interval.
+ *  \param good_link_updates Number of updates without congestion so far,
+ *         updated here.
+ *  \param packet_loss Packet loss in percent.
+ *  \param rtt Round trip time in ms.
+ *  \param rtt_variance Variance of the round trip time in ms.
+ *  \param backlog If too much reliable data is not acknowledged yet.
+ */
+uint32_t STKPeer::getNewStateInterval(uint32_t interval,
+                                      unsigned* good_link_updates,
+                                      uint32_t packet_loss, uint32_t rtt,
+                                      uint32_t rtt_variance, bool backlog)
+{
+    const uint32_t max_interval = 4;
+    if (backlog)
+    {
+        *good_link_updates = 0;
+        return max_interval;
+    }
+    if (packet_loss > 5 || rtt_variance > std::max(50u, rtt / 2))
+    {
+        *good_link_updates = 0;
+        return std::min(interval * 2, max_interval);
+    }
+    if (interval > 1 && ++(*good_link_updates) >= 3)
+    {
+        *good_link_updates = 0;
+        return interval / 2;
+    }
+    return interval;
+}   // getNewStateInterval
+
+//-----------------------------------------------------------------------------
+void STKPeer::unitTesting()
+{
+    unsigned good = 0;
+    uint32_t interval = getNewStateInterval(1, &good, 0, 50, 5, false);
+    assert(interval == 1);
+    interval = getNewStateInterval(1, &good, 10, 50, 5, false);
+    assert(interval == 2);
+    interval = getNewStateInterval(2, &good, 0, 50, 100, false);
+    assert(interval == 4);
+    interval = getNewStateInterval(4, &good, 0, 50, 5, false);
+    assert(interval == 4);
+    interval = getNewStateInterval(1, &good, 0, 50, 5, true);
+    assert(interval == 4);
+    assert(good == 0);
+
+    // Recover slowly
+    for (int i = 0; i < 2; i++)
+        interval = getNewStateInterval(interval, &good, 0, 50, 5, false);
+    assert(interval == 4);
+    interval = getNewStateInterval(interval, &good, 0, 50, 5, false);
+    assert(interval == 2);
+    for (int i = 0; i < 2; i++)
+        interval = getNewStateInterval(interval, &good, 0, 50, 5, false);
+    assert(interval == 2);
+    interval = getNewStateInterval(interval, &good, 0, 50, 5, false);
+    assert(interval == 1);
+    (void)interval;
+}   // unitTesting
+
 //-----------------------------------------------------------------------------
 void STKPeer::setCrypto(std::unique_ptr<Crypto>&& c)
 {
@@ -32,6 +32,7 @@
 
 #include <atomic>
 #include <deque>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <set>
@@ -77,6 +78,10 @@ protected:
     /** Host id of this peer. */
     uint32_t m_host_id;
 
+    /** Host id of this peer in the recording if it is replayed (see
+     *  NetworkRecorder), otherwise the maximum value. */
+    uint32_t m_replayed_host_id;
+
     TransportAddress m_peer_address;
 
     STKHost* m_host;
@@ -96,6 +101,24 @@ protected:
 
     std::atomic<uint32_t> m_average_ping;
 
+    /** Only every n-th state is sent to this peer, adapted to the quality
+     *  of the connection in updateStateInterval(). */
+    std::atomic<uint32_t> m_state_interval;
+
+    /** Packet loss of reliable packets in percent, measured by enet. */
+    std::atomic<uint32_t> m_packet_loss;
+
+    /** Bytes of all messages sent to and received from this peer
+     *  (without enet headers), for the metrics file. */
+    std::atomic<uint64_t> m_bytes_sent, m_bytes_received;
+
+    /** Number of late controller actions of this peer, which made the
+     *  server rewind. */
+    std::atomic<uint32_t> m_late_actions;
+
+    /** Number of state interval updates in a row without congestion. */
+    unsigned m_good_link_updates;
+
     std::set<unsigned> m_available_kart_ids;
 
     std::string m_user_version;
@@ -115,6 +138,7 @@ public:
     void reset();
     // ------------------------------------------------------------------------
     bool isConnected() const;
+    bool canSendPacket() const;
     const TransportAddress& getAddress() const { return m_peer_address; }
     bool isSamePeer(const STKPeer* peer) const;
     bool isSamePeer(const ENetPeer* peer) const;
@@ -137,6 +161,17 @@ public:
     /** Returns the host id of this peer. */
     uint32_t getHostId() const                            { return m_host_id; }
     // ------------------------------------------------------------------------
+    /** Marks this peer as replayed, its messages are already decrypted. Must
+     *  be called before any event of this peer is created. */
+    void setReplayed(uint32_t recorded_host_id)
+                                  { m_replayed_host_id = recorded_host_id; }
+    // ------------------------------------------------------------------------
+    bool isReplayed() const
+         { return m_replayed_host_id != std::numeric_limits<uint32_t>::max(); }
+    // ------------------------------------------------------------------------
+    /** Returns the host id of a replayed peer in the recording. */
+    uint32_t getReplayedHostId() const           { return m_replayed_host_id; }
+    // ------------------------------------------------------------------------
     float getConnectedTime() const
        { return float(StkTime::getRealTimeMs() - m_connected_time) / 1000.0f; }
     // ------------------------------------------------------------------------
@@ -188,6 +223,34 @@ public:
     // ------------------------------------------------------------------------
     uint32_t getAveragePing() const           { return m_average_ping.load(); }
     // ------------------------------------------------------------------------
+    void updateStateInterval();
+    // ------------------------------------------------------------------------
+    static uint32_t getNewStateInterval(uint32_t interval,
+                                        unsigned* good_link_updates,
+                                        uint32_t packet_loss, uint32_t rtt,
+                                        uint32_t rtt_variance, bool backlog);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    /** Returns n if only every n-th state should be sent to this peer. */
+    uint32_t getStateInterval() const       { return m_state_interval.load(); }
+    // ------------------------------------------------------------------------
+    /** Returns the packet loss of reliable packets in percent. */
+    uint32_t getPacketLoss() const             { return m_packet_loss.load(); }
+    // ------------------------------------------------------------------------
+    void addBytesSent(uint64_t bytes)         { m_bytes_sent.fetch_add(bytes); }
+    // ------------------------------------------------------------------------
+    uint64_t getBytesSent() const                { return m_bytes_sent.load(); }
+    // ------------------------------------------------------------------------
+    void addBytesReceived(uint64_t bytes)
+                                          { m_bytes_received.fetch_add(bytes); }
+    // ------------------------------------------------------------------------
+    uint64_t getBytesReceived() const        { return m_bytes_received.load(); }
+    // ------------------------------------------------------------------------
+    void addLateAction()                        { m_late_actions.fetch_add(1); }
+    // ------------------------------------------------------------------------
+    uint32_t getLateActions() const            { return m_late_actions.load(); }
+    // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
     void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
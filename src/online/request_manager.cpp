@@ -29,6 +29,7 @@
 #include <stdio.h>
 #include <memory.h>
 #include <errno.h>
+#include <limits>
 
 #if defined(WIN32) && !defined(__CYGWIN__)
 #  define WIN32_LEAN_AND_MEAN
@@ -99,6 +100,61 @@ namespace Online
      *                     availale.
      */
     void RequestManager::startNetworkThread()
+    {
+        createNetworkThread();
+
+        // In case that login id was not saved (or first start of stk),
+        // current player would not be defined at this stage.
+        PlayerProfile *player = PlayerManager::getCurrentPlayer();
+        if (player && player->wasOnlineLastTime() &&
+            !UserConfigParams::m_always_show_login_screen &&
+            UserConfigParams::m_internet_status != RequestManager::IPERM_NOT_ALLOWED)
+        {
+            PlayerManager::resumeSavedSession();
+        }
+    }   // startNetworkThread
+
+    // ------------------------------------------------------------------------
+    /** Stops the network thread before this process calls fork() (see
+     *  ServerConfig::loadServerLobbyFromConfig). Only the forking thread is
+     *  copied into the child, so a network thread in the middle of a request
+     *  could leave the queue mutex or curl locked forever in the child. A
+     *  quit request with the lowest priority is queued, so all requests
+     *  queued before are still executed, and the thread is joined.
+     *  restartNetworkThreadAfterFork() must be called afterwards in the
+     *  parent and in each child.
+     */
+    void RequestManager::stopNetworkThreadForFork()
+    {
+        Request *quit = new Request(true, std::numeric_limits<int>::min(),
+                                    Request::RT_QUIT);
+        quit->setAbortable(false);
+        addRequest(quit);
+
+        m_thread_id.lock();
+        if (m_thread_id.getData())
+        {
+            pthread_join(*m_thread_id.getData(), NULL);
+            delete m_thread_id.getData();
+            m_thread_id.getData() = NULL;
+        }
+        m_thread_id.unlock();
+    }   // stopNetworkThreadForFork
+
+    // ------------------------------------------------------------------------
+    /** Starts the network thread again after stopNetworkThreadForFork() and
+     *  fork(). The session of the parent is inherited by the child, so it is
+     *  not resumed again.
+     */
+    void RequestManager::restartNetworkThreadAfterFork()
+    {
+        resetCanBeDeleted();
+        createNetworkThread();
+    }   // restartNetworkThreadAfterFork
+
+    // ------------------------------------------------------------------------
+    /** Creates the actual thread which executes all requests. */
+    void RequestManager::createNetworkThread()
     {
         pthread_attr_t  attr;
         pthread_attr_init(&attr);
@@ -117,17 +173,7 @@ namespace Online
                        errno);
         }
         pthread_attr_destroy(&attr);
-
-        // In case that login id was not saved (or first start of stk),
-        // current player would not be defined at this stage.
-        PlayerProfile *player = PlayerManager::getCurrentPlayer();
-        if (player && player->wasOnlineLastTime() &&
-            !UserConfigParams::m_always_show_login_screen &&
-            UserConfigParams::m_internet_status != RequestManager::IPERM_NOT_ALLOWED)
-        {
-            PlayerManager::resumeSavedSession();
-        }
-    }   // startNetworkThread
+    }   // createNetworkThread
 
     // ------------------------------------------------------------------------
     /** This function inserts a high priority request to quit into the request
@@ -131,6 +131,7 @@ namespace Online
             void handleResultQueue();
 
             static void *mainLoop(void *obj);
+            void createNetworkThread();
 
             RequestManager(); //const std::string &url
             ~RequestManager();
@@ -158,6 +159,8 @@ namespace Online
 
             void addRequest(Online::Request *request);
             void startNetworkThread();
+            void stopNetworkThreadForFork();
+            void restartNetworkThreadAfterFork();
             void stopNetworkThread();
 
             bool getAbort() { return m_abort.getAtomic(); }
@@ -30,6 +30,8 @@
 #include "tracks/terrain_info.hpp"
 #include "tracks/track.hpp"
 
+#include <string.h>
+
 #define ROLLING_INFLUENCE_FIX
 
 
@@ -41,8 +43,17 @@ btRigidBody& btKart::getFixedBody()
     return s_fixed;
 }
 
+// ----------------------------------------------------------------------------
+/** Returns true if the x, y and z values of both vectors have the same bits.
+ */
+static bool isIdentical(const btVector3 &a, const btVector3 &b)
+{
+    return memcmp((const btScalar*)a, (const btScalar*)b,
+                  3 * sizeof(btScalar)) == 0;
+}   // isIdentical
+
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster)
 {
@@ -248,6 +259,76 @@ void btKart::updateAllWheelTransformsWS()
     }
 }   // updateAllWheelTransformsWS
 
+// ----------------------------------------------------------------------------
+/** Updates the world space data of a wheel and computes its suspension ray,
+ *  which goes from m_hardPointWS to m_contactPointWS.
+ *  \param wheel The wheel.
+ *  \param fraction Fraction of the distance of the wheel from the center
+ *         of the chassis at which the ray starts.
+ *  \return The length of the ray.
+ */
+btScalar btKart::getWheelRay(btWheelInfo* wheel, float fraction)
+{
+    updateWheelTransformsWS(*wheel, getChassisWorldTransform(), false,
+                            fraction);
+
+    btScalar max_susp_len = wheel->getSuspensionRestLength()
+                          + wheel->m_maxSuspensionTravel;
+
+    // Do a slightly longer raycast to see if the kart might soon hit the 
+    // ground and some 'cushioning' is needed to avoid that the chassis
+    // hits the ground.
+    btScalar raylen = max_susp_len + 0.5f;
+
+    btVector3 rayvector = wheel->m_raycastInfo.m_wheelDirectionWS * (raylen);
+    wheel->m_raycastInfo.m_contactPointWS =
+        wheel->m_raycastInfo.m_hardPointWS + rayvector;
+    return raylen;
+}   // getWheelRay
+
+// ----------------------------------------------------------------------------
+/** Adds the suspension rays of all wheels to a batch of rays, so that they
+ *  can be cast together with the rays of all other karts before the karts
+ *  are updated (see STKDynamicsWorld::updateActions). This does not change
+ *  the kart.
+ *  \param rays The batch of rays.
+ *  \return False if the rays of the karts must not be cast ahead of time,
+ *          because this kart will move its chassis during its update.
+ */
+bool btKart::addWheelRays(btAlignedObjectArray<btKartRaycaster::BatchRay>
+                          *rays)
+{
+    // The additional rotation changes the world transform of the chassis
+    // during the update, which can change the rays of karts updated later
+    if (m_ticks_additional_rotation > 0)
+        return false;
+
+    for (int i = 0; i < m_wheelInfo.size(); i++)
+    {
+        btWheelInfo wheel = m_wheelInfo[i];
+        getWheelRay(&wheel, 1.0f);
+        btKartRaycaster::BatchRay& ray = rays->expand();
+        ray.m_from   = wheel.m_raycastInfo.m_hardPointWS;
+        ray.m_to     = wheel.m_raycastInfo.m_contactPointWS;
+        ray.m_ignore = m_chassisBody;
+        ray.m_object = NULL;
+    }
+    return true;
+}   // addWheelRays
+
+// ----------------------------------------------------------------------------
+/** Stores the results of the batch raycast for the wheels of this kart,
+ *  which are used by the next rayCast() calls if the rays are the same.
+ *  \param rays The results, one for each wheel in the order added by
+ *         addWheelRays().
+ */
+void btKart::setPrefetchedWheelRays(const btKartRaycaster::BatchRay *rays)
+{
+    m_prefetched_rays.resize(0);
+    for (int i = 0; i < m_wheelInfo.size(); i++)
+        m_prefetched_rays.push_back(rays[i]);
+}   // setPrefetchedWheelRays
+
 // ----------------------------------------------------------------------------
 /**
  */
@@ -267,26 +348,31 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
     }
 
-    updateWheelTransformsWS(wheel, getChassisWorldTransform(), false, fraction);
-
     btScalar max_susp_len = wheel.getSuspensionRestLength()
                           + wheel.m_maxSuspensionTravel;
-
-    // Do a slightly longer raycast to see if the kart might soon hit the 
-    // ground and some 'cushioning' is needed to avoid that the chassis
-    // hits the ground.
-    btScalar raylen = max_susp_len + 0.5f;
-
-    btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (raylen);
+    btScalar raylen = getWheelRay(&wheel, fraction);
     const btVector3& source = wheel.m_raycastInfo.m_hardPointWS;
-    wheel.m_raycastInfo.m_contactPointWS = source + rayvector;
     const btVector3& target = wheel.m_raycastInfo.m_contactPointWS;
 
     btVehicleRaycaster::btVehicleRaycasterResult rayResults;
 
     btAssert(m_vehicleRaycaster);
 
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+    void* object;
+    // Use the result of the batch raycast of all karts if it was done
+    // for exactly this ray
+    const btKartRaycaster::BatchRay* prefetched =
+        index < (unsigned int)m_prefetched_rays.size()
+        ? &m_prefetched_rays[index] : NULL;
+    if (prefetched && fraction == 1.0f &&
+        isIdentical(prefetched->m_from, source) &&
+        isIdentical(prefetched->m_to, target))
+    {
+        rayResults = prefetched->m_result;
+        object     = prefetched->m_object;
+    }
+    else
+        object = m_vehicleRaycaster->castRay(source,target,rayResults);
 
     wheel.m_raycastInfo.m_groundObject = 0;
 
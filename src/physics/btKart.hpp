@@ -69,7 +69,11 @@ private:
     btScalar calcRollingFriction(btWheelContactPoint& contactPoint);
 
     btScalar            m_damping;
-    btVehicleRaycaster *m_vehicleRaycaster;
+    btKartRaycaster    *m_vehicleRaycaster;
+
+    /** Results of the batch raycast of all karts for the wheels of this
+     *  kart in this physics step, empty if there are none. */
+    btAlignedObjectArray<btKartRaycaster::BatchRay> m_prefetched_rays;
 
     /** Sliding (skidding) will only be permited when this is true. Also check
      *  the friction parameter in the wheels since friction directly affects
@@ -123,6 +127,7 @@ private:
 
     void     defaultInit();
     btScalar rayCast(btWheelInfo& wheel, const btVector3& ray);
+    btScalar getWheelRay(btWheelInfo* wheel, float fraction);
     void     updateWheelTransformsWS(btWheelInfo& wheel,
                                      btTransform chassis_trans,
                                      bool interpolatedTransform=true,
@@ -137,7 +142,7 @@ public:
      *         (this is used to get access to the kart properties).
      */
                        btKart(btRigidBody* chassis,
-                              btVehicleRaycaster* raycaster,
+                              btKartRaycaster* raycaster,
                               Kart *kart);
      virtual          ~btKart();
     void               reset();
@@ -171,6 +176,10 @@ public:
     void               updateAllWheelPositions();
     void               getVisualContactPoint(const btTransform& chassis_trans,
                                              btVector3 *left, btVector3 *right);
+    bool               addWheelRays(
+                    btAlignedObjectArray<btKartRaycaster::BatchRay> *rays);
+    void               setPrefetchedWheelRays(
+                                  const btKartRaycaster::BatchRay *rays);
         // ------------------------------------------------------------------------
     /** Returns true if both rear visual wheels touch the ground. */
     bool visualWheelsTouchGround() const
@@ -186,6 +195,13 @@ public:
         updateVehicle(step);
     }   // updateAction
     // ------------------------------------------------------------------------
+    /** Discards the results of the batch raycast, which are only valid
+     *  during one physics step. */
+    void discardPrefetchedWheelRays() { m_prefetched_rays.resize(0); }
+    // ------------------------------------------------------------------------
+    /** Returns the raycaster used by this kart. */
+    btKartRaycaster* getRaycaster() { return m_vehicleRaycaster; }
+    // ------------------------------------------------------------------------
     /** Returns the number of wheels of this vehicle. */
     inline int getNumWheels() const { return int(m_wheelInfo.size());}
     // ------------------------------------------------------------------------
@@ -13,57 +13,192 @@
 #include "btKartRaycast.hpp"
 
 #include "BulletCollision/CollisionDispatch/btCollisionWorld.h"
+#include "BulletCollision/CollisionShapes/btConcaveShape.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
 #include "BulletDynamics/Dynamics/btDynamicsWorld.h"
 
 #include "modes/world.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
-void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
-                               btVehicleRaycasterResult& result)
+// ============================================================================
+/** A closest ray result callback which also stores the index of the
+ *  triangle that was hit. */
+class btKartRaycaster::ClosestWithNormal
+                         : public btCollisionWorld::ClosestRayResultCallback
 {
-    // ========================================================================
-    class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
-    {
-    private:
-        int m_triangle_index;
-    public:
-        /** Constructor, initialises the triangle index. */
-        ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
-                          : btCollisionWorld::ClosestRayResultCallback(from,to)
-        {
-            m_triangle_index = -1;
-        }   // CloestWithNormal
-        // --------------------------------------------------------------------
-        /** Stores the index of the triangle hit. */
-        virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
-                                         bool normalInWorldSpace)
-        {
-            // We don't always get a triangle index, sometimes (e.g. ray hits
-            // other kart) we get shapePart=-1, or no localShapeInfo at all
-            if(rayResult.m_localShapeInfo &&
-                rayResult.m_localShapeInfo->m_shapePart>-1)
-                m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
-            return
-                btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
-                normalInWorldSpace);
-        }
-        // --------------------------------------------------------------------
-        /** Returns the index of the triangle which was hit, or -1 if
-         *  no triangle was hit. */
-        int getTriangleIndex() const { return m_triangle_index; }
+private:
+    int m_triangle_index;
+public:
+    /** Constructor, initialises the triangle index. */
+    ClosestWithNormal(const btVector3 &from,
+                      const btVector3 &to)
+                      : btCollisionWorld::ClosestRayResultCallback(from,to)
+    {
+        m_triangle_index = -1;
+    }   // CloestWithNormal
+    // ------------------------------------------------------------------------
+    /** Constructor for an array of callbacks, setRay() must be called
+     *  before use. */
+    ClosestWithNormal()
+         : btCollisionWorld::ClosestRayResultCallback(btVector3(0, 0, 0),
+                                                      btVector3(0, 0, 0))
+    {
+        m_triangle_index = -1;
+    }   // CloestWithNormal
+    // ------------------------------------------------------------------------
+    /** Sets the ray of a callback which was not used yet. */
+    void setRay(const btVector3 &from, const btVector3 &to)
+    {
+        m_rayFromWorld = from;
+        m_rayToWorld   = to;
+    }   // setRay
+    // ------------------------------------------------------------------------
+    /** Stores the index of the triangle hit. */
+    virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
+                                     bool normalInWorldSpace)
+    {
+        // We don't always get a triangle index, sometimes (e.g. ray hits
+        // other kart) we get shapePart=-1, or no localShapeInfo at all
+        if(rayResult.m_localShapeInfo &&
+            rayResult.m_localShapeInfo->m_shapePart>-1)
+            m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
+        return
+            btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
+            normalInWorldSpace);
+    }
+    // ------------------------------------------------------------------------
+    /** Returns the index of the triangle which was hit, or -1 if
+     *  no triangle was hit. */
+    int getTriangleIndex() const { return m_triangle_index; }
+
+};   // CloestWithNormal
+
+// ============================================================================
+/** Tests one ray against the triangles of a concave shape, and passes hits
+ *  on to the result callback of that ray (the same as bullet does in
+ *  btCollisionWorld::rayTestSingle). */
+class TriangleRayBridge : public btTriangleRaycastCallback
+{
+private:
+    btCollisionWorld::RayResultCallback *m_result_callback;
+    btCollisionObject                   *m_object;
+    const btTransform                   *m_object_trans;
+public:
+    /** Constructor for an array of bridges, init() must be called before
+     *  use. */
+    TriangleRayBridge()
+        : btTriangleRaycastCallback(btVector3(0, 0, 0), btVector3(0, 0, 0))
+    {
+        m_result_callback = NULL;
+        m_object          = NULL;
+        m_object_trans    = NULL;
+    }   // TriangleRayBridge
+    // ------------------------------------------------------------------------
+    /** Sets the ray to test.
+     *  \param from Start of the ray in the coordinates of the object.
+     *  \param to End of the ray in the coordinates of the object.
+     *  \param result_callback Callback to which hits are reported.
+     *  \param object The object which is tested.
+     *  \param object_trans The world transform of the object.
+     */
+    void init(const btVector3 &from, const btVector3 &to,
+              btCollisionWorld::RayResultCallback *result_callback,
+              btCollisionObject *object, const btTransform *object_trans)
+    {
+        m_from            = from;
+        m_to              = to;
+        m_flags           = result_callback->m_flags;
+        m_hitFraction     = result_callback->m_closestHitFraction;
+        m_result_callback = result_callback;
+        m_object          = object;
+        m_object_trans    = object_trans;
+    }   // init
+    // ------------------------------------------------------------------------
+    virtual btScalar reportHit(const btVector3 &hit_normal_local,
+                               btScalar hit_fraction, int part_id,
+                               int triangle_index)
+    {
+        btCollisionWorld::LocalShapeInfo shape_info;
+        shape_info.m_shapePart     = part_id;
+        shape_info.m_triangleIndex = triangle_index;
+        btVector3 hit_normal_world = m_object_trans->getBasis()
+                                   * hit_normal_local;
+        btCollisionWorld::LocalRayResult ray_result(m_object, &shape_info,
+                                                    hit_normal_world,
+                                                    hit_fraction);
+        return m_result_callback->addSingleResult(ray_result,
+                                                  /*normal_in_world*/true);
+    }   // reportHit
+};   // TriangleRayBridge
 
-    };   // CloestWithNormal
-    // ========================================================================
+// ============================================================================
+/** Passes each triangle found for the bounding box of a packet of rays on
+ *  to the test of each ray. */
+class TrianglePacketCallback : public btTriangleCallback
+{
+private:
+    TriangleRayBridge *m_rays;
+    int                m_count;
+public:
+    TrianglePacketCallback(TriangleRayBridge *rays, int count)
+        : m_rays(rays), m_count(count)
+    {
+    }   // TrianglePacketCallback
+    // ------------------------------------------------------------------------
+    virtual void processTriangle(btVector3 *triangle, int part_id,
+                                 int triangle_index)
+    {
+        for (int i = 0; i < m_count; i++)
+            m_rays[i].processTriangle(triangle, part_id, triangle_index);
+    }   // processTriangle
+};   // TrianglePacketCallback
 
+// ============================================================================
+/** Collects all collision objects whose bounding box overlaps the bounding
+ *  box of a packet of rays. */
+class PacketBroadphaseCallback : public btBroadphaseAabbCallback
+{
+private:
+    btAlignedObjectArray<btCollisionObject*> *m_objects;
+public:
+    PacketBroadphaseCallback(btAlignedObjectArray<btCollisionObject*> *o)
+        : m_objects(o)
+    {
+    }   // PacketBroadphaseCallback
+    // ------------------------------------------------------------------------
+    virtual bool process(const btBroadphaseProxy *proxy)
+    {
+        m_objects->push_back((btCollisionObject*)proxy->m_clientObject);
+        return true;
+    }   // process
+};   // PacketBroadphaseCallback
+
+// ============================================================================
+void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
+                               btVehicleRaycasterResult& result)
+{
     ClosestWithNormal rayCallback(from,to);
 
     m_dynamicsWorld->rayTest(from, to, rayCallback);
 
+    return getResult(rayCallback, result);
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Converts the closest hit of a ray into the result of castRay().
+ *  \param rayCallback The callback used to cast the ray.
+ *  \param result Returns the hit point, normal and triangle index.
+ *  \return The body hit, or NULL if the ray did not hit a body with
+ *          contact response.
+ */
+void* btKartRaycaster::getResult(const ClosestWithNormal& rayCallback,
+                                 btVehicleRaycasterResult& result) const
+{
     if (rayCallback.hasHit())
     {
-        btRigidBody* body = btRigidBody::upcast(rayCallback.m_collisionObject);
+        const btRigidBody* body =
+            btRigidBody::upcast(rayCallback.m_collisionObject);
         if (body && body->hasContactResponse())
         {
             result.m_hitPointInWorld = rayCallback.m_hitPointWorld;
@@ -79,8 +214,8 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
             // different triangle mesh). TODO: Add a mapping from bullet
             // objects back to triangle meshes, so that it's easy to pick up
             // the right triangle mesh for smoothing
-            TriangleMesh::RigidBodyTriangleMesh *rbtm =
-                dynamic_cast<TriangleMesh::RigidBodyTriangleMesh*>(body);
+            const TriangleMesh::RigidBodyTriangleMesh *rbtm =
+                dynamic_cast<const TriangleMesh::RigidBodyTriangleMesh*>(body);
             if(m_smooth_normals &&
                 rayCallback.getTriangleIndex()>-1 &&
                 rbtm != NULL                         )
@@ -101,9 +236,125 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                     result.m_hitNormalInWorld.getZ());
 #endif
             }
-            return body;
+            return (void*)body;
         }
     }
     return 0;
-}
+}   // getResult
+
+// ----------------------------------------------------------------------------
+/** Casts many rays at once, with the same results as castRay() for each of
+ *  them. Consecutive rays with the same m_ignore object (e.g. the wheels of
+ *  one kart) are close together, so they are cast as one packet: the
+ *  broadphase is only queried once for the bounding box of the packet, and
+ *  each concave shape (e.g. the track) is only traversed once, testing each
+ *  triangle found against all rays of the packet.
+ *  \param rays The rays to cast, the results are stored in each ray.
+ */
+void btKartRaycaster::castRays(btAlignedObjectArray<BatchRay> *rays)
+{
+    int start = 0;
+    while (start < rays->size())
+    {
+        int end = start + 1;
+        while (end < rays->size() &&
+               (*rays)[end].m_ignore == (*rays)[start].m_ignore)
+            end++;
+        castPacket(&(*rays)[start], end - start);
+        start = end;
+    }
+}   // castRays
+
+// ----------------------------------------------------------------------------
+/** Casts a packet of rays which are close to each other.
+ *  \param rays The rays of this packet.
+ *  \param count Number of rays in this packet.
+ */
+void btKartRaycaster::castPacket(BatchRay *rays, int count)
+{
+    const int MAX_PACKET_SIZE = 8;
+    if (count > MAX_PACKET_SIZE)
+    {
+        castPacket(rays, MAX_PACKET_SIZE);
+        castPacket(rays + MAX_PACKET_SIZE, count - MAX_PACKET_SIZE);
+        return;
+    }
+
+    ClosestWithNormal callbacks[MAX_PACKET_SIZE];
+    btVector3 aabb_min = rays[0].m_from;
+    btVector3 aabb_max = rays[0].m_from;
+    for (int i = 0; i < count; i++)
+    {
+        callbacks[i].setRay(rays[i].m_from, rays[i].m_to);
+        aabb_min.setMin(rays[i].m_from);
+        aabb_min.setMin(rays[i].m_to);
+        aabb_max.setMax(rays[i].m_from);
+        aabb_max.setMax(rays[i].m_to);
+    }
+
+    // One broadphase query for all rays. This finds all objects a ray
+    // query would find for each ray (and maybe a few more, which are then
+    // simply not hit).
+    m_candidates.resize(0);
+    PacketBroadphaseCallback broadphase_callback(&m_candidates);
+    m_dynamicsWorld->getBroadphase()->aabbTest(aabb_min, aabb_max,
+                                               broadphase_callback);
+
+    TriangleRayBridge bridges[MAX_PACKET_SIZE];
+    for (int n = 0; n < m_candidates.size(); n++)
+    {
+        btCollisionObject *object = m_candidates[n];
+        const btCollisionShape *shape = object->getCollisionShape();
+        const btTransform &trans = object->getWorldTransform();
+        btTransform world_to_object = trans.inverse();
+
+        int num_bridges = 0;
+        btVector3 local_min(0, 0, 0), local_max(0, 0, 0);
+        for (int i = 0; i < count; i++)
+        {
+            // Same conditions as in btCollisionWorld::rayTest, except that
+            // the object casting the ray is ignored directly
+            if (callbacks[i].m_closestHitFraction == btScalar(0.0f) ||
+                object == rays[i].m_ignore ||
+                !callbacks[i].needsCollision(object->getBroadphaseHandle()))
+                continue;
+
+            if (!shape->isConcave())
+            {
+                btTransform from_trans(btMatrix3x3::getIdentity(),
+                                       rays[i].m_from);
+                btTransform to_trans(btMatrix3x3::getIdentity(),
+                                     rays[i].m_to);
+                btCollisionWorld::rayTestSingle(from_trans, to_trans, object,
+                                                shape, trans, callbacks[i]);
+                continue;
+            }
+            btVector3 from = world_to_object * rays[i].m_from;
+            btVector3 to   = world_to_object * rays[i].m_to;
+            bridges[num_bridges].init(from, to, &callbacks[i], object,
+                                      &trans);
+            if (num_bridges == 0)
+            {
+                local_min = from;
+                local_max = from;
+            }
+            local_min.setMin(from);
+            local_min.setMin(to);
+            local_max.setMax(from);
+            local_max.setMax(to);
+            num_bridges++;
+        }   // for i < count
+
+        // Traverse a concave shape (e.g. the bvh of the track) only once,
+        // testing each triangle found against all rays.
+        if (num_bridges > 0)
+        {
+            TrianglePacketCallback packet_callback(bridges, num_bridges);
+            ((const btConcaveShape*)shape)->processAllTriangles(
+                &packet_callback, local_min, local_max);
+        }
+    }   // for n < m_candidates.size()
 
+    for (int i = 0; i < count; i++)
+        rays[i].m_object = getResult(callbacks[i], rays[i].m_result);
+}   // castPacket
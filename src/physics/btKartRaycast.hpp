@@ -22,11 +22,36 @@ class btDynamicsWorld;
 
 class btKartRaycaster : public btVehicleRaycaster
 {
+public:
+    /** One ray of a batch cast with castRays(). */
+    struct BatchRay
+    {
+        btVector3                m_from;
+        btVector3                m_to;
+        /** The object casting the ray (i.e. the chassis of a kart), which
+         *  is never hit by its own rays. */
+        const btCollisionObject *m_ignore;
+        /** The result as returned by castRay(). */
+        btVehicleRaycasterResult m_result;
+        /** The object that was hit as returned by castRay(), or NULL. */
+        void                    *m_object;
+    };
+
 private:
+    class ClosestWithNormal;
+
     btDynamicsWorld*    m_dynamicsWorld;
     /** True if the normals should be smoothed. Not all tracks support this,
     *  so this flag is set depending on track when constructing this object. */
     bool                m_smooth_normals;
+
+    /** Objects found in the broadphase for one packet of rays, only kept
+     *  to avoid allocations in each castRays() call. */
+    btAlignedObjectArray<btCollisionObject*> m_candidates;
+
+    void  castPacket(BatchRay *rays, int count);
+    void* getResult(const ClosestWithNormal& callback,
+                    btVehicleRaycasterResult& result) const;
 public:
     btKartRaycaster(btDynamicsWorld* world, bool smooth_normals=false)
         :m_dynamicsWorld(world), m_smooth_normals(smooth_normals)
@@ -35,6 +60,7 @@ public:
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
                           btVehicleRaycasterResult& result);
+    void castRays(btAlignedObjectArray<BatchRay> *rays);
 
 };
 
@@ -843,6 +843,44 @@ void PhysicalObject::restoreState(BareNetworkString *buffer, int count)
     m_body->setInterpolationAngularVelocity(m_last_av);
 }   // restoreState
 
+// ----------------------------------------------------------------------------
+/** Saves the predicted state of this object on a client. The server only
+ *  includes an object in a state if it moved since the last state it sent
+ *  (see saveState()), so an object which did not move since the last state
+ *  received is predicted not to be part of the state (empty prediction).
+ */
+BareNetworkString* PhysicalObject::savePrediction()
+{
+    const btTransform& t = m_body->getWorldTransform();
+    if ((t.getOrigin() - m_last_transform.getOrigin()).length() < 0.01f &&
+        (m_body->getLinearVelocity() - m_last_lv).length() < 0.01f &&
+        (m_body->getAngularVelocity() - m_last_av).length() < 0.01f)
+        return new BareNetworkString();
+
+    BareNetworkString *buffer = new BareNetworkString();
+    CompressNetworkBody::compress(t, m_body->getLinearVelocity(),
+        m_body->getAngularVelocity(), buffer, NULL/*body*/, NULL/*ms*/);
+    return buffer;
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Compares a state received from the server with the prediction saved for
+ *  the same time, the difference must be small enough not to be smoothed.
+ *  \param prediction Prediction saved by savePrediction().
+ *  \param buffer The confirmed state from the server.
+ *  \param count Number of bytes of this object in buffer.
+ */
+bool PhysicalObject::matchesPrediction(BareNetworkString* prediction,
+                                       BareNetworkString* buffer, int count)
+{
+    const int BODY_SIZE = CompressNetworkBody::COMPRESSED_SIZE;
+    if ((int)prediction->size() != BODY_SIZE || count != BODY_SIZE ||
+        (int)buffer->size() < count)
+        return false;
+    return CompressNetworkBody::isClose(prediction, buffer,
+        stk_config->m_snb_min_adjust_length);
+}   // matchesPrediction
+
 // ----------------------------------------------------------------------------
 std::function<void()> PhysicalObject::getLocalStateRestoreFunction()
 {
@@ -284,6 +284,9 @@ public:
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
+    virtual BareNetworkString* savePrediction();
+    virtual bool matchesPrediction(BareNetworkString* prediction,
+                                   BareNetworkString* buffer, int count);
     virtual void undoState(BareNetworkString *buffer) {}
     virtual std::function<void()> getLocalStateRestoreFunction();
     LEAK_CHECK()
@@ -32,6 +32,7 @@
 #include "modes/soccer_world.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "karts/explosion_animation.hpp"
 #include "physics/btKart.hpp"
 #include "physics/irr_debug_drawer.hpp"
@@ -413,6 +414,17 @@ void Physics::KartKartCollision(AbstractKart *kart_a,
     kart_a->crashed(kart_b, /*handle_attachments*/true);
     kart_b->crashed(kart_a, /*handle_attachments*/false);
 
+    // Both karts must be sent to each other in every state for a while
+    if (NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer())
+    {
+        if (auto gp = GameProtocol::lock())
+        {
+            gp->getStateRelevance().addInteraction(kart_a->getWorldKartId(),
+                kart_b->getWorldKartId());
+        }
+    }
+
     AbstractKart *left_kart, *right_kart;
 
     // Determine which kart is pushed to the left, and which one to the
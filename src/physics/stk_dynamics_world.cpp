@@ -0,0 +1,62 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_dynamics_world.hpp"
+
+#include "physics/btKart.hpp"
+
+// ----------------------------------------------------------------------------
+/** Updates all karts (the only actions in STK). Before that the wheel rays
+ *  of all karts are cast in one batch: the transforms of all bodies are
+ *  already integrated at this point, and updating a kart only changes
+ *  its velocities, so the rays of all karts are known in advance. Each
+ *  kart only uses the batch result for a wheel if its ray is still
+ *  exactly the same, otherwise it casts the ray again.
+ *  \param time_step Time step of this physics step.
+ */
+void STKDynamicsWorld::updateActions(btScalar time_step)
+{
+    m_wheel_rays.resize(0);
+    bool use_batch = m_actions.size() > 0;
+    for (int i = 0; i < m_actions.size() && use_batch; i++)
+    {
+        btKart* kart = static_cast<btKart*>(m_actions[i]);
+        use_batch = kart->addWheelRays(&m_wheel_rays);
+    }
+
+    if (use_batch)
+    {
+        static_cast<btKart*>(m_actions[0])->getRaycaster()
+                                          ->castRays(&m_wheel_rays);
+        int offset = 0;
+        for (int i = 0; i < m_actions.size(); i++)
+        {
+            btKart* kart = static_cast<btKart*>(m_actions[i]);
+            kart->setPrefetchedWheelRays(&m_wheel_rays[offset]);
+            offset += kart->getNumWheels();
+        }
+    }
+
+    btDiscreteDynamicsWorld::updateActions(time_step);
+
+    if (use_batch)
+    {
+        for (int i = 0; i < m_actions.size(); i++)
+            static_cast<btKart*>(m_actions[i])->discardPrefetchedWheelRays();
+    }
+}   // updateActions
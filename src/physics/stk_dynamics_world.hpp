@@ -21,12 +21,22 @@
 
 #include "btBulletDynamicsCommon.h"
 
+#include "physics/btKartRaycast.hpp"
+
 /** A thin wrapper around bullet's btDiscreteDynamicsWorld. Used to
  *  be able to query and set the 'left over' time from a previous
  *  time step, which is needed for more precise rewind/replays.
  */
 class STKDynamicsWorld : public btDiscreteDynamicsWorld
 {
+private:
+    /** The wheel rays of all karts in the current step, only kept to avoid
+     *  allocations in each step. */
+    btAlignedObjectArray<btKartRaycaster::BatchRay> m_wheel_rays;
+
+protected:
+    virtual void updateActions(btScalar time_step);
+
 public:
     /** The standard constructor which just created a btDiscreteDynamicsWorld. */
     STKDynamicsWorld(btDispatcher*             dispatcher,
@@ -22,11 +22,14 @@
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/log.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
 
-#include <fstream>
+#include <algorithm>
+#include <string.h>
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -89,10 +92,13 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
  *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  \param bvh If not NULL, this bvh (e.g. loaded from the track physics
+ *         cache) is used instead of building it on the fly. It must have
+ *         been built for exactly the triangles of this mesh, and it is not
+ *         freed by this mesh.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object,
+                                        btOptimizedBvh* bvh)
 {
     if(m_triangleIndex2Material.size()==0)
     {
@@ -102,56 +108,20 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         m_collision_object = NULL;
         return;
     }
-    // Now convert the triangle mesh into a static rigid body
+    // Now convert the triangle mesh into a static rigid body. The quantized
+    // bvh is smaller and faster for raycasts, but can only store the
+    // triangle index in 21 bits.
+    const bool quantized = m_triangleIndex2Material.size() < (1 << 21);
     btBvhTriangleMeshShape* bhv_triangle_mesh;
-
-    if (serialized_bhv != NULL)
+    if (bvh != NULL)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh,
+            bvh->isQuantized(), false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(bvh);
     }
     else
     {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, quantized);
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -178,16 +148,16 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  for height of terrain detection).
  *  \param friction Friction to be used for this TriangleMesh.
  *  \param flags Additional collision flags (default 0).
- *  \param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
+ *  \param bvh If not NULL, the bvh to use instead of building it on the fly
+ *         (see createCollisionShape).
  */
 void TriangleMesh::createPhysicalBody(float friction,
                                       btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+                                      btOptimizedBvh* bvh)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false, bvh);
     main_loop->renderGUI(5583);
 
     btTransform startTransform;
@@ -232,6 +202,7 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    m_neighbours.clear();
 }   // removeAll
 
 // -----------------------------------------------------------------------------
@@ -303,6 +274,210 @@ btVector3 TriangleMesh::getInterpolatedNormal(unsigned int index,
     return s*n1 + t*n2 + w*n3;
 }   // getInterpolatedNormal
 
+// ============================================================================
+/** A special ray result class that stores the index of the triangle
+ *  that was hit. */
+class MaterialRayResult : public btCollisionWorld::ClosestRayResultCallback
+{
+public:
+    /** Stores the index of the triangle that was hit. */
+    int m_index;
+    // ------------------------------------------------------------------------
+    MaterialRayResult(const btVector3 &p1, const btVector3 &p2)
+                    : btCollisionWorld::ClosestRayResultCallback(p1,p2)
+    {
+        m_index = -1;
+    }   // MaterialRayResult
+    // ------------------------------------------------------------------------
+    virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
+                                     bool normalInWorldSpace)
+    {
+        m_index = rayResult.m_localShapeInfo->m_triangleIndex;
+        return btCollisionWorld::ClosestRayResultCallback
+                ::addSingleResult(rayResult, normalInWorldSpace);
+    }   // AddSingleResult
+};   // MaterialRayResult
+
+// ============================================================================
+/** Tests a ray against single triangles of a mesh and passes hits on to a
+ *  result callback, exactly as btCollisionWorld::rayTestSingle does it for
+ *  a triangle mesh shape. */
+class TriangleMeshRayCallback : public btTriangleRaycastCallback
+{
+private:
+    btCollisionWorld::RayResultCallback *m_result;
+    btCollisionObject                   *m_object;
+    btTransform                          m_world_trans;
+public:
+    TriangleMeshRayCallback(const btVector3 &from_local,
+                            const btVector3 &to_local,
+                            btCollisionWorld::RayResultCallback *result,
+                            btCollisionObject *object,
+                            const btTransform &world_trans)
+        : btTriangleRaycastCallback(from_local, to_local, result->m_flags),
+          m_result(result), m_object(object), m_world_trans(world_trans)
+    {
+        m_hitFraction = result->m_closestHitFraction;
+    }   // TriangleMeshRayCallback
+    // ------------------------------------------------------------------------
+    virtual btScalar reportHit(const btVector3 &normal_local,
+                               btScalar hit_fraction, int part_id,
+                               int triangle_index)
+    {
+        btCollisionWorld::LocalShapeInfo shape_info;
+        shape_info.m_shapePart     = part_id;
+        shape_info.m_triangleIndex = triangle_index;
+        btCollisionWorld::LocalRayResult ray_result(m_object, &shape_info,
+                                       m_world_trans.getBasis()*normal_local,
+                                       hit_fraction);
+        return m_result->addSingleResult(ray_result,
+                                         /*normalInWorldSpace*/true);
+    }   // reportHit
+};   // TriangleMeshRayCallback
+
+// ----------------------------------------------------------------------------
+/** Computes for each triangle which triangles share an edge with it. This
+ *  allows castRay() to first test the triangles close to the one hit by a
+ *  previous raycast. Since the vertices are not shared between triangles,
+ *  vertices are considered to be the same if they have identical
+ *  coordinates.
+ */
+void TriangleMesh::computeNeighbours()
+{
+    /** An edge of a triangle, the two end points are sorted so that the
+     *  same edge of two triangles gets the same key. */
+    struct Edge
+    {
+        float m_key[6];
+        int   m_triangle;
+        bool operator<(const Edge &other) const
+        {
+            return memcmp(m_key, other.m_key, sizeof(m_key)) < 0;
+        }
+    };   // Edge
+
+    const unsigned int n = getNumTriangles();
+    std::vector<Edge> edges;
+    edges.reserve(3 * n);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        btVector3 p[3];
+        getTriangle(i, &p[0], &p[1], &p[2]);
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            float a[3] = { p[j].getX(), p[j].getY(), p[j].getZ() };
+            const btVector3 &q = p[(j + 1) % 3];
+            float b[3] = { q.getX(), q.getY(), q.getZ() };
+            Edge e;
+            bool swap = memcmp(a, b, sizeof(a)) > 0;
+            memcpy(e.m_key,     swap ? b : a, sizeof(a));
+            memcpy(e.m_key + 3, swap ? a : b, sizeof(a));
+            e.m_triangle = i;
+            edges.push_back(e);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    m_neighbours.clear();
+    m_neighbours.resize(3 * n, -1);
+    unsigned int first = 0;
+    while (first < edges.size())
+    {
+        unsigned int last = first + 1;
+        while (last < edges.size() &&
+               memcmp(edges[first].m_key, edges[last].m_key,
+                      sizeof(edges[first].m_key)) == 0)
+            last++;
+        // Link all triangles sharing this edge, as long as they have
+        // a free entry left (which is only not the case for edges shared
+        // by more than two triangles).
+        for (unsigned int i = first; i < last; i++)
+        {
+            int *neighbours = &m_neighbours[3 * edges[i].m_triangle];
+            for (unsigned int j = first; j < last; j++)
+            {
+                int other = edges[j].m_triangle;
+                if (other == edges[i].m_triangle)
+                    continue;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    if (neighbours[k] == other)
+                        break;
+                    if (neighbours[k] == -1)
+                    {
+                        neighbours[k] = other;
+                        break;
+                    }
+                }
+            }
+        }
+        first = last;
+    }
+}   // computeNeighbours
+
+// ----------------------------------------------------------------------------
+/** Tries to do a raycast by only looking at the triangles close to a given
+ *  triangle. The given triangle and its neighbours are tested first. If one
+ *  of them is hit, only the part of the ray up to that hit needs to be
+ *  traversed in the bvh to find the closest hit. The triangles are tested
+ *  in the same order as rayTestSingle does, so the result is identical to
+ *  a full raycast.
+ *  \param triangle Index of the triangle to start with.
+ *  \param from/to The from and to position for the raycast.
+ *  \param world_trans The world transform of the mesh.
+ *  \param result The callback which receives the hits.
+ *  \return False if neither the triangle nor its neighbours were hit, in
+ *          which case a full raycast must be done.
+ */
+bool TriangleMesh::castRayNearTriangle(int triangle, const btVector3 &from,
+                                       const btVector3 &to,
+                                       const btTransform &world_trans,
+                                       btCollisionWorld::RayResultCallback
+                                                                  *result)
+                                       const
+{
+    if (triangle < 0 || 3 * triangle >= (int)m_neighbours.size())
+        return false;
+
+    btTransform world_to_local = world_trans.inverse();
+    btVector3 from_local = world_to_local * from;
+    btVector3 to_local   = world_to_local * to;
+
+    MaterialRayResult near_result(from, to);
+    btCollisionObject *object = m_collision_object ? m_collision_object
+                                                   : m_body;
+    TriangleMeshRayCallback near_callback(from_local, to_local, &near_result,
+                                          object, world_trans);
+    btVector3 p[3];
+    getTriangle(triangle, &p[0], &p[1], &p[2]);
+    near_callback.processTriangle(p, 0, triangle);
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        int neighbour = m_neighbours[3 * triangle + i];
+        if (neighbour == -1)
+            continue;
+        getTriangle(neighbour, &p[0], &p[1], &p[2]);
+        near_callback.processTriangle(p, 0, neighbour);
+    }
+    if (!near_result.hasHit())
+        return false;
+
+    // Only triangles hit before (or at) this hit can be closer, so the ray
+    // is only traversed up to there. It is made a bit longer to be safe
+    // against rounding errors, and against the tolerance bullet uses at
+    // the edges of triangles.
+    btScalar fraction = near_result.m_closestHitFraction
+                      + 1.0f / (to_local - from_local).length();
+    btVector3 end_local = from_local.lerp(to_local, btMin(fraction,
+                                                          btScalar(1.0f)));
+
+    TriangleMeshRayCallback callback(from_local, to_local, result, object,
+                                     world_trans);
+    static_cast<btBvhTriangleMeshShape*>(m_collision_shape)
+        ->performRaycast(&callback, from_local, end_local);
+    return result->hasHit();
+}   // castRayNearTriangle
+
 // ----------------------------------------------------------------------------
 /** Casts a ray from 'from' to 'to'. If a triangle of this mesh was hit,
  *  xyz and material will be set.
@@ -314,16 +489,24 @@ btVector3 TriangleMesh::getInterpolatedNormal(unsigned int index,
  *         based on the three normals of the triangle and the location of the
  *         hit point (which is more compute intensive, but results in much
  *         smoother results).
+ *  \param triangle If not NULL, the index of the triangle hit by a previous
+ *         raycast (or -1). If computeNeighbours() was called, this triangle
+ *         and its neighbours are tested first, which is a lot faster if the
+ *         ray hits one of them. On return it is set to the index of the
+ *         triangle hit, or -1 if nothing was hit.
  *  \return True if a triangle was hit, false otherwise (and no output
  *          variable will be set.
  */
 bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
                            btVector3 *xyz, const Material **material,
-                           btVector3 *normal, bool interpolate_normal) const
+                           btVector3 *normal, bool interpolate_normal,
+                           int *triangle) const
 {
     if(!m_collision_shape)
     {
         *material=NULL;
+        if(triangle)
+            *triangle = -1;
         return false;
     }
 
@@ -342,43 +525,23 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     else
         world_trans.setIdentity();
 
-    btCollisionWorld::ClosestRayResultCallback result(from, to);
+    MaterialRayResult ray_callback(from, to);
 
-    /** A special ray result class that stores the index of the triangle
-     *  that was hit. */
-    class MaterialRayResult : public btCollisionWorld::ClosestRayResultCallback
+    if(!triangle ||
+       !castRayNearTriangle(*triangle, from, to, world_trans, &ray_callback))
     {
-    public:
-        /** Stores the index of the triangle that was hit. */
-        int m_index;
-        // --------------------------------------------------------------------
-        MaterialRayResult(const btVector3 &p1, const btVector3 &p2,
-                          const TriangleMesh *me)
-                        : btCollisionWorld::ClosestRayResultCallback(p1,p2)
-        {
-            m_index = -1;;
-        }   // MaterialRayResult
-        // --------------------------------------------------------------------
-        virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
-                                         bool normalInWorldSpace)
-        {
-            m_index = rayResult.m_localShapeInfo->m_triangleIndex;
-            return btCollisionWorld::ClosestRayResultCallback
-                    ::addSingleResult(rayResult, normalInWorldSpace);
-        }   // AddSingleResult
-        // --------------------------------------------------------------------
-    };   // myCollision
-
-    MaterialRayResult ray_callback(from, to, this);
-
-    // If this is a rigid body, m_collision_object is NULL, and the
-    // rigid body is the actual collision object.
-    btCollisionWorld::rayTestSingle(trans_from, trans_to,
-                                    m_collision_object ? m_collision_object : m_body,
-                                    m_collision_shape, world_trans,
-                                    ray_callback);
+        // If this is a rigid body, m_collision_object is NULL, and the
+        // rigid body is the actual collision object.
+        btCollisionWorld::rayTestSingle(trans_from, trans_to,
+                                        m_collision_object ? m_collision_object
+                                                           : m_body,
+                                        m_collision_shape, world_trans,
+                                        ray_callback);
+    }
     // Get the index of the triangle hit
     int index = ray_callback.m_index;
+    if(triangle)
+        *triangle = ray_callback.hasHit() ? index : -1;
     if(ray_callback.hasHit())
     {
         *xyz      = ray_callback.m_hitPointWorld;
@@ -407,3 +570,65 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     return ray_callback.hasHit();
 
 }   // castRay
+
+// ----------------------------------------------------------------------------
+/** Tests that raycasts which start with the triangle hit previously give
+ *  exactly the same results as full raycasts.
+ */
+void TriangleMesh::unitTesting()
+{
+    // A bumpy grid, with a second smaller grid above part of it, so that
+    // some rays hit a triangle far away from the one hit before, and some
+    // rays hit the triangle above the previous one.
+    TriangleMesh tm(/*can_be_transformed*/false);
+    const btVector3 up(0, 1, 0);
+    for (int layer = 0; layer < 2; layer++)
+    {
+        const int size = layer == 0 ? 20 : 5;
+        for (int x = 0; x < size; x++)
+        {
+            for (int z = 0; z < size; z++)
+            {
+                btVector3 p[4];
+                for (int i = 0; i < 4; i++)
+                {
+                    float px = float(x + (i == 1 || i == 2));
+                    float pz = float(z + (i >= 2));
+                    p[i] = btVector3(px, 2.0f*layer + 0.1f*sinf(px*pz), pz);
+                }
+                tm.addTriangle(p[0], p[1], p[2], up, up, up, NULL);
+                tm.addTriangle(p[0], p[2], p[3], up, up, up, NULL);
+            }
+        }
+    }
+    tm.createCollisionShape();
+    tm.computeNeighbours();
+
+    // A triangle not at the border of the grid has three neighbours.
+    const unsigned int inner = 2 * (5 * 20 + 5);
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        if (tm.m_neighbours[3 * inner + i] == -1)
+            Log::fatal("TriangleMesh", "Missing neighbour of %d.", inner);
+    }
+
+    int triangle = -1;
+    for (int i = 0; i < 2000; i++)
+    {
+        btVector3 from(0.5f + 18.0f * (i % 400) / 400.0f,
+                       i % 3 == 0 ? 1.0f : 3.0f,
+                       0.5f + 0.009f * i);
+        btVector3 to = from + btVector3(0.1f * sinf(float(i)), -10000.0f,
+                                        0.1f * cosf(float(i)));
+        btVector3 xyz, normal, cached_xyz, cached_normal;
+        const Material *material;
+        bool hit = tm.castRay(from, to, &xyz, &material, &normal,
+                              /*interpolate*/true);
+        bool cached_hit = tm.castRay(from, to, &cached_xyz, &material,
+                                     &cached_normal, /*interpolate*/true,
+                                     &triangle);
+        if (!hit || !cached_hit || xyz != cached_xyz ||
+            normal != cached_normal)
+            Log::fatal("TriangleMesh", "Raycast %d differs.", i);
+    }
+}   // unitTesting
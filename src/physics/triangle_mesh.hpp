@@ -57,6 +57,16 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** For each triangle the indices of up to three triangles which share
+     *  an edge with it, -1 for unused entries. It is empty if
+     *  computeNeighbours() was not called. */
+    std::vector<int>             m_neighbours;
+
+    bool castRayNearTriangle(int triangle, const btVector3 &from,
+                             const btVector3 &to,
+                             const btTransform &world_trans,
+                             btCollisionWorld::RayResultCallback *result)
+                             const;
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -76,11 +86,13 @@ public:
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void createCollisionShape(bool create_collision_object=true,
+                              btOptimizedBvh* bvh=NULL);
     void createPhysicalBody(float friction,
                             btCollisionObject::CollisionFlags flags=
                                (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                            btOptimizedBvh* bvh=NULL);
+    void computeNeighbours();
     void removeAll();
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
@@ -104,6 +116,20 @@ public:
     const Material* getMaterial(int n) const
                                           {return m_triangleIndex2Material[n];}
     // ------------------------------------------------------------------------
+    /** Returns the number of triangles in this mesh. */
+    unsigned int getNumTriangles() const
+                      { return (unsigned int)m_triangleIndex2Material.size(); }
+    // ------------------------------------------------------------------------
+    /** Returns the bvh of the collision shape, or NULL if no collision shape
+     *  was created. */
+    const btOptimizedBvh* getBvh() const
+    {
+        if (!m_collision_shape)
+            return NULL;
+        return static_cast<btBvhTriangleMeshShape*>(m_collision_shape)
+            ->getOptimizedBvh();
+    }   // getBvh
+    // ------------------------------------------------------------------------
     const btCollisionShape &getCollisionShape() const
                                           { return *m_collision_shape; }
     // ------------------------------------------------------------------------
@@ -111,7 +137,8 @@ public:
     // ------------------------------------------------------------------------
     bool castRay(const btVector3 &from, const btVector3 &to,
                  btVector3 *xyz, const Material **material,
-                 btVector3 *normal=NULL, bool interpolate_normal=false) const;
+                 btVector3 *normal=NULL, bool interpolate_normal=false,
+                 int *triangle=NULL) const;
     // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
@@ -146,6 +173,8 @@ public:
         assert(indx < m_p1p2p3.size());
         return m_p1p2p3[indx];
     }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
 };
 #endif
 /* EOF */
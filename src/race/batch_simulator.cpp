@@ -0,0 +1,404 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "race/batch_simulator.hpp"
+
+#include "config/user_config.hpp"
+#include "karts/kart_properties_manager.hpp"
+#include "karts/kart_with_stats.hpp"
+#include "main_loop.hpp"
+#include "modes/profile_world.hpp"
+#include "online/request_manager.hpp"
+#include "tracks/track.hpp"
+#include "tracks/track_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#if !defined(WIN32) && !defined(ANDROID)
+#  include <sys/types.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+BatchSimulator *BatchSimulator::m_batch_simulator = NULL;
+
+// ----------------------------------------------------------------------------
+/** Returns the CPU time used by this process in seconds. */
+static double getCPUTime()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}   // getCPUTime
+
+// ----------------------------------------------------------------------------
+/** Creates the batch simulator, which enables batch races.
+ *  \param csv_file Name of the file to write the results to.
+ */
+void BatchSimulator::create(const std::string &csv_file)
+{
+    assert(!m_batch_simulator);
+    m_batch_simulator = new BatchSimulator(csv_file);
+}   // create
+
+// ----------------------------------------------------------------------------
+BatchSimulator::BatchSimulator(const std::string &csv_file)
+{
+    m_csv_file        = csv_file;
+    m_repetitions     = 1;
+    m_num_laps        = 3;
+    m_num_jobs        = std::max(std::thread::hardware_concurrency(), 1u);
+    m_race_index      = -1;
+    m_start_cpu_time  = 0.0;
+    m_start_real_time = 0;
+}   // BatchSimulator
+
+// ----------------------------------------------------------------------------
+/** Sets the tracks to race on, by default all race tracks are used.
+ *  \param tracks Identifiers of the tracks.
+ */
+void BatchSimulator::setTracks(const std::vector<std::string> &tracks)
+{
+    for (unsigned int i = 0; i < tracks.size(); i++)
+    {
+        const Track *track = track_manager->getTrack(tracks[i]);
+        if (!track || !track->isRaceTrack())
+        {
+            Log::warn("BatchSimulator", "'%s' is not a race track, ignored.",
+                      tracks[i].c_str());
+            continue;
+        }
+        m_tracks.push_back(tracks[i]);
+    }
+}   // setTracks
+
+// ----------------------------------------------------------------------------
+/** Sets the karts to race with, by default the default kart is used.
+ *  \param karts Identifiers of the karts.
+ */
+void BatchSimulator::setKarts(const std::vector<std::string> &karts)
+{
+    for (unsigned int i = 0; i < karts.size(); i++)
+    {
+        if (!kart_properties_manager->getKart(karts[i]))
+        {
+            Log::warn("BatchSimulator", "Kart '%s' not found, ignored.",
+                      karts[i].c_str());
+            continue;
+        }
+        m_karts.push_back(karts[i]);
+    }
+}   // setKarts
+
+// ----------------------------------------------------------------------------
+/** Sets the AI difficulties to race with, by default the current difficulty
+ *  is used.
+ *  \param difficulties The difficulties as numbers (see --difficulty).
+ */
+void BatchSimulator::setDifficulties(const std::vector<std::string>
+                                                                &difficulties)
+{
+    for (unsigned int i = 0; i < difficulties.size(); i++)
+    {
+        int n = -1;
+        if (!StringUtils::fromString(difficulties[i], n) ||
+            n < 0 || n > RaceManager::DIFFICULTY_LAST)
+        {
+            Log::warn("BatchSimulator", "Invalid difficulty '%s', ignored.",
+                      difficulties[i].c_str());
+            continue;
+        }
+        m_difficulties.push_back(RaceManager::Difficulty(n));
+    }
+}   // setDifficulties
+
+// ----------------------------------------------------------------------------
+/** Returns the name of the file the process of a race writes its results
+ *  to. */
+std::string BatchSimulator::getPartFileName(unsigned int race) const
+{
+    return m_csv_file + "." + StringUtils::toString(race) + ".part";
+}   // getPartFileName
+
+// ----------------------------------------------------------------------------
+/** Runs all races. In the original process this only returns after all
+ *  races are done (and the CSV file is written), by exiting STK. For each
+ *  race a process is forked, in which this function returns after the race
+ *  manager is set up for its race, which can then be started as usual.
+ */
+void BatchSimulator::run()
+{
+    if (m_tracks.empty())
+    {
+        for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+        {
+            const Track *track = track_manager->getTrack(i);
+            if (track->isRaceTrack())
+                m_tracks.push_back(track->getIdent());
+        }
+    }
+    if (m_karts.empty())
+        m_karts.push_back(UserConfigParams::m_default_kart);
+    if (m_difficulties.empty())
+        m_difficulties.push_back(race_manager->getDifficulty());
+
+    for (unsigned int t = 0; t < m_tracks.size(); t++)
+    {
+        for (unsigned int k = 0; k < m_karts.size(); k++)
+        {
+            for (unsigned int d = 0; d < m_difficulties.size(); d++)
+            {
+                for (unsigned int r = 0; r < m_repetitions; r++)
+                {
+                    Race race;
+                    race.m_track      = m_tracks[t];
+                    race.m_kart       = m_karts[k];
+                    race.m_difficulty = m_difficulties[d];
+                    race.m_repetition = r;
+                    m_races.push_back(race);
+                }
+            }
+        }
+    }
+    if (m_races.empty())
+    {
+        Log::error("BatchSimulator", "No races to run.");
+        Log::flushBuffers();
+        exit(1);
+    }
+
+#if defined(WIN32) || defined(ANDROID)
+    Log::error("BatchSimulator", "Batch races are not supported on this "
+               "platform.");
+    Log::flushBuffers();
+    exit(1);
+#else
+    // Each race gets its own seed, so that repeated races differ, while
+    // the whole batch can still be reproduced with --seed.
+    const int seed = rand();
+    const pid_t parent_pid = getpid();
+    const uint64_t start_time = StkTime::getRealTimeMs();
+    Log::info("BatchSimulator", "Running %u races, up to %u at a time.",
+              (unsigned int)m_races.size(), m_num_jobs);
+
+    // fork() only copies the calling thread, so the request manager thread
+    // is stopped first (the original process only waits for the races).
+    Online::RequestManager::get()->stopNetworkThreadForFork();
+    std::map<pid_t, unsigned int> running;
+    unsigned int next = 0, done = 0, failed = 0;
+    while (next < m_races.size() || !running.empty())
+    {
+        while (next < m_races.size() && running.size() < m_num_jobs)
+        {
+            // Otherwise buffered output is written by each race again
+            Log::flushBuffers();
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                Log::error("BatchSimulator", "Failed to fork race %u: %s",
+                           next, strerror(errno));
+                break;
+            }
+            if (pid == 0)
+            {
+                m_race_index = next;
+                srand(seed + next);
+                main_loop->setParentPid((unsigned)parent_pid);
+                Online::RequestManager::get()->restartNetworkThreadAfterFork();
+                setupRace();
+                return;
+            }
+            running[pid] = next++;
+        }
+        // If no race could be started, there is nothing to wait for.
+        if (running.empty())
+        {
+            failed += (unsigned int)m_races.size() - next;
+            break;
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            Log::error("BatchSimulator", "Failed to wait for races: %s",
+                       strerror(errno));
+            failed += (unsigned int)(running.size() + m_races.size() - next);
+            break;
+        }
+        std::map<pid_t, unsigned int>::iterator it = running.find(pid);
+        if (it == running.end())
+            continue;
+        const Race &race = m_races[it->second];
+        done++;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            Log::info("BatchSimulator", "Race %u/%u done: %s, %s, %s.",
+                      done, (unsigned int)m_races.size(),
+                      race.m_track.c_str(), race.m_kart.c_str(),
+                      race_manager->getDifficultyAsString(race.m_difficulty)
+                                  .c_str());
+        }
+        else
+        {
+            failed++;
+            Log::warn("BatchSimulator", "Race %u (%s, %s, %s) failed.",
+                      it->second, race.m_track.c_str(), race.m_kart.c_str(),
+                      race_manager->getDifficultyAsString(race.m_difficulty)
+                                  .c_str());
+        }
+        running.erase(it);
+    }
+
+    writeCSV();
+    Log::info("BatchSimulator", "%u races done in %f s, %u failed, results "
+              "written to '%s'.", (unsigned int)m_races.size() - failed,
+              (StkTime::getRealTimeMs() - start_time) * 0.001f, failed,
+              m_csv_file.c_str());
+    Log::flushBuffers();
+    exit(failed == 0 ? 0 : 1);
+#endif
+}   // run
+
+// ----------------------------------------------------------------------------
+/** Sets up the race manager for the race of this process.
+ */
+void BatchSimulator::setupRace()
+{
+    const Race &race = m_races[m_race_index];
+    // The races already run in parallel, so don't add more threads.
+    UserConfigParams::m_kart_threads = 1;
+    ProfileWorld::setProfileModeLaps(m_num_laps);
+    race_manager->setNumLaps(m_num_laps);
+    race_manager->setMinorMode(RaceManager::MINOR_MODE_NORMAL_RACE);
+    race_manager->setTrack(race.m_track);
+    race_manager->setDifficulty(race.m_difficulty);
+    if (race_manager->getNumPlayers() > 0)
+        race_manager->setPlayerKart(0, race.m_kart);
+    race_manager->setAIKartOverride(race.m_kart);
+}   // setupRace
+
+// ----------------------------------------------------------------------------
+/** Called by ProfileWorld when the race starts, i.e. after the track is
+ *  loaded. */
+void BatchSimulator::raceStarted()
+{
+    m_start_cpu_time  = getCPUTime();
+    m_start_real_time = StkTime::getRealTimeMs();
+}   // raceStarted
+
+// ----------------------------------------------------------------------------
+/** Called by ProfileWorld at the end of the race. It writes the results of
+ *  all karts, and then exits the process of this race without any cleanup,
+ *  which is left to the original process (and which would e.g. save the
+ *  user config).
+ *  \param world The world of the finished race.
+ */
+void BatchSimulator::raceFinished(const World *world)
+{
+    const double race_cpu_time = getCPUTime() - m_start_cpu_time;
+    const float race_real_time =
+        (StkTime::getRealTimeMs() - m_start_real_time) * 0.001f;
+    const Race &race = m_races[m_race_index];
+    const std::string difficulty =
+        race_manager->getDifficultyAsString(race.m_difficulty);
+
+    std::ofstream csv(getPartFileName(m_race_index).c_str());
+    for (unsigned int i = 0; i < world->getNumKarts(); i++)
+    {
+        const KartWithStats *kart =
+            dynamic_cast<const KartWithStats*>(world->getKart(i));
+        if (!kart)
+            continue;
+        csv << m_race_index << "," << race.m_track << "," << race.m_kart
+            << "," << difficulty << "," << race.m_repetition << ","
+            << i + 1 << "," << kart->getPosition() << ","
+            << kart->getFinishTime() << ",";
+        const std::vector<float> &lap_times = kart->getLapTimes();
+        for (unsigned int lap = 0; lap < m_num_laps; lap++)
+        {
+            if (lap < lap_times.size())
+                csv << lap_times[lap];
+            csv << ",";
+        }
+        csv << kart->getTopSpeed()         << ","
+            << kart->getBonusCount()       << ","
+            << kart->getBananaCount()      << ","
+            << kart->getSmallNitroCount()  << ","
+            << kart->getLargeNitroCount()  << ","
+            << kart->getBubblegumCount()   << ","
+            << kart->getPowerupUseCount()  << ","
+            << kart->getExplosionCount()   << ","
+            << kart->getRescueCount()      << ","
+            << kart->getOffTrackCount()    << ","
+            << world->getTime()            << ","
+            << m_start_cpu_time            << ","
+            << race_cpu_time               << ","
+            << race_real_time              << "\n";
+    }
+    csv.close();
+    Log::flushBuffers();
+    std::_Exit(csv.fail() ? 1 : 0);
+}   // raceFinished
+
+// ----------------------------------------------------------------------------
+/** Combines the results written by the processes of all races into the
+ *  CSV file.
+ */
+void BatchSimulator::writeCSV() const
+{
+    std::ofstream csv(m_csv_file.c_str());
+    csv << "race,track,kart,difficulty,repetition,start_position,"
+           "end_position,finish_time,";
+    for (unsigned int lap = 0; lap < m_num_laps; lap++)
+        csv << "lap_" << lap + 1 << ",";
+    csv << "top_speed,bonus_boxes,bananas,small_nitros,large_nitros,"
+           "bubblegums,powerups_used,explosions,rescues,off_track,race_time,"
+           "load_cpu_time,race_cpu_time,race_real_time\n";
+
+    for (unsigned int i = 0; i < m_races.size(); i++)
+    {
+        const std::string name = getPartFileName(i);
+        std::ifstream part(name.c_str());
+        if (!part.is_open())
+            continue;
+        // Writing an empty buffer would set the fail bit of csv.
+        if (part.peek() != EOF)
+            csv << part.rdbuf();
+        part.close();
+        remove(name.c_str());
+    }
+    if (csv.fail())
+    {
+        Log::error("BatchSimulator", "Failed to write '%s'.",
+                   m_csv_file.c_str());
+    }
+}   // writeCSV
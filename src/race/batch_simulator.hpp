@@ -0,0 +1,116 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_BATCH_SIMULATOR_HPP
+#define HEADER_BATCH_SIMULATOR_HPP
+
+#include "race/race_manager.hpp"
+#include "utils/no_copy.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class World;
+
+/** \class BatchSimulator
+ *  \brief Runs a batch of AI races without graphics as fast as possible,
+ *  e.g. to tune the AI or to balance the karts. One race is done for each
+ *  combination of the selected tracks, karts and AI difficulties (and
+ *  repeated if requested), with all karts of a race being the same kart.
+ *  Each race runs in its own process forked from the original process
+ *  after all karts and tracks are loaded, so the races are isolated from
+ *  each other and several of them can run at the same time. Each process
+ *  writes the results of its race, and the original process combines them
+ *  into one CSV file with one line per kart and race.
+ *  \ingroup race
+ */
+class BatchSimulator : public NoCopy
+{
+private:
+    static BatchSimulator *m_batch_simulator;
+
+    /** The settings of one race. */
+    struct Race
+    {
+        std::string             m_track;
+        std::string             m_kart;
+        RaceManager::Difficulty m_difficulty;
+        unsigned int            m_repetition;
+    };   // Race
+
+    /** All races to run, in the order they are written to the CSV file. */
+    std::vector<Race> m_races;
+
+    /** Name of the CSV file to write the results to. */
+    std::string m_csv_file;
+
+    std::vector<std::string> m_tracks;
+    std::vector<std::string> m_karts;
+    std::vector<RaceManager::Difficulty> m_difficulties;
+
+    /** How often each combination of track, kart and difficulty is raced. */
+    unsigned int m_repetitions;
+
+    /** Number of laps of each race. */
+    unsigned int m_num_laps;
+
+    /** Maximum number of races run at the same time. */
+    unsigned int m_num_jobs;
+
+    /** Index of the race run by this process, or -1 in the original
+     *  process. */
+    int m_race_index;
+
+    /** CPU time used by this process when its race started. */
+    double m_start_cpu_time;
+
+    /** Real time in ms when the race of this process started. */
+    uint64_t m_start_real_time;
+
+    BatchSimulator(const std::string &csv_file);
+    std::string getPartFileName(unsigned int race) const;
+    void setupRace();
+    void writeCSV() const;
+
+public:
+    // ------------------------------------------------------------------------
+    static void create(const std::string &csv_file);
+    // ------------------------------------------------------------------------
+    /** Returns the batch simulator, or NULL if no batch races are done. */
+    static BatchSimulator *get() { return m_batch_simulator; }
+    // ------------------------------------------------------------------------
+    void setTracks(const std::vector<std::string> &tracks);
+    void setKarts(const std::vector<std::string> &karts);
+    void setDifficulties(const std::vector<std::string> &difficulties);
+    void run();
+    void raceStarted();
+    void raceFinished(const World *world);
+    // ------------------------------------------------------------------------
+    /** Sets how often each combination of track, kart and difficulty is
+     *  raced. */
+    void setRepetitions(unsigned int n) { m_repetitions = n;  }
+    // ------------------------------------------------------------------------
+    /** Sets the number of laps of each race. */
+    void setNumLaps(unsigned int laps)  { m_num_laps = laps;  }
+    // ------------------------------------------------------------------------
+    /** Sets the maximum number of races run at the same time. */
+    void setNumJobs(unsigned int jobs)  { m_num_jobs = jobs;  }
+};   // BatchSimulator
+
+#endif
@@ -26,13 +26,29 @@
 #include "utils/constants.hpp"
 
 #include <math.h>
+#include <string.h>
 
+uint32_t TerrainInfo::m_prefetch_generation = 1;
+
+//-----------------------------------------------------------------------------
+/** Returns true if the x, y and z values of both vectors have the same bits.
+ *  Unlike operator==, this tells 0 from -0, which can change a raycast.
+ */
+static bool isIdentical(const btVector3 &a, const btVector3 &b)
+{
+    return memcmp((const btScalar*)a, (const btScalar*)b,
+                  3 * sizeof(btScalar)) == 0;
+}   // isIdentical
+
+//-----------------------------------------------------------------------------
 /** Constructor to initialise terrain data.
  */
 TerrainInfo::TerrainInfo()
 {
     m_last_material = NULL;
     m_material      = NULL;
+    m_triangle      = -1;
+    m_prefetched_generation = 0;
 }   // TerrainInfo
 
 //-----------------------------------------------------------------------------
@@ -44,6 +60,8 @@ TerrainInfo::TerrainInfo(const Vec3 &pos)
     // initialise HoT
     m_last_material = NULL;
     m_material = NULL;
+    m_triangle = -1;
+    m_prefetched_generation = 0;
     update(pos);
 }   // TerrainInfo
 
@@ -59,7 +77,7 @@ void TerrainInfo::update(const Vec3 &from)
 
     const TriangleMesh &tm = Track::getCurrentTrack()->getTriangleMesh();
     tm.castRay(from, to, &m_hit_point, &m_material, &m_normal,
-               /*interpolate*/false);
+               /*interpolate*/false, &m_triangle);
     // Now also raycast against all track objects (that are driveable).
     Track::getCurrentTrack()->getTrackObjectManager()
                      ->castRay(from, to, &m_hit_point, &m_material,
@@ -67,31 +85,93 @@ void TerrainInfo::update(const Vec3 &from)
 }   // update
 
 //-----------------------------------------------------------------------------
-/** Update the terrain information based on the latest position.
- *  \param tran The transform ov the kart
+/** Casts a ray down (relative to the given rotation) against the track and
+ *  all driveable track objects. It only reads the track data, so it can be
+ *  called from several threads at the same time (see prefetch()).
+ *  \param rotation Rotation of the object, the ray goes along its -Y axis.
  *  \param from World coordinates from which to start the raycast.
+ *  \param hit_point Set to the closest hit, unchanged if nothing was hit.
+ *  \param material Set to the material hit, NULL if nothing was hit.
+ *  \param normal Set to the interpolated normal at the hit point.
+ *  \param triangle The track triangle hit by the previous raycast, on
+ *         return the track triangle hit (see TriangleMesh::castRay).
+ *  \return True if anything was hit.
  */
-void TerrainInfo::update(const btMatrix3x3 &rotation, const Vec3 &from)
+bool TerrainInfo::castDown(const btMatrix3x3 &rotation, const Vec3 &from,
+                           Vec3 *hit_point, const Material **material,
+                           Vec3 *normal, int *triangle)
 {
-    m_last_material = m_material;
-    // Save the origin for debug drawing
-    m_origin_ray    = from;
-
     // Compute the 'to' vector by rotating a long 'down' vectory by the
     // kart rotation, and adding the start point to it.
     btVector3 to(0, -10000.0f, 0);
     to = from + rotation*to;
 
     const TriangleMesh &tm = Track::getCurrentTrack()->getTriangleMesh();
-    tm.castRay(from, to, &m_hit_point, &m_material, &m_normal,
-               /*interpolate*/true);
+    bool hit = tm.castRay(from, to, hit_point, material, normal,
+                          /*interpolate*/true, triangle);
     // Now also raycast against all track objects (that are driveable). If
     // there should be a closer result (than the one against the main track 
     // mesh), its data will be returned.
-    Track::getCurrentTrack()->getTrackObjectManager()
-                            ->castRay(from, to, &m_hit_point, &m_material,
-                                      &m_normal, /*interpolate*/true);
+    if (Track::getCurrentTrack()->getTrackObjectManager()
+                            ->castRay(from, to, hit_point, material,
+                                      normal, /*interpolate*/true))
+        hit = true;
+    return hit;
+}   // castDown
+
+//-----------------------------------------------------------------------------
+/** Update the terrain information based on the latest position.
+ *  \param tran The transform ov the kart
+ *  \param from World coordinates from which to start the raycast.
+ */
+void TerrainInfo::update(const btMatrix3x3 &rotation, const Vec3 &from)
+{
+    m_last_material = m_material;
+    // Save the origin for debug drawing
+    m_origin_ray    = from;
+
+    if (m_prefetched_generation == m_prefetch_generation &&
+        isIdentical(rotation[0], m_prefetch_rotation[0]) &&
+        isIdentical(rotation[1], m_prefetch_rotation[1]) &&
+        isIdentical(rotation[2], m_prefetch_rotation[2]) &&
+        isIdentical(from, m_prefetch_from))
+    {
+        if (m_prefetch_hit)
+            m_hit_point = m_prefetch_hit_point;
+        m_material = m_prefetch_material;
+        m_normal   = m_prefetch_normal;
+        m_triangle = m_prefetch_triangle;
+    }
+    else
+    {
+        castDown(rotation, from, &m_hit_point, &m_material, &m_normal,
+                 &m_triangle);
+    }
+    m_prefetched_generation = 0;
 }   // update
+
+//-----------------------------------------------------------------------------
+/** Does the raycast of update(rotation, from) ahead of time, without
+ *  changing the current terrain information. This can be called for
+ *  several objects in parallel, as long as the track does not change until
+ *  the matching update() calls, after which discardPrefetches() must be
+ *  called. If update() is called with different values, the prefetched
+ *  result is not used and the raycast is done again, so the result is
+ *  always the same as without prefetching.
+ *  \param rotation Rotation that is expected to be passed to update().
+ *  \param from Origin that is expected to be passed to update().
+ */
+void TerrainInfo::prefetch(const btMatrix3x3 &rotation, const Vec3 &from)
+{
+    m_prefetch_rotation = rotation;
+    m_prefetch_from     = from;
+    m_prefetch_triangle = m_triangle;
+    m_prefetch_hit      = castDown(rotation, from, &m_prefetch_hit_point,
+                                   &m_prefetch_material, &m_prefetch_normal,
+                                   &m_prefetch_triangle);
+    m_prefetched_generation = m_prefetch_generation;
+}   // prefetch
+
 //-----------------------------------------------------------------------------
 /** Update the terrain information based on the latest position.
 *  \param Position from which to start the rayast from.
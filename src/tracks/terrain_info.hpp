@@ -21,6 +21,10 @@
 
 #include "utils/vec3.hpp"
 
+#include "LinearMath/btMatrix3x3.h"
+
+#include <cstdint>
+
 class btTransform;
 class Material;
 
@@ -43,6 +47,31 @@ private:
     /** DEBUG only: origin of raycast. */
     Vec3 m_origin_ray;
 
+    /** Index of the track triangle hit by the last raycast, or -1. The next
+     *  raycast tests this triangle and its neighbours first. */
+    int               m_triangle;
+
+    /** Increased by discardPrefetches(), which makes all prefetched
+     *  results invalid. */
+    static uint32_t   m_prefetch_generation;
+
+    /** Value of m_prefetch_generation when prefetch() was called, 0 if
+     *  there is no prefetched result. It is only used if update() is called
+     *  with exactly the same rotation and origin. */
+    uint32_t          m_prefetched_generation;
+    /** True if the prefetched raycast hit anything. */
+    bool              m_prefetch_hit;
+    btMatrix3x3       m_prefetch_rotation;
+    Vec3              m_prefetch_from;
+    Vec3              m_prefetch_hit_point;
+    Vec3              m_prefetch_normal;
+    const Material   *m_prefetch_material;
+    int               m_prefetch_triangle;
+
+    static bool castDown(const btMatrix3x3 &rotation, const Vec3 &from,
+                         Vec3 *hit_point, const Material **material,
+                         Vec3 *normal, int *triangle);
+
 public:
              TerrainInfo();
              TerrainInfo(const Vec3 &pos);
@@ -51,6 +80,10 @@ public:
     bool     getSurfaceInfo(const Vec3 &from, Vec3 *position,
                             const Material **m);
     virtual void update(const btMatrix3x3 &rotation, const Vec3 &from);
+    void     prefetch(const btMatrix3x3 &rotation, const Vec3 &from);
+    // ------------------------------------------------------------------------
+    /** Makes the results of all prefetch() calls done so far invalid. */
+    static void discardPrefetches()            { m_prefetch_generation++; }
     virtual void update(const Vec3 &from);
     virtual void update(const Vec3 &from, const Vec3 &towards);
 
@@ -80,6 +113,11 @@ public:
     /** Returns the hit point of the raycast. */
     const btVector3& getHitPoint() const { return m_hit_point; }
     const Vec3& getOrigin() const { return m_origin_ray;  }
+    // ------------------------------------------------------------------------
+    /** Returns the index of the track triangle hit by the last raycast, or
+     *  -1 if none was hit. It can be passed to TriangleMesh::castRay() to
+     *  speed up raycasts close to this object. */
+    int getTriangleIndex() const { return m_triangle; }
 
 };  // TerrainInfo
 
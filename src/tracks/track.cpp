@@ -74,6 +74,7 @@
 #include "tracks/model_definition_loader.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object_manager.hpp"
+#include "tracks/track_physics_cache.hpp"
 #include "utils/constants.hpp"
 #include "utils/log.hpp"
 #include "utils/mini_glm.hpp"
@@ -132,6 +133,8 @@ Track::Track(const std::string &filename)
     m_version               = 0;
     m_track_mesh            = NULL;
     m_gfx_effect_mesh       = NULL;
+    m_physics_cache         = NULL;
+    m_physics_fingerprint   = 0;
     m_internal              = false;
     m_enable_auto_rescue    = true;  // Below set to false in arenas
     m_enable_push_back      = true;
@@ -369,6 +372,10 @@ void Track::cleanup()
     delete m_gfx_effect_mesh;
     m_gfx_effect_mesh = NULL;
 
+    // The bvhs of the meshes above are stored in the cache
+    delete m_physics_cache;
+    m_physics_cache = NULL;
+
 #ifndef SERVER_ONLY
     if (CVS->isGLSL())
         irr_driver->cleanSunInterposer();
@@ -860,6 +867,27 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         return;
     }
 
+    // Use the cached triangles and bvhs if all nodes are the same as when
+    // the cache was saved. Otherwise the main track, which was not converted
+    // in loadMainTrack, must be converted first.
+    uint64_t fingerprint = hashPhysicsNodes(m_static_physics_only_nodes,
+                                            m_physics_fingerprint);
+    fingerprint = hashPhysicsNodes(m_object_physics_only_nodes, fingerprint);
+    fingerprint = hashPhysicsNodes(std::vector<scene::ISceneNode*>(
+        m_all_nodes.begin() + main_track_count, m_all_nodes.end()),
+        fingerprint);
+    bool from_cache = false;
+    if (m_physics_cache->isAvailable())
+    {
+        from_cache = m_physics_cache->load(fingerprint, m_track_mesh,
+                                           m_gfx_effect_mesh);
+        if (!from_cache)
+        {
+            for (unsigned int i = 0; i < main_track_count; i++)
+                convertTrackToBullet(m_all_nodes[i]);
+        }
+    }
+
 
     // Now convert all objects that are only used for the physics
     // (like invisible walls).
@@ -867,7 +895,8 @@ void Track::createPhysicsModel(unsigned int main_track_count)
     {
         main_loop->renderGUI(5550, i, m_static_physics_only_nodes.size());
 
-        convertTrackToBullet(m_static_physics_only_nodes[i]);
+        if (!from_cache)
+            convertTrackToBullet(m_static_physics_only_nodes[i]);
         if (UserConfigParams::m_physics_debug &&
             m_static_physics_only_nodes[i]->getType() == scene::ESNT_MESH)
         {
@@ -893,7 +922,8 @@ void Track::createPhysicsModel(unsigned int main_track_count)
     for (unsigned int i = 0; i<m_object_physics_only_nodes.size(); i++)
     {
         main_loop->renderGUI(5565, i, m_static_physics_only_nodes.size());
-        convertTrackToBullet(m_object_physics_only_nodes[i]);
+        if (!from_cache)
+            convertTrackToBullet(m_object_physics_only_nodes[i]);
         m_object_physics_only_nodes[i]->setVisible(false);
         m_object_physics_only_nodes[i]->grab();
         irr_driver->removeNode(m_object_physics_only_nodes[i]);
@@ -904,17 +934,75 @@ void Track::createPhysicsModel(unsigned int main_track_count)
     for(unsigned int i=main_track_count; i<m_all_nodes.size(); i++)
     {
         main_loop->renderGUI(5570, i, m_all_nodes.size());
-        convertTrackToBullet(m_all_nodes[i]);
+        if (!from_cache)
+            convertTrackToBullet(m_all_nodes[i]);
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
     main_loop->renderGUI(5580);
-    m_track_mesh->createPhysicalBody(m_friction);
+    m_track_mesh->createPhysicalBody(m_friction,
+        (btCollisionObject::CollisionFlags)0,
+        m_physics_cache->getTrackBvh());
+    m_track_mesh->computeNeighbours();
     main_loop->renderGUI(5585);
-    m_gfx_effect_mesh->createCollisionShape();
+    m_gfx_effect_mesh->createCollisionShape(/*create_collision_object*/true,
+        m_physics_cache->getGFXEffectBvh());
     main_loop->renderGUI(5590);
+    if (!from_cache)
+        m_physics_cache->save(fingerprint, *m_track_mesh, *m_gfx_effect_mesh);
 
 }   // createPhysicsModel
 
+// -----------------------------------------------------------------------------
+/** Adds the scene nodes which are converted to physics to a hash, which is
+ *  used to check if the cached track physics can be used. It contains the
+ *  type and transform of each node and the size and bounding box of each
+ *  mesh buffer, so it is cheap to compute compared to converting the nodes.
+ *  \param nodes The nodes in the order in which they are converted.
+ *  \param h The hash of the nodes converted before.
+ */
+uint64_t Track::hashPhysicsNodes(const std::vector<scene::ISceneNode*>& nodes,
+                                 uint64_t h)
+{
+    for (scene::ISceneNode* node : nodes)
+    {
+        // Same as in convertTrackToBullet
+        if (node->getType() == scene::ESNT_LOD_NODE)
+            node = ((LODNode*)node)->getFirstNode();
+        if (node == NULL)
+            continue;
+        const int type = node->getType();
+        h = TrackPhysicsCache::hash(&type, sizeof(type), h);
+        scene::IMesh *mesh;
+        switch (node->getType())
+        {
+        case scene::ESNT_MESH:
+        case scene::ESNT_WATER_SURFACE:
+        case scene::ESNT_OCTREE:
+            mesh = ((scene::IMeshSceneNode*)node)->getMesh();
+            break;
+        case scene::ESNT_ANIMATED_MESH:
+            mesh = ((scene::IAnimatedMeshSceneNode*)node)->getMesh();
+            break;
+        default:
+            continue;
+        }
+        node->updateAbsolutePosition();
+        const core::matrix4& m = node->getAbsoluteTransformation();
+        h = TrackPhysicsCache::hash(m.pointer(), 16 * sizeof(f32), h);
+        for (unsigned int i = 0; i < mesh->getMeshBufferCount(); i++)
+        {
+            scene::IMeshBuffer *mb = mesh->getMeshBuffer(i);
+            const u32 data[3] = { (u32)mb->getVertexType(),
+                mb->getVertexCount(), mb->getIndexCount() };
+            h = TrackPhysicsCache::hash(data, sizeof(data), h);
+            const core::aabbox3df& box = mb->getBoundingBox();
+            h = TrackPhysicsCache::hash(&box.MinEdge, sizeof(box.MinEdge), h);
+            h = TrackPhysicsCache::hash(&box.MaxEdge, sizeof(box.MaxEdge), h);
+        }
+    }
+    return h;
+}   // hashPhysicsNodes
+
 // -----------------------------------------------------------------------------
 
 
@@ -1190,6 +1278,13 @@ bool Track::loadMainTrack(const XMLNode &root)
 
     m_track_mesh      = new TriangleMesh(/*can_be_transformed*/false);
     m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
+    // The objects of a track can depend on the mode, so each mode has its
+    // own cache file
+    std::string cache_name = m_ident + "-" +
+        StringUtils::toString((int)race_manager->getMinorMode());
+    if (race_manager->getReverseTrack())
+        cache_name += "-reverse";
+    m_physics_cache = new TrackPhysicsCache(m_root, cache_name);
 
     const XMLNode *track_node = root.getNode("track");
     std::string model_name;
@@ -1458,18 +1553,25 @@ bool Track::loadMainTrack(const XMLNode &root)
 
     }   // for i
 
-    // This will (at this stage) only convert the main track model.
+    // This will (at this stage) only convert the main track model. If the
+    // track physics is cached, it is only converted in createPhysicsModel
+    // if the cache turns out to be unusable.
+    const bool use_cache = m_physics_cache->isAvailable();
     for(unsigned int i=0; i<m_all_nodes.size(); i++)
     {
         main_loop->renderGUI(4350, i, m_all_nodes.size());
-        convertTrackToBullet(m_all_nodes[i]);
+        if (!use_cache)
+            convertTrackToBullet(m_all_nodes[i]);
         main_loop->renderGUI(4360, i, m_all_nodes.size());
         uploadNodeVertexBuffer(m_all_nodes[i]);
         main_loop->renderGUI(4400, i, m_all_nodes.size());
     }
 
-    // Free the tangent (track mesh) after converting to physics
-    if (ProfileWorld::isNoGraphics())
+    m_physics_fingerprint = hashPhysicsNodes(m_all_nodes,
+                                             TrackPhysicsCache::hash(NULL, 0));
+    // Free the tangent (track mesh) after converting to physics, otherwise
+    // it is freed in freeCachedMeshVertexBuffer
+    if (ProfileWorld::isNoGraphics() && !use_cache)
         tangent_mesh->freeMeshVertexBuffer();
 
     if (m_track_mesh == NULL)
@@ -53,6 +53,7 @@ class PhysicalObject;
 class RenderTarget;
 class TrackObject;
 class TrackObjectManager;
+class TrackPhysicsCache;
 class TriangleMesh;
 class XMLNode;
 
@@ -196,6 +197,10 @@ private:
      *  allowing the kart to drive in/partly under water), but the
      *  actual surface position is needed for the water splash effect. */
     TriangleMesh*            m_gfx_effect_mesh;
+    /** The cached collision data of this track, if any. */
+    TrackPhysicsCache*       m_physics_cache;
+    /** Hash of the main track nodes, see hashPhysicsNodes. */
+    uint64_t                 m_physics_fingerprint;
     /** Minimum coordinates of this track. */
     Vec3                     m_aabb_min;
     /** Maximum coordinates of this track. */
@@ -395,6 +400,8 @@ private:
     void loadArenaGraph(const XMLNode &node);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
     void convertTrackToBullet(scene::ISceneNode *node);
+    uint64_t hashPhysicsNodes(const std::vector<scene::ISceneNode*>& nodes,
+                              uint64_t h);
     bool loadMainTrack(const XMLNode &node);
     void loadMinimap();
     void createWater(const XMLNode &node);
@@ -0,0 +1,506 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "tracks/track_physics_cache.hpp"
+
+#include "graphics/central_settings.hpp"
+#include "graphics/material.hpp"
+#include "graphics/material_manager.hpp"
+#include "io/file_manager.hpp"
+#include "physics/triangle_mesh.hpp"
+#include "utils/constants.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef WIN32
+#  include <process.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+/** Identifies a cache file. */
+static const uint32_t CACHE_MAGIC = 0x504b5453;   // "STKP"
+
+/** Must be increased whenever the file format changes. */
+static const uint32_t CACHE_VERSION = 1;
+
+/** The serialized bvh contains floats and pointers, so it can only be
+ *  used by a build with the same sizes. */
+static const uint32_t CACHE_FORMAT = (uint32_t)sizeof(btScalar) |
+                                     (uint32_t)sizeof(void*) << 8;
+
+/** Magic, version, format, padding and key. */
+static const size_t HEADER_SIZE = 24;
+
+// ----------------------------------------------------------------------------
+/** Reads values from the cache file with bounds checking. */
+class CacheReader
+{
+private:
+    const char* m_data;
+    size_t      m_size;
+    size_t      m_pos;
+public:
+    CacheReader(const char* data, size_t size, size_t pos)
+        : m_data(data), m_size(size), m_pos(pos) {}
+    // ------------------------------------------------------------------------
+    /** Returns a pointer to the next n bytes and skips them, or NULL if
+     *  the file is too short. */
+    const char* skip(size_t n)
+    {
+        if (n > m_size - m_pos)
+            return NULL;
+        const char* p = m_data + m_pos;
+        m_pos += n;
+        return p;
+    }   // skip
+    // ------------------------------------------------------------------------
+    template<typename T> bool get(T* value)
+    {
+        const char* p = skip(sizeof(T));
+        if (!p)
+            return false;
+        memcpy(value, p, sizeof(T));
+        return true;
+    }   // get
+    // ------------------------------------------------------------------------
+    bool getString(std::string* s)
+    {
+        uint32_t len;
+        if (!get(&len))
+            return false;
+        const char* p = skip(len);
+        if (!p)
+            return false;
+        s->assign(p, len);
+        return true;
+    }   // getString
+    // ------------------------------------------------------------------------
+    /** Skips the padding up to the next 16 byte boundary. */
+    bool align()        { return skip((16 - m_pos % 16) % 16) != NULL; }
+};   // CacheReader
+
+// ----------------------------------------------------------------------------
+template<typename T> static void add(std::string* out, const T& value)
+{
+    out->append((const char*)&value, sizeof(T));
+}   // add
+// ----------------------------------------------------------------------------
+static void addString(std::string* out, const std::string& s)
+{
+    add(out, (uint32_t)s.size());
+    out->append(s);
+}   // addString
+// ----------------------------------------------------------------------------
+static void addVec3(std::string* out, const btVector3& v)
+{
+    add(out, (float)v.getX());
+    add(out, (float)v.getY());
+    add(out, (float)v.getZ());
+}   // addVec3
+// ----------------------------------------------------------------------------
+static btVector3 getVec3(const char* p)
+{
+    float f[3];
+    memcpy(f, p, sizeof(f));
+    return btVector3(f[0], f[1], f[2]);
+}   // getVec3
+
+// ----------------------------------------------------------------------------
+/** Computes the cache key of a track and maps its cache file if it exists
+ *  and the key matches.
+ *  \param track_dir Directory of the track, ending with '/'.
+ *  \param name Name of the cache file, must be different for each mode in
+ *         which the track can contain different objects.
+ */
+TrackPhysicsCache::TrackPhysicsCache(const std::string& track_dir,
+                                     const std::string& name)
+{
+    m_filename = file_manager->getCachedPhysicsDir() + name + ".physics";
+    m_data     = NULL;
+    m_size     = 0;
+    m_mapped   = false;
+    m_bvh[0]   = NULL;
+    m_bvh[1]   = NULL;
+
+    m_key = hash(STK_VERSION, strlen(STK_VERSION));
+    m_key = hash(name.c_str(), name.size(), m_key);
+#ifndef SERVER_ONLY
+    // The materials of triangles are taken from different places with and
+    // without shader based rendering
+    const bool glsl = CVS->isGLSL();
+    m_key = hash(&glsl, sizeof(glsl), m_key);
+#endif
+    std::set<std::string> files;
+    file_manager->listFiles(files, track_dir);
+    for (const std::string& f : files)
+    {
+        if (f == "." || f == "..")
+            continue;
+        struct stat st;
+        if (stat((track_dir + f).c_str(), &st) != 0)
+            continue;
+        const uint64_t size = (uint64_t)st.st_size;
+        const uint64_t time = (uint64_t)st.st_mtime;
+        m_key = hash(f.c_str(), f.size(), m_key);
+        m_key = hash(&size, sizeof(size), m_key);
+        m_key = hash(&time, sizeof(time), m_key);
+    }
+    mapFile();
+}   // TrackPhysicsCache
+
+// ----------------------------------------------------------------------------
+TrackPhysicsCache::~TrackPhysicsCache()
+{
+    unmapFile();
+}   // ~TrackPhysicsCache
+
+// ----------------------------------------------------------------------------
+/** 64 bit FNV-1a hash of the given data.
+ *  \param h Hash of previous data to continue with.
+ */
+uint64_t TrackPhysicsCache::hash(const void* data, size_t size, uint64_t h)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}   // hash
+
+// ----------------------------------------------------------------------------
+/** Maps the cache file into memory (or reads it where mmap is not available)
+ *  and checks its header. The memory is writable but private, since the
+ *  bvh is initialised in place.
+ *  \return True if the file exists and has the right key.
+ */
+bool TrackPhysicsCache::mapFile()
+{
+#ifdef WIN32
+    std::ifstream in(m_filename, std::ios::in | std::ios::binary);
+    if (!in.is_open())
+        return false;
+    in.seekg(0, std::ios::end);
+    const std::streamoff size = in.tellg();
+    if (size < (std::streamoff)HEADER_SIZE)
+        return false;
+    in.seekg(0, std::ios::beg);
+    m_size = (size_t)size;
+    m_data = (char*)btAlignedAlloc((int)m_size, 16);
+    m_mapped = false;
+    if (!in.read(m_data, m_size))
+    {
+        unmapFile();
+        return false;
+    }
+#else
+    int fd = ::open(m_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)HEADER_SIZE)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    m_data = (char*)p;
+    m_size = (size_t)st.st_size;
+    m_mapped = true;
+#endif
+
+    CacheReader r(m_data, m_size, 0);
+    uint32_t magic = 0, version = 0, format = 0, padding = 0;
+    uint64_t key = 0;
+    r.get(&magic);
+    r.get(&version);
+    r.get(&format);
+    r.get(&padding);
+    r.get(&key);
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION ||
+        format != CACHE_FORMAT || key != m_key)
+    {
+        Log::info("TrackPhysicsCache", "'%s' is outdated.",
+                  m_filename.c_str());
+        unmapFile();
+        return false;
+    }
+    return true;
+}   // mapFile
+
+// ----------------------------------------------------------------------------
+void TrackPhysicsCache::unmapFile()
+{
+    if (!m_data)
+        return;
+#ifndef WIN32
+    if (m_mapped)
+        munmap(m_data, m_size);
+    else
+#endif
+        btAlignedFree(m_data);
+    m_data   = NULL;
+    m_size   = 0;
+    m_bvh[0] = NULL;
+    m_bvh[1] = NULL;
+}   // unmapFile
+
+// ----------------------------------------------------------------------------
+/** Adds the cached triangles to the (empty) meshes and initialises their
+ *  bvhs, which can then be passed to TriangleMesh::createCollisionShape.
+ *  Nothing is changed if the cache can not be used.
+ *  \param fingerprint Hash of all scene nodes that would be converted, the
+ *         cache is only used if it was saved with the same fingerprint.
+ *  \return True if the meshes were filled from the cache.
+ */
+bool TrackPhysicsCache::load(uint64_t fingerprint, TriangleMesh* track_mesh,
+                             TriangleMesh* gfx_effect_mesh)
+{
+    if (!m_data)
+        return false;
+    assert(track_mesh->getNumTriangles() == 0 &&
+           gfx_effect_mesh->getNumTriangles() == 0);
+
+    CacheReader r(m_data, m_size, HEADER_SIZE);
+    uint64_t cached_fingerprint = 0;
+    if (!r.get(&cached_fingerprint) || cached_fingerprint != fingerprint)
+    {
+        Log::info("TrackPhysicsCache", "The objects of the track have "
+            "changed, not using '%s'.", m_filename.c_str());
+        return false;
+    }
+
+    uint32_t material_count = 0;
+    if (!r.get(&material_count))
+        return false;
+    std::vector<const Material*> materials;
+    for (uint32_t i = 0; i < material_count; i++)
+    {
+        std::string full_path, uv_two, shader;
+        if (!r.getString(&full_path) || !r.getString(&uv_two) ||
+            !r.getString(&shader))
+            return false;
+        const Material* m =
+            material_manager->getMaterialSPM(full_path, uv_two, shader);
+        if (!m || m->getTexFullPath() != full_path ||
+            m->getUVTwoTexture() != uv_two || m->getShaderName() != shader)
+        {
+            Log::info("TrackPhysicsCache", "Material '%s' not found, not "
+                "using '%s'.", full_path.c_str(), m_filename.c_str());
+            return false;
+        }
+        materials.push_back(m);
+    }
+
+    // Check all data before anything is changed
+    struct MeshData
+    {
+        uint32_t    m_count;
+        const char* m_vertices;
+        const char* m_normals;
+        const char* m_materials;
+        char*       m_bvh;
+        uint32_t    m_bvh_size;
+    } mesh_data[2];
+    for (MeshData& md : mesh_data)
+    {
+        const size_t vec3_size = 3 * sizeof(float);
+        // Vertices, normals and material index of a triangle use 76 bytes
+        if (!r.get(&md.m_count) || md.m_count > m_size / 76)
+            return false;
+        md.m_vertices  = r.skip(3 * vec3_size * md.m_count);
+        md.m_normals   = r.skip(3 * vec3_size * md.m_count);
+        md.m_materials = r.skip(sizeof(uint32_t) * md.m_count);
+        if (!md.m_vertices || !md.m_normals || !md.m_materials ||
+            !r.get(&md.m_bvh_size) || !r.align())
+            return false;
+        md.m_bvh = (char*)r.skip(md.m_bvh_size);
+        if (!md.m_bvh || (md.m_count > 0 && md.m_bvh_size == 0))
+            return false;
+        for (uint32_t i = 0; i < md.m_count; i++)
+        {
+            uint32_t index;
+            memcpy(&index, md.m_materials + i * sizeof(index), sizeof(index));
+            if (index >= material_count)
+                return false;
+        }
+    }
+    btOptimizedBvh* bvh[2] = { NULL, NULL };
+    for (unsigned i = 0; i < 2; i++)
+    {
+        if (mesh_data[i].m_count == 0)
+            continue;
+        bvh[i] = btOptimizedBvh::deSerializeInPlace(mesh_data[i].m_bvh,
+            mesh_data[i].m_bvh_size, false/*swap_endian*/);
+        if (!bvh[i])
+            return false;
+    }
+
+    TriangleMesh* meshes[2] = { track_mesh, gfx_effect_mesh };
+    for (unsigned i = 0; i < 2; i++)
+    {
+        const MeshData& md = mesh_data[i];
+        const size_t tri_size = 3 * 3 * sizeof(float);
+        for (uint32_t j = 0; j < md.m_count; j++)
+        {
+            const char* v = md.m_vertices + j * tri_size;
+            const char* n = md.m_normals + j * tri_size;
+            uint32_t index;
+            memcpy(&index, md.m_materials + j * sizeof(index), sizeof(index));
+            const size_t s = 3 * sizeof(float);
+            meshes[i]->addTriangle(getVec3(v), getVec3(v + s),
+                getVec3(v + 2 * s), getVec3(n), getVec3(n + s),
+                getVec3(n + 2 * s), materials[index]);
+        }
+        m_bvh[i] = bvh[i];
+    }
+    Log::info("TrackPhysicsCache", "Loaded %d triangles from '%s'.",
+        mesh_data[0].m_count + mesh_data[1].m_count, m_filename.c_str());
+    return true;
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Writes the triangles and bvhs of both meshes to the cache file, after
+ *  their collision shapes were created. The file is written to a temporary
+ *  file first and then renamed, so other processes loading the same track
+ *  never see a partial file.
+ *  \param fingerprint Hash of all scene nodes which were converted.
+ */
+void TrackPhysicsCache::save(uint64_t fingerprint,
+                             const TriangleMesh& track_mesh,
+                             const TriangleMesh& gfx_effect_mesh) const
+{
+    const TriangleMesh* meshes[2] = { &track_mesh, &gfx_effect_mesh };
+    std::unordered_map<const Material*, uint32_t> material_index;
+    std::vector<const Material*> materials;
+    for (const TriangleMesh* mesh : meshes)
+    {
+        if (mesh->getNumTriangles() > 0 && !mesh->getBvh())
+            return;
+        for (unsigned int i = 0; i < mesh->getNumTriangles(); i++)
+        {
+            const Material* m = mesh->getMaterial(i);
+            if (!m)
+                return;
+            if (material_index.find(m) == material_index.end())
+            {
+                material_index[m] = (uint32_t)materials.size();
+                materials.push_back(m);
+            }
+        }
+    }
+
+    std::string out;
+    add(&out, CACHE_MAGIC);
+    add(&out, CACHE_VERSION);
+    add(&out, CACHE_FORMAT);
+    add(&out, (uint32_t)0);
+    add(&out, m_key);
+    add(&out, fingerprint);
+    add(&out, (uint32_t)materials.size());
+    for (const Material* m : materials)
+    {
+        addString(&out, m->getTexFullPath());
+        addString(&out, m->getUVTwoTexture());
+        addString(&out, m->getShaderName());
+    }
+
+    for (const TriangleMesh* mesh : meshes)
+    {
+        const unsigned int count = mesh->getNumTriangles();
+        add(&out, (uint32_t)count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            btVector3 p1, p2, p3;
+            mesh->getTriangle(i, &p1, &p2, &p3);
+            addVec3(&out, p1);
+            addVec3(&out, p2);
+            addVec3(&out, p3);
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            btVector3 n1, n2, n3;
+            mesh->getNormals(i, &n1, &n2, &n3);
+            addVec3(&out, n1);
+            addVec3(&out, n2);
+            addVec3(&out, n3);
+        }
+        for (unsigned int i = 0; i < count; i++)
+            add(&out, material_index[mesh->getMaterial(i)]);
+
+        const btOptimizedBvh* bvh = count > 0 ? mesh->getBvh() : NULL;
+        const unsigned bvh_size = bvh ? bvh->calculateSerializeBufferSize()
+                                      : 0;
+        add(&out, (uint32_t)bvh_size);
+        out.append((16 - out.size() % 16) % 16, '\0');
+        if (bvh)
+        {
+            void* buffer = btAlignedAlloc(bvh_size, 16);
+            bvh->serialize(buffer, bvh_size, false/*swap_endian*/);
+            out.append((const char*)buffer, bvh_size);
+            btAlignedFree(buffer);
+        }
+    }
+
+#ifdef WIN32
+    const int pid = _getpid();
+#else
+    const int pid = (int)getpid();
+#endif
+    const std::string tmp = m_filename + "." + StringUtils::toString(pid);
+    std::ofstream file(tmp, std::ios::out | std::ios::binary);
+    if (!file.is_open() || !file.write(out.data(), out.size()))
+    {
+        Log::warn("TrackPhysicsCache", "Can't write '%s'.", tmp.c_str());
+        return;
+    }
+    file.close();
+#ifdef WIN32
+    // rename does not replace an existing file on windows
+    remove(m_filename.c_str());
+#endif
+    if (rename(tmp.c_str(), m_filename.c_str()) != 0)
+    {
+        Log::warn("TrackPhysicsCache", "Can't write '%s'.",
+                  m_filename.c_str());
+        remove(tmp.c_str());
+        return;
+    }
+    Log::info("TrackPhysicsCache", "Saved %d triangles to '%s'.",
+        track_mesh.getNumTriangles() + gfx_effect_mesh.getNumTriangles(),
+        m_filename.c_str());
+}   // save
@@ -0,0 +1,94 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TRACK_PHYSICS_CACHE_HPP
+#define HEADER_TRACK_PHYSICS_CACHE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class btOptimizedBvh;
+class TriangleMesh;
+
+/** \brief An on-disk cache of the collision data of a track.
+ *  Converting all scene nodes of a track into triangles and building the
+ *  bvh of the track mesh takes most of the time when a track is loaded. So
+ *  the triangles, normals and materials of the track mesh and the gfx
+ *  effect mesh are written to a file, together with their serialized
+ *  (quantized) bvh. The next time the track is loaded in the same mode, the
+ *  file is mapped into memory, the triangles are copied into the meshes and
+ *  the bvh is used in place without building it again.
+ *  The cache is keyed by the name, size and modification time of all files
+ *  of the track, the STK version and the mode, and it is only used if the
+ *  scene nodes that would be converted have not changed (see load()).
+ *  The object must exist as long as the collision shapes of the meshes,
+ *  since the bvh of the shapes is stored in its memory.
+ * \ingroup tracks
+ */
+class TrackPhysicsCache : public NoCopy
+{
+private:
+    /** Name of the cache file. */
+    std::string m_filename;
+
+    /** Hash of the track files, STK version and mode. */
+    uint64_t m_key;
+
+    /** The content of the cache file if it exists and has the right key,
+     *  NULL otherwise. */
+    char* m_data;
+
+    /** Size of m_data. */
+    size_t m_size;
+
+    /** If m_data was mapped with mmap (or read into allocated memory). */
+    bool m_mapped;
+
+    /** Bvh of the track mesh and the gfx effect mesh, stored in m_data.
+     *  NULL if the cache was not loaded or the mesh has no triangles. */
+    btOptimizedBvh* m_bvh[2];
+
+    bool mapFile();
+    void unmapFile();
+
+public:
+    TrackPhysicsCache(const std::string& track_dir, const std::string& name);
+    ~TrackPhysicsCache();
+    bool load(uint64_t fingerprint, TriangleMesh* track_mesh,
+              TriangleMesh* gfx_effect_mesh);
+    void save(uint64_t fingerprint, const TriangleMesh& track_mesh,
+              const TriangleMesh& gfx_effect_mesh) const;
+    static uint64_t hash(const void* data, size_t size,
+                         uint64_t h = 14695981039346656037ULL);
+    // ------------------------------------------------------------------------
+    /** Returns true if a cache file with the right key exists. It can still
+     *  be rejected by load() if the scene nodes have changed. */
+    bool isAvailable() const                          { return m_data != NULL; }
+    // ------------------------------------------------------------------------
+    /** Returns the loaded bvh of the track mesh, or NULL. */
+    btOptimizedBvh* getTrackBvh() const                   { return m_bvh[0]; }
+    // ------------------------------------------------------------------------
+    /** Returns the loaded bvh of the gfx effect mesh, or NULL. */
+    btOptimizedBvh* getGFXEffectBvh() const               { return m_bvh[1]; }
+
+};   // TrackPhysicsCache
+
+#endif
@@ -44,6 +44,10 @@ public:
     /** Sets this instance to be ready to be deleted. */
     void setCanBeDeleted() {m_can_be_deleted.setAtomic(true); }
     // ------------------------------------------------------------------------
+    /** Sets this instance to be not ready to be deleted again, e.g. after
+     *  its thread was restarted. */
+    void resetCanBeDeleted() { m_can_be_deleted.setAtomic(false); }
+    // ------------------------------------------------------------------------
     /** Waits at most t seconds for this class to be ready to be deleted.
      *  \return true if the class is ready, false in case of a time out.
      */
@@ -0,0 +1,89 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SPSC_QUEUE_HPP
+#define HEADER_SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/** A bounded lock-free queue for exactly one producer thread and one
+ *  consumer thread. push() is only called by the producer, pop() only by
+ *  the consumer. SIZE must be a power of two.
+ */
+template<typename TYPE, size_t SIZE>
+class SPSCQueue
+{
+private:
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    std::array<TYPE, SIZE> m_data;
+
+    /** Index of the next element to be read, only written by the consumer.
+     *  Head and tail are kept on different cache lines, so producer and
+     *  consumer do not invalidate each other's cache. */
+    alignas(64) std::atomic<size_t> m_head;
+
+    /** Index of the next element to be written, only written by the
+     *  producer. */
+    alignas(64) std::atomic<size_t> m_tail;
+
+public:
+    // ------------------------------------------------------------------------
+    SPSCQueue()
+    {
+        m_head.store(0);
+        m_tail.store(0);
+    }   // SPSCQueue
+    // ------------------------------------------------------------------------
+    /** Adds an element, returns false if the queue is full. */
+    bool push(const TYPE& value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == SIZE)
+            return false;
+        m_data[tail & (SIZE - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }   // push
+    // ------------------------------------------------------------------------
+    /** Removes the oldest element, returns false if the queue is empty. */
+    bool pop(TYPE* value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        *value = m_data[head & (SIZE - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }   // pop
+    // ------------------------------------------------------------------------
+    /** Returns the number of elements in the queue. This is only a snapshot
+     *  if called while the other thread is active. */
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) -
+               m_head.load(std::memory_order_acquire);
+    }   // size
+    // ------------------------------------------------------------------------
+    static size_t capacity()                                  { return SIZE; }
+
+};   // SPSCQueue
+
+#endif
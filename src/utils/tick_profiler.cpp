@@ -0,0 +1,217 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/tick_profiler.hpp"
+
+#include "config/stk_config.hpp"
+#include "network/server_config.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
+
+bool TickProfiler::m_enabled = false;
+std::atomic<uint32_t>
+    TickProfiler::m_durations[TickProfiler::TS_COUNT]
+                             [TickProfiler::HISTORY_SIZE];
+std::atomic<uint32_t> TickProfiler::m_sample_count[TickProfiler::TS_COUNT];
+std::atomic<uint32_t> TickProfiler::m_overruns(0);
+uint32_t TickProfiler::m_written_count[TickProfiler::TS_COUNT] = {};
+uint32_t TickProfiler::m_written_overruns = 0;
+uint64_t TickProfiler::m_next_write_time = 0;
+
+// ----------------------------------------------------------------------------
+const char* TickProfiler::getSectionName(TickSection section)
+{
+    switch (section)
+    {
+    case TS_TICK:           return "tick";
+    case TS_SERVER_LOBBY:   return "server-lobby";
+    case TS_WORLD_UPDATE:   return "world-update";
+    case TS_REWIND_MANAGER: return "rewind-manager";
+    case TS_SEND_STATE:     return "send-state";
+    case TS_PHYSICS:        return "physics";
+    default:                return "";
+    }
+}   // getSectionName
+
+// ----------------------------------------------------------------------------
+/** Stores the duration of one execution of a section.
+ *  \param section The section.
+ *  \param us Duration in microseconds.
+ */
+void TickProfiler::addDuration(TickSection section, uint32_t us)
+{
+    uint32_t n = m_sample_count[section].load(std::memory_order_relaxed);
+    m_durations[section][n % HISTORY_SIZE].store(us,
+                                                 std::memory_order_relaxed);
+    m_sample_count[section].store(n + 1, std::memory_order_release);
+}   // addDuration
+
+// ----------------------------------------------------------------------------
+/** Called at the end of each tick of the main loop with the duration of the
+ *  whole tick. Counts ticks that took longer than a tick lasts, and writes
+ *  the statistics to the tick profile file if it is time to do so.
+ *  \param tick_us Duration of the tick in microseconds.
+ */
+void TickProfiler::tickEnded(uint32_t tick_us)
+{
+    addDuration(TS_TICK, tick_us);
+    if (tick_us > (uint32_t)(stk_config->ticks2Time(1) * 1000000.0f))
+        m_overruns.fetch_add(1, std::memory_order_relaxed);
+
+    const std::string& file = ServerConfig::m_tick_profile_file;
+    if (file.empty())
+        return;
+    uint64_t now = StkTime::getRealTimeMs();
+    if (m_next_write_time == 0)
+    {
+        m_next_write_time = now +
+            (uint64_t)ServerConfig::m_tick_profile_interval * 1000;
+    }
+    else if (now >= m_next_write_time)
+    {
+        writeToFile();
+        m_next_write_time = now +
+            (uint64_t)ServerConfig::m_tick_profile_interval * 1000;
+    }
+}   // tickEnded
+
+// ----------------------------------------------------------------------------
+/** Sorts the values and stores the 50th, 90th and 99th percentile and the
+ *  maximum in result. All results are 0 if there are no values.
+ */
+void TickProfiler::percentiles(std::vector<uint32_t>* values,
+                               uint32_t *result)
+{
+    if (values->empty())
+    {
+        result[0] = result[1] = result[2] = result[3] = 0;
+        return;
+    }
+    std::sort(values->begin(), values->end());
+    const size_t last = values->size() - 1;
+    result[0] = (*values)[last * 50 / 100];
+    result[1] = (*values)[last * 90 / 100];
+    result[2] = (*values)[last * 99 / 100];
+    result[3] = (*values)[last];
+}   // percentiles
+
+// ----------------------------------------------------------------------------
+/** Computes the percentiles (see percentiles()) of the last durations of a
+ *  section.
+ *  \param section The section.
+ *  \param samples Maximum number of durations to use, the most recent ones.
+ *  \param result Array of 4 values to store the result in.
+ */
+void TickProfiler::getPercentiles(TickSection section, uint32_t samples,
+                                  uint32_t *result)
+{
+    uint32_t n = m_sample_count[section].load(std::memory_order_acquire);
+    samples = std::min(samples, std::min(n, (uint32_t)HISTORY_SIZE));
+    std::vector<uint32_t> values;
+    values.reserve(samples);
+    for (uint32_t i = n - samples; i != n; i++)
+    {
+        values.push_back(m_durations[section][i % HISTORY_SIZE]
+                         .load(std::memory_order_relaxed));
+    }
+    percentiles(&values, result);
+}   // getPercentiles
+
+// ----------------------------------------------------------------------------
+/** Appends one line per section with the percentiles of all durations since
+ *  the last write to the tick profile file (CSV, times in microseconds).
+ */
+void TickProfiler::writeToFile()
+{
+    const std::string& file = ServerConfig::m_tick_profile_file;
+    std::ofstream out(file, std::ios::app);
+    if (!out.is_open())
+    {
+        Log::warn("TickProfiler", "Can't write to %s.", file.c_str());
+        return;
+    }
+    if (out.tellp() == 0)
+        out << "time,section,samples,p50,p90,p99,max,overruns\n";
+
+    uint64_t time = StkTime::getTimeSinceEpoch();
+    uint32_t overruns = m_overruns.load(std::memory_order_relaxed);
+    for (int i = 0; i < TS_COUNT; i++)
+    {
+        TickSection section = (TickSection)i;
+        uint32_t n = m_sample_count[i].load(std::memory_order_acquire);
+        uint32_t samples = n - m_written_count[i];
+        m_written_count[i] = n;
+        uint32_t result[4];
+        getPercentiles(section, samples, result);
+        out << time << "," << getSectionName(section) << "," << samples
+            << "," << result[0] << "," << result[1] << "," << result[2]
+            << "," << result[3] << ","
+            << (section == TS_TICK ? overruns - m_written_overruns : 0)
+            << "\n";
+    }
+    m_written_overruns = overruns;
+}   // writeToFile
+
+// ----------------------------------------------------------------------------
+/** Returns the percentiles of the durations of the last ticks of all
+ *  sections as a human readable table, used in the network console.
+ */
+std::string TickProfiler::getStatistics()
+{
+    if (!m_enabled)
+        return "Tick profiler is only enabled on servers without graphics.";
+    std::string ret = StringUtils::insertValues("Last %d ticks, "
+        "%d overruns in total (times in us):\n",
+        std::min(m_sample_count[TS_TICK].load(), (uint32_t)HISTORY_SIZE),
+        m_overruns.load());
+    for (int i = 0; i < TS_COUNT; i++)
+    {
+        uint32_t result[4];
+        getPercentiles((TickSection)i, HISTORY_SIZE, result);
+        ret += StringUtils::insertValues("%s: p50 %d p90 %d p99 %d max %d\n",
+            getSectionName((TickSection)i), result[0], result[1], result[2],
+            result[3]);
+    }
+    return ret;
+}   // getStatistics
+
+// ----------------------------------------------------------------------------
+void TickProfiler::unitTesting()
+{
+    uint32_t result[4];
+    std::vector<uint32_t> values;
+    percentiles(&values, result);
+    assert(result[0] == 0 && result[3] == 0);
+
+    for (uint32_t i = 100; i > 0; i--)
+        values.push_back(i);
+    percentiles(&values, result);
+    assert(result[0] == 50);
+    assert(result[1] == 90);
+    assert(result[2] == 99);
+    assert(result[3] == 100);
+
+    values.assign(1, 7);
+    percentiles(&values, result);
+    assert(result[0] == 7 && result[1] == 7 && result[2] == 7);
+}   // unitTesting
@@ -0,0 +1,133 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TICK_PROFILER_HPP
+#define HEADER_TICK_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** A low overhead profiler for servers without graphics. Unlike Profiler,
+ *  which draws its results on screen, it keeps the durations of the last
+ *  ticks of a few sections of a server tick in ring buffers. Percentiles
+ *  of those durations can be shown in the network console ("tickstats"),
+ *  and are appended to the file set in the server config every
+ *  tick-profile-interval seconds.
+ *  All sections are measured in the main thread, but the statistics can be
+ *  read from any thread.
+ */
+class TickProfiler
+{
+public:
+    /** The measured sections. A section can contain other sections, e.g.
+     *  TS_PHYSICS is part of TS_WORLD_UPDATE. */
+    enum TickSection
+    {
+        TS_TICK = 0,           //!< Protocol manager and world update
+        TS_SERVER_LOBBY,       //!< ServerLobby::update
+        TS_WORLD_UPDATE,       //!< World::updateWorld
+        TS_REWIND_MANAGER,     //!< RewindManager::update
+        TS_SEND_STATE,         //!< GameProtocol::sendState
+        TS_PHYSICS,            //!< Physics::update
+        TS_COUNT
+    };
+
+    // ------------------------------------------------------------------------
+    /** Measures the time from its creation till its destruction for a
+     *  section, if the tick profiler is enabled. A TS_TICK scope must be
+     *  used once per tick of the main loop. */
+    class Scope
+    {
+    private:
+        std::chrono::steady_clock::time_point m_start;
+        TickSection m_section;
+        bool m_enabled;
+    public:
+        Scope(TickSection section)
+            : m_section(section), m_enabled(TickProfiler::isEnabled())
+        {
+            if (m_enabled)
+                m_start = std::chrono::steady_clock::now();
+        }   // Scope
+        // --------------------------------------------------------------------
+        ~Scope()
+        {
+            if (!m_enabled)
+                return;
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>
+                (std::chrono::steady_clock::now() - m_start).count();
+            if (m_section == TS_TICK)
+                TickProfiler::tickEnded((uint32_t)us);
+            else
+                TickProfiler::addDuration(m_section, (uint32_t)us);
+        }   // ~Scope
+    };   // Scope
+
+private:
+    /** Number of durations kept per section, about a minute at 120 ticks
+     *  per second. */
+    static const unsigned HISTORY_SIZE = 8192;
+
+    static bool m_enabled;
+
+    /** Durations in microseconds, index is the sample count modulo
+     *  HISTORY_SIZE. */
+    static std::atomic<uint32_t> m_durations[TS_COUNT][HISTORY_SIZE];
+
+    /** Total number of durations added for each section. */
+    static std::atomic<uint32_t> m_sample_count[TS_COUNT];
+
+    /** Number of ticks which took longer than one tick. */
+    static std::atomic<uint32_t> m_overruns;
+
+    /** Sample count of each section when the file was written last. */
+    static uint32_t m_written_count[TS_COUNT];
+
+    /** Overruns when the file was written last. */
+    static uint32_t m_written_overruns;
+
+    /** When the statistics should be written to the file next (in ms). */
+    static uint64_t m_next_write_time;
+
+    static void writeToFile();
+
+public:
+    static void unitTesting();
+    static void addDuration(TickSection section, uint32_t us);
+    static void tickEnded(uint32_t tick_us);
+    static std::string getStatistics();
+    static void getPercentiles(TickSection section, uint32_t samples,
+                               uint32_t *result);
+    static void percentiles(std::vector<uint32_t>* values, uint32_t *result);
+    static const char* getSectionName(TickSection section);
+    // ------------------------------------------------------------------------
+    /** Enables or disables the profiler. */
+    static void setEnabled(bool enabled)               { m_enabled = enabled; }
+    // ------------------------------------------------------------------------
+    /** Returns if the profiler is enabled. */
+    static bool isEnabled()                                { return m_enabled; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of ticks which took longer than one tick. */
+    static uint32_t getOverruns()                  { return m_overruns.load(); }
+
+};   // TickProfiler
+
+#endif
@@ -0,0 +1,170 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/worker_pool.hpp"
+
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <string>
+
+/** Starts num_threads - 1 worker threads, the thread calling parallelFor()
+ *  is the last one.
+ *  \param num_threads Number of threads used by parallelFor().
+ */
+WorkerPool::WorkerPool(unsigned num_threads)
+{
+    m_function     = NULL;
+    m_count        = 0;
+    m_next_index.store(0);
+    m_busy_threads = 0;
+    m_open         = false;
+    m_generation   = 0;
+    m_exit         = false;
+    for (unsigned i = 1; i < num_threads; i++)
+        m_threads.emplace_back(&WorkerPool::mainLoop, this, i);
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_exit = true;
+    m_start_cv.notify_all();
+    ul.unlock();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+/** The main loop of a worker thread, which helps with each loop started by
+ *  parallelFor() until the pool is destroyed.
+ *  \param thread_id Number of this thread, only used in its name.
+ */
+void WorkerPool::mainLoop(unsigned thread_id)
+{
+    std::string name = "WorkerPool " + std::to_string(thread_id);
+    VS::setThreadName(name.c_str());
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    while (true)
+    {
+        m_start_cv.wait(ul, [this, generation]
+            {
+                return m_exit || m_generation != generation;
+            });
+        if (m_exit)
+            return;
+        generation = m_generation;
+        if (!m_open)
+            continue;
+        m_busy_threads++;
+        ul.unlock();
+        runIndices();
+        ul.lock();
+        if (--m_busy_threads == 0)
+            m_done_cv.notify_one();
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Calls the function of the current loop with the indices not taken by
+ *  another thread yet.
+ */
+void WorkerPool::runIndices()
+{
+    for (unsigned i = m_next_index.fetch_add(1); i < m_count;
+         i = m_next_index.fetch_add(1))
+    {
+        (*m_function)(i);
+    }
+}   // runIndices
+
+// ----------------------------------------------------------------------------
+/** Calls function(i) for all i in [0, count) using all threads of this
+ *  pool, and returns once all calls are done. Must only be called by one
+ *  thread at a time.
+ *  \param count Number of indices.
+ *  \param function The function to call for each index.
+ */
+void WorkerPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& function)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        for (unsigned i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_function     = &function;
+    m_count        = count;
+    m_next_index.store(0);
+    m_open         = true;
+    m_generation++;
+    m_start_cv.notify_all();
+    ul.unlock();
+
+    runIndices();
+
+    // All indices are taken, only wait for the threads still working on one
+    ul.lock();
+    m_open = false;
+    m_done_cv.wait(ul, [this] { return m_busy_threads == 0; });
+    m_function = NULL;
+    m_count    = 0;
+}   // parallelFor
+
+// ----------------------------------------------------------------------------
+void WorkerPool::unitTesting()
+{
+    std::vector<unsigned> results(1000);
+    std::function<void(unsigned)> square = [&results](unsigned i)
+        {
+            results[i] = i * i;
+        };
+
+    // Each index must be done exactly once, for many loops in a row
+    WorkerPool pool(4);
+    assert(pool.getNumThreads() == 4);
+    for (unsigned loop = 0; loop < 200; loop++)
+    {
+        unsigned count = (loop * 37) % (unsigned)results.size();
+        std::fill(results.begin(), results.end(), 0);
+        pool.parallelFor(count, square);
+        for (unsigned i = 0; i < results.size(); i++)
+            assert(results[i] == (i < count ? i * i : 0));
+    }
+
+    std::atomic<unsigned> calls(0);
+    pool.parallelFor(0, [&calls](unsigned) { calls.fetch_add(1); });
+    assert(calls.load() == 0);
+    pool.parallelFor(1000, [&calls](unsigned) { calls.fetch_add(1); });
+    assert(calls.load() == 1000);
+
+    // Without worker threads everything is done in the calling thread
+    WorkerPool serial(1);
+    assert(serial.getNumThreads() == 1);
+    std::thread::id caller = std::this_thread::get_id();
+    serial.parallelFor(100, [caller](unsigned)
+        {
+            assert(std::this_thread::get_id() == caller);
+        });
+}   // unitTesting
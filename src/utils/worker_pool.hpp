@@ -0,0 +1,97 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \class WorkerPool
+ *  \brief A small set of threads that is kept alive to run short loops in
+ *  parallel, e.g. a query done for each kart once per physics step.
+ *  parallelFor() hands out the indices of a loop to the worker threads and
+ *  the calling thread, and only returns once all of them are done. The
+ *  order in which the indices are done is undefined, so the function must
+ *  only write data that belongs to its index to give the same result as
+ *  a serial loop.
+ *  \ingroup utils
+ */
+class WorkerPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    /** Protects all members below except m_next_index. */
+    std::mutex m_mutex;
+
+    /** Signals the worker threads that a new loop (or exit) is waiting. */
+    std::condition_variable m_start_cv;
+
+    /** Signals the calling thread that all worker threads are done. */
+    std::condition_variable m_done_cv;
+
+    /** The function of the current loop, NULL if there is none. */
+    const std::function<void(unsigned)>* m_function;
+
+    /** Number of indices in the current loop. */
+    unsigned m_count;
+
+    /** Next index of the current loop to be done. */
+    std::atomic<unsigned> m_next_index;
+
+    /** Number of worker threads helping with the current loop. */
+    unsigned m_busy_threads;
+
+    /** True while worker threads may still start helping with the current
+     *  loop. Once the calling thread has run out of indices it stops
+     *  threads from joining, so it does not wait for threads that are
+     *  still waking up. */
+    bool m_open;
+
+    /** Increased for each loop, so a worker thread can tell a new loop
+     *  from a spurious wake up. */
+    uint64_t m_generation;
+
+    bool m_exit;
+
+    void mainLoop(unsigned thread_id);
+    void runIndices();
+
+public:
+    static void unitTesting();
+    WorkerPool(unsigned num_threads);
+    ~WorkerPool();
+    void parallelFor(unsigned count,
+                     const std::function<void(unsigned)>& function);
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads used by parallelFor(), including the
+     *  calling thread. */
+    unsigned getNumThreads() const
+                                  { return (unsigned)m_threads.size() + 1; }
+
+};   // WorkerPool
+
+#endif